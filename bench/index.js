@@ -0,0 +1,162 @@
+"use strict";
+
+// Throughput benchmark over the simulated readers of src/fake (npm run build:fake first).
+// Every configuration runs in a process of its own, the fake readers being set up
+// from the environment when the addon loads.
+//
+// node bench [--mode transmit|status] [--readers 1,4,16] [--concurrency 1,4]
+//            [--duration ms] [--apdu-us us] [--apdu hex] [--res-len n]
+//            [--io-threads n] [--present-ms ms] [--absent-ms ms] [--json]
+
+const { fork } = require('child_process');
+const path = require('path');
+
+
+const defaults = {
+	'mode': 'transmit',
+	'readers': '1,4,16',
+	'concurrency': '1,4',
+	'duration': '2000',
+	'apdu-us': '0',
+	// READ BINARY of 16 bytes
+	'apdu': '00b0000010',
+	'res-len': '258',
+	'io-threads': '0',
+	'present-ms': '',
+	'absent-ms': '',
+};
+
+function parseArgs(argv) {
+
+	const args = Object.assign({}, defaults);
+
+	for (let i = 0; i < argv.length; i++) {
+
+		const name = argv[i].replace(/^--/, '');
+
+		if (name === 'json') {
+			args.json = true;
+		} else if (name in defaults && i + 1 < argv.length) {
+			args[name] = argv[++i];
+		} else {
+			throw new Error('Unknown option ' + argv[i]);
+		}
+
+	}
+
+	// status mode measures the monitor thread, the cards have to come and go
+	if (args.mode === 'status') {
+		args['present-ms'] = args['present-ms'] || '5';
+		args['absent-ms'] = args['absent-ms'] || '5';
+	}
+
+	return args;
+
+}
+
+function list(value) {
+	return value.split(',').map(Number);
+}
+
+function runOne(args, readers, concurrency) {
+
+	const env = Object.assign({}, process.env, {
+		PCSCLITE_FAKE: '1',
+		PCSC_FAKE_READERS: String(readers),
+		PCSC_FAKE_APDU_US: args['apdu-us'],
+		PCSC_FAKE_PRESENT_MS: args['present-ms'],
+		PCSC_FAKE_ABSENT_MS: args['absent-ms'],
+	});
+
+	const config = {
+		mode: args.mode,
+		readers: readers,
+		concurrency: concurrency,
+		duration: Number(args.duration),
+		apdu: args.apdu,
+		resLen: Number(args['res-len']),
+		ioThreads: Number(args['io-threads']),
+	};
+
+	return new Promise((resolve, reject) => {
+
+		const child = fork(path.join(__dirname, 'worker.js'), [JSON.stringify(config)], { env: env });
+
+		let result = null;
+
+		child.on('message', (message) => {
+			result = message;
+		});
+
+		child.on('exit', (code) => {
+			if (result && result.error) {
+				reject(new Error(result.error));
+			} else if (!result) {
+				reject(new Error('Benchmark worker exited with code ' + code));
+			} else {
+				resolve(result);
+			}
+		});
+
+	});
+
+}
+
+function format(value, digits) {
+	return value.toFixed(digits).padStart(10);
+}
+
+function printHeader(mode) {
+	if (mode === 'transmit') {
+		console.log('   readers concurrency    APDUs/s    p50 ms    p99 ms  loop p99  loop max');
+	} else {
+		console.log('   readers   status/s   dropped  loop p99  loop max');
+	}
+}
+
+function printRow(mode, r) {
+	if (mode === 'transmit') {
+		console.log(String(r.readers).padStart(10) + String(r.concurrency).padStart(12) +
+			format(r.apdusPerSec, 0) + format(r.p50, 3) + format(r.p99, 3) +
+			format(r.loopP99, 3) + format(r.loopMax, 3) +
+			(r.errors ? '  (' + r.errors + ' errors)' : ''));
+	} else {
+		console.log(String(r.readers).padStart(10) + format(r.statusPerSec, 0) +
+			String(r.droppedEvents).padStart(10) + format(r.loopP99, 3) + format(r.loopMax, 3));
+	}
+}
+
+async function main() {
+
+	const args = parseArgs(process.argv.slice(2));
+	const concurrencies = args.mode === 'transmit' ? list(args.concurrency) : [0];
+	const results = [];
+
+	if (!args.json) {
+		printHeader(args.mode);
+	}
+
+	for (const readers of list(args.readers)) {
+		for (const concurrency of concurrencies) {
+
+			const result = await runOne(args, readers, concurrency);
+
+			results.push(result);
+
+			if (!args.json) {
+				printRow(args.mode, result);
+			}
+
+		}
+	}
+
+	if (args.json) {
+		console.log(JSON.stringify(results, null, 2));
+	}
+
+}
+
+main().catch((err) => {
+	console.error(err.message);
+	process.exit(1);
+});
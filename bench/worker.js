@@ -0,0 +1,155 @@
+"use strict";
+
+// Runs one configuration of the benchmark (see index.js) and reports back over IPC.
+// The fake readers are set up from the environment by the parent, before the addon loads.
+
+const { createHistogram, monitorEventLoopDelay } = require('perf_hooks');
+const pcsclite = require('../lib/pcsclite');
+
+
+const config = JSON.parse(process.argv[2]);
+const apdu = Buffer.from(config.apdu, 'hex');
+
+const pcsc = pcsclite({ ioThreads: config.ioThreads || undefined });
+
+const readers = [];
+let statusEvents = 0;
+
+pcsc.on('error', fail);
+
+pcsc.on('reader', (reader) => {
+
+	reader.on('error', fail);
+
+	reader.on('status', () => {
+		statusEvents++;
+	});
+
+	readers.push(reader);
+
+	if (readers.length === config.readers) {
+		setup(run);
+	}
+
+});
+
+function fail(err) {
+	process.send({ error: err.message }, () => process.exit(1));
+}
+
+function setup(cb) {
+
+	if (config.mode !== 'transmit') {
+		return cb();
+	}
+
+	let pending = readers.length;
+
+	readers.forEach((reader) => {
+		reader.connect({ share_mode: reader.SCARD_SHARE_SHARED }, (err, protocol) => {
+
+			if (err) {
+				return fail(err);
+			}
+
+			reader.protocol = protocol;
+
+			if (--pending === 0) {
+				cb();
+			}
+
+		});
+	});
+
+}
+
+function run() {
+
+	const latency = createHistogram();
+	const loop = monitorEventLoopDelay({ resolution: 10 });
+
+	let running = true;
+	let inFlight = 0;
+	let apdus = 0;
+	let errors = 0;
+
+	// every reader keeps `concurrency` transmits queued
+	function transmit(reader) {
+
+		if (!running) {
+			if (--inFlight === 0) {
+				done();
+			}
+			return;
+		}
+
+		const start = process.hrtime.bigint();
+
+		reader.transmit(apdu, config.resLen, reader.protocol, (err) => {
+
+			latency.record(Number(process.hrtime.bigint() - start) || 1);
+
+			if (err) {
+				errors++;
+			} else {
+				apdus++;
+			}
+
+			transmit(reader);
+
+		});
+
+	}
+
+	const statusStart = statusEvents;
+	const start = process.hrtime.bigint();
+
+	loop.enable();
+
+	if (config.mode === 'transmit') {
+		readers.forEach((reader) => {
+			for (let i = 0; i < config.concurrency; i++) {
+				inFlight++;
+				transmit(reader);
+			}
+		});
+	}
+
+	setTimeout(() => {
+
+		running = false;
+
+		if (!inFlight) {
+			done();
+		}
+
+	}, config.duration);
+
+	function done() {
+
+		const seconds = Number(process.hrtime.bigint() - start) / 1e9;
+
+		loop.disable();
+
+		const result = {
+			readers: config.readers,
+			concurrency: config.concurrency,
+			seconds: seconds,
+			apdus: apdus,
+			errors: errors,
+			apdusPerSec: apdus / seconds,
+			p50: latency.count ? latency.percentile(50) / 1e6 : 0,
+			p99: latency.count ? latency.percentile(99) / 1e6 : 0,
+			loopP99: loop.percentile(99) / 1e6,
+			loopMax: loop.max / 1e6,
+			statusPerSec: (statusEvents - statusStart) / seconds,
+			droppedEvents: pcsc.dropped_events(),
+		};
+
+		Promise.all(readers.map(reader => reader.close()))
+			.then(() => pcsc.close())
+			.then(() => process.send(result, () => process.exit(0)));
+
+	}
+
+}
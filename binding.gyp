@@ -1,28 +1,72 @@
 {
+	"variables": {
+		# node-gyp configure -- -Dfake_pcsc=1 also builds pcsclite_fake.node, see bench/
+		"fake_pcsc%": 0,
+		"pcsclite_sources": [
+			"src/addon.cpp",
+			"src/pcsclite.cpp",
+			"src/cardreader.cpp",
+			"src/executor.cpp",
+			"src/apdu.cpp",
+			"src/contextregistry.cpp",
+			"src/stats.cpp",
+			"src/session.cpp",
+			"src/responsecache.cpp",
+			"src/atrmatcher.cpp",
+			"src/statetable.cpp",
+			"src/aes.cpp",
+			"src/securechannel.cpp",
+			"src/tlv.cpp",
+			"src/apduscript.cpp",
+			"src/pool.cpp"
+		]
+	},
+	"target_defaults": {
+		"include_dirs": [
+			"<!@(node -p \"require('node-addon-api').include\")"
+		],
+		"defines": [
+			"NAPI_VERSION=8"
+		],
+		"cflags": [
+			"-Wall",
+			"-Wextra",
+			"-Wno-unused-parameter",
+			"-fPIC",
+			"-fno-strict-aliasing",
+			"-pedantic"
+		],
+		"cflags_cc": [
+			"-std=c++17"
+		],
+		"conditions": [
+			[
+				"OS=='mac'",
+				{
+					"xcode_settings": {
+						"GCC_ENABLE_CPP_EXCEPTIONS": "YES",
+						"CLANG_CXX_LIBRARY": "libc++",
+						"MACOSX_DEPLOYMENT_TARGET": "10.15"
+					}
+				}
+			],
+			[
+				"OS=='win'",
+				{
+					"msvs_settings": {
+						"VCCLCompilerTool": {
+							"ExceptionHandling": 1
+						}
+					}
+				}
+			]
+		]
+	},
 	"targets": [
 		{
 			"target_name": "pcsclite",
 			"sources": [
-				"src/addon.cpp",
-				"src/pcsclite.cpp",
-				"src/cardreader.cpp"
-			],
-			"include_dirs": [
-				"<!@(node -p \"require('node-addon-api').include\")"
-			],
-			"defines": [
-				"NAPI_VERSION=8"
-			],
-			"cflags": [
-				"-Wall",
-				"-Wextra",
-				"-Wno-unused-parameter",
-				"-fPIC",
-				"-fno-strict-aliasing",
-				"-pedantic"
-			],
-			"cflags_cc": [
-				"-std=c++17"
+				"<@(pcsclite_sources)"
 			],
 			"conditions": [
 				[
@@ -47,12 +91,7 @@
 						"libraries": [
 							"-framework",
 							"PCSC"
-						],
-						"xcode_settings": {
-							"GCC_ENABLE_CPP_EXCEPTIONS": "YES",
-							"CLANG_CXX_LIBRARY": "libc++",
-							"MACOSX_DEPLOYMENT_TARGET": "10.15"
-						}
+						]
 					}
 				],
 				[
@@ -60,15 +99,35 @@
 					{
 						"libraries": [
 							"-lWinSCard"
-						],
-						"msvs_settings": {
-							"VCCLCompilerTool": {
-								"ExceptionHandling": 1
-							}
-						}
+						]
 					}
 				]
 			]
 		}
+	],
+	"conditions": [
+		[
+			"fake_pcsc==1 and OS!='win'",
+			{
+				"targets": [
+					{
+						# The same addon over the simulated readers of src/fake instead of pcscd
+						"target_name": "pcsclite_fake",
+						"sources": [
+							"<@(pcsclite_sources)",
+							"src/fake/winscard.cpp",
+							"src/fake/testing.cpp"
+						],
+						"include_dirs": [
+							"src/fake"
+						],
+						# Exports the internals test/fake checks, see src/fake/testing.h
+						"defines": [
+							"PCSC_FAKE"
+						]
+					}
+				]
+			}
+		]
 	]
 }
@@ -1,4 +1,5 @@
 import { EventEmitter } from "events";
+import { Readable } from "stream";
 
 export type ConnectOptions = {
 	share_mode?: number;
@@ -7,7 +8,138 @@ export type ConnectOptions = {
 
 export type Status = {
 	atr?: Buffer;
+	cardType?: any;
 	state: number;
+	seq?: number;
+	timestamp?: bigint;
+};
+
+export type PCSCLiteOptions = {
+	statusQueueSize?: number;
+	ioThreads?: number;
+	replay?: string | Buffer;
+	speed?: number;
+	atrPatterns?: AtrPattern[];
+	filter?: (name: string) => boolean;
+	stateTable?: number;
+};
+
+export type ReaderSlot = {
+	name?: string;
+	id?: number;
+	state?: number;
+	connected?: boolean;
+	atr?: Uint8Array;
+	atrLength?: number;
+	seq?: number;
+	timestamp?: bigint;
+};
+
+export type AtrPattern = {
+	atr: string | Buffer;
+	mask?: Buffer;
+	type: any;
+};
+
+export type TransmitBatchOptions = {
+	expected_sw?: number[];
+	transaction?: boolean;
+};
+
+export type TransmitBatchResult = {
+	data: Buffer;
+	offsets: Uint32Array;
+	count: number;
+	stopped: boolean;
+	responses: Buffer[];
+};
+
+export type ScriptOptions = {
+	maxSteps?: number;
+	transaction?: boolean;
+};
+
+export type ScriptResult = {
+	data: Buffer;
+	offsets: Uint32Array;
+	count: number;
+	responses: Buffer[];
+	vars: { [name: string]: Buffer };
+	steps: number;
+};
+
+export type TransmitManyResult =
+	| ({ reader: CardReader; error?: undefined } & TransmitBatchResult)
+	| { reader: CardReader; error: Error };
+
+export type SessionKeys = {
+	enc: Buffer;
+	mac: Buffer;
+	rmac: Buffer;
+};
+
+export type ReconnectOptions = {
+	share_mode?: number;
+	protocol?: number;
+	initialization?: number;
+};
+
+export type TransmitOptions = {
+	chaining?: boolean;
+	cache?: boolean;
+	tlv?: boolean;
+};
+
+export type ReadStreamOptions = {
+	offset?: number;
+	length?: number;
+	chunk_size?: number;
+	highWaterMark?: number;
+};
+
+export type RequestOptions = {
+	timeout?: number;
+	signal?: AbortSignal;
+};
+
+export type LatencyStats = {
+	count: number;
+	min: number;
+	max: number;
+	mean: number;
+	p50: number;
+	p90: number;
+	p99: number;
+	p999: number;
+};
+
+export type PoolStats = {
+	hits: number;
+	misses: number;
+	free: number;
+};
+
+export type CacheStats = {
+	entries: number;
+	bytes: number;
+	hits: number;
+	misses: number;
+};
+
+export type IoStats = {
+	requests: number;
+	apdus: number;
+	bytes_in: number;
+	bytes_out: number;
+	errors: { [code: string]: number };
+	cached: number;
+	latency: {
+		queue: LatencyStats;
+		lock: LatencyStats;
+		scard: LatencyStats;
+		delivery: LatencyStats;
+		total: LatencyStats;
+	};
 };
 
 export type AnyOrNothing = any | undefined | null;
@@ -21,7 +153,72 @@ export interface PCSCLite extends EventEmitter {
 
 	once(type: "reader", listener: (reader: CardReader) => void): this;
 
-	close(): void;
+	close(): Promise<void>;
+
+	close(cb: () => void): void;
+
+	dropped_events(): number;
+
+	getStats(): IoStats & { readers: number; dropped_events: number };
+
+	resetStats(): void;
+
+	setAtrPatterns(patterns: AtrPattern[]): void;
+
+	transmitMany(
+		readers: CardReader[],
+		apdus: Buffer[],
+		res_len: number,
+		protocol: number | number[],
+		cb: (err: AnyOrNothing, results: TransmitManyResult[]) => void
+	): void;
+
+	transmitMany(
+		readers: CardReader[],
+		apdus: Buffer[],
+		res_len: number,
+		protocol: number | number[],
+		options: TransmitBatchOptions,
+		cb: (err: AnyOrNothing, results: TransmitManyResult[]) => void
+	): void;
+
+	stateTable?: ReaderStateTable;
+}
+
+export class ApduScript {
+	send(...parts: (Buffer | number[] | number | string | { length: string })[]): this;
+
+	set(name: string, value: Buffer | number[] | number): this;
+
+	capture(name: string, start?: number, end?: number): this;
+
+	add(name: string, value: number): this;
+
+	label(name: string): this;
+
+	jump(label: string): this;
+
+	ifSw(sw: number, label: string, mask?: number): this;
+
+	unlessSw(sw: number, label: string, mask?: number): this;
+
+	end(): this;
+
+	compile(): { code: Buffer; vars: string[] };
+}
+
+export class ReaderStateTable {
+	constructor(source: number | SharedArrayBuffer);
+
+	readonly buffer: SharedArrayBuffer;
+
+	readonly bytes: Uint8Array;
+
+	readonly size: number;
+
+	read(index: number, target: ReaderSlot): boolean;
+
+	snapshot(): Required<ReaderSlot>[];
 }
 
 export interface CardReader extends EventEmitter {
@@ -50,6 +247,11 @@ export interface CardReader extends EventEmitter {
 	SCARD_RESET_CARD: number;
 	SCARD_UNPOWER_CARD: number;
 	SCARD_EJECT_CARD: number;
+	// SCP03 security level
+	SCP03_C_MAC: number;
+	SCP03_C_DECRYPTION: number;
+	SCP03_R_MAC: number;
+	SCP03_R_ENCRYPTION: number;
 	name: string;
 	state: number;
 	connected: boolean;
@@ -75,7 +277,13 @@ export interface CardReader extends EventEmitter {
 	SCARD_CTL_CODE(code: number): number;
 
 	get_status(
-		cb: (err: AnyOrNothing, state: number, atr?: Buffer) => void
+		cb: (
+			err: AnyOrNothing,
+			state: number,
+			atr?: Buffer,
+			seq?: number,
+			timestamp?: bigint
+		) => void
 	): void;
 
 	connect(callback: (err: AnyOrNothing, protocol: number) => void): void;
@@ -85,17 +293,91 @@ export interface CardReader extends EventEmitter {
 		callback: (err: AnyOrNothing, protocol: number) => void
 	): void;
 
+	reconnect(cb: (err: AnyOrNothing, protocol: number) => void): void;
+
+	reconnect(options: ReconnectOptions, cb: (err: AnyOrNothing, protocol: number) => void): void;
+
 	disconnect(callback: (err: AnyOrNothing) => void): void;
 
 	disconnect(disposition: number, callback: (err: AnyOrNothing) => void): void;
 
 	transmit(
 		data: Buffer,
-		res_len: number,
+		res_len: number | Buffer,
 		protocol: number,
 		cb: (err: AnyOrNothing, response: Buffer) => void
 	): void;
 
+	transmit(
+		data: Buffer,
+		res_len: number | Buffer,
+		protocol: number,
+		options: TransmitOptions,
+		cb: (err: AnyOrNothing, response: Buffer, tlv?: Uint32Array | null) => void
+	): void;
+
+	transmitBatch(
+		apdus: Buffer[],
+		res_len: number,
+		protocol: number,
+		cb: (err: AnyOrNothing, result: TransmitBatchResult) => void
+	): void;
+
+	transmitBatch(
+		apdus: Buffer[],
+		res_len: number,
+		protocol: number,
+		options: TransmitBatchOptions,
+		cb: (err: AnyOrNothing, result: TransmitBatchResult) => void
+	): void;
+
+	runScript(
+		script: ApduScript,
+		res_len: number,
+		protocol: number,
+		cb: (err: AnyOrNothing, result: ScriptResult) => void
+	): void;
+
+	runScript(
+		script: ApduScript,
+		res_len: number,
+		protocol: number,
+		options: ScriptOptions,
+		cb: (err: AnyOrNothing, result: ScriptResult) => void
+	): void;
+
+	beginTransaction(cb: (err: AnyOrNothing) => void): void;
+
+	endTransaction(cb: (err: AnyOrNothing) => void): void;
+
+	endTransaction(disposition: number, cb: (err: AnyOrNothing) => void): void;
+
+	openSecureChannel(keys: SessionKeys, level: number, cb: (err: AnyOrNothing) => void): void;
+
+	closeSecureChannel(cb: (err: AnyOrNothing) => void): void;
+
+	getStats(): IoStats & { cache: CacheStats; pool: { batons: PoolStats; requests: PoolStats; buffers: PoolStats } };
+
+	resetStats(): void;
+
+	createReadStream(protocol: number, options?: ReadStreamOptions): Readable;
+
+	connectAsync(options?: ConnectOptions & RequestOptions): Promise<number | undefined>;
+
+	transmitAsync(
+		data: Buffer,
+		res_len: number | Buffer,
+		protocol: number,
+		options?: TransmitOptions & RequestOptions
+	): Promise<Buffer>;
+
+	controlAsync(
+		data: Buffer,
+		control_code: number,
+		res_len: number,
+		options?: RequestOptions
+	): Promise<Buffer>;
+
 	control(
 		data: Buffer,
 		control_code: number,
@@ -103,9 +385,25 @@ export interface CardReader extends EventEmitter {
 		cb: (err: AnyOrNothing, response: Buffer) => void
 	): void;
 
-	close(): void;
+	clearCache(): void;
+
+	startRecording(path: string): void;
+
+	stopRecording(): Promise<void>;
+
+	stopRecording(cb: (err: AnyOrNothing) => void): void;
+
+	close(): Promise<void>;
+
+	close(cb: () => void): void;
 }
 
-declare function pcsc(): PCSCLite;
+declare function pcsc(options?: PCSCLiteOptions): PCSCLite;
+
+declare namespace pcsc {
+	function indexTlv(data: Buffer): Uint32Array | null;
+
+	function findTlv(index: Uint32Array, tag: number, start?: number): number;
+}
 
 export default pcsc;
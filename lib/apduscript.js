@@ -0,0 +1,225 @@
+"use strict";
+
+// Builds the scripts a reader runs on its I/O thread (see CardReader.runScript()),
+// compiled to the bytecode of src/apduscript.h.
+
+const END = 0x00;
+const LIT = 0x01;
+const VAR = 0x02;
+const VAR_LEN = 0x03;
+const SEND = 0x04;
+const SET = 0x05;
+const CAPTURE = 0x06;
+const ADD = 0x07;
+const JUMP = 0x08;
+const IF_SW = 0x09;
+const UNLESS_SW = 0x0A;
+
+const TO_END = 0xFFFF;
+const MAX_VARS = 256;
+
+
+function ApduScript() {
+
+	this._ops = [];
+	this._labels = {};
+	this._vars = [];
+	this._compiled = null;
+
+}
+
+ApduScript.prototype._var = function (name) {
+
+	let index = this._vars.indexOf(name);
+
+	if (index === -1) {
+		if (this._vars.length === MAX_VARS) {
+			throw new RangeError('Too many variables');
+		}
+		index = this._vars.push(name) - 1;
+	}
+
+	return index;
+
+};
+
+ApduScript.prototype._push = function (op) {
+
+	this._ops.push(op);
+	this._compiled = null;
+	return this;
+
+};
+
+// parts, in order: Buffer or array of bytes (literal), number (a byte),
+// string (a variable) or { length: name } (the length of a variable, a byte)
+ApduScript.prototype.send = function (...parts) {
+
+	parts.forEach((part) => {
+		if (typeof part === 'string') {
+			this._ops.push({ code: VAR, var: this._var(part) });
+		} else if (part !== null && typeof part === 'object' && typeof part.length === 'string') {
+			this._ops.push({ code: VAR_LEN, var: this._var(part.length) });
+		} else {
+			const bytes = Buffer.from(typeof part === 'number' ? [part] : part);
+			if (bytes.length > 0xFFFF) {
+				throw new RangeError('Literal too long');
+			}
+			this._ops.push({ code: LIT, bytes: bytes });
+		}
+	});
+
+	return this._push({ code: SEND });
+
+};
+
+ApduScript.prototype.set = function (name, value) {
+
+	const bytes = Buffer.from(typeof value === 'number' ? [value] : value);
+
+	if (bytes.length > 0xFFFF) {
+		throw new RangeError('Value too long');
+	}
+
+	return this._push({ code: SET, var: this._var(name), bytes: bytes });
+
+};
+
+// bytes [start, end) of the data of the last response (status word excluded),
+// up to its end by default
+ApduScript.prototype.capture = function (name, start, end) {
+
+	start = start || 0;
+	end = end === undefined ? TO_END : end;
+
+	if (start > 0xFFFE || end > 0xFFFE && end !== TO_END || end < start) {
+		throw new RangeError('Invalid capture range');
+	}
+
+	return this._push({ code: CAPTURE, var: this._var(name), start: start, end: end });
+
+};
+
+// adds 0 to 255 to a variable, as a big endian number wrapping around
+ApduScript.prototype.add = function (name, value) {
+
+	return this._push({ code: ADD, var: this._var(name), value: value & 0xFF });
+
+};
+
+ApduScript.prototype.label = function (name) {
+
+	this._labels[name] = this._ops.length;
+	this._compiled = null;
+	return this;
+
+};
+
+ApduScript.prototype.jump = function (label) {
+
+	return this._push({ code: JUMP, label: label });
+
+};
+
+// jumps when the status word of the last response, masked, is sw
+// e.g. ifSw(0x6100, 'more', 0xFF00)
+ApduScript.prototype.ifSw = function (sw, label, mask) {
+
+	return this._push({ code: IF_SW, sw: sw, mask: mask === undefined ? 0xFFFF : mask, label: label });
+
+};
+
+ApduScript.prototype.unlessSw = function (sw, label, mask) {
+
+	return this._push({ code: UNLESS_SW, sw: sw, mask: mask === undefined ? 0xFFFF : mask, label: label });
+
+};
+
+ApduScript.prototype.end = function () {
+
+	return this._push({ code: END });
+
+};
+
+function opLength(op) {
+
+	switch (op.code) {
+		case LIT: return 3 + op.bytes.length;
+		case VAR: case VAR_LEN: return 2;
+		case SET: return 4 + op.bytes.length;
+		case CAPTURE: return 6;
+		case ADD: case JUMP: return 3;
+		case IF_SW: case UNLESS_SW: return 7;
+		default: return 1;
+	}
+
+}
+
+// { code: Buffer, vars: [names] }, cached until the script changes
+ApduScript.prototype.compile = function () {
+
+	if (this._compiled) {
+		return this._compiled;
+	}
+
+	// offset of each op, and of the end
+	const offsets = [0];
+	this._ops.forEach((op) => offsets.push(offsets[offsets.length - 1] + opLength(op)));
+
+	const length = offsets[offsets.length - 1];
+	if (length > 0xFFFF) {
+		throw new RangeError('Script too long');
+	}
+
+	const code = Buffer.alloc(length);
+	const target = (label) => {
+		if (!(label in this._labels)) {
+			throw new Error('Undefined label: ' + label);
+		}
+		return offsets[this._labels[label]];
+	};
+
+	this._ops.forEach((op, i) => {
+		let at = offsets[i];
+		code[at++] = op.code;
+		switch (op.code) {
+			case LIT:
+				code.writeUInt16BE(op.bytes.length, at);
+				op.bytes.copy(code, at + 2);
+				break;
+			case VAR:
+			case VAR_LEN:
+				code[at] = op.var;
+				break;
+			case SET:
+				code[at] = op.var;
+				code.writeUInt16BE(op.bytes.length, at + 1);
+				op.bytes.copy(code, at + 3);
+				break;
+			case CAPTURE:
+				code[at] = op.var;
+				code.writeUInt16BE(op.start, at + 1);
+				code.writeUInt16BE(op.end, at + 3);
+				break;
+			case ADD:
+				code[at] = op.var;
+				code[at + 1] = op.value;
+				break;
+			case JUMP:
+				code.writeUInt16BE(target(op.label), at);
+				break;
+			case IF_SW:
+			case UNLESS_SW:
+				code.writeUInt16BE(op.sw & 0xFFFF, at);
+				code.writeUInt16BE(op.mask & 0xFFFF, at + 2);
+				code.writeUInt16BE(target(op.label), at + 4);
+				break;
+		}
+	});
+
+	this._compiled = { code: code, vars: this._vars.slice() };
+	return this._compiled;
+
+};
+
+module.exports = ApduScript;
@@ -1,12 +1,19 @@
 "use strict";
 
 const EventEmitter = require('events');
+const fs = require('fs');
+const { Readable } = require('stream');
+const ReaderStateTable = require('./statetable');
+const ApduScript = require('./apduscript');
 
 // pcsclite.node is a Node.js native C++ addon that is compiled during installation
 // via node-gyp (see package.json > scripts > install)
 // the build output name and directory is constant so we can require it directly
 // see https://github.com/nodejs/node-gyp/issues/263, https://github.com/nodejs/node-gyp/issues/631
-const pcsclite = require('../build/Release/pcsclite.node');
+// PCSCLITE_FAKE=1 loads the build over simulated readers instead (see Benchmarks in README.md)
+const pcsclite = process.env.PCSCLITE_FAKE
+	? require('../build/Release/pcsclite_fake.node')
+	: require('../build/Release/pcsclite.node');
 
 const { PCSCLite, CardReader } = pcsclite;
 
@@ -14,102 +21,294 @@ const { PCSCLite, CardReader } = pcsclite;
 inherits(PCSCLite, EventEmitter);
 inherits(CardReader, EventEmitter);
 
-function parseReadersString(buffer) {
+module.exports = function (options) {
 
-	try {
+	options = options || {};
 
-		const string = buffer.toString().slice(0, -1);
+	const readers = {};
 
-		// it looks like
-		// ACS ACR122U PICC Interface\u0000ACS ACR122U PICC Interface 01\u0000\u0000
-		// [reader_name]\u0000[reader_name]\u0000\u0000
-		//              ^separator         ^separator^end_separator
+	// ioThreads: size of a thread pool shared by all the readers for their I/O,
+	// by default every reader gets a thread of its own
+	const p = new PCSCLite(options.ioThreads);
 
-		// returns readers in array
-		// like [ 'ACS ACR122U PICC Interface', 'ACS ACR122U PICC Interface 01' ]
+	p.readers = readers;
 
-		return string.split('\u0000').slice(0, -1);
+	// atrPatterns: see setAtrPatterns()
+	if (options.atrPatterns) {
+		p.setAtrPatterns(options.atrPatterns);
+	}
 
-	} catch (e) {
-		return [];
+	// stateTable: number of slots of a shared memory table of the reader states
+	// kept by the monitor thread, see ReaderStateTable
+	if (options.stateTable) {
+		p.stateTable = new ReaderStateTable(options.stateTable);
+		p._attach_state_table(p.stateTable.bytes);
 	}
 
-}
+	process.nextTick(function () {
 
-/*
- * It returns an array with the elements contained in a that aren't contained in b
- */
-function diff(a, b) {
+		// replay: a session log (path or Buffer, see CardReader.startRecording())
+		// played back as the only reader, instead of the PC/SC readers
+		if (options.replay) {
+			return replay(p, options.replay, options.speed);
+		}
+
+		// statusQueueSize bounds the number of status events buffered
+		// between the monitor thread and the event loop (see dropped_events())
+		// the reader list is diffed natively, only the changes are reported
+		p.start(function (err, newNames, removedNames) {
+
+			if (err) {
+				return p.emit('error', err);
+			}
+
+			// filter: the readers this instance handles, e.g. to shard them over worker threads,
+			// the monitor thread only watches the ones taken
+			const names = options.filter ? newNames.filter(name => options.filter(name)) : newNames;
+
+			if (options.filter) {
+				p._own(names);
+			}
+
+			names.forEach(function (name) {
+				p.emit('reader', addReader(p, name));
+			});
+
+			removedNames.forEach(function (name) {
+				if (readers[name]) {
+					readers[name].close();
+				}
+			});
+
+		}, options.statusQueueSize, !!options.filter);
+
+	});
+
+	return p;
+};
+
+module.exports.ReaderStateTable = ReaderStateTable;
+module.exports.ApduScript = ApduScript;
+
+// BER-TLV index of data, 4 entries per data object: tag, depth, offset and length of its value
+// null when data isn't well-formed BER-TLV
+module.exports.indexTlv = function (data) {
+	return CardReader._index_tlv(data);
+};
+
+// Position in index of the first data object with tag, from the one at position start, or -1
+module.exports.findTlv = function (index, tag, start) {
+
+	for (let i = start || 0; i < index.length; i += 4) {
+		if (index[i] === tag) {
+			return i;
+		}
+	}
 
-	return a.filter(i => b.indexOf(i) === -1);
+	return -1;
+
+};
+
+function addReader(p, name) {
+
+	// the status of all readers is watched by the monitor thread of p
+	const r = new CardReader(name, p);
+
+	r.on('_end', function () {
+		r.removeAllListeners('status');
+		delete p.readers[name];
+		r.emit('end');
+	});
+
+	p.readers[name] = r;
+
+	r.get_status(function (err, state, atr, seq, timestamp, cardType) {
+
+		if (err) {
+			return r.emit('error', err);
+		}
+
+		const status = { state: state };
+
+		if (atr) {
+			status.atr = atr;
+		}
+
+		// index of the first ATR pattern matching, classified natively
+		if (cardType !== undefined) {
+			status.cardType = p._cardTypes[cardType];
+		}
+
+		status.seq = seq;
+		status.timestamp = timestamp;
+
+		r.emit('status', status);
+
+		r.state = state;
+
+	});
+
+	return r;
 
 }
 
-module.exports = function () {
+function replay(p, log, speed) {
 
-	const readers = {};
+	const start = function (err, log) {
 
-	const p = new PCSCLite();
+		if (err) {
+			return p.emit('error', err);
+		}
 
-	p.readers = readers;
+		let r;
 
-	process.nextTick(function () {
+		try {
+			r = addReader(p, CardReader._replay_reader(log));
+			// speed scales the recorded timings, 0 answers right away
+			r._replay(log, typeof speed === 'number' ? speed : 1);
+		} catch (err) {
+			return p.emit('error', err);
+		}
 
-		p.start(function (err, data) {
+		p.emit('reader', r);
 
-			if (err) {
-				return p.emit('error', err);
-			}
+	};
 
-			const names = parseReadersString(data);
+	if (Buffer.isBuffer(log)) {
+		return start(null, log);
+	}
 
-			const currentNames = Object.keys(readers);
-			const newNames = diff(names, currentNames);
-			const removedNames = diff(currentNames, names);
+	fs.readFile(log, start);
 
-			newNames.forEach(function (name) {
+}
 
-				const r = new CardReader(name);
+PCSCLite.prototype.close = function (cb) {
 
-				r.on('_end', function () {
-					r.removeAllListeners('status');
-					delete readers[name];
-					r.emit('end');
-				});
+	if (typeof cb !== 'function') {
+		return new Promise(resolve => this.close(resolve));
+	}
 
-				readers[name] = r;
+	// the monitor thread is never waited for on the event loop
+	if (this._close()) {
+		this.once('_closed', () => cb());
+	} else {
+		process.nextTick(cb);
+	}
 
-				r.get_status(function (err, state, atr) {
+};
 
-					if (err) {
-						return r.emit('error', err);
-					}
+PCSCLite.prototype.setAtrPatterns = function (patterns) {
 
-					const status = { state: state };
+	const atrs = [];
+	const masks = [];
+	const types = [];
 
-					if (atr) {
-						status.atr = atr;
-					}
+	patterns.forEach(function (pattern) {
 
-					r.emit('status', status);
+		if (typeof pattern.atr === 'string') {
+			// hex digits, '.' for any nibble, as in smartcard_list.txt
+			const digits = pattern.atr.replace(/\s+/g, '');
 
-					r.state = state;
+			if (!/^([0-9a-fA-F.]{2})*$/.test(digits)) {
+				throw new TypeError('Invalid ATR pattern ' + pattern.atr);
+			}
 
-				});
+			atrs.push(Buffer.from(digits.replace(/\./g, '0'), 'hex'));
+			masks.push(Buffer.from(digits.replace(/[0-9a-fA-F]/g, 'f').replace(/\./g, '0'), 'hex'));
+		} else {
+			atrs.push(pattern.atr);
+			masks.push(pattern.mask);
+		}
 
-				p.emit('reader', r);
+		types.push(pattern.type);
 
-			});
+	});
 
-			removedNames.forEach(function (name) {
-				readers[name].close();
-			});
+	this._set_atr_patterns(atrs, masks);
+	this._cardTypes = types;
 
+};
+
+PCSCLite.prototype.transmitMany = function (readers, apdus, res_len, protocol, options, cb) {
+
+	if (typeof options === 'function') {
+		cb = options;
+		options = undefined;
+	}
+
+	options = options || {};
+
+	// one entry per reader, in order: its transmitBatch() result or its error
+	const results = new Array(readers.length);
+	const targets = [];
+	const protocols = [];
+	const indexes = [];
+
+	readers.forEach(function (reader, i) {
+		if (!reader.connected) {
+			results[i] = { reader: reader, error: new Error('Card Reader not connected') };
+		} else {
+			targets.push(reader);
+			// protocol: of all the readers, or an Array of one per reader
+			protocols.push(Array.isArray(protocol) ? protocol[i] : protocol);
+			indexes.push(i);
+		}
+	});
+
+	if (!targets.length) {
+		return process.nextTick(cb, null, results);
+	}
+
+	// every reader runs the whole script on its own I/O thread, the callback
+	// comes once all of them are done
+	CardReader._transmit_many(targets, apdus, res_len, protocols, options.expected_sw, !!options.transaction, function (err, batches) {
+		if (err) {
+			return cb(err);
+		}
+
+		batches.forEach(function (result, j) {
+			results[indexes[j]] = result instanceof Error
+				? { reader: targets[j], error: result }
+				: Object.assign(unpackBatch(result), { reader: targets[j] });
 		});
 
+		cb(null, results);
 	});
 
-	return p;
+};
+
+CardReader.prototype.close = function (cb) {
+
+	if (typeof cb !== 'function') {
+		return new Promise(resolve => this.close(resolve));
+	}
+
+	if (this._close()) {
+		this.once('end', () => cb());
+	} else {
+		process.nextTick(cb);
+	}
+
+};
+
+CardReader.prototype.startRecording = function (path) {
+
+	// the requests and status changes of the reader, from now on
+	this._start_recording(path);
+
+};
+
+CardReader.prototype.stopRecording = function (cb) {
+
+	if (typeof cb !== 'function') {
+		return new Promise((resolve, reject) => this.stopRecording(err => err ? reject(err) : resolve()));
+	}
+
+	// the log is written off the event loop, cb is called once it is complete
+	if (!this._stop_recording(cb)) {
+		process.nextTick(cb, null);
+	}
+
 };
 
 CardReader.prototype.connect = function (options, cb) {
@@ -134,6 +333,30 @@ CardReader.prototype.connect = function (options, cb) {
 
 };
 
+CardReader.prototype.reconnect = function (options, cb) {
+
+	if (typeof options === 'function') {
+		cb = options;
+		options = undefined;
+	}
+
+	options = options || {};
+
+	let initialization = options.initialization;
+
+	if (typeof initialization !== 'number') {
+		initialization = this.SCARD_LEAVE_CARD;
+	}
+
+	if (!this.connected) {
+		return cb(new Error('Card Reader not connected'));
+	}
+
+	// the share mode and protocol default to the ones of the last connection
+	this._reconnect(options.share_mode, options.protocol, initialization, cb);
+
+};
+
 CardReader.prototype.disconnect = function (disposition, cb) {
 
 	if (typeof disposition === 'function') {
@@ -153,13 +376,177 @@ CardReader.prototype.disconnect = function (disposition, cb) {
 
 };
 
-CardReader.prototype.transmit = function (data, res_len, protocol, cb) {
+CardReader.prototype.transmit = function (data, res_len, protocol, options, cb) {
+
+	if (typeof options === 'function') {
+		cb = options;
+		options = undefined;
+	}
+
+	options = options || {};
 
 	if (!this.connected) {
 		return cb(new Error('Card Reader not connected'));
 	}
 
-	this._transmit(data, res_len, protocol, cb);
+	const chaining = !!options.chaining;
+	// a cached response is returned by _transmit() instead of being called back
+	const cache = !!options.cache;
+	// tlv: the BER-TLV index of the response comes as a third argument, see indexTlv()
+	const tlv = !!options.tlv;
+
+	if (Buffer.isBuffer(res_len)) {
+		// the response is written straight into the given buffer
+		const output = res_len;
+		const done = function (err, len, index) {
+			if (err) {
+				return cb(err);
+			}
+
+			cb(err, output.subarray(0, len), index);
+		};
+
+		const len = this._transmit(data, output, protocol, chaining, cache, tlv, done);
+
+		if (typeof len === 'number') {
+			process.nextTick(done, null, len, tlv ? indexResponse(output.subarray(0, len)) : undefined);
+		}
+
+		return;
+	}
+
+	const response = this._transmit(data, res_len, protocol, chaining, cache, tlv, cb);
+
+	if (response) {
+		process.nextTick(cb, null, response, tlv ? indexResponse(response) : undefined);
+	}
+
+};
+
+// index of a cached response, as the worker thread builds it
+function indexResponse(response) {
+	return CardReader._index_tlv(response.subarray(0, Math.max(response.length - 2, 0)));
+}
+
+CardReader.prototype.transmitBatch = function (apdus, res_len, protocol, options, cb) {
+
+	if (typeof options === 'function') {
+		cb = options;
+		options = undefined;
+	}
+
+	options = options || {};
+
+	if (!this.connected) {
+		return cb(new Error('Card Reader not connected'));
+	}
+
+	this._transmit_batch(apdus, res_len, protocol, options.expected_sw, !!options.transaction, function (err, result) {
+		if (err) {
+			return cb(err);
+		}
+
+		cb(null, unpackBatch(result));
+	});
+
+};
+
+CardReader.prototype.runScript = function (script, res_len, protocol, options, cb) {
+
+	if (typeof options === 'function') {
+		cb = options;
+		options = undefined;
+	}
+
+	options = options || {};
+
+	if (!this.connected) {
+		return cb(new Error('Card Reader not connected'));
+	}
+
+	const compiled = script.compile();
+	// maxSteps bounds the instructions run, so that a loop the card never ends can't hold the reader
+	const maxSteps = options.maxSteps === undefined ? 10000 : options.maxSteps;
+
+	this._run_script(compiled.code, compiled.vars.length, res_len, protocol, maxSteps, !!options.transaction,
+		function (err, result) {
+			if (err) {
+				return cb(err);
+			}
+
+			// the variables by name, as the script left them
+			const vars = {};
+			compiled.vars.forEach((name, i) => vars[name] = result.vars[i]);
+			result.vars = vars;
+
+			cb(null, unpackBatch(result));
+		});
+
+};
+
+// views into the packed buffer of a batch, no copies
+function unpackBatch(result) {
+
+	result.responses = [];
+	for (let i = 0; i < result.count; i++) {
+		result.responses.push(result.data.subarray(result.offsets[i], result.offsets[i + 1]));
+	}
+
+	return result;
+
+}
+
+CardReader.prototype.clearCache = function () {
+
+	// the cache is also cleared by every status change, (re)connection and reset
+	this._clear_cache();
+
+};
+
+CardReader.prototype.beginTransaction = function (cb) {
+
+	if (!this.connected) {
+		return cb(new Error('Card Reader not connected'));
+	}
+
+	this._begin_transaction(cb);
+
+};
+
+CardReader.prototype.endTransaction = function (disposition, cb) {
+
+	if (typeof disposition === 'function') {
+		cb = disposition;
+		disposition = undefined;
+	}
+
+	if (typeof disposition !== 'number') {
+		disposition = this.SCARD_LEAVE_CARD;
+	}
+
+	if (!this.connected) {
+		return cb(new Error('Card Reader not connected'));
+	}
+
+	this._end_transaction(disposition, cb);
+
+};
+
+CardReader.prototype.openSecureChannel = function (keys, level, cb) {
+
+	if (!this.connected) {
+		return cb(new Error('Card Reader not connected'));
+	}
+
+	// keys: the SCP03 session keys derived after INITIALIZE UPDATE, kept natively from then on
+	// the next command is expected to be the EXTERNAL AUTHENTICATE (with level as its P1)
+	this._secure_channel(keys.enc, keys.mac, keys.rmac, level, cb);
+
+};
+
+CardReader.prototype.closeSecureChannel = function (cb) {
+
+	this._secure_channel(null, null, null, 0, cb);
 
 };
 
@@ -181,6 +568,148 @@ CardReader.prototype.control = function (data, control_code, res_len, cb) {
 
 };
 
+// ids of the promise based requests and of the read streams
+let requestId = 0;
+
+/*
+ * Starts a promise based request bound to options.timeout (ms)
+ * and to the AbortSignal options.signal, if any
+ */
+function cancellable(reader, options, start) {
+
+	options = options || {};
+
+	const signal = options.signal;
+
+	if (signal && signal.aborted) {
+		const err = new Error('Request aborted');
+		err.code = 'ABORT_ERR';
+		return Promise.reject(err);
+	}
+
+	requestId = (requestId + 1) >>> 0;
+
+	const id = requestId;
+	const promise = start(options.timeout, id);
+
+	if (!signal) {
+		return promise;
+	}
+
+	const onAbort = function () {
+		reader._cancel(id);
+	};
+
+	signal.addEventListener('abort', onAbort, { once: true });
+
+	return promise.finally(function () {
+		signal.removeEventListener('abort', onAbort);
+	});
+
+}
+
+CardReader.prototype.connectAsync = function (options) {
+
+	options = options || {};
+
+	const share_mode = options.share_mode || this.SCARD_SHARE_EXCLUSIVE;
+	let protocol = options.protocol;
+
+	if (typeof protocol === 'undefined' || protocol === null) {
+		protocol = this.SCARD_PROTOCOL_T0 | this.SCARD_PROTOCOL_T1;
+	}
+
+	if (this.connected) {
+		return Promise.resolve();
+	}
+
+	return cancellable(this, options, (timeout, id) => this._connect_async(share_mode, protocol, timeout, id));
+
+};
+
+CardReader.prototype.transmitAsync = function (data, res_len, protocol, options) {
+
+	if (!this.connected) {
+		return Promise.reject(new Error('Card Reader not connected'));
+	}
+
+	const promise = cancellable(this, options, (timeout, id) => this._transmit_async(data, res_len, protocol, !!(options && options.chaining), !!(options && options.cache), timeout, id));
+
+	if (Buffer.isBuffer(res_len)) {
+		return promise.then(len => res_len.subarray(0, len));
+	}
+
+	return promise;
+
+};
+
+CardReader.prototype.controlAsync = function (data, control_code, res_len, options) {
+
+	if (!this.connected) {
+		return Promise.reject(new Error('Card Reader not connected'));
+	}
+
+	const output = Buffer.alloc(res_len);
+
+	return cancellable(this, options, (timeout, id) => this._control_async(data, control_code, output, timeout, id))
+		.then(len => output.slice(0, len));
+
+};
+
+CardReader.prototype.createReadStream = function (protocol, options) {
+
+	options = options || {};
+
+	const reader = this;
+	const offset = options.offset || 0;
+	const length = options.length || 0;
+	const chunk_size = options.chunk_size || 256;
+
+	// READ BINARY offsets are 3 bytes at most
+	if (offset < 0 || length < 0 || offset > 0xFFFFFF || offset + length > 0x1000000) {
+		throw new RangeError('Offset and length must not go past offset 0xFFFFFF');
+	}
+
+	requestId = (requestId + 1) >>> 0;
+
+	const id = requestId;
+	let started = false;
+
+	const stream = new Readable({
+		highWaterMark: options.highWaterMark,
+		read() {
+			if (started) {
+				return reader._read_binary_resume(id);
+			}
+
+			if (!reader.connected) {
+				return this.destroy(new Error('Card Reader not connected'));
+			}
+
+			started = true;
+			reader._read_binary(id, protocol, offset, length, chunk_size, function (err, chunk) {
+				if (err) {
+					stream.destroy(err);
+					return false;
+				}
+
+				// tells the worker whether to keep reading ahead
+				return stream.push(chunk);
+			});
+		},
+		destroy(err, cb) {
+			if (started) {
+				reader._read_binary_destroy(id);
+			}
+
+			cb(err);
+		},
+	});
+
+	return stream;
+
+};
+
 CardReader.prototype.SCARD_CTL_CODE = function (code) {
 
 	const isWin = /^win/.test(process.platform);
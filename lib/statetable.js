@@ -0,0 +1,135 @@
+"use strict";
+
+// Reads the reader state table a PCSCLite instance keeps in shared memory
+// (see stateTable in pcsclite.js), from any thread, without calls into the addon.
+// The layout is the one of src/statetable.h, in the native byte order.
+
+const HEADER_SIZE = 16;
+const SLOT_SIZE = 320;
+const ATR_SIZE = 36;
+
+// uint32 indexes of the fields within a slot
+const SEQ = 0;
+const FLAGS = 1;
+const STATE = 2;
+const ATRLEN = 3;
+const ID = 8;
+const NAMELEN = 9;
+// uint64 indexes
+const TIME = 2;
+const EVENT = 3;
+// byte offsets
+const ATR = 40;
+const NAME = ATR + ATR_SIZE;
+
+const FLAG_USED = 1;
+const FLAG_CONNECTED = 2;
+
+
+// source: a number of slots to allocate, or the buffer of an existing table
+// (e.g. posted to a worker)
+function ReaderStateTable(source) {
+
+	if (typeof source === 'number') {
+		source = new SharedArrayBuffer(HEADER_SIZE + source * SLOT_SIZE);
+	}
+
+	this.buffer = source;
+	this.bytes = new Uint8Array(source);
+	this.size = source.byteLength < HEADER_SIZE ? 0 : Math.floor((source.byteLength - HEADER_SIZE) / SLOT_SIZE);
+
+	this._u32 = new Uint32Array(source, 0, (HEADER_SIZE + this.size * SLOT_SIZE) / 4);
+	this._u64 = new BigUint64Array(source, 0, (HEADER_SIZE + this.size * SLOT_SIZE) / 8);
+	this._atr = new Uint8Array(ATR_SIZE);
+
+}
+
+// Copies slot index into target, false when no reader has it. target is reused
+// from call to call: its atr is filled in place and the name only decoded when
+// the slot got another reader, so that polling doesn't allocate.
+ReaderStateTable.prototype.read = function (index, target) {
+
+	const u32 = this._u32;
+	const base = (HEADER_SIZE + index * SLOT_SIZE) / 4;
+
+	if (!target.atr) {
+		target.atr = new Uint8Array(ATR_SIZE);
+	}
+
+	// seqlock: the monitor thread never waits for the readers, the copy is
+	// retried if the slot changed meanwhile. It goes to locals (and the atr
+	// to a scratch buffer) first: target only gets a copy known to be whole.
+	const scratch = this._atr;
+
+	for (;;) {
+
+		const seq = Atomics.load(u32, base + SEQ);
+
+		if (seq & 1) {
+			continue;
+		}
+
+		const flags = u32[base + FLAGS];
+		const id = u32[base + ID];
+		const state = u32[base + STATE];
+		const atrLength = Math.min(u32[base + ATRLEN], ATR_SIZE);
+		const eventSeq = this._u64[base / 2 + EVENT];
+		const timestamp = this._u64[base / 2 + TIME];
+		let name = target.name;
+
+		if (flags & FLAG_USED) {
+
+			const atr = base * 4 + ATR;
+			scratch.set(this.bytes.subarray(atr, atr + atrLength));
+
+			if (target.id !== id) {
+				const offset = base * 4 + NAME;
+				name = Buffer.from(this.bytes.subarray(offset, offset + Math.min(u32[base + NAMELEN], SLOT_SIZE - NAME))).toString();
+			}
+
+		}
+
+		if (Atomics.load(u32, base + SEQ) !== seq) {
+			continue;
+		}
+
+		if (!(flags & FLAG_USED)) {
+			return false;
+		}
+
+		target.id = id;
+		target.name = name;
+		target.state = state;
+		target.connected = !!(flags & FLAG_CONNECTED);
+		target.atrLength = atrLength;
+		target.atr.set(scratch.subarray(0, atrLength));
+		target.seq = Number(eventSeq);
+		target.timestamp = timestamp;
+
+		return true;
+
+	}
+
+};
+
+// The readers of all the used slots, allocating.
+ReaderStateTable.prototype.snapshot = function () {
+
+	const readers = [];
+
+	for (let i = 0; i < this.size; i++) {
+
+		const slot = {};
+
+		if (this.read(i, slot)) {
+			slot.atr = slot.atr.slice(0, slot.atrLength);
+			readers.push(slot);
+		}
+
+	}
+
+	return readers;
+
+};
+
+module.exports = ReaderStateTable;
@@ -1,9 +1,27 @@
+#include "addon.h"
 #include "pcsclite.h"
 #include "cardreader.h"
+#ifdef PCSC_FAKE
+#include "testing.h"
+#endif
 
 Napi::Object InitAll(Napi::Env env, Napi::Object exports) {
+    AddonData* data = new AddonData();
+    napi_status status = napi_get_uv_event_loop(env, &data->loop);
+    if (status != napi_ok) {
+        delete data;
+        Napi::Error::New(env, "Failed to get the event loop").ThrowAsJavaScriptException();
+        return exports;
+    }
+
+    data->buffers = std::make_shared<BufferPool>();
+    env.SetInstanceData(data);
+
     PCSCLite::Init(env, exports);
     CardReader::Init(env, exports);
+#ifdef PCSC_FAKE
+    InitTesting(env, exports);
+#endif
     return exports;
 }
 
@@ -0,0 +1,25 @@
+#ifndef ADDON_H
+#define ADDON_H
+
+#include <napi.h>
+#include <uv.h>
+#include <memory>
+#include "pool.h"
+
+/*
+ * State of the addon in an environment (the main thread or a worker thread),
+ * kept as its instance data: nothing is shared between environments but the
+ * PC/SC contexts of ContextRegistry.
+ */
+struct AddonData {
+    // Loop of the environment, the one all our handles and requests go to
+    uv_loop_t* loop;
+    Napi::FunctionReference pcsclite_constructor;
+    Napi::FunctionReference cardreader_constructor;
+    // Response buffers of all the readers, kept alive by the ones still handed over to JS
+    std::shared_ptr<BufferPool> buffers;
+
+    static AddonData* Get(Napi::Env env) { return env.GetInstanceData<AddonData>(); };
+};
+
+#endif /* ADDON_H */
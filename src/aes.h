@@ -0,0 +1,49 @@
+#ifndef AES_H
+#define AES_H
+
+#include <cstddef>
+#include <cstdint>
+
+#define AES_BLOCK_SIZE 16
+
+/*
+ * AES block cipher (FIPS-197) with 128, 192 or 256 bit keys, and the modes
+ * the secure channel is built on: CBC without padding and CMAC (NIST SP
+ * 800-38B, RFC 4493). Self-contained, so that the addon links against no
+ * crypto library whatever the platform.
+ */
+class Aes {
+
+    public:
+
+        // key_len of 16, 24 or 32 bytes.
+        Aes(const uint8_t* key, size_t key_len);
+        // Wipes the round keys.
+        ~Aes();
+
+        void Encrypt(const uint8_t* in, uint8_t* out) const;
+        void Decrypt(const uint8_t* in, uint8_t* out) const;
+
+        // len a multiple of AES_BLOCK_SIZE, in and out may be the same.
+        void CbcEncrypt(const uint8_t* iv, const uint8_t* in, uint8_t* out, size_t len) const;
+        void CbcDecrypt(const uint8_t* iv, const uint8_t* in, uint8_t* out, size_t len) const;
+
+        void Cmac(const uint8_t* data, size_t len, uint8_t* mac) const;
+
+        static bool ValidKeyLength(size_t key_len) { return key_len == 16 || key_len == 24 || key_len == 32; };
+
+    private:
+
+        Aes(const Aes&);
+        Aes& operator=(const Aes&);
+
+    private:
+
+        uint8_t m_round_keys[240];
+        int m_rounds;
+};
+
+// Zeroes secrets, in a way the compiler can't leave out.
+void secure_zero(void* data, size_t len);
+
+#endif /* AES_H */
@@ -0,0 +1,248 @@
+#include "apdu.h"
+#include <vector>
+
+namespace {
+
+    const BYTE CLA_CHAINING = 0x10;
+    const BYTE INS_GET_RESPONSE = 0xC0;
+    const BYTE INS_READ_BINARY = 0xB0;
+    const BYTE INS_READ_BINARY_ODD = 0xB1;
+
+    inline bool sw_is(const BYTE* response, DWORD len, BYTE sw1, BYTE sw2) {
+        return len >= 2 && response[len - 2] == sw1 && response[len - 1] == sw2;
+    }
+
+    /*
+     * Splits an extended length command with more than 255 bytes of data into
+     * short commands. Returns false, leaving chain empty, for other commands.
+     */
+    bool split_command(const BYTE* in_data, DWORD in_len, std::vector<std::vector<BYTE>>& chain) {
+        if (in_len < 7 || in_data[4] != 0) {
+            return false;
+        }
+
+        DWORD lc = (in_data[5] << 8) | in_data[6];
+        if (lc <= 255 || (in_len != 7 + lc && in_len != 7 + lc + 2)) {
+            return false;
+        }
+
+        const BYTE* data = in_data + 7;
+        bool has_le = (in_len == 7 + lc + 2);
+        DWORD le = has_le ? (in_data[7 + lc] << 8) | in_data[8 + lc] : 0;
+
+        for (DWORD offset = 0; offset < lc; offset += 255) {
+            DWORD size = (lc - offset > 255) ? 255 : lc - offset;
+            bool last = (offset + size == lc);
+
+            std::vector<BYTE> command;
+            command.reserve(5 + size + 1);
+            command.push_back(last ? in_data[0] : in_data[0] | CLA_CHAINING);
+            command.insert(command.end(), in_data + 1, in_data + 4);
+            command.push_back(size);
+            command.insert(command.end(), data + offset, data + offset + size);
+            if (last && has_le) {
+                // Short Le, 0x00 standing for 256 (or more)
+                command.push_back((le == 0 || le > 255) ? 0x00 : le);
+            }
+
+            chain.push_back(command);
+        }
+
+        return true;
+    }
+
+    /* CLA of a GET RESPONSE on the logical channel of the given command */
+    BYTE get_response_cla(BYTE cla) {
+        if ((cla & 0xC0) == 0x40) {
+            // Further interindustry class, channels 4 to 19
+            return 0x40 | (cla & 0x0F);
+        }
+
+        return cla & 0x03;
+    }
+
+    /*
+     * Le correction: the command expecting exactly le bytes (0 for 256), in
+     * place of its Le if any. An extended Le stays extended when there is an
+     * extended Lc, and a command without data gets a short Le.
+     */
+    void set_le(std::vector<BYTE>& command, BYTE le) {
+        size_t size = command.size();
+        if (size <= 4) {
+            /* Case 1 */
+            command.push_back(le);
+        } else if (size == 5) {
+            /* Case 2S */
+            command[4] = le;
+        } else if (command[4] != 0) {
+            /* Case 3S, or 4S replacing its Le */
+            if (size == 6u + command[4]) {
+                command.back() = le;
+            } else {
+                command.push_back(le);
+            }
+        } else if (size == 7) {
+            /* Case 2E, sent again as 2S */
+            command.resize(4);
+            command.push_back(le);
+        } else {
+            /* Case 3E, or 4E replacing its Le */
+            size_t lc = (command[5] << 8) | command[6];
+            if (size == 9 + lc) {
+                command.resize(size - 2);
+            }
+
+            DWORD extended_le = le ? le : 256;
+            command.push_back((extended_le >> 8) & 0xFF);
+            command.push_back(extended_le & 0xFF);
+        }
+    }
+}
+
+LONG transmit_chained(SCARDHANDLE card, const SCARD_IO_REQUEST* send_pci,
+                      const BYTE* in_data, DWORD in_len,
+                      BYTE* out_data, DWORD* out_len) {
+
+    DWORD capacity = *out_len;
+    DWORD len;
+    LONG result;
+
+    std::vector<std::vector<BYTE>> chain;
+    if (!split_command(in_data, in_len, chain)) {
+        chain.push_back(std::vector<BYTE>(in_data, in_data + in_len));
+    }
+
+    /* Outgoing chain: every link but the last one must be accepted with 9000 */
+    for (size_t i = 0; i + 1 < chain.size(); i++) {
+        len = capacity;
+        result = SCardTransmit(card, send_pci, chain[i].data(), chain[i].size(), NULL, out_data, &len);
+        if (result != SCARD_S_SUCCESS) {
+            return result;
+        }
+
+        if (!sw_is(out_data, len, 0x90, 0x00)) {
+            *out_len = len;
+            return SCARD_S_SUCCESS;
+        }
+    }
+
+    std::vector<BYTE> command = chain.back();
+    bool corrected = false;
+    DWORD total = 0;
+
+    for (int exchanges = 0; exchanges < MAX_CHAINED_EXCHANGES; exchanges++) {
+        len = capacity - total;
+        result = SCardTransmit(card, send_pci, command.data(), command.size(), NULL, out_data + total, &len);
+        if (result != SCARD_S_SUCCESS) {
+            return result;
+        }
+
+        if (len < 2) {
+            *out_len = total + len;
+            return SCARD_S_SUCCESS;
+        }
+
+        BYTE sw1 = out_data[total + len - 2];
+        BYTE sw2 = out_data[total + len - 1];
+
+        if (sw1 == 0x6C && !corrected) {
+            /* Wrong Le: send the same command again, once, with the right one */
+            corrected = true;
+            set_le(command, sw2);
+            continue;
+        }
+
+        if (sw1 == 0x61) {
+            /* More data available: keep what came with it, minus the SW */
+            total += len - 2;
+            BYTE get_response[] = { get_response_cla(command[0]), INS_GET_RESPONSE, 0x00, 0x00, sw2 };
+            command.assign(get_response, get_response + sizeof(get_response));
+            corrected = false;
+            continue;
+        }
+
+        *out_len = total + len;
+        return SCARD_S_SUCCESS;
+    }
+
+    return SCARD_F_COMM_ERROR;
+}
+
+DWORD read_binary_command(DWORD offset, DWORD le, BYTE* command) {
+    bool extended = le > 256;
+    DWORD len = 0;
+
+    command[len++] = 0x00;
+    if (offset <= MAX_SHORT_EF_OFFSET) {
+        command[len++] = INS_READ_BINARY;
+        command[len++] = offset >> 8;
+        command[len++] = offset & 0xFF;
+    } else {
+        command[len++] = INS_READ_BINARY_ODD;
+        command[len++] = 0x00;
+        command[len++] = 0x00;
+
+        BYTE offset_len = (offset > 0xFFFF) ? 3 : 2;
+        if (extended) {
+            command[len++] = 0x00;
+            command[len++] = 0x00;
+        }
+
+        command[len++] = 2 + offset_len;
+        command[len++] = 0x54;
+        command[len++] = offset_len;
+        for (int i = offset_len - 1; i >= 0; i--) {
+            command[len++] = (offset >> (8 * i)) & 0xFF;
+        }
+    }
+
+    if (extended) {
+        // A 3 bytes Le without data, 2 bytes after the extended Lc
+        if (command[1] == INS_READ_BINARY) {
+            command[len++] = 0x00;
+        }
+
+        command[len++] = (le >> 8) & 0xFF;
+        command[len++] = le & 0xFF;
+    } else {
+        command[len++] = le & 0xFF;
+    }
+
+    return len;
+}
+
+DWORD read_binary_room(DWORD offset, DWORD le) {
+    if (offset <= MAX_SHORT_EF_OFFSET) {
+        return le;
+    }
+
+    /* The longest data whose header still fits, e.g. 7F bytes (53 7F) in 82 */
+    if (le < 2) {
+        return 0;
+    }
+
+    return (le - 2 < 0x80) ? le - 2 : (le - 3 < 0x100) ? le - 3 : le - 4;
+}
+
+void read_binary_data(DWORD offset, const BYTE* response, DWORD len,
+                      DWORD* data_offset, DWORD* data_len) {
+    *data_offset = 0;
+    *data_len = len;
+
+    if (offset <= MAX_SHORT_EF_OFFSET || len < 2 || response[0] != 0x53) {
+        return;
+    }
+
+    DWORD header = 2;
+    DWORD size = response[1];
+    if (size == 0x81 && len >= 3) {
+        header = 3;
+        size = response[2];
+    } else if (size == 0x82 && len >= 4) {
+        header = 4;
+        size = (response[2] << 8) | response[3];
+    }
+
+    *data_offset = header;
+    *data_len = (size < len - header) ? size : len - header;
+}
@@ -0,0 +1,60 @@
+#ifndef APDU_H
+#define APDU_H
+
+#ifdef __APPLE__
+#include <PCSC/winscard.h>
+#include <PCSC/wintypes.h>
+#else
+#include <winscard.h>
+#endif
+
+// Bounds the exchanges of a single chained transmission
+#define MAX_CHAINED_EXCHANGES 1024
+
+// Offsets above this need READ BINARY with the odd instruction (B1)
+#define MAX_SHORT_EF_OFFSET 0x7FFF
+// Largest offset read_binary_command() encodes, in 3 bytes
+#define MAX_EF_OFFSET 0xFFFFFF
+// Longest command built by read_binary_command()
+#define MAX_READ_BINARY_COMMAND 15
+
+/*
+ * SCardTransmit() plus the ISO 7816-4 transport rules the caller would
+ * otherwise handle one round-trip at a time:
+ *
+ *  - an extended length command whose data is over 255 bytes is sent as a
+ *    chain of short commands (CLA bit 0x10 set on all but the last one),
+ *  - on 6Cxx the (last) command is sent again with Le = xx,
+ *  - on 61xx the rest of the response is fetched with GET RESPONSE and
+ *    appended to the data already received.
+ *
+ * The reassembled response, ending with the last status word, is written to
+ * out_data and its length to out_len (capacity on input).
+ */
+LONG transmit_chained(SCARDHANDLE card, const SCARD_IO_REQUEST* send_pci,
+                      const BYTE* in_data, DWORD in_len,
+                      BYTE* out_data, DWORD* out_len);
+
+/*
+ * Builds a READ BINARY of le bytes (1 to 65536) at offset (up to
+ * MAX_EF_OFFSET) of the current EF, using the odd instruction with an offset
+ * data object (54) past 0x7FFF.
+ * Returns the length of the command written to command.
+ */
+DWORD read_binary_command(DWORD offset, DWORD le, BYTE* command);
+
+/*
+ * Data held by a READ BINARY response of le bytes at offset which doesn't
+ * reach the end of the file: le, less the header of the discretionary data
+ * object (53) of the odd instruction.
+ */
+DWORD read_binary_room(DWORD offset, DWORD le);
+
+/*
+ * Locates the data of a READ BINARY response (status word excluded),
+ * unwrapping the discretionary data object (53) of the odd instruction.
+ */
+void read_binary_data(DWORD offset, const BYTE* response, DWORD len,
+                      DWORD* data_offset, DWORD* data_len);
+
+#endif /* APDU_H */
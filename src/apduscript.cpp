@@ -0,0 +1,233 @@
+#include "apduscript.h"
+
+namespace {
+
+    // Length of the instruction at code, its operands included, or 0 if it is cut short or unknown
+    size_t instruction_length(const uint8_t* code, size_t len) {
+        size_t length;
+        switch (code[0]) {
+            case SCRIPT_END:
+            case SCRIPT_SEND:
+                return 1;
+            case SCRIPT_VAR:
+            case SCRIPT_VAR_LEN:
+                length = 2;
+                break;
+            case SCRIPT_ADD:
+            case SCRIPT_JUMP:
+                length = 3;
+                break;
+            case SCRIPT_LIT:
+                length = len < 3 ? 3 : 3 + ((code[1] << 8) | code[2]);
+                break;
+            case SCRIPT_SET:
+                length = len < 4 ? 4 : 4 + ((code[2] << 8) | code[3]);
+                break;
+            case SCRIPT_CAPTURE:
+                length = 6;
+                break;
+            case SCRIPT_IF_SW:
+            case SCRIPT_UNLESS_SW:
+                length = 7;
+                break;
+            default:
+                return 0;
+        }
+
+        return length <= len ? length : 0;
+    }
+
+    // Whether the instruction takes a variable, as its first operand
+    bool has_var(uint8_t opcode) {
+        return opcode == SCRIPT_VAR || opcode == SCRIPT_VAR_LEN || opcode == SCRIPT_SET ||
+               opcode == SCRIPT_CAPTURE || opcode == SCRIPT_ADD;
+    }
+
+    uint16_t operand16(const uint8_t* code) {
+        return (code[0] << 8) | code[1];
+    }
+}
+
+const char* ApduScript::Validate(const uint8_t* code, size_t len, size_t vars) {
+    if (vars > MAX_SCRIPT_VARS) {
+        return "Too many variables";
+    }
+
+    if (len > 0xFFFF) {
+        return "Script too long";
+    }
+
+    std::vector<bool> starts(len + 1, false);
+    std::vector<uint16_t> targets;
+    for (size_t pc = 0; pc < len;) {
+        starts[pc] = true;
+        size_t length = instruction_length(code + pc, len - pc);
+        if (!length) {
+            return "Invalid instruction";
+        }
+
+        const uint8_t* op = code + pc;
+        if (has_var(op[0]) && op[1] >= vars) {
+            return "Undefined variable";
+        }
+
+        if (op[0] == SCRIPT_CAPTURE && operand16(op + 4) != SCRIPT_TO_END && operand16(op + 4) < operand16(op + 2)) {
+            return "Capture ends before its start";
+        } else if (op[0] == SCRIPT_JUMP) {
+            targets.push_back(operand16(op + 1));
+        } else if (op[0] == SCRIPT_IF_SW || op[0] == SCRIPT_UNLESS_SW) {
+            targets.push_back(operand16(op + 5));
+        }
+
+        pc += length;
+    }
+
+    /* Onto an instruction, or the end of the script */
+    starts[len] = true;
+    for (size_t i = 0; i < targets.size(); i++) {
+        if (targets[i] > len || !starts[targets[i]]) {
+            return "Jump out of the instructions";
+        }
+    }
+
+    return NULL;
+}
+
+ApduScript::ApduScript(const uint8_t* code, size_t len, size_t vars, uint32_t max_steps)
+    : m_code(code, code + len),
+      m_max_steps(max_steps),
+      m_vars(vars),
+      m_fault(NULL),
+      m_pc(0),
+      m_steps(0) {
+
+    m_offsets.push_back(0);
+    m_command_offsets.push_back(0);
+}
+
+void ApduScript::fault(const char* reason) {
+    m_fault = reason;
+}
+
+LONG ApduScript::Run(const Transmit& transmit, DWORD out_len) {
+    const uint8_t* code = m_code.data();
+    std::vector<BYTE> command;
+    std::vector<BYTE> out(out_len);
+    /* Data and status word of the last response */
+    size_t response = 0;
+    size_t response_len = 0;
+    uint16_t sw = 0;
+
+    for (m_pc = 0; m_pc < m_code.size();) {
+        if (m_steps == m_max_steps) {
+            fault("Step budget exhausted");
+            return SCARD_S_SUCCESS;
+        }
+
+        m_steps++;
+        const uint8_t* op = code + m_pc;
+        size_t next = m_pc + instruction_length(op, m_code.size() - m_pc);
+        std::vector<BYTE>* var = has_var(op[0]) ? &m_vars[op[1]] : NULL;
+
+        switch (op[0]) {
+            case SCRIPT_END:
+                return SCARD_S_SUCCESS;
+
+            /* The command never grows past MAX_SCRIPT_COMMAND, even when it isn't sent */
+            case SCRIPT_LIT:
+                if (command.size() + operand16(op + 1) > MAX_SCRIPT_COMMAND) {
+                    fault("Invalid command length");
+                    return SCARD_S_SUCCESS;
+                }
+                command.insert(command.end(), op + 3, op + 3 + operand16(op + 1));
+                break;
+
+            case SCRIPT_VAR:
+                if (command.size() + var->size() > MAX_SCRIPT_COMMAND) {
+                    fault("Invalid command length");
+                    return SCARD_S_SUCCESS;
+                }
+                command.insert(command.end(), var->begin(), var->end());
+                break;
+
+            case SCRIPT_VAR_LEN:
+                if (var->size() > 0xFF) {
+                    fault("Variable too long for a length byte");
+                    return SCARD_S_SUCCESS;
+                }
+                if (command.size() + 1 > MAX_SCRIPT_COMMAND) {
+                    fault("Invalid command length");
+                    return SCARD_S_SUCCESS;
+                }
+                command.push_back((BYTE)var->size());
+                break;
+
+            case SCRIPT_SEND: {
+                if (command.size() < 4 || command.size() > MAX_SCRIPT_COMMAND) {
+                    fault("Invalid command length");
+                    return SCARD_S_SUCCESS;
+                }
+
+                m_commands.insert(m_commands.end(), command.begin(), command.end());
+                m_command_offsets.push_back(m_commands.size());
+
+                DWORD len = out_len;
+                LONG result = transmit(command.data(), command.size(), out.data(), &len);
+                if (result != SCARD_S_SUCCESS) {
+                    return result;
+                }
+
+                response = m_data.size();
+                response_len = len >= 2 ? len - 2 : 0;
+                sw = len >= 2 ? (out[len - 2] << 8) | out[len - 1] : 0;
+                m_data.insert(m_data.end(), out.begin(), out.begin() + len);
+                m_offsets.push_back(m_data.size());
+                command.clear();
+                break;
+            }
+
+            case SCRIPT_SET:
+                var->assign(op + 4, op + 4 + operand16(op + 2));
+                break;
+
+            case SCRIPT_CAPTURE: {
+                size_t start = operand16(op + 2);
+                size_t end = operand16(op + 4) == SCRIPT_TO_END ? response_len : operand16(op + 4);
+                if (start > end || end > response_len) {
+                    fault("Capture out of the response");
+                    return SCARD_S_SUCCESS;
+                }
+
+                const BYTE* data = m_data.data() + response;
+                var->assign(data + start, data + end);
+                break;
+            }
+
+            case SCRIPT_ADD: {
+                /* Big endian, wrapping around */
+                unsigned int carry = op[2];
+                for (size_t i = var->size(); i-- > 0 && carry;) {
+                    carry += (*var)[i];
+                    (*var)[i] = (BYTE)carry;
+                    carry >>= 8;
+                }
+                break;
+            }
+
+            case SCRIPT_JUMP:
+                next = operand16(op + 1);
+                break;
+
+            case SCRIPT_IF_SW:
+            case SCRIPT_UNLESS_SW:
+                if (((sw & operand16(op + 3)) == operand16(op + 1)) == (op[0] == SCRIPT_IF_SW)) {
+                    next = operand16(op + 5);
+                }
+                break;
+        }
+
+        m_pc = next;
+    }
+
+    return SCARD_S_SUCCESS;
+}
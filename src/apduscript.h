@@ -0,0 +1,94 @@
+#ifndef APDUSCRIPT_H
+#define APDUSCRIPT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#ifdef __APPLE__
+#include <PCSC/winscard.h>
+#include <PCSC/wintypes.h>
+#else
+#include <winscard.h>
+#endif
+
+// Opcodes, operands big endian (see lib/apduscript.js)
+#define SCRIPT_END 0x00             // stops the script
+#define SCRIPT_LIT 0x01             // LIT len16 bytes: appends bytes to the command
+#define SCRIPT_VAR 0x02             // VAR var: appends a variable to the command
+#define SCRIPT_VAR_LEN 0x03         // VAR_LEN var: appends the length of a variable, one byte
+#define SCRIPT_SEND 0x04            // transmits the command, and starts a new one
+#define SCRIPT_SET 0x05             // SET var len16 bytes
+#define SCRIPT_CAPTURE 0x06         // CAPTURE var start16 end16: the last response data in [start, end)
+#define SCRIPT_ADD 0x07             // ADD var value8: to the variable, as a big endian number
+#define SCRIPT_JUMP 0x08            // JUMP target16
+#define SCRIPT_IF_SW 0x09           // IF_SW sw16 mask16 target16: jumps when SW & mask == sw
+#define SCRIPT_UNLESS_SW 0x0A       // UNLESS_SW sw16 mask16 target16: jumps otherwise
+
+// End of a CAPTURE up to the end of the response data
+#define SCRIPT_TO_END 0xFFFF
+// Most variables a script may use
+#define MAX_SCRIPT_VARS 256
+// Longest command, an extended one with 65535 bytes of data and Le
+#define MAX_SCRIPT_COMMAND (4 + 3 + 65535 + 2)
+
+/*
+ * Interpreter of APDU scripts: commands assembled from literal bytes and
+ * variables, variables captured from the responses, and jumps on their status
+ * words, so that a whole exchange with branches and loops (e.g. reading the
+ * records of a file until 6A83) runs on the I/O thread in one go.
+ *
+ * The code is checked once by Validate(), Run() trusts it: every operand is
+ * in bounds and every jump lands on an instruction. Each instruction run is a
+ * step, a script stops with a fault past its budget of steps.
+ */
+class ApduScript {
+
+    public:
+
+        // Transmits a command, the response written to out of *out_len bytes (capacity on input)
+        typedef std::function<LONG(const BYTE* in, DWORD in_len, BYTE* out, DWORD* out_len)> Transmit;
+
+        // NULL when the code of a script with vars variables is well-formed, what is wrong otherwise.
+        static const char* Validate(const uint8_t* code, size_t len, size_t vars);
+
+        ApduScript(const uint8_t* code, size_t len, size_t vars, uint32_t max_steps);
+
+        // Runs the script, responses of up to out_len bytes. Returns the first transmission
+        // error, with the responses so far; Fault() tells whether it stopped on a fault.
+        LONG Run(const Transmit& transmit, DWORD out_len);
+
+        // Why the script stopped before its end, NULL if it didn't.
+        const char* Fault() const { return m_fault; };
+        // Offset of the instruction it stopped at.
+        size_t Pc() const { return m_pc; };
+        uint32_t Steps() const { return m_steps; };
+
+        // All the responses, back to back, and their offsets followed by the total length.
+        std::vector<BYTE>& Data() { return m_data; };
+        const std::vector<uint32_t>& Offsets() const { return m_offsets; };
+        // The commands sent, the same way.
+        const std::vector<BYTE>& Commands() const { return m_commands; };
+        const std::vector<uint32_t>& CommandOffsets() const { return m_command_offsets; };
+
+        const std::vector<std::vector<BYTE> >& Vars() const { return m_vars; };
+
+    private:
+
+        void fault(const char* reason);
+
+    private:
+
+        std::vector<uint8_t> m_code;
+        uint32_t m_max_steps;
+        std::vector<std::vector<BYTE> > m_vars;
+        std::vector<BYTE> m_data;
+        std::vector<uint32_t> m_offsets;
+        std::vector<BYTE> m_commands;
+        std::vector<uint32_t> m_command_offsets;
+        const char* m_fault;
+        size_t m_pc;
+        uint32_t m_steps;
+};
+
+#endif /* APDUSCRIPT_H */
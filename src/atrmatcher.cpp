@@ -0,0 +1,60 @@
+#include "atrmatcher.h"
+
+namespace {
+
+    std::string masked(const BYTE* atr, const std::vector<BYTE>& mask) {
+        std::string key(mask.size(), '\0');
+        for (size_t i = 0; i < mask.size(); i++) {
+            key[i] = (char)(atr[i] & mask[i]);
+        }
+
+        return key;
+    }
+}
+
+void AtrMatcher::Set(const std::vector<std::vector<BYTE> >& atrs, const std::vector<std::vector<BYTE> >& masks) {
+    m_groups.clear();
+    m_size = atrs.size();
+
+    for (size_t i = 0; i < atrs.size(); i++) {
+        const std::vector<BYTE>& atr = atrs[i];
+        std::vector<BYTE> mask = (i < masks.size() && !masks[i].empty()) ? masks[i]
+                                                                          : std::vector<BYTE>(atr.size(), 0xFF);
+        mask.resize(atr.size(), 0xFF);
+
+        std::vector<Group>& groups = m_groups[atr.size()];
+        Group* group = NULL;
+        for (size_t g = 0; g < groups.size(); g++) {
+            if (groups[g].mask == mask) {
+                group = &groups[g];
+                break;
+            }
+        }
+
+        if (!group) {
+            groups.push_back(Group());
+            group = &groups.back();
+            group->mask = mask;
+        }
+
+        /* The first pattern wins over the later ones */
+        group->patterns.emplace(masked(atr.data(), mask), (int)i);
+    }
+}
+
+int AtrMatcher::Match(const BYTE* atr, size_t len) const {
+    std::map<size_t, std::vector<Group> >::const_iterator it = m_groups.find(len);
+    if (it == m_groups.end()) {
+        return NO_MATCH;
+    }
+
+    int match = NO_MATCH;
+    for (const Group& group : it->second) {
+        std::unordered_map<std::string, int>::const_iterator found = group.patterns.find(masked(atr, group.mask));
+        if (found != group.patterns.end() && (match == NO_MATCH || found->second < match)) {
+            match = found->second;
+        }
+    }
+
+    return match;
+}
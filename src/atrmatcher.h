@@ -0,0 +1,54 @@
+#ifndef ATRMATCHER_H
+#define ATRMATCHER_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#ifdef __APPLE__
+#include <PCSC/winscard.h>
+#include <PCSC/wintypes.h>
+#else
+#include <winscard.h>
+#endif
+
+/*
+ * Table of ATR patterns, each an ATR and a mask of the bits to compare, an
+ * ATR matching the patterns of its length only.
+ *
+ * The patterns sharing a length and a mask are compiled into a hash table of
+ * their masked ATR, so a match costs one masked copy and one lookup per
+ * distinct mask of that length, however many patterns there are. Tables like
+ * smartcard_list.txt have thousands of patterns but few distinct masks.
+ */
+class AtrMatcher {
+
+    public:
+
+        static const int NO_MATCH = -1;
+
+        // Replaces the table, the mask of a pattern being all ones when empty.
+        void Set(const std::vector<std::vector<BYTE> >& atrs, const std::vector<std::vector<BYTE> >& masks);
+
+        // Index of the first pattern matching the ATR, NO_MATCH if none.
+        int Match(const BYTE* atr, size_t len) const;
+
+        size_t Size() const { return m_size; };
+
+    private:
+
+        struct Group {
+            std::vector<BYTE> mask;
+            // Masked ATR -> index of the first pattern
+            std::unordered_map<std::string, int> patterns;
+        };
+
+    private:
+
+        // By ATR length
+        std::map<size_t, std::vector<Group> > m_groups;
+        size_t m_size = 0;
+};
+
+#endif /* ATRMATCHER_H */
@@ -1,5 +1,9 @@
 #include "cardreader.h"
+#include "addon.h"
 #include "common.h"
+#include "apdu.h"
+#include "tlv.h"
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 
@@ -7,10 +11,32 @@ Napi::Object CardReader::Init(Napi::Env env, Napi::Object exports) {
     Napi::Function func = DefineClass(env, "CardReader", {
         InstanceMethod("get_status", &CardReader::GetStatus),
         InstanceMethod("_connect", &CardReader::Connect),
+        InstanceMethod("_reconnect", &CardReader::Reconnect),
         InstanceMethod("_disconnect", &CardReader::Disconnect),
         InstanceMethod("_transmit", &CardReader::Transmit),
+        InstanceMethod("_transmit_batch", &CardReader::TransmitBatch),
+        InstanceMethod("_run_script", &CardReader::RunScript),
         InstanceMethod("_control", &CardReader::Control),
-        InstanceMethod("close", &CardReader::Close),
+        InstanceMethod("_begin_transaction", &CardReader::BeginTransaction),
+        InstanceMethod("_end_transaction", &CardReader::EndTransaction),
+        InstanceMethod("_read_binary", &CardReader::ReadBinary),
+        InstanceMethod("_read_binary_resume", &CardReader::ReadBinaryResume),
+        InstanceMethod("_read_binary_destroy", &CardReader::ReadBinaryDestroy),
+        InstanceMethod("_connect_async", &CardReader::ConnectAsync),
+        InstanceMethod("_transmit_async", &CardReader::TransmitAsync),
+        InstanceMethod("_control_async", &CardReader::ControlAsync),
+        InstanceMethod("_cancel", &CardReader::Cancel),
+        InstanceMethod("_close", &CardReader::Close),
+        InstanceMethod("getStats", &CardReader::GetStats),
+        InstanceMethod("resetStats", &CardReader::ResetStats),
+        InstanceMethod("_clear_cache", &CardReader::ClearCache),
+        InstanceMethod("_start_recording", &CardReader::StartRecording),
+        InstanceMethod("_stop_recording", &CardReader::StopRecording),
+        InstanceMethod("_replay", &CardReader::Replay),
+        StaticMethod("_replay_reader", &CardReader::ReplayReader),
+        StaticMethod("_transmit_many", &CardReader::TransmitMany),
+        InstanceMethod("_secure_channel", &CardReader::SetSecureChannel),
+        StaticMethod("_index_tlv", &CardReader::IndexTlv),
         // Share Mode
         InstanceValue("SCARD_SHARE_SHARED", Napi::Number::New(env, SCARD_SHARE_SHARED)),
         InstanceValue("SCARD_SHARE_EXCLUSIVE", Napi::Number::New(env, SCARD_SHARE_EXCLUSIVE)),
@@ -37,11 +63,15 @@ Napi::Object CardReader::Init(Napi::Env env, Napi::Object exports) {
         InstanceValue("SCARD_LEAVE_CARD", Napi::Number::New(env, SCARD_LEAVE_CARD)),
         InstanceValue("SCARD_RESET_CARD", Napi::Number::New(env, SCARD_RESET_CARD)),
         InstanceValue("SCARD_UNPOWER_CARD", Napi::Number::New(env, SCARD_UNPOWER_CARD)),
-        InstanceValue("SCARD_EJECT_CARD", Napi::Number::New(env, SCARD_EJECT_CARD))
+        InstanceValue("SCARD_EJECT_CARD", Napi::Number::New(env, SCARD_EJECT_CARD)),
+        // SCP03 security level
+        InstanceValue("SCP03_C_MAC", Napi::Number::New(env, SecureChannel::C_MAC)),
+        InstanceValue("SCP03_C_DECRYPTION", Napi::Number::New(env, SecureChannel::C_DECRYPTION)),
+        InstanceValue("SCP03_R_MAC", Napi::Number::New(env, SecureChannel::R_MAC)),
+        InstanceValue("SCP03_R_ENCRYPTION", Napi::Number::New(env, SecureChannel::R_ENCRYPTION))
     });
 
-    Napi::FunctionReference* constructor = new Napi::FunctionReference();
-    *constructor = Napi::Persistent(func);
+    AddonData::Get(env)->cardreader_constructor = Napi::Persistent(func);
     exports.Set("CardReader", func);
     return exports;
 }
@@ -50,20 +80,45 @@ CardReader::CardReader(const Napi::CallbackInfo& info)
     : Napi::ObjectWrap<CardReader>(info),
       m_card_context(0),
       m_card_handle(0),
+      m_share_mode(SCARD_SHARE_EXCLUSIVE),
+      m_pref_protocol(SCARD_PROTOCOL_T0 | SCARD_PROTOCOL_T1),
       m_name(""),
-      m_state(0) {
+      m_pcsclite(NULL),
+      m_lane(0),
+      m_hung(NULL),
+      m_cleanup_hook(false),
+      m_recorder(NULL),
+      m_replay(NULL),
+      m_replay_timer(NULL),
+      m_replay_status(0),
+      m_replay_start(0),
+      m_replay_seq(0) {
 
     Napi::Env env = info.Env();
 
+    assert(uv_mutex_init(&m_mutex) == 0);
+
     if (info.Length() < 1 || !info[0].IsString()) {
         Napi::TypeError::New(env, "Reader name required").ThrowAsJavaScriptException();
         return;
     }
 
+    /* Of this environment: a PCSCLite instance of another thread can't be used */
+    Napi::FunctionReference& pcsclite_constructor = AddonData::Get(env)->pcsclite_constructor;
+    if (info.Length() < 2 || !info[1].IsObject() ||
+        !info[1].As<Napi::Object>().InstanceOf(pcsclite_constructor.Value())) {
+        Napi::TypeError::New(env, "PCSCLite instance required").ThrowAsJavaScriptException();
+        return;
+    }
+
     m_name = info[0].As<Napi::String>().Utf8Value();
+    m_buffers = AddonData::Get(env)->buffers;
+    m_pcsclite = PCSCLite::Unwrap(info[1].As<Napi::Object>());
+    m_pcsclite->Attach(this);
 
-    assert(uv_mutex_init(&m_mutex) == 0);
-    assert(uv_cond_init(&m_cond) == 0);
+    // Our timers must be closed before the loop of the environment is
+    napi_add_env_cleanup_hook(env, EnvCleanup, this);
+    m_cleanup_hook = true;
 
     Napi::Object obj = this->Value();
     obj.Set("name", info[0]);
@@ -71,16 +126,52 @@ CardReader::CardReader(const Napi::CallbackInfo& info)
 }
 
 CardReader::~CardReader() {
-    if (m_status_thread) {
-        SCardCancel(m_card_context);
-        assert(uv_thread_join(&m_status_thread) == 0);
+    /* Unless the environment is being torn down, and its loop with it */
+    bool env_alive = m_cleanup_hook;
+    if (m_cleanup_hook) {
+        napi_remove_env_cleanup_hook(Env(), EnvCleanup, this);
     }
 
-    if (m_card_context) {
-        SCardReleaseContext(m_card_context);
+    if (m_pcsclite) {
+        m_pcsclite->Detach(this);
+    }
+
+    // No chunk can be in flight anymore, each one keeps us alive
+    for (std::map<uint32_t, ReadBinaryStream*>::iterator it = m_streams.begin(); it != m_streams.end(); ++it) {
+        delete it->second;
+    }
+
+    if (m_recorder) {
+        m_recorder->Close(Env(), Napi::Function());
+    }
+
+    /* No handle behind a replay */
+    SCARDHANDLE card_handle = m_replay ? 0 : m_card_handle;
+    stop_replay_status();
+    delete m_replay;
+
+    /*
+     * The context is shared, so the handle must not outlive us. Both calls may
+     * block in pcscd, so they go to our lane's thread, whose context it is,
+     * rather than run in the finalizer.
+     */
+    if (m_executor && env_alive && (card_handle || m_card_context)) {
+        ReleaseJob* job = new ReleaseJob();
+        job->request.data = job;
+        job->card_handle = card_handle;
+        job->card_context = m_card_context;
+        job->executor = m_executor;
+        m_executor->Queue(m_lane, &job->request, DoRelease, AfterRelease);
+    } else {
+        if (card_handle) {
+            SCardDisconnect(card_handle, SCARD_LEAVE_CARD);
+        }
+
+        if (m_card_context) {
+            ContextRegistry::Release(m_card_context);
+        }
     }
 
-    uv_cond_destroy(&m_cond);
     uv_mutex_destroy(&m_mutex);
 }
 
@@ -92,18 +183,16 @@ Napi::Value CardReader::GetStatus(const Napi::CallbackInfo& info) {
         return env.Undefined();
     }
 
-    Napi::Function cb = info[0].As<Napi::Function>();
+    if (!m_pcsclite) {
+        Napi::Error::New(env, "PCSCLite instance is gone").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
 
-    AsyncBaton *async_baton = new AsyncBaton();
-    async_baton->async.data = async_baton;
-    async_baton->callback.Reset();
-    async_baton->callback = Napi::Persistent(cb);
-    async_baton->reader = this;
-    async_baton->env = env;
+    Napi::Function cb = info[0].As<Napi::Function>();
 
-    uv_async_init(uv_default_loop(), &async_baton->async, (uv_async_cb)HandleReaderStatusChange);
-    int ret = uv_thread_create(&m_status_thread, HandlerFunction, async_baton);
-    assert(ret == 0);
+    /* The status is reported by the monitor thread of the PCSCLite instance */
+    m_status_callback = Napi::Persistent(cb);
+    m_pcsclite->Watch(this);
 
     return env.Undefined();
 }
@@ -126,24 +215,68 @@ Napi::Value CardReader::Connect(const Napi::CallbackInfo& info) {
         return env.Undefined();
     }
 
-    ConnectInput* ci = new ConnectInput();
+    ConnectInput* ci = m_connect_inputs.New();
     ci->share_mode = info[0].As<Napi::Number>().Uint32Value();
     ci->pref_protocol = info[1].As<Napi::Number>().Uint32Value();
     Napi::Function cb = info[2].As<Napi::Function>();
 
-    Baton* baton = new Baton();
+    Baton* baton = m_batons.New();
     baton->request.data = baton;
     baton->callback.Reset();
     baton->callback = Napi::Persistent(cb);
     baton->reader = this;
     baton->input = ci;
+    baton->result = m_connect_results.New();
+    baton->env = env;
+    baton->method = "SCardConnect";
+
+    queue_work(baton, DoConnect, reinterpret_cast<uv_after_work_cb>(AfterConnect));
+
+    return env.Undefined();
+}
+
+Napi::Value CardReader::Reconnect(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (!info[0].IsNumber() && !info[0].IsUndefined()) {
+        Napi::TypeError::New(env, "First argument must be an integer").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    if (!info[1].IsNumber() && !info[1].IsUndefined()) {
+        Napi::TypeError::New(env, "Second argument must be an integer").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    if (!info[2].IsNumber()) {
+        Napi::TypeError::New(env, "Third argument must be an integer").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    if (!info[3].IsFunction()) {
+        Napi::TypeError::New(env, "Fourth argument must be a callback function").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    /* Undefined share mode or protocol: the ones of the last connection */
+    ReconnectInput* ri = new ReconnectInput();
+    ri->same_share_mode = info[0].IsUndefined();
+    ri->share_mode = ri->same_share_mode ? 0 : info[0].As<Napi::Number>().Uint32Value();
+    ri->same_protocol = info[1].IsUndefined();
+    ri->pref_protocol = ri->same_protocol ? 0 : info[1].As<Napi::Number>().Uint32Value();
+    ri->initialization = info[2].As<Napi::Number>().Uint32Value();
+    Napi::Function cb = info[3].As<Napi::Function>();
+
+    Baton* baton = m_batons.New();
+    baton->request.data = baton;
+    baton->callback.Reset();
+    baton->callback = Napi::Persistent(cb);
+    baton->reader = this;
+    baton->input = ri;
     baton->env = env;
+    baton->method = "SCardReconnect";
 
-    int status = uv_queue_work(uv_default_loop(),
-                               &baton->request,
-                               DoConnect,
-                               reinterpret_cast<uv_after_work_cb>(AfterConnect));
-    assert(status == 0);
+    queue_work(baton, DoReconnect, reinterpret_cast<uv_after_work_cb>(AfterReconnect));
 
     return env.Undefined();
 }
@@ -164,19 +297,19 @@ Napi::Value CardReader::Disconnect(const Napi::CallbackInfo& info) {
     DWORD disposition = info[0].As<Napi::Number>().Uint32Value();
     Napi::Function cb = info[1].As<Napi::Function>();
 
-    Baton* baton = new Baton();
-    baton->input = reinterpret_cast<void*>(new DWORD(disposition));
+    DisconnectInput* di = m_disconnect_inputs.New();
+    di->disposition = disposition;
+
+    Baton* baton = m_batons.New();
+    baton->input = di;
     baton->request.data = baton;
     baton->callback.Reset();
     baton->callback = Napi::Persistent(cb);
     baton->reader = this;
     baton->env = env;
+    baton->method = "SCardDisconnect";
 
-    int status = uv_queue_work(uv_default_loop(),
-                               &baton->request,
-                               DoDisconnect,
-                               reinterpret_cast<uv_after_work_cb>(AfterDisconnect));
-    assert(status == 0);
+    queue_work(baton, DoDisconnect, reinterpret_cast<uv_after_work_cb>(AfterDisconnect));
 
     return env.Undefined();
 }
@@ -189,8 +322,8 @@ Napi::Value CardReader::Transmit(const Napi::CallbackInfo& info) {
         return env.Undefined();
     }
 
-    if (!info[1].IsNumber()) {
-        Napi::TypeError::New(env, "Second argument must be an integer").ThrowAsJavaScriptException();
+    if (!info[1].IsNumber() && !info[1].IsBuffer()) {
+        Napi::TypeError::New(env, "Second argument must be an integer or a Buffer").ThrowAsJavaScriptException();
         return env.Undefined();
     }
 
@@ -199,45 +332,83 @@ Napi::Value CardReader::Transmit(const Napi::CallbackInfo& info) {
         return env.Undefined();
     }
 
-    if (!info[3].IsFunction()) {
-        Napi::TypeError::New(env, "Fourth argument must be a callback function").ThrowAsJavaScriptException();
+    if (!info[3].IsBoolean()) {
+        Napi::TypeError::New(env, "Fourth argument must be a boolean").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    if (!info[4].IsBoolean()) {
+        Napi::TypeError::New(env, "Fifth argument must be a boolean").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    if (!info[5].IsBoolean()) {
+        Napi::TypeError::New(env, "Sixth argument must be a boolean").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    if (!info[6].IsFunction()) {
+        Napi::TypeError::New(env, "Seventh argument must be a callback function").ThrowAsJavaScriptException();
         return env.Undefined();
     }
 
     Napi::Buffer<uint8_t> buffer_data = info[0].As<Napi::Buffer<uint8_t>>();
-    uint32_t out_len = info[1].As<Napi::Number>().Uint32Value();
     uint32_t protocol = info[2].As<Napi::Number>().Uint32Value();
-    Napi::Function cb = info[3].As<Napi::Function>();
+    bool cache = info[4].As<Napi::Boolean>().Value();
+    Napi::Function cb = info[6].As<Napi::Function>();
+
+    /* A cached response is returned right away, the callback is not called */
+    if (cache) {
+        Napi::Value cached = cached_response(env, protocol, buffer_data, info[1]);
+        if (!cached.IsEmpty()) {
+            return cached;
+        }
+    }
 
-    Baton* baton = new Baton();
+    Baton* baton = m_batons.New();
     baton->request.data = baton;
     baton->callback.Reset();
     baton->callback = Napi::Persistent(cb);
     baton->reader = this;
     baton->env = env;
 
-    TransmitInput *ti = new TransmitInput();
+    /*
+     * The command is read straight from the JS Buffer, which is pinned until
+     * the transmission is done. So is the response Buffer, when given.
+     */
+    TransmitInput *ti = m_transmit_inputs.New();
     ti->card_protocol = protocol;
-    ti->in_data = new unsigned char[buffer_data.Length()];
+    ti->chaining = info[3].As<Napi::Boolean>().Value();
+    ti->cache = cache;
+    ti->cache_generation = m_cache.Generation();
+    ti->tlv = info[5].As<Napi::Boolean>().Value();
+    ti->in_data = buffer_data.Data();
     ti->in_len = buffer_data.Length();
-    memcpy(ti->in_data, buffer_data.Data(), ti->in_len);
-    ti->out_len = out_len;
+    ti->in_ref = Napi::Persistent(buffer_data.As<Napi::Object>());
+    if (info[1].IsBuffer()) {
+        Napi::Buffer<uint8_t> out_buf = info[1].As<Napi::Buffer<uint8_t>>();
+        ti->out_data = out_buf.Data();
+        ti->out_len = out_buf.Length();
+        ti->out_ref = Napi::Persistent(out_buf.As<Napi::Object>());
+    } else {
+        ti->out_data = NULL;
+        ti->out_len = info[1].As<Napi::Number>().Uint32Value();
+    }
+
     baton->input = ti;
+    baton->result = transmit_result(ti);
+    baton->method = "SCardTransmit";
 
-    int status = uv_queue_work(uv_default_loop(),
-                               &baton->request,
-                               DoTransmit,
-                               reinterpret_cast<uv_after_work_cb>(AfterTransmit));
-    assert(status == 0);
+    queue_work(baton, DoTransmit, reinterpret_cast<uv_after_work_cb>(AfterTransmit));
 
     return env.Undefined();
 }
 
-Napi::Value CardReader::Control(const Napi::CallbackInfo& info) {
+Napi::Value CardReader::TransmitBatch(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
 
-    if (!info[0].IsBuffer()) {
-        Napi::TypeError::New(env, "First argument must be a Buffer").ThrowAsJavaScriptException();
+    if (!info[0].IsArray()) {
+        Napi::TypeError::New(env, "First argument must be an Array of Buffers").ThrowAsJavaScriptException();
         return env.Undefined();
     }
 
@@ -246,307 +417,2059 @@ Napi::Value CardReader::Control(const Napi::CallbackInfo& info) {
         return env.Undefined();
     }
 
-    if (!info[2].IsBuffer()) {
-        Napi::TypeError::New(env, "Third argument must be a Buffer").ThrowAsJavaScriptException();
+    if (!info[2].IsNumber()) {
+        Napi::TypeError::New(env, "Third argument must be an integer").ThrowAsJavaScriptException();
         return env.Undefined();
     }
 
-    if (!info[3].IsFunction()) {
-        Napi::TypeError::New(env, "Fourth argument must be a callback function").ThrowAsJavaScriptException();
+    if (!info[3].IsArray() && !info[3].IsUndefined() && !info[3].IsNull()) {
+        Napi::TypeError::New(env, "Fourth argument must be an Array of status words").ThrowAsJavaScriptException();
         return env.Undefined();
     }
 
-    Napi::Buffer<uint8_t> in_buf = info[0].As<Napi::Buffer<uint8_t>>();
-    DWORD control_code = info[1].As<Napi::Number>().Uint32Value();
-    Napi::Buffer<uint8_t> out_buf = info[2].As<Napi::Buffer<uint8_t>>();
-    Napi::Function cb = info[3].As<Napi::Function>();
+    if (!info[4].IsBoolean()) {
+        Napi::TypeError::New(env, "Fifth argument must be a boolean").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    if (!info[5].IsFunction()) {
+        Napi::TypeError::New(env, "Sixth argument must be a callback function").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    TransmitBatchInput *ti = batch_input(env, info[0].As<Napi::Array>(), info[1].As<Napi::Number>().Uint32Value(),
+                                         info[3], info[4].As<Napi::Boolean>().Value(),
+                                         "First argument must be an Array of Buffers");
+    if (!ti) {
+        return env.Undefined();
+    }
+
+    ti->card_protocol = info[2].As<Napi::Number>().Uint32Value();
+    Napi::Function cb = info[5].As<Napi::Function>();
 
-    Baton* baton = new Baton();
+    Baton* baton = m_batons.New();
     baton->request.data = baton;
     baton->callback.Reset();
     baton->callback = Napi::Persistent(cb);
     baton->reader = this;
+    baton->input = ti;
     baton->env = env;
+    baton->method = "SCardTransmit";
 
-    ControlInput *ci = new ControlInput();
-    ci->control_code = control_code;
-    ci->in_data = in_buf.Data();
-    ci->in_len = in_buf.Length();
-    ci->out_data = out_buf.Data();
-    ci->out_len = out_buf.Length();
-    baton->input = ci;
-
-    int status = uv_queue_work(uv_default_loop(),
-                               &baton->request,
-                               DoControl,
-                               reinterpret_cast<uv_after_work_cb>(AfterControl));
-    assert(status == 0);
+    queue_work(baton, DoTransmitBatch, reinterpret_cast<uv_after_work_cb>(AfterTransmitBatch));
 
     return env.Undefined();
 }
 
-Napi::Value CardReader::Close(const Napi::CallbackInfo& info) {
+Napi::Value CardReader::RunScript(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
 
-    LONG result = SCARD_S_SUCCESS;
-    if (m_status_thread) {
-        uv_mutex_lock(&m_mutex);
-        if (m_state == 0) {
-            int ret;
-            int times = 0;
-            m_state = 1;
-            do {
-                result = SCardCancel(m_status_card_context);
-                ret = uv_cond_timedwait(&m_cond, &m_mutex, 10000000);
-            } while ((ret != 0) && (++ times < 5));
-        }
-
-        uv_mutex_unlock(&m_mutex);
-        assert(uv_thread_join(&m_status_thread) == 0);
-        m_status_thread = 0;
-    }
-
-    return Napi::Number::New(env, result);
-}
-
-void CardReader::HandleReaderStatusChange(uv_async_t *handle) {
-    AsyncBaton* async_baton = static_cast<AsyncBaton*>(handle->data);
-    CardReader* reader = async_baton->reader;
-    Napi::Env env(async_baton->env);
-    Napi::HandleScope scope(env);
-
-    if (reader->m_status_thread) {
-        uv_mutex_lock(&reader->m_mutex);
+    if (!info[0].IsBuffer()) {
+        Napi::TypeError::New(env, "First argument must be a Buffer").ThrowAsJavaScriptException();
+        return env.Undefined();
     }
 
-    AsyncResult* ar = async_baton->async_result;
-
-    if (reader->m_state == 1) {
-        // Swallow events : Listening thread was cancelled by user.
-    } else if ((ar->result == SCARD_S_SUCCESS) ||
-               (ar->result == (LONG)SCARD_E_NO_READERS_AVAILABLE) ||
-               (ar->result == (LONG)SCARD_E_UNKNOWN_READER)) {
-        if (ar->status != 0) {
-            std::vector<napi_value> argv = {
-                env.Undefined(),
-                Napi::Number::New(env, ar->status),
-                Napi::Buffer<uint8_t>::Copy(env, ar->atr, ar->atrlen)
-            };
-
-            async_baton->callback.Call(argv);
+    for (size_t i = 1; i < 5; i++) {
+        if (!info[i].IsNumber()) {
+            Napi::TypeError::New(env, "Second to fifth arguments must be integers").ThrowAsJavaScriptException();
+            return env.Undefined();
         }
-    } else {
-        Napi::Value err = Napi::Error::New(env, error_msg("SCardGetStatusChange", ar->result)).Value();
-        std::vector<napi_value> argv = { err };
-        async_baton->callback.Call(argv);
     }
 
-    if (ar->do_exit) {
-        uv_close(reinterpret_cast<uv_handle_t*>(&async_baton->async), CloseCallback);
+    if (!info[5].IsBoolean()) {
+        Napi::TypeError::New(env, "Sixth argument must be a boolean").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
 
-        // Emit end event
-        std::vector<napi_value> argv = { Napi::String::New(env, "_end") };
-        Napi::Object obj = async_baton->reader->Value();
-        Napi::Function emit = obj.Get("emit").As<Napi::Function>();
-        emit.Call(obj, argv);
+    if (!info[6].IsFunction()) {
+        Napi::TypeError::New(env, "Seventh argument must be a callback function").ThrowAsJavaScriptException();
+        return env.Undefined();
     }
 
-    if (reader->m_status_thread) {
-        uv_mutex_unlock(&reader->m_mutex);
+    /* Checked once here, the I/O thread runs it as is */
+    Napi::Buffer<uint8_t> code = info[0].As<Napi::Buffer<uint8_t>>();
+    uint32_t vars = info[1].As<Napi::Number>().Uint32Value();
+    const char* invalid = ApduScript::Validate(code.Data(), code.Length(), vars);
+    if (invalid) {
+        Napi::Error::New(env, std::string("Invalid script: ") + invalid).ThrowAsJavaScriptException();
+        return env.Undefined();
     }
-}
 
-void CardReader::HandlerFunction(void* arg) {
-    AsyncBaton* async_baton = static_cast<AsyncBaton*>(arg);
-    CardReader* reader = async_baton->reader;
-    async_baton->async_result = new AsyncResult();
-    async_baton->async_result->do_exit = false;
+    ScriptInput *si = new ScriptInput();
+    si->out_len = info[2].As<Napi::Number>().Uint32Value();
+    si->card_protocol = info[3].As<Napi::Number>().Uint32Value();
+    si->transaction = info[5].As<Napi::Boolean>().Value();
+    si->record = m_recorder != NULL;
+    si->script.reset(new ApduScript(code.Data(), code.Length(), vars, info[4].As<Napi::Number>().Uint32Value()));
 
-    LONG result = SCardEstablishContext(SCARD_SCOPE_SYSTEM, NULL, NULL, &reader->m_status_card_context);
+    Baton* baton = m_batons.New();
+    baton->request.data = baton;
+    baton->callback = Napi::Persistent(info[6].As<Napi::Function>());
+    baton->reader = this;
+    baton->input = si;
+    baton->env = env;
+    baton->method = "SCardTransmit";
 
-    SCARD_READERSTATE card_reader_state = SCARD_READERSTATE();
-    card_reader_state.szReader = reader->m_name.c_str();
-    card_reader_state.dwCurrentState = SCARD_STATE_UNAWARE;
+    queue_work(baton, DoRunScript, reinterpret_cast<uv_after_work_cb>(AfterRunScript));
 
-    while (!reader->m_state) {
-        result = SCardGetStatusChange(reader->m_status_card_context, INFINITE, &card_reader_state, 1);
+    return env.Undefined();
+}
 
-        uv_mutex_lock(&reader->m_mutex);
-        if (reader->m_state == 1) {
-            uv_cond_signal(&reader->m_cond);
-        } else if (result != (LONG)SCARD_S_SUCCESS) {
-            reader->m_state = 2;
-        }
+Napi::Value CardReader::TransmitMany(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
 
-        async_baton->async_result->do_exit = (reader->m_state != 0);
-        async_baton->async_result->result = result;
-        if (card_reader_state.dwEventState == card_reader_state.dwCurrentState) {
-            async_baton->async_result->status = 0;
-        } else {
-            async_baton->async_result->status = card_reader_state.dwEventState;
-        }
-        memcpy(async_baton->async_result->atr, card_reader_state.rgbAtr, card_reader_state.cbAtr);
-        async_baton->async_result->atrlen = card_reader_state.cbAtr;
+    if (!info[0].IsArray()) {
+        Napi::TypeError::New(env, "First argument must be an Array of CardReaders").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
 
-        uv_mutex_unlock(&reader->m_mutex);
+    if (!info[1].IsArray()) {
+        Napi::TypeError::New(env, "Second argument must be an Array of Buffers").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
 
-        uv_async_send(&async_baton->async);
-        card_reader_state.dwCurrentState = card_reader_state.dwEventState;
+    if (!info[2].IsNumber()) {
+        Napi::TypeError::New(env, "Third argument must be an integer").ThrowAsJavaScriptException();
+        return env.Undefined();
     }
-}
 
-void CardReader::DoConnect(uv_work_t* req) {
-    Baton* baton = static_cast<Baton*>(req->data);
-    ConnectInput *ci = static_cast<ConnectInput*>(baton->input);
+    if (!info[3].IsArray()) {
+        Napi::TypeError::New(env, "Fourth argument must be an Array of protocols").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
 
-    DWORD card_protocol;
-    LONG result = SCARD_S_SUCCESS;
-    CardReader* obj = baton->reader;
+    if (!info[4].IsArray() && !info[4].IsUndefined() && !info[4].IsNull()) {
+        Napi::TypeError::New(env, "Fifth argument must be an Array of status words").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
 
-    uv_mutex_lock(&obj->m_mutex);
-    if (!obj->m_card_context) {
-        result = SCardEstablishContext(SCARD_SCOPE_SYSTEM, NULL, NULL, &obj->m_card_context);
+    if (!info[5].IsBoolean()) {
+        Napi::TypeError::New(env, "Sixth argument must be a boolean").ThrowAsJavaScriptException();
+        return env.Undefined();
     }
 
-    if (result == SCARD_S_SUCCESS) {
-        result = SCardConnect(obj->m_card_context,
-                              obj->m_name.c_str(),
-                              ci->share_mode,
-                              ci->pref_protocol,
-                              &obj->m_card_handle,
-                              &card_protocol);
+    if (!info[6].IsFunction()) {
+        Napi::TypeError::New(env, "Seventh argument must be a callback function").ThrowAsJavaScriptException();
+        return env.Undefined();
     }
 
-    uv_mutex_unlock(&obj->m_mutex);
+    /* Of this environment only, as the readers of a PCSCLite instance */
+    Napi::Array readers = info[0].As<Napi::Array>();
+    Napi::Array protocols = info[3].As<Napi::Array>();
+    Napi::Function constructor = AddonData::Get(env)->cardreader_constructor.Value();
+    std::vector<CardReader*> targets;
+    targets.reserve(readers.Length());
+    for (uint32_t i = 0; i < readers.Length(); i++) {
+        Napi::Value reader = readers.Get(i);
+        if (!reader.IsObject() || !reader.As<Napi::Object>().InstanceOf(constructor) ||
+            !protocols.Get(i).IsNumber()) {
+            Napi::TypeError::New(env, "A CardReader and a protocol are required for each target")
+                .ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
 
-    ConnectResult *cr = new ConnectResult();
-    cr->result = result;
-    if (!result) {
-        cr->card_protocol = card_protocol;
+        targets.push_back(CardReader::Unwrap(reader.As<Napi::Object>()));
     }
 
-    baton->result = cr;
-}
-
-void CardReader::AfterConnect(uv_work_t* req, int status) {
-    Baton* baton = static_cast<Baton*>(req->data);
-    ConnectInput *ci = static_cast<ConnectInput*>(baton->input);
-    ConnectResult *cr = static_cast<ConnectResult*>(baton->result);
-    Napi::Env env(baton->env);
-    Napi::HandleScope scope(env);
+    TransmitBatchInput *script = batch_input(env, info[1].As<Napi::Array>(), info[2].As<Napi::Number>().Uint32Value(),
+                                             info[4], info[5].As<Napi::Boolean>().Value(),
+                                             "Second argument must be an Array of Buffers");
+    if (!script) {
+        return env.Undefined();
+    }
 
-    if (cr->result) {
-        Napi::Value err = Napi::Error::New(env, error_msg("SCardConnect", cr->result)).Value();
-        std::vector<napi_value> argv = { err };
-        baton->callback.Call(argv);
-    } else {
-        baton->reader->Value().Set("connected", Napi::Boolean::New(env, true));
-        std::vector<napi_value> argv = {
-            env.Null(),
-            Napi::Number::New(env, cr->card_protocol)
-        };
+    TransmitManyGroup* group = new TransmitManyGroup();
+    group->pending = targets.size();
+    group->results = Napi::Persistent(Napi::Array::New(env, targets.size()).As<Napi::Object>());
+    group->callback = Napi::Persistent(info[6].As<Napi::Function>());
+
+    /*
+     * Every reader runs the script on its own executor lane, so they all go in
+     * parallel, and the group calls back once the last one is done.
+     */
+    for (uint32_t i = 0; i < targets.size(); i++) {
+        TransmitBatchInput *ti = new TransmitBatchInput(*script);
+        ti->card_protocol = protocols.Get(i).As<Napi::Number>().Uint32Value();
+
+        Baton* baton = targets[i]->m_batons.New();
+        baton->request.data = baton;
+        baton->reader = targets[i];
+        baton->input = ti;
+        baton->env = env;
+        baton->group = group;
+        baton->group_index = i;
+        baton->method = "SCardTransmit";
+
+        targets[i]->queue_work(baton, DoTransmitBatch, reinterpret_cast<uv_after_work_cb>(AfterTransmitBatch));
+    }
 
-        baton->callback.Call(argv);
+    delete script;
+    if (targets.empty()) {
+        group->pending = 1;
+        settle_group(group, env, 0, Napi::Value());
     }
 
-    baton->callback.Reset();
-    delete ci;
-    delete cr;
-    delete baton;
+    return env.Undefined();
 }
 
-void CardReader::DoDisconnect(uv_work_t* req) {
-    Baton* baton = static_cast<Baton*>(req->data);
-    DWORD* disposition = reinterpret_cast<DWORD*>(baton->input);
+CardReader::TransmitBatchInput* CardReader::batch_input(Napi::Env env, Napi::Array apdus, DWORD out_len,
+                                                        Napi::Value expected_sw, bool transaction,
+                                                        const char* type_error) {
+    TransmitBatchInput *ti = new TransmitBatchInput();
+    ti->out_len = out_len;
+    ti->transaction = transaction;
+    ti->in_lens.reserve(apdus.Length());
+    for (uint32_t i = 0; i < apdus.Length(); i++) {
+        Napi::Value apdu = apdus.Get(i);
+        if (!apdu.IsBuffer()) {
+            delete ti;
+            Napi::TypeError::New(env, type_error).ThrowAsJavaScriptException();
+            return NULL;
+        }
 
-    LONG result = SCARD_S_SUCCESS;
-    CardReader* obj = baton->reader;
+        Napi::Buffer<uint8_t> buffer_data = apdu.As<Napi::Buffer<uint8_t>>();
+        ti->in_data.insert(ti->in_data.end(), buffer_data.Data(), buffer_data.Data() + buffer_data.Length());
+        ti->in_lens.push_back(buffer_data.Length());
+    }
 
-    uv_mutex_lock(&obj->m_mutex);
-    if (obj->m_card_handle) {
-        result = SCardDisconnect(obj->m_card_handle, *disposition);
-        if (result == SCARD_S_SUCCESS) {
-            obj->m_card_handle = 0;
+    if (expected_sw.IsArray()) {
+        Napi::Array expected = expected_sw.As<Napi::Array>();
+        for (uint32_t i = 0; i < expected.Length(); i++) {
+            ti->expected_sw.push_back(expected.Get(i).As<Napi::Number>().Uint32Value() & 0xFFFF);
         }
     }
 
-    uv_mutex_unlock(&obj->m_mutex);
-
-    baton->result = reinterpret_cast<void*>(new LONG(result));
+    return ti;
 }
 
-void CardReader::AfterDisconnect(uv_work_t* req, int status) {
-    Baton* baton = static_cast<Baton*>(req->data);
-    LONG* result = reinterpret_cast<LONG*>(baton->result);
-    Napi::Env env(baton->env);
-    Napi::HandleScope scope(env);
+Napi::Value CardReader::Control(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
 
-    if (*result) {
-        Napi::Value err = Napi::Error::New(env, error_msg("SCardDisconnect", *result)).Value();
-        std::vector<napi_value> argv = { err };
-        baton->callback.Call(argv);
-    } else {
-        baton->reader->Value().Set("connected", Napi::Boolean::New(env, false));
-        std::vector<napi_value> argv = { env.Null() };
-        baton->callback.Call(argv);
+    if (!info[0].IsBuffer()) {
+        Napi::TypeError::New(env, "First argument must be a Buffer").ThrowAsJavaScriptException();
+        return env.Undefined();
     }
 
-    baton->callback.Reset();
-    DWORD* disposition = reinterpret_cast<DWORD*>(baton->input);
-    delete disposition;
-    delete result;
-    delete baton;
-}
-
-void CardReader::DoTransmit(uv_work_t* req) {
-    Baton* baton = static_cast<Baton*>(req->data);
-    TransmitInput *ti = static_cast<TransmitInput*>(baton->input);
-    CardReader* obj = baton->reader;
+    if (!info[1].IsNumber()) {
+        Napi::TypeError::New(env, "Second argument must be an integer").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
 
-    TransmitResult *tr = new TransmitResult();
-    tr->data = new unsigned char[ti->out_len];
-    tr->len = ti->out_len;
-    LONG result = SCARD_E_INVALID_HANDLE;
+    if (!info[2].IsBuffer()) {
+        Napi::TypeError::New(env, "Third argument must be a Buffer").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
 
-    uv_mutex_lock(&obj->m_mutex);
-    if (obj->m_card_handle) {
-        SCARD_IO_REQUEST send_pci = { ti->card_protocol, sizeof(SCARD_IO_REQUEST) };
-        result = SCardTransmit(obj->m_card_handle, &send_pci, ti->in_data, ti->in_len,
-                               NULL, tr->data, &tr->len);
+    if (!info[3].IsFunction()) {
+        Napi::TypeError::New(env, "Fourth argument must be a callback function").ThrowAsJavaScriptException();
+        return env.Undefined();
     }
 
-    uv_mutex_unlock(&obj->m_mutex);
+    Napi::Buffer<uint8_t> in_buf = info[0].As<Napi::Buffer<uint8_t>>();
+    DWORD control_code = info[1].As<Napi::Number>().Uint32Value();
+    Napi::Buffer<uint8_t> out_buf = info[2].As<Napi::Buffer<uint8_t>>();
+    Napi::Function cb = info[3].As<Napi::Function>();
 
-    tr->result = result;
-    baton->result = tr;
-}
+    Baton* baton = m_batons.New();
+    baton->request.data = baton;
+    baton->callback.Reset();
+    baton->callback = Napi::Persistent(cb);
+    baton->reader = this;
+    baton->env = env;
 
-void CardReader::AfterTransmit(uv_work_t* req, int status) {
-    Baton* baton = static_cast<Baton*>(req->data);
-    TransmitInput *ti = static_cast<TransmitInput*>(baton->input);
-    TransmitResult *tr = static_cast<TransmitResult*>(baton->result);
+    ControlInput *ci = m_control_inputs.New();
+    ci->control_code = control_code;
+    ci->in_data = in_buf.Data();
+    ci->in_len = in_buf.Length();
+    ci->out_data = out_buf.Data();
+    ci->out_len = out_buf.Length();
+    ci->in_ref = Napi::Persistent(in_buf.As<Napi::Object>());
+    ci->out_ref = Napi::Persistent(out_buf.As<Napi::Object>());
+    baton->input = ci;
+    baton->result = m_control_results.New();
+    baton->method = "SCardControl";
+
+    queue_work(baton, DoControl, reinterpret_cast<uv_after_work_cb>(AfterControl));
+
+    return env.Undefined();
+}
+
+Napi::Value CardReader::BeginTransaction(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (!info[0].IsFunction()) {
+        Napi::TypeError::New(env, "First argument must be a callback function").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    Napi::Function cb = info[0].As<Napi::Function>();
+
+    Baton* baton = m_batons.New();
+    baton->request.data = baton;
+    baton->callback.Reset();
+    baton->callback = Napi::Persistent(cb);
+    baton->reader = this;
+    baton->env = env;
+
+    TransactionInput *ti = new TransactionInput();
+    ti->begin = true;
+    ti->disposition = SCARD_LEAVE_CARD;
+    baton->input = ti;
+    baton->method = "SCardBeginTransaction";
+
+    queue_work(baton, DoTransaction, reinterpret_cast<uv_after_work_cb>(AfterTransaction));
+
+    return env.Undefined();
+}
+
+Napi::Value CardReader::EndTransaction(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (!info[0].IsNumber()) {
+        Napi::TypeError::New(env, "First argument must be an integer").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    if (!info[1].IsFunction()) {
+        Napi::TypeError::New(env, "Second argument must be a callback function").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    Napi::Function cb = info[1].As<Napi::Function>();
+
+    Baton* baton = m_batons.New();
+    baton->request.data = baton;
+    baton->callback.Reset();
+    baton->callback = Napi::Persistent(cb);
+    baton->reader = this;
+    baton->env = env;
+
+    TransactionInput *ti = new TransactionInput();
+    ti->begin = false;
+    ti->disposition = info[0].As<Napi::Number>().Uint32Value();
+    baton->input = ti;
+    baton->method = "SCardEndTransaction";
+
+    queue_work(baton, DoTransaction, reinterpret_cast<uv_after_work_cb>(AfterTransaction));
+
+    return env.Undefined();
+}
+
+Napi::Value CardReader::SetSecureChannel(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    /* The session keys S-ENC, S-MAC and S-RMAC, or nulls to close the channel */
+    bool open = !info[0].IsNull();
+    for (size_t i = 0; open && i < 3; i++) {
+        if (!info[i].IsBuffer() || !Aes::ValidKeyLength(info[i].As<Napi::Buffer<uint8_t>>().Length()) ||
+            info[i].As<Napi::Buffer<uint8_t>>().Length() != info[0].As<Napi::Buffer<uint8_t>>().Length()) {
+            Napi::TypeError::New(env, "Session keys must be Buffers of 16, 24 or 32 bytes")
+                .ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+    }
+
+    if (!info[3].IsNumber()) {
+        Napi::TypeError::New(env, "Fourth argument must be an integer").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    /* The levels of SCP03: command protection comes with C-MAC, response encryption with R-MAC */
+    uint32_t level = info[3].As<Napi::Number>().Uint32Value();
+    const uint32_t c_mac = SecureChannel::C_MAC, r_mac = SecureChannel::R_MAC;
+    if ((level & ~0x33u) || ((level & SecureChannel::C_DECRYPTION) && !(level & c_mac)) ||
+        ((level & r_mac) && !(level & c_mac)) || ((level & SecureChannel::R_ENCRYPTION) && !(level & r_mac))) {
+        Napi::TypeError::New(env, "Invalid security level").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    if (!info[4].IsFunction()) {
+        Napi::TypeError::New(env, "Fifth argument must be a callback function").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    SecureChannel* channel = NULL;
+    if (open) {
+        channel = new SecureChannel(info[0].As<Napi::Buffer<uint8_t>>().Data(),
+                                    info[1].As<Napi::Buffer<uint8_t>>().Data(),
+                                    info[2].As<Napi::Buffer<uint8_t>>().Data(),
+                                    info[0].As<Napi::Buffer<uint8_t>>().Length(), (uint8_t)level);
+    }
+
+    Baton* baton = m_batons.New();
+    baton->request.data = baton;
+    baton->callback = Napi::Persistent(info[4].As<Napi::Function>());
+    baton->reader = this;
+    baton->input = channel;
+    baton->env = env;
+
+    /* Swapped in behind the requests already queued */
+    queue_work(baton, DoSecureChannel, reinterpret_cast<uv_after_work_cb>(AfterSecureChannel));
+
+    return env.Undefined();
+}
+
+Napi::Value CardReader::ReadBinary(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    for (size_t i = 0; i < 5; i++) {
+        if (!info[i].IsNumber()) {
+            Napi::TypeError::New(env, "First five arguments must be integers").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+    }
+
+    if (!info[5].IsFunction()) {
+        Napi::TypeError::New(env, "Sixth argument must be a callback function").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    /* Offsets are 3 bytes at most, see read_binary_command() */
+    int64_t offset = info[2].As<Napi::Number>().Int64Value();
+    int64_t length = info[3].As<Napi::Number>().Int64Value();
+    if (offset < 0 || length < 0 || offset > MAX_EF_OFFSET || offset + length > MAX_EF_OFFSET + 1) {
+        Napi::RangeError::New(env, "Offset and length must not go past offset 0xFFFFFF").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    DWORD chunk_size = info[4].As<Napi::Number>().Uint32Value();
+    if (chunk_size < 1 || chunk_size > 65536) {
+        Napi::RangeError::New(env, "Chunk size must be between 1 and 65536").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    ReadBinaryStream* stream = new ReadBinaryStream();
+    stream->id = info[0].As<Napi::Number>().Uint32Value();
+    stream->card_protocol = info[1].As<Napi::Number>().Uint32Value();
+    stream->offset = (DWORD)offset;
+    stream->end = length ? (DWORD)(offset + length) : 0;
+    stream->chunk_size = chunk_size;
+    stream->reading = false;
+    stream->paused = false;
+    stream->delivering = false;
+    stream->done = false;
+    stream->destroyed = false;
+    stream->callback = Napi::Persistent(info[5].As<Napi::Function>());
+
+    std::map<uint32_t, ReadBinaryStream*>::iterator it = m_streams.find(stream->id);
+    if (it != m_streams.end()) {
+        delete stream;
+        Napi::Error::New(env, "Stream id already in use").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    m_streams[stream->id] = stream;
+    queue_read_binary(env, stream);
+
+    return env.Undefined();
+}
+
+Napi::Value CardReader::ReadBinaryResume(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (!info[0].IsNumber()) {
+        Napi::TypeError::New(env, "First argument must be an integer").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    std::map<uint32_t, ReadBinaryStream*>::iterator it = m_streams.find(info[0].As<Napi::Number>().Uint32Value());
+    if (it == m_streams.end()) {
+        return env.Undefined();
+    }
+
+    ReadBinaryStream* stream = it->second;
+    stream->paused = false;
+    if (!stream->reading && !stream->done && !stream->destroyed) {
+        queue_read_binary(env, stream);
+    }
+
+    return env.Undefined();
+}
+
+Napi::Value CardReader::ReadBinaryDestroy(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (!info[0].IsNumber()) {
+        Napi::TypeError::New(env, "First argument must be an integer").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    std::map<uint32_t, ReadBinaryStream*>::iterator it = m_streams.find(info[0].As<Napi::Number>().Uint32Value());
+    if (it == m_streams.end()) {
+        return env.Undefined();
+    }
+
+    /* A chunk in flight, or the callback being run, frees it later */
+    ReadBinaryStream* stream = it->second;
+    stream->destroyed = true;
+    if (!stream->reading && !stream->delivering) {
+        erase_stream(stream);
+    }
+
+    return env.Undefined();
+}
+
+Napi::Value CardReader::ConnectAsync(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (!info[0].IsNumber()) {
+        Napi::TypeError::New(env, "First argument must be an integer").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    if (!info[1].IsNumber()) {
+        Napi::TypeError::New(env, "Second argument must be an integer").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    Baton* baton = new_async_baton(info, 2, "SCardConnect");
+    if (!baton) {
+        return env.Undefined();
+    }
+
+    ConnectInput* ci = m_connect_inputs.New();
+    ci->share_mode = info[0].As<Napi::Number>().Uint32Value();
+    ci->pref_protocol = info[1].As<Napi::Number>().Uint32Value();
+    baton->input = ci;
+    baton->result = m_connect_results.New();
+
+    Napi::Promise promise = baton->deferred->Promise();
+    queue_work(baton, DoConnect, reinterpret_cast<uv_after_work_cb>(AfterConnect));
+
+    return promise;
+}
+
+Napi::Value CardReader::TransmitAsync(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (!info[0].IsBuffer()) {
+        Napi::TypeError::New(env, "First argument must be a Buffer").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    if (!info[1].IsNumber() && !info[1].IsBuffer()) {
+        Napi::TypeError::New(env, "Second argument must be an integer or a Buffer").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    if (!info[2].IsNumber()) {
+        Napi::TypeError::New(env, "Third argument must be an integer").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    if (!info[3].IsBoolean()) {
+        Napi::TypeError::New(env, "Fourth argument must be a boolean").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    if (!info[4].IsBoolean()) {
+        Napi::TypeError::New(env, "Fifth argument must be a boolean").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    Napi::Buffer<uint8_t> buffer_data = info[0].As<Napi::Buffer<uint8_t>>();
+    uint32_t protocol = info[2].As<Napi::Number>().Uint32Value();
+    bool cache = info[4].As<Napi::Boolean>().Value();
+    if (cache) {
+        Napi::Value cached = cached_response(env, protocol, buffer_data, info[1]);
+        if (!cached.IsEmpty()) {
+            Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(env);
+            deferred.Resolve(cached);
+            return deferred.Promise();
+        }
+    }
+
+    Baton* baton = new_async_baton(info, 5, "SCardTransmit");
+    if (!baton) {
+        return env.Undefined();
+    }
+
+    TransmitInput *ti = m_transmit_inputs.New();
+    ti->card_protocol = protocol;
+    ti->chaining = info[3].As<Napi::Boolean>().Value();
+    ti->cache = cache;
+    ti->cache_generation = m_cache.Generation();
+    ti->in_data = buffer_data.Data();
+    ti->in_len = buffer_data.Length();
+    ti->in_ref = Napi::Persistent(buffer_data.As<Napi::Object>());
+    if (info[1].IsBuffer()) {
+        Napi::Buffer<uint8_t> out_buf = info[1].As<Napi::Buffer<uint8_t>>();
+        ti->out_data = out_buf.Data();
+        ti->out_len = out_buf.Length();
+        ti->out_ref = Napi::Persistent(out_buf.As<Napi::Object>());
+    } else {
+        ti->out_data = NULL;
+        ti->out_len = info[1].As<Napi::Number>().Uint32Value();
+    }
+
+    baton->input = ti;
+    baton->result = transmit_result(ti);
+
+    Napi::Promise promise = baton->deferred->Promise();
+    queue_work(baton, DoTransmit, reinterpret_cast<uv_after_work_cb>(AfterTransmit));
+
+    return promise;
+}
+
+Napi::Value CardReader::ControlAsync(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (!info[0].IsBuffer()) {
+        Napi::TypeError::New(env, "First argument must be a Buffer").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    if (!info[1].IsNumber()) {
+        Napi::TypeError::New(env, "Second argument must be an integer").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    if (!info[2].IsBuffer()) {
+        Napi::TypeError::New(env, "Third argument must be a Buffer").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    Baton* baton = new_async_baton(info, 3, "SCardControl");
+    if (!baton) {
+        return env.Undefined();
+    }
+
+    Napi::Buffer<uint8_t> in_buf = info[0].As<Napi::Buffer<uint8_t>>();
+    Napi::Buffer<uint8_t> out_buf = info[2].As<Napi::Buffer<uint8_t>>();
+    ControlInput *ci = m_control_inputs.New();
+    ci->control_code = info[1].As<Napi::Number>().Uint32Value();
+    ci->in_data = in_buf.Data();
+    ci->in_len = in_buf.Length();
+    ci->out_data = out_buf.Data();
+    ci->out_len = out_buf.Length();
+    ci->in_ref = Napi::Persistent(in_buf.As<Napi::Object>());
+    ci->out_ref = Napi::Persistent(out_buf.As<Napi::Object>());
+    baton->input = ci;
+    baton->result = m_control_results.New();
+
+    Napi::Promise promise = baton->deferred->Promise();
+    queue_work(baton, DoControl, reinterpret_cast<uv_after_work_cb>(AfterControl));
+
+    return promise;
+}
+
+Napi::Value CardReader::Cancel(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (!info[0].IsNumber()) {
+        Napi::TypeError::New(env, "First argument must be an integer").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    std::map<uint32_t, Baton*>::iterator it = m_pending.find(info[0].As<Napi::Number>().Uint32Value());
+    if (it == m_pending.end()) {
+        return Napi::Boolean::New(env, false);
+    }
+
+    cancel_baton(it->second, SCARD_E_CANCELLED);
+    return Napi::Boolean::New(env, true);
+}
+
+Napi::Value CardReader::Close(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    bool replaying = m_replay_timer != NULL;
+    stop_replay_status();
+
+    /* Whether '_end' is still to come, from the loop */
+    bool ending = m_pcsclite && m_pcsclite->Unwatch(this, true);
+
+    /* No monitor thread behind a replay, the reader ends right away */
+    if (replaying && !ending) {
+        EmitEnd(env);
+    }
+
+    return Napi::Boolean::New(env, ending);
+}
+
+Napi::Value CardReader::GetStats(const Napi::CallbackInfo& info) {
+    Napi::Object stats = m_stats.ToObject(info.Env());
+    stats.Set("cache", m_cache.ToObject(info.Env()));
+
+    /* The inputs and results of all the requests together */
+    PoolCounters requests;
+    size_t free = 0;
+    requests.Add(m_connect_inputs.Counters());
+    requests.Add(m_connect_results.Counters());
+    requests.Add(m_disconnect_inputs.Counters());
+    requests.Add(m_transmit_inputs.Counters());
+    requests.Add(m_transmit_results.Counters());
+    requests.Add(m_control_inputs.Counters());
+    requests.Add(m_control_results.Counters());
+    free += m_connect_inputs.Free() + m_connect_results.Free() + m_disconnect_inputs.Free();
+    free += m_transmit_inputs.Free() + m_transmit_results.Free();
+    free += m_control_inputs.Free() + m_control_results.Free();
+
+    Napi::Object pool = Napi::Object::New(info.Env());
+    pool.Set("batons", m_batons.Counters().ToObject(info.Env(), m_batons.Free()));
+    pool.Set("requests", requests.ToObject(info.Env(), free));
+    pool.Set("buffers", m_buffer_counters.ToObject(info.Env(), m_buffers->Free()));
+    stats.Set("pool", pool);
+    return stats;
+}
+
+Napi::Value CardReader::ResetStats(const Napi::CallbackInfo& info) {
+    m_stats.Reset();
+    m_batons.ResetCounters();
+    m_connect_inputs.ResetCounters();
+    m_connect_results.ResetCounters();
+    m_disconnect_inputs.ResetCounters();
+    m_transmit_inputs.ResetCounters();
+    m_transmit_results.ResetCounters();
+    m_control_inputs.ResetCounters();
+    m_control_results.ResetCounters();
+    m_buffer_counters.Reset();
+    return info.Env().Undefined();
+}
+
+Napi::Value CardReader::ClearCache(const Napi::CallbackInfo& info) {
+    m_cache.Clear();
+    return info.Env().Undefined();
+}
+
+CardReader::TransmitResult* CardReader::transmit_result(TransmitInput* ti) {
+    /* The response goes to the caller's Buffer, to a pooled one, or to one handed over to JS */
+    TransmitResult *tr = m_transmit_results.New();
+    tr->data = ti->out_data ? ti->out_data : m_buffers->Get(ti->out_len, m_buffer_counters);
+    if (!tr->data) {
+        tr->data = new unsigned char[ti->out_len];
+    }
+
+    tr->len = ti->out_len;
+    return tr;
+}
+
+Napi::Value CardReader::cached_response(Napi::Env env, DWORD protocol, Napi::Buffer<uint8_t> command,
+                                        Napi::Value output) {
+    /*
+     * Only while nothing is queued: a cached response must not overtake a
+     * request which could change the card state, e.g. a disconnection.
+     */
+    if (!m_queued.empty()) {
+        return Napi::Value();
+    }
+
+    const std::string* response = m_cache.Find(protocol, command.Data(), command.Length());
+    if (!response) {
+        return Napi::Value();
+    }
+
+    if (output.IsBuffer()) {
+        Napi::Buffer<uint8_t> out_buf = output.As<Napi::Buffer<uint8_t>>();
+        if (response->size() > out_buf.Length()) {
+            return Napi::Value();
+        }
+
+        memcpy(out_buf.Data(), response->data(), response->size());
+        record_cached(protocol, command, *response);
+        return Napi::Number::New(env, response->size());
+    }
+
+    if (response->size() > output.As<Napi::Number>().Uint32Value()) {
+        return Napi::Value();
+    }
+
+    record_cached(protocol, command, *response);
+    return Napi::Buffer<uint8_t>::Copy(env, reinterpret_cast<const uint8_t*>(response->data()), response->size());
+}
+
+void CardReader::record_cached(DWORD protocol, Napi::Buffer<uint8_t> command, const std::string& response) {
+    m_stats.RecordCached();
+    if (m_recorder) {
+        m_recorder->Record(SESSION_CACHED_TRANSMIT, uv_hrtime(), 0, SCARD_S_SUCCESS, protocol, command.Data(),
+                           command.Length(), reinterpret_cast<const BYTE*>(response.data()), response.size());
+    }
+}
+
+Napi::Value CardReader::StartRecording(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (!info[0].IsString()) {
+        Napi::TypeError::New(env, "First argument must be a string").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    if (m_recorder) {
+        Napi::Error::New(env, "Already recording").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    std::string error;
+    m_recorder = SessionRecorder::Open(AddonData::Get(env)->loop, info[0].As<Napi::String>().Utf8Value(), m_name,
+                                       &error);
+    if (!m_recorder) {
+        Napi::Error::New(env, error).ThrowAsJavaScriptException();
+    }
+
+    return env.Undefined();
+}
+
+Napi::Value CardReader::StopRecording(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (!info[0].IsFunction()) {
+        Napi::TypeError::New(env, "First argument must be a callback function").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    /* Whether the callback is to be called, once the log is written */
+    if (!m_recorder) {
+        return Napi::Boolean::New(env, false);
+    }
+
+    m_recorder->Close(env, info[0].As<Napi::Function>());
+    m_recorder = NULL;
+    return Napi::Boolean::New(env, true);
+}
+
+Napi::Value CardReader::Replay(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (!info[0].IsBuffer()) {
+        Napi::TypeError::New(env, "First argument must be a Buffer").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    if (!info[1].IsNumber()) {
+        Napi::TypeError::New(env, "Second argument must be a number").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    if (m_replay || m_executor) {
+        Napi::Error::New(env, "Reader already in use").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    Napi::Buffer<uint8_t> log = info[0].As<Napi::Buffer<uint8_t>>();
+    std::string error;
+    m_replay = SessionReplay::Parse(log.Data(), log.Length(), info[1].As<Napi::Number>().DoubleValue(), &error);
+    if (!m_replay) {
+        Napi::Error::New(env, error).ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    /* Status changes are due at their offset from now, requests are answered when made */
+    m_replay_start = uv_hrtime();
+    m_replay_timer = new uv_timer_t();
+    uv_timer_init(AddonData::Get(env)->loop, m_replay_timer);
+    m_replay_timer->data = this;
+    schedule_replay_status();
+
+    return env.Undefined();
+}
+
+Napi::Value CardReader::ReplayReader(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (!info[0].IsBuffer()) {
+        Napi::TypeError::New(env, "First argument must be a Buffer").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    Napi::Buffer<uint8_t> log = info[0].As<Napi::Buffer<uint8_t>>();
+    std::string name;
+    if (!SessionReplay::ReaderName(log.Data(), log.Length(), &name)) {
+        Napi::Error::New(env, "Not a session log").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    return Napi::String::New(env, name);
+}
+
+void CardReader::EmitStatus(Napi::Env env, DWORD status, const BYTE* atr, DWORD atrlen,
+                            uint64_t seq, uint64_t timestamp) {
+    if (m_recorder) {
+        m_recorder->Record(SESSION_STATUS, timestamp, 0, SCARD_S_SUCCESS, status, NULL, 0, atr, atrlen);
+    }
+
+    /* A new state or ATR, the card may not be the one which answered */
+    m_cache.Clear();
+
+    if (m_status_callback.IsEmpty()) {
+        return;
+    }
+
+    /* Index of the first ATR pattern of the PCSCLite instance matching, if any */
+    int card_type = AtrMatcher::NO_MATCH;
+    if (m_pcsclite && (status & SCARD_STATE_PRESENT)) {
+        card_type = m_pcsclite->GetAtrMatcher().Match(atr, atrlen);
+    }
+
+    std::vector<napi_value> argv = {
+        env.Undefined(),
+        Napi::Number::New(env, status),
+        Napi::Buffer<uint8_t>::Copy(env, atr, atrlen),
+        Napi::Number::New(env, seq),
+        Napi::BigInt::New(env, timestamp),
+        card_type == AtrMatcher::NO_MATCH ? env.Undefined() : Napi::Number::New(env, card_type)
+    };
+
+    m_status_callback.Call(argv);
+    report_pending_exception(env);
+}
+
+void CardReader::DoRelease(uv_work_t* req) {
+    ReleaseJob* job = static_cast<ReleaseJob*>(req->data);
+
+    if (job->card_handle) {
+        SCardDisconnect(job->card_handle, SCARD_LEAVE_CARD);
+    }
+
+    if (job->card_context) {
+        ContextRegistry::Release(job->card_context);
+    }
+}
+
+void CardReader::AfterRelease(uv_work_t* req, int status) {
+    /* May drop the last reference to the executor, whose threads are idle by now */
+    delete static_cast<ReleaseJob*>(req->data);
+}
+
+void CardReader::EnvCleanup(void* arg) {
+    CardReader* obj = static_cast<CardReader*>(arg);
+    obj->m_cleanup_hook = false;
+
+    /*
+     * The environment goes away with requests or a replay in flight: their
+     * timers are closed now, the rest is freed along with the reader.
+     */
+    obj->stop_replay_status();
+    std::set<Baton*> batons(obj->m_queued);
+    for (std::map<uint32_t, Baton*>::iterator it = obj->m_pending.begin(); it != obj->m_pending.end(); ++it) {
+        batons.insert(it->second);
+    }
+
+    for (std::set<Baton*>::iterator it = batons.begin(); it != batons.end(); ++it) {
+        Baton* baton = *it;
+        if (baton->timer) {
+            uv_timer_stop(baton->timer);
+            uv_close(reinterpret_cast<uv_handle_t*>(baton->timer), [](uv_handle_t* handle) {
+                delete reinterpret_cast<uv_timer_t*>(handle);
+            });
+            baton->timer = NULL;
+        }
+    }
+
+    if (obj->m_recorder) {
+        obj->m_recorder->Close(obj->Env(), Napi::Function());
+        obj->m_recorder = NULL;
+    }
+}
+
+void CardReader::EmitEnd(Napi::Env env) {
+    m_status_callback.Reset();
+
+    // Emit end event
+    std::vector<napi_value> argv = { Napi::String::New(env, "_end") };
+    Napi::Object obj = Value();
+    Napi::Function emit = obj.Get("emit").As<Napi::Function>();
+    emit.Call(obj, argv);
+    report_pending_exception(env);
+}
+
+Napi::Value CardReader::IndexTlv(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (!info[0].IsBuffer()) {
+        Napi::TypeError::New(env, "First argument must be a Buffer").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    Napi::Buffer<uint8_t> data = info[0].As<Napi::Buffer<uint8_t>>();
+    std::vector<uint32_t> index;
+    bool valid = tlv_index(data.Data(), data.Length(), &index);
+    return tlv_array(env, index, valid);
+}
+
+Napi::Value CardReader::tlv_array(Napi::Env env, const std::vector<uint32_t>& index, bool valid) {
+    if (!valid) {
+        return env.Null();
+    }
+
+    /* A single allocation, however many data objects */
+    Napi::Uint32Array array = Napi::Uint32Array::New(env, index.size());
+    if (!index.empty()) {
+        memcpy(array.Data(), index.data(), index.size() * sizeof(uint32_t));
+    }
+
+    return array;
+}
+
+Napi::Value CardReader::response_buffer(Napi::Env env, LPBYTE data, DWORD len, DWORD capacity) {
+    /*
+     * Hand the response over to JS without copying it, unless it would pin a
+     * big allocation for a few bytes (e.g. a status word in 64KB).
+     */
+    if (capacity > RESPONSE_COPY_THRESHOLD && len < capacity / 2) {
+        Napi::Buffer<uint8_t> buffer = Napi::Buffer<uint8_t>::Copy(env, data, len);
+        delete [] data;
+        return buffer;
+    }
+
+    return Napi::Buffer<uint8_t>::NewOrCopy(env, data, len, [](Napi::Env, uint8_t* data) {
+        delete [] data;
+    });
+}
+
+CardReader::Baton* CardReader::new_async_baton(const Napi::CallbackInfo& info, size_t index, const char* method) {
+    Napi::Env env = info.Env();
+
+    if (!info[index].IsUndefined() && !info[index].IsNumber()) {
+        Napi::TypeError::New(env, "Timeout must be a number").ThrowAsJavaScriptException();
+        return NULL;
+    }
+
+    if (!info[index + 1].IsNumber()) {
+        Napi::TypeError::New(env, "Request id must be an integer").ThrowAsJavaScriptException();
+        return NULL;
+    }
+
+    Baton* baton = m_batons.New();
+    baton->request.data = baton;
+    baton->reader = this;
+    baton->env = env;
+    baton->deferred = new Napi::Promise::Deferred(env);
+    baton->id = info[index + 1].As<Napi::Number>().Uint32Value();
+    baton->method = method;
+
+    int64_t timeout = info[index].IsNumber() ? info[index].As<Napi::Number>().Int64Value() : 0;
+    if (timeout > 0) {
+        baton->deadline = uv_hrtime() + (uint64_t)timeout * 1000000;
+        baton->timer = new uv_timer_t();
+        uv_timer_init(AddonData::Get(env)->loop, baton->timer);
+        baton->timer->data = baton;
+        uv_timer_start(baton->timer, DeadlineCallback, timeout, 0);
+        // The pending request already keeps the loop alive
+        uv_unref(reinterpret_cast<uv_handle_t*>(baton->timer));
+    }
+
+    m_pending[baton->id] = baton;
+    return baton;
+}
+
+void CardReader::DeadlineCallback(uv_timer_t* timer) {
+    Baton* baton = static_cast<Baton*>(timer->data);
+    baton->reader->cancel_baton(baton, SCARD_E_TIMEOUT);
+}
+
+void CardReader::UnavailableCallback(uv_timer_t* timer) {
+    Baton* baton = static_cast<Baton*>(timer->data);
+    if (baton->reader->m_hung) {
+        baton->reader->cancel_baton(baton, SCARD_E_READER_UNAVAILABLE);
+    }
+}
+
+void CardReader::cancel_baton(Baton* baton, LONG reason) {
+    /* Read streams and secure channel changes go on */
+    if (baton->settled || !baton->method) {
+        return;
+    }
+
+    /* Still queued requests are skipped by the worker, see check_deadline() */
+    baton->cancelled = true;
+
+    Napi::Env env(baton->env);
+    Napi::HandleScope scope(env);
+    Napi::Object err = Napi::Error::New(env, error_msg(baton->method, reason)).Value();
+    err.Set("code", Napi::String::New(env, reason == SCARD_E_TIMEOUT ? "ETIMEDOUT" :
+                                           reason == SCARD_E_CANCELLED ? "ABORT_ERR" : "EBUSY"));
+    std::vector<napi_value> argv = { err };
+    settle(baton, argv);
+
+    if (!baton->running) {
+        return;
+    }
+
+    /*
+     * Best effort for a request blocked in the card: SCardCancel() aborts
+     * blocking calls of the context where the platform supports it, only
+     * when no other reader shares it (see ContextRegistry::Cancel()).
+     * Nothing guarantees that SCardTransmit() returns, and the worker holds
+     * the reader until it does: the requests queued behind fail right away
+     * rather than wait for it, as do the new ones until then.
+     */
+    if (m_card_context) {
+        ContextRegistry::Cancel(m_card_context);
+    }
+
+    m_hung = baton;
+    std::vector<Baton*> queued(m_queued.begin(), m_queued.end());
+    for (size_t i = 0; i < queued.size(); i++) {
+        cancel_baton(queued[i], SCARD_E_READER_UNAVAILABLE);
+    }
+}
+
+LONG CardReader::check_deadline(Baton* baton) {
+    if (baton->cancelled) {
+        return SCARD_E_CANCELLED;
+    }
+
+    if (baton->deadline && uv_hrtime() >= baton->deadline) {
+        return SCARD_E_TIMEOUT;
+    }
+
+    return SCARD_S_SUCCESS;
+}
+
+void CardReader::recover_reset(Baton* baton, LONG result) {
+    CardReader* obj = baton->reader;
+
+    /*
+     * The card was reset by another application: reconnect the handle right
+     * away, without a new cold connection, so that the next request finds it
+     * usable. The request itself still fails, the card lost its state.
+     */
+    if (result != SCARD_W_RESET_CARD || !obj->m_card_handle || obj->m_replay) {
+        return;
+    }
+
+    /* The session of the card is gone with the reset */
+    if (obj->m_secure_channel) {
+        obj->m_secure_channel->Fail();
+    }
+
+    DWORD card_protocol;
+    if (SCardReconnect(obj->m_card_handle, obj->m_share_mode, obj->m_pref_protocol,
+                       SCARD_LEAVE_CARD, &card_protocol) == SCARD_S_SUCCESS) {
+        baton->reconnected_protocol = card_protocol;
+    }
+}
+
+Napi::Object CardReader::scard_error(Napi::Env env, Baton* baton, const char* method, LONG result) {
+    Napi::Object err = Napi::Error::New(env, error_msg(method, result)).Value();
+    if (baton->reconnected_protocol) {
+        err.Set("reconnected", Napi::Boolean::New(env, true));
+        err.Set("protocol", Napi::Number::New(env, baton->reconnected_protocol));
+    }
+
+    return err;
+}
+
+void CardReader::settle(Baton* baton, const std::vector<napi_value>& argv) {
+    /* Already failed on timeout or cancellation, see cancel_baton() */
+    if (baton->settled) {
+        return;
+    }
+
+    baton->settled = true;
+    Napi::Env env(baton->env);
+    if (baton->group) {
+        settle_group(baton->group, env, baton->group_index, Napi::Value(env, argv.size() > 1 ? argv[1] : argv[0]));
+        return;
+    }
+
+    if (!baton->deferred) {
+        baton->callback.Call(argv);
+        return;
+    }
+
+    Napi::Value err(env, argv[0]);
+    if (!err.IsNull() && !err.IsUndefined()) {
+        baton->deferred->Reject(err);
+    } else {
+        baton->deferred->Resolve(argv.size() > 1 ? argv[1] : env.Undefined());
+    }
+}
+
+void CardReader::settle_group(TransmitManyGroup* group, Napi::Env env, uint32_t index, Napi::Value result) {
+    /* The error or the result of the reader, the others go on regardless */
+    if (!result.IsEmpty()) {
+        group->results.Value().Set(index, result);
+    }
+
+    if (--group->pending) {
+        return;
+    }
+
+    group->callback.Call({ env.Null(), group->results.Value() });
+    delete group;
+}
+
+void CardReader::release_baton(Baton* baton) {
+    if (baton->timer) {
+        uv_timer_stop(baton->timer);
+        uv_close(reinterpret_cast<uv_handle_t*>(baton->timer), [](uv_handle_t* handle) {
+            delete reinterpret_cast<uv_timer_t*>(handle);
+        });
+    }
+
+    if (baton->deferred) {
+        std::map<uint32_t, Baton*>& pending = baton->reader->m_pending;
+        std::map<uint32_t, Baton*>::iterator it = pending.find(baton->id);
+        if (it != pending.end() && it->second == baton) {
+            pending.erase(it);
+        }
+
+        delete baton->deferred;
+    }
+
+    CardReader* reader = baton->reader;
+    reader->m_batons.Delete(baton);
+    reader->Unref();
+}
+
+void CardReader::queue_read_binary(Napi::Env env, ReadBinaryStream* stream) {
+    Baton* baton = m_batons.New();
+    baton->request.data = baton;
+    baton->reader = this;
+    baton->input = stream;
+    baton->env = env;
+
+    stream->reading = true;
+    queue_work(baton, DoReadBinary, reinterpret_cast<uv_after_work_cb>(AfterReadBinary));
+}
+
+void CardReader::erase_stream(ReadBinaryStream* stream) {
+    m_streams.erase(stream->id);
+    delete stream;
+}
+
+void CardReader::queue_work(Baton* baton, uv_work_cb work_cb, uv_after_work_cb after_work_cb) {
+    if (!m_executor) {
+        /* Use the pool of the PCSCLite instance if any, or a thread of our own */
+        if (m_pcsclite) {
+            m_executor = m_pcsclite->GetExecutor();
+        }
+
+        if (!m_executor) {
+            m_executor = std::make_shared<Executor>(Napi::Env(baton->env), 1);
+        }
+
+        m_lane = m_executor->NextLane();
+    }
+
+    baton->work_cb = work_cb;
+    baton->after_work_cb = after_work_cb;
+    baton->trace.submitted = uv_hrtime();
+
+    // Keep this reader (and so its executor) alive until the work is done
+    Ref();
+    m_queued.insert(baton);
+    m_executor->Queue(m_lane, &baton->request, DoWork, AfterWork);
+
+    /* Would wait behind the hung request, see cancel_baton(). Callbacks are never called synchronously. */
+    if (m_hung && baton->deferred) {
+        cancel_baton(baton, SCARD_E_READER_UNAVAILABLE);
+    } else if (m_hung && baton->method) {
+        baton->timer = new uv_timer_t();
+        uv_timer_init(AddonData::Get(Napi::Env(baton->env))->loop, baton->timer);
+        baton->timer->data = baton;
+        uv_timer_start(baton->timer, UnavailableCallback, 0, 0);
+    }
+}
+
+void CardReader::DoWork(uv_work_t* req) {
+    Baton* baton = static_cast<Baton*>(req->data);
+    baton->trace.started = uv_hrtime();
+    baton->work_cb(req);
+}
+
+void CardReader::AfterWork(uv_work_t* req, int status) {
+    Baton* baton = static_cast<Baton*>(req->data);
+    CardReader* obj = baton->reader;
+    baton->trace.completed = uv_hrtime();
+    obj->m_stats.Record(baton->trace);
+    obj->m_queued.erase(baton);
+    if (obj->m_hung == baton) {
+        obj->m_hung = NULL;
+    }
+
+    /* The card lost its state, so did the cached responses */
+    LONG result = baton->trace.result;
+    if (baton->reconnected_protocol || result == SCARD_W_RESET_CARD || result == SCARD_W_REMOVED_CARD ||
+        result == SCARD_E_NO_SMARTCARD) {
+        obj->m_cache.Clear();
+    }
+
+    baton->after_work_cb(req, status);
+}
+
+void CardReader::lock_reader(Baton* baton) {
+    uv_mutex_lock(&baton->reader->m_mutex);
+    baton->trace.locked = uv_hrtime();
+}
+
+void CardReader::unlock_reader(Baton* baton) {
+    baton->trace.returned = uv_hrtime();
+    uv_mutex_unlock(&baton->reader->m_mutex);
+}
+
+DWORD CardReader::read_binary_le(const ReadBinaryStream* stream) {
+    /* Up to the end asked for, or to the last offset which can be read */
+    DWORD remaining = (stream->end ? stream->end : MAX_EF_OFFSET + 1) - stream->offset;
+
+    /* Past 0x7FFF, Le also counts the header of the 53 DO wrapping the data */
+    if (stream->offset > MAX_SHORT_EF_OFFSET) {
+        remaining += (remaining < 0x80) ? 2 : (remaining < 0x100) ? 3 : 4;
+    }
+
+    return (remaining < stream->chunk_size) ? remaining : stream->chunk_size;
+}
+
+/*
+ * The handle of a replayed connection, never passed to SCard: the replay
+ * answers on behalf of the reader.
+ */
+static const SCARDHANDLE REPLAY_CARD_HANDLE = 1;
+
+LONG CardReader::scard_connect(CardReader* obj, DWORD share_mode, DWORD pref_protocol, DWORD* card_protocol) {
+    if (obj->m_replay) {
+        const SessionReplay::Event* event;
+        LONG result = obj->m_replay->Request(SESSION_CONNECT, &event);
+        if (result == SCARD_S_SUCCESS) {
+            obj->m_card_handle = REPLAY_CARD_HANDLE;
+            *card_protocol = event->arg;
+        }
+
+        return result;
+    }
+
+    return SCardConnect(obj->m_card_context,
+                        obj->m_name.c_str(),
+                        share_mode,
+                        pref_protocol,
+                        &obj->m_card_handle,
+                        card_protocol);
+}
+
+LONG CardReader::scard_reconnect(CardReader* obj, DWORD share_mode, DWORD pref_protocol,
+                                 DWORD initialization, DWORD* card_protocol) {
+    if (obj->m_replay) {
+        const SessionReplay::Event* event;
+        LONG result = obj->m_replay->Request(SESSION_RECONNECT, &event);
+        if (result == SCARD_S_SUCCESS) {
+            *card_protocol = event->arg;
+        }
+
+        return result;
+    }
+
+    return SCardReconnect(obj->m_card_handle, share_mode, pref_protocol, initialization, card_protocol);
+}
+
+LONG CardReader::scard_disconnect(CardReader* obj, DWORD disposition) {
+    if (obj->m_replay) {
+        const SessionReplay::Event* event;
+        return obj->m_replay->Request(SESSION_DISCONNECT, &event);
+    }
+
+    return SCardDisconnect(obj->m_card_handle, disposition);
+}
+
+LONG CardReader::scard_transmit(CardReader* obj, const SCARD_IO_REQUEST* send_pci, const BYTE* in_data,
+                                DWORD in_len, BYTE* out_data, DWORD* out_len, bool chaining) {
+    if (obj->m_replay) {
+        /* The recorded response, chained or not */
+        const SessionReplay::Event* event;
+        LONG result = obj->m_replay->Request(SESSION_TRANSMIT, &event);
+        if (result == SCARD_S_SUCCESS) {
+            if (event->out_data.size() > *out_len) {
+                return SCARD_E_INSUFFICIENT_BUFFER;
+            }
+
+            memcpy(out_data, event->out_data.data(), event->out_data.size());
+            *out_len = event->out_data.size();
+        }
+
+        return result;
+    }
+
+    if (obj->m_secure_channel) {
+        return secure_transmit(obj, send_pci, in_data, in_len, out_data, out_len, chaining);
+    }
+
+    if (chaining) {
+        return transmit_chained(obj->m_card_handle, send_pci, in_data, in_len, out_data, out_len);
+    }
+
+    return SCardTransmit(obj->m_card_handle, send_pci, in_data, in_len, NULL, out_data, out_len);
+}
+
+LONG CardReader::secure_transmit(CardReader* obj, const SCARD_IO_REQUEST* send_pci, const BYTE* in_data,
+                                 DWORD in_len, BYTE* out_data, DWORD* out_len, bool chaining) {
+    SecureChannel* channel = obj->m_secure_channel.get();
+    std::vector<BYTE> command;
+    LONG result = channel->Wrap(in_data, in_len, &command);
+    if (result != SCARD_S_SUCCESS) {
+        return result;
+    }
+
+    /* Transport (chaining, GET RESPONSE) stays below the secure messaging */
+    std::vector<BYTE> response(*out_len + SECURE_CHANNEL_OVERHEAD);
+    DWORD response_len = response.size();
+    if (chaining) {
+        result = transmit_chained(obj->m_card_handle, send_pci, command.data(), command.size(),
+                                  response.data(), &response_len);
+    } else {
+        result = SCardTransmit(obj->m_card_handle, send_pci, command.data(), command.size(), NULL,
+                               response.data(), &response_len);
+    }
+
+    /* Whether the card got the command is unknown, so are its counter and chaining value */
+    if (result != SCARD_S_SUCCESS) {
+        channel->Fail();
+        return result;
+    }
+
+    result = channel->Unwrap(response.data(), response_len, out_data, out_len);
+    secure_zero(response.data(), response.size());
+    return result;
+}
+
+LONG CardReader::scard_control(CardReader* obj, DWORD control_code, LPCVOID in_data, DWORD in_len,
+                               LPVOID out_data, DWORD out_len, DWORD* len) {
+    if (obj->m_replay) {
+        const SessionReplay::Event* event;
+        LONG result = obj->m_replay->Request(SESSION_CONTROL, &event);
+        if (result == SCARD_S_SUCCESS) {
+            if (event->out_data.size() > out_len) {
+                return SCARD_E_INSUFFICIENT_BUFFER;
+            }
+
+            memcpy(out_data, event->out_data.data(), event->out_data.size());
+            *len = event->out_data.size();
+        }
+
+        return result;
+    }
+
+    return SCardControl(obj->m_card_handle, control_code, in_data, in_len, out_data, out_len, len);
+}
+
+LONG CardReader::scard_transaction(CardReader* obj, bool begin, DWORD disposition) {
+    if (obj->m_replay) {
+        const SessionReplay::Event* event;
+        return obj->m_replay->Request(begin ? SESSION_BEGIN_TRANSACTION : SESSION_END_TRANSACTION, &event);
+    }
+
+    if (begin) {
+        return SCardBeginTransaction(obj->m_card_handle);
+    }
+
+    return SCardEndTransaction(obj->m_card_handle, disposition);
+}
+
+void CardReader::record(Baton* baton, uint8_t type, LONG result, uint32_t arg, const BYTE* in_data, size_t in_len,
+                        const BYTE* out_data, size_t out_len) {
+    const RequestTrace& trace = baton->trace;
+    uint64_t duration = (trace.locked && trace.returned > trace.locked) ? trace.returned - trace.locked : 0;
+    m_recorder->Record(type, trace.submitted, duration, result, arg, in_data, in_len, out_data, out_len);
+}
+
+void CardReader::schedule_replay_status() {
+    const std::vector<SessionReplay::Event>& events = m_replay->StatusEvents();
+    if (!m_replay_timer || m_replay_status >= events.size()) {
+        return;
+    }
+
+    uint64_t due = m_replay_start + m_replay->Scale(events[m_replay_status].time);
+    uint64_t now = uv_hrtime();
+    uint64_t timeout = (due > now) ? (due - now + 999999) / 1000000 : 0;
+    uv_timer_start(m_replay_timer, ReplayStatusCallback, timeout, 0);
+}
+
+void CardReader::stop_replay_status() {
+    if (!m_replay_timer) {
+        return;
+    }
+
+    uv_timer_stop(m_replay_timer);
+    uv_close(reinterpret_cast<uv_handle_t*>(m_replay_timer), [](uv_handle_t* handle) {
+        delete reinterpret_cast<uv_timer_t*>(handle);
+    });
+    m_replay_timer = NULL;
+}
+
+void CardReader::ReplayStatusCallback(uv_timer_t* timer) {
+    CardReader* obj = static_cast<CardReader*>(timer->data);
+    const std::vector<SessionReplay::Event>& events = obj->m_replay->StatusEvents();
+    Napi::Env env = obj->Env();
+    Napi::HandleScope scope(env);
+
+    /* Every change due by now, in order, unless the reader gets closed meanwhile */
+    uint64_t now = uv_hrtime();
+    while (obj->m_replay_timer && obj->m_replay_status < events.size() &&
+           obj->m_replay_start + obj->m_replay->Scale(events[obj->m_replay_status].time) <= now) {
+        const SessionReplay::Event& event = events[obj->m_replay_status++];
+        obj->EmitStatus(env, event.arg, event.out_data.data(), event.out_data.size(),
+                        ++obj->m_replay_seq, uv_hrtime());
+    }
+
+    obj->schedule_replay_status();
+}
+
+void CardReader::DoConnect(uv_work_t* req) {
+    Baton* baton = static_cast<Baton*>(req->data);
+    ConnectInput *ci = static_cast<ConnectInput*>(baton->input);
+
+    DWORD card_protocol;
+    LONG result = SCARD_S_SUCCESS;
+    CardReader* obj = baton->reader;
+
+    lock_reader(baton);
+    /* Requests past their deadline or cancelled while queued fail early */
+    result = check_deadline(baton);
+    if (result == SCARD_S_SUCCESS && !obj->m_card_context && !obj->m_replay) {
+        /* The one of our lane's thread, where all our requests run */
+        result = ContextRegistry::Acquire(ContextRegistry::CONTEXT_IO, NULL, &obj->m_card_context);
+    }
+
+    if (result == SCARD_S_SUCCESS) {
+        baton->running = true;
+        result = scard_connect(obj, ci->share_mode, ci->pref_protocol, &card_protocol);
+        baton->running = false;
+    }
+
+    if (result == SCARD_S_SUCCESS) {
+        obj->m_share_mode = ci->share_mode;
+        obj->m_pref_protocol = ci->pref_protocol;
+        obj->m_secure_channel.reset();
+    }
+
+    unlock_reader(baton);
+
+    baton->trace.result = result;
+    ConnectResult *cr = static_cast<ConnectResult*>(baton->result);
+    cr->result = result;
+    if (!result) {
+        cr->card_protocol = card_protocol;
+    }
+}
+
+void CardReader::AfterConnect(uv_work_t* req, int status) {
+    Baton* baton = static_cast<Baton*>(req->data);
+    ConnectInput *ci = static_cast<ConnectInput*>(baton->input);
+    ConnectResult *cr = static_cast<ConnectResult*>(baton->result);
+    Napi::Env env(baton->env);
+    Napi::HandleScope scope(env);
+
+    baton->reader->m_cache.Clear();
+    if (baton->reader->m_recorder) {
+        baton->reader->record(baton, SESSION_CONNECT, cr->result, cr->result ? 0 : cr->card_protocol,
+                              NULL, 0, NULL, 0);
+    }
+
+    if (cr->result) {
+        Napi::Value err = Napi::Error::New(env, error_msg("SCardConnect", cr->result)).Value();
+        std::vector<napi_value> argv = { err };
+        settle(baton, argv);
+    } else {
+        baton->reader->Value().Set("connected", Napi::Boolean::New(env, true));
+        if (baton->reader->m_pcsclite) {
+            baton->reader->m_pcsclite->GetStateTable().SetConnected(baton->reader->m_name, true);
+        }
+
+        std::vector<napi_value> argv = {
+            env.Null(),
+            Napi::Number::New(env, cr->card_protocol)
+        };
+
+        settle(baton, argv);
+    }
+
+    baton->callback.Reset();
+    baton->reader->m_connect_inputs.Delete(ci);
+    baton->reader->m_connect_results.Delete(cr);
+    release_baton(baton);
+}
+
+void CardReader::DoReconnect(uv_work_t* req) {
+    Baton* baton = static_cast<Baton*>(req->data);
+    ReconnectInput *ri = static_cast<ReconnectInput*>(baton->input);
+
+    DWORD card_protocol;
+    LONG result = SCARD_E_INVALID_HANDLE;
+    CardReader* obj = baton->reader;
+
+    lock_reader(baton);
+    /* Requests cancelled while queued fail early, see cancel_baton() */
+    LONG expired = check_deadline(baton);
+    if (expired != SCARD_S_SUCCESS) {
+        result = expired;
+    } else if (obj->m_card_handle) {
+        DWORD share_mode = ri->same_share_mode ? obj->m_share_mode : ri->share_mode;
+        DWORD pref_protocol = ri->same_protocol ? obj->m_pref_protocol : ri->pref_protocol;
+
+        /* Keeps the handle, and the card powered unless asked otherwise */
+        result = scard_reconnect(obj, share_mode, pref_protocol, ri->initialization, &card_protocol);
+        if (result == SCARD_S_SUCCESS) {
+            obj->m_share_mode = share_mode;
+            obj->m_pref_protocol = pref_protocol;
+        }
+    }
+
+    unlock_reader(baton);
+
+    baton->trace.result = result;
+    ConnectResult *cr = new ConnectResult();
+    cr->result = result;
+    if (!result) {
+        cr->card_protocol = card_protocol;
+    }
+
+    baton->result = cr;
+}
+
+void CardReader::AfterReconnect(uv_work_t* req, int status) {
+    Baton* baton = static_cast<Baton*>(req->data);
+    ReconnectInput *ri = static_cast<ReconnectInput*>(baton->input);
+    ConnectResult *cr = static_cast<ConnectResult*>(baton->result);
+    Napi::Env env(baton->env);
+    Napi::HandleScope scope(env);
+
+    baton->reader->m_cache.Clear();
+    if (baton->reader->m_recorder) {
+        baton->reader->record(baton, SESSION_RECONNECT, cr->result, cr->result ? 0 : cr->card_protocol,
+                              NULL, 0, NULL, 0);
+    }
+
+    if (cr->result) {
+        Napi::Value err = Napi::Error::New(env, error_msg("SCardReconnect", cr->result)).Value();
+        std::vector<napi_value> argv = { err };
+        settle(baton, argv);
+    } else {
+        std::vector<napi_value> argv = {
+            env.Null(),
+            Napi::Number::New(env, cr->card_protocol)
+        };
+
+        settle(baton, argv);
+    }
+
+    baton->callback.Reset();
+    delete ri;
+    delete cr;
+    release_baton(baton);
+}
+
+void CardReader::DoDisconnect(uv_work_t* req) {
+    Baton* baton = static_cast<Baton*>(req->data);
+    DisconnectInput* di = static_cast<DisconnectInput*>(baton->input);
+
+    LONG result = SCARD_S_SUCCESS;
+    CardReader* obj = baton->reader;
+
+    lock_reader(baton);
+    LONG expired = check_deadline(baton);
+    if (expired != SCARD_S_SUCCESS) {
+        result = expired;
+    } else if (obj->m_card_handle) {
+        result = scard_disconnect(obj, di->disposition);
+        if (result == SCARD_S_SUCCESS) {
+            obj->m_card_handle = 0;
+            obj->m_secure_channel.reset();
+        }
+    }
+
+    unlock_reader(baton);
+
+    baton->trace.result = result;
+}
+
+void CardReader::AfterDisconnect(uv_work_t* req, int status) {
+    Baton* baton = static_cast<Baton*>(req->data);
+    DisconnectInput* di = static_cast<DisconnectInput*>(baton->input);
+    /* As DoDisconnect() traced it */
+    LONG result = baton->trace.result;
     Napi::Env env(baton->env);
     Napi::HandleScope scope(env);
 
-    if (tr->result) {
-        Napi::Value err = Napi::Error::New(env, error_msg("SCardTransmit", tr->result)).Value();
+    baton->reader->m_cache.Clear();
+    if (baton->reader->m_recorder) {
+        baton->reader->record(baton, SESSION_DISCONNECT, result, di->disposition, NULL, 0, NULL, 0);
+    }
+
+    if (result) {
+        Napi::Value err = Napi::Error::New(env, error_msg("SCardDisconnect", result)).Value();
         std::vector<napi_value> argv = { err };
-        baton->callback.Call(argv);
+        settle(baton, argv);
     } else {
+        baton->reader->Value().Set("connected", Napi::Boolean::New(env, false));
+        if (baton->reader->m_pcsclite) {
+            baton->reader->m_pcsclite->GetStateTable().SetConnected(baton->reader->m_name, false);
+        }
+
+        std::vector<napi_value> argv = { env.Null() };
+        settle(baton, argv);
+    }
+
+    baton->callback.Reset();
+    baton->reader->m_disconnect_inputs.Delete(di);
+    release_baton(baton);
+}
+
+void CardReader::DoTransmit(uv_work_t* req) {
+    Baton* baton = static_cast<Baton*>(req->data);
+    TransmitInput *ti = static_cast<TransmitInput*>(baton->input);
+    CardReader* obj = baton->reader;
+
+    TransmitResult *tr = static_cast<TransmitResult*>(baton->result);
+    LONG result = SCARD_E_INVALID_HANDLE;
+
+    lock_reader(baton);
+    LONG expired = check_deadline(baton);
+    if (expired != SCARD_S_SUCCESS) {
+        result = expired;
+    } else if (obj->m_card_handle) {
+        SCARD_IO_REQUEST send_pci = { ti->card_protocol, sizeof(SCARD_IO_REQUEST) };
+        baton->running = true;
+        /* With chaining, GET RESPONSE, Le correction and command chaining stay on this thread */
+        result = scard_transmit(obj, &send_pci, ti->in_data, ti->in_len, tr->data, &tr->len, ti->chaining);
+        baton->running = false;
+    }
+
+    recover_reset(baton, result);
+
+    unlock_reader(baton);
+
+    /* Still on this thread, the data objects of the response without its status word */
+    if (ti->tlv && result == SCARD_S_SUCCESS && tr->len >= 2) {
+        tr->tlv_valid = tlv_index(tr->data, tr->len - 2, &tr->tlv);
+    }
+
+    baton->trace.result = result;
+    baton->trace.apdus = 1;
+    baton->trace.bytes_in = ti->in_len;
+    baton->trace.bytes_out = (result == SCARD_S_SUCCESS) ? tr->len : 0;
+    tr->result = result;
+}
+
+void CardReader::AfterTransmit(uv_work_t* req, int status) {
+    Baton* baton = static_cast<Baton*>(req->data);
+    TransmitInput *ti = static_cast<TransmitInput*>(baton->input);
+    TransmitResult *tr = static_cast<TransmitResult*>(baton->result);
+    Napi::Env env(baton->env);
+    Napi::HandleScope scope(env);
+
+    /* Before the response gets handed over to JS */
+    if (baton->reader->m_recorder) {
+        baton->reader->record(baton, SESSION_TRANSMIT, tr->result, ti->card_protocol, ti->in_data, ti->in_len,
+                              tr->data, tr->result ? 0 : tr->len);
+    }
+
+    /* Successful responses only, other status words may not last */
+    if (ti->cache && !tr->result && tr->len >= 2 &&
+        tr->data[tr->len - 2] == 0x90 && tr->data[tr->len - 1] == 0x00) {
+        baton->reader->m_cache.Insert(ti->cache_generation, ti->card_protocol, ti->in_data, ti->in_len,
+                                      tr->data, tr->len);
+    }
+
+    if (tr->result) {
+        Napi::Value err = scard_error(env, baton, "SCardTransmit", tr->result);
+        std::vector<napi_value> argv = { err };
+        settle(baton, argv);
+    } else if (ti->out_data) {
         std::vector<napi_value> argv = {
             env.Null(),
-            Napi::Buffer<uint8_t>::Copy(env, tr->data, tr->len)
+            Napi::Number::New(env, tr->len)
         };
 
-        baton->callback.Call(argv);
+        if (ti->tlv) {
+            argv.push_back(tlv_array(env, tr->tlv, tr->tlv_valid));
+        }
+
+        settle(baton, argv);
+    } else {
+        /* Both hand the buffer over, or copy it out when that's cheaper */
+        Napi::Value response;
+        if (BufferPool::Pooled(ti->out_len)) {
+            response = baton->reader->m_buffers->ToBuffer(env, tr->data, tr->len);
+        } else {
+            response = response_buffer(env, tr->data, tr->len, ti->out_len);
+        }
+        tr->data = NULL;
+
+        std::vector<napi_value> argv = { env.Null(), response };
+
+        if (ti->tlv) {
+            argv.push_back(tlv_array(env, tr->tlv, tr->tlv_valid));
+        }
+
+        settle(baton, argv);
+    }
+
+    baton->callback.Reset();
+    CardReader* reader = baton->reader;
+    if (!ti->out_data && tr->data) {
+        if (BufferPool::Pooled(ti->out_len)) {
+            reader->m_buffers->Put(tr->data);
+        } else {
+            delete [] tr->data;
+        }
+    }
+
+    reader->m_transmit_inputs.Delete(ti);
+    reader->m_transmit_results.Delete(tr);
+    release_baton(baton);
+}
+
+void CardReader::DoTransmitBatch(uv_work_t* req) {
+    Baton* baton = static_cast<Baton*>(req->data);
+    TransmitBatchInput *ti = static_cast<TransmitBatchInput*>(baton->input);
+    CardReader* obj = baton->reader;
+
+    TransmitBatchResult *tr = new TransmitBatchResult();
+    tr->result = SCARD_S_SUCCESS;
+    tr->stopped = false;
+    tr->offsets.reserve(ti->in_lens.size() + 1);
+    tr->offsets.push_back(0);
+
+    std::vector<BYTE> out(ti->out_len);
+    SCARD_IO_REQUEST send_pci = { ti->card_protocol, sizeof(SCARD_IO_REQUEST) };
+    const BYTE* in_data = ti->in_data.data();
+
+    /*
+     * The whole batch runs under a single lock, nobody in this process can
+     * interleave. A transaction keeps other processes out as well.
+     */
+    lock_reader(baton);
+    bool in_transaction = false;
+    tr->method = "SCardTransmit";
+    tr->result = check_deadline(baton);
+    /* Replays hold the transmissions only, see record() */
+    if (tr->result == SCARD_S_SUCCESS && ti->transaction && !obj->m_replay) {
+        tr->result = obj->m_card_handle ? SCardBeginTransaction(obj->m_card_handle) : SCARD_E_INVALID_HANDLE;
+        if (tr->result == SCARD_S_SUCCESS) {
+            in_transaction = true;
+        } else {
+            tr->method = "SCardBeginTransaction";
+        }
+    }
+
+    for (size_t i = 0; tr->result == SCARD_S_SUCCESS && i < ti->in_lens.size(); i++) {
+        if (!obj->m_card_handle) {
+            tr->result = SCARD_E_INVALID_HANDLE;
+            break;
+        }
+
+        DWORD out_len = ti->out_len;
+        tr->result = scard_transmit(obj, &send_pci, in_data, ti->in_lens[i], out.data(), &out_len, false);
+        if (tr->result != SCARD_S_SUCCESS) {
+            break;
+        }
+
+        tr->data.insert(tr->data.end(), out.begin(), out.begin() + out_len);
+        tr->offsets.push_back(tr->data.size());
+        in_data += ti->in_lens[i];
+
+        if (!ti->expected_sw.empty()) {
+            uint16_t sw = (out_len >= 2) ? (out[out_len - 2] << 8) | out[out_len - 1] : 0;
+            if (std::find(ti->expected_sw.begin(), ti->expected_sw.end(), sw) == ti->expected_sw.end()) {
+                tr->stopped = true;
+                break;
+            }
+        }
+    }
+
+    if (in_transaction) {
+        LONG result = SCardEndTransaction(obj->m_card_handle, SCARD_LEAVE_CARD);
+        if (tr->result == SCARD_S_SUCCESS && result != SCARD_S_SUCCESS) {
+            tr->result = result;
+            tr->method = "SCardEndTransaction";
+        }
+    }
+
+    recover_reset(baton, tr->result);
+
+    unlock_reader(baton);
+
+    baton->trace.result = tr->result;
+    baton->trace.apdus = tr->offsets.size() - 1;
+    baton->trace.bytes_in = in_data - ti->in_data.data();
+    baton->trace.bytes_out = tr->data.size();
+    baton->result = tr;
+}
+
+void CardReader::AfterTransmitBatch(uv_work_t* req, int status) {
+    Baton* baton = static_cast<Baton*>(req->data);
+    TransmitBatchInput *ti = static_cast<TransmitBatchInput*>(baton->input);
+    TransmitBatchResult *tr = static_cast<TransmitBatchResult*>(baton->result);
+    Napi::Env env(baton->env);
+    Napi::HandleScope scope(env);
+
+    /* One transmission each, up to the failing one */
+    if (baton->reader->m_recorder) {
+        const BYTE* in_data = ti->in_data.data();
+        for (size_t i = 0; i < ti->in_lens.size(); i++) {
+            if (i + 1 < tr->offsets.size()) {
+                baton->reader->record(baton, SESSION_TRANSMIT, SCARD_S_SUCCESS, ti->card_protocol,
+                                      in_data, ti->in_lens[i], tr->data.data() + tr->offsets[i],
+                                      tr->offsets[i + 1] - tr->offsets[i]);
+            } else {
+                if (tr->result && strcmp(tr->method, "SCardTransmit") == 0) {
+                    baton->reader->record(baton, SESSION_TRANSMIT, tr->result, ti->card_protocol,
+                                          in_data, ti->in_lens[i], NULL, 0);
+                }
+                break;
+            }
+
+            in_data += ti->in_lens[i];
+        }
+    }
+
+    if (tr->result) {
+        Napi::Object err = scard_error(env, baton, tr->method, tr->result);
+        /* Index of the command that failed */
+        if (strcmp(tr->method, "SCardTransmit") == 0) {
+            err.Set("index", Napi::Number::New(env, tr->offsets.size() - 1));
+        }
+        std::vector<napi_value> argv = { err };
+        settle(baton, argv);
+    } else {
+        size_t count = tr->offsets.size() - 1;
+        Napi::Uint32Array offsets = Napi::Uint32Array::New(env, tr->offsets.size());
+        memcpy(offsets.Data(), tr->offsets.data(), tr->offsets.size() * sizeof(uint32_t));
+
+        Napi::Object result = Napi::Object::New(env);
+        std::vector<BYTE>* data = new std::vector<BYTE>();
+        data->swap(tr->data);
+        result.Set("data", Napi::Buffer<uint8_t>::NewOrCopy(env, data->data(), data->size(),
+                                                            [](Napi::Env, uint8_t*, std::vector<BYTE>* data) {
+                                                                delete data;
+                                                            }, data));
+        result.Set("offsets", offsets);
+        result.Set("count", Napi::Number::New(env, count));
+        result.Set("stopped", Napi::Boolean::New(env, tr->stopped));
+
+        std::vector<napi_value> argv = { env.Null(), result };
+        settle(baton, argv);
     }
 
     baton->callback.Reset();
-    delete [] ti->in_data;
     delete ti;
-    delete [] tr->data;
     delete tr;
-    delete baton;
+    release_baton(baton);
+}
+
+void CardReader::DoRunScript(uv_work_t* req) {
+    Baton* baton = static_cast<Baton*>(req->data);
+    ScriptInput *si = static_cast<ScriptInput*>(baton->input);
+    CardReader* obj = baton->reader;
+
+    ScriptResult *sr = new ScriptResult();
+    sr->result = SCARD_S_SUCCESS;
+    sr->method = "SCardTransmit";
+
+    SCARD_IO_REQUEST send_pci = { si->card_protocol, sizeof(SCARD_IO_REQUEST) };
+
+    /* As a batch: under a single lock, and a transaction if asked */
+    lock_reader(baton);
+    bool in_transaction = false;
+    sr->result = check_deadline(baton);
+    if (sr->result == SCARD_S_SUCCESS && si->transaction && !obj->m_replay) {
+        sr->result = obj->m_card_handle ? SCardBeginTransaction(obj->m_card_handle) : SCARD_E_INVALID_HANDLE;
+        if (sr->result == SCARD_S_SUCCESS) {
+            in_transaction = true;
+        } else {
+            sr->method = "SCardBeginTransaction";
+        }
+    }
+
+    if (sr->result == SCARD_S_SUCCESS) {
+        sr->result = si->script->Run([obj, &send_pci](const BYTE* in, DWORD in_len, BYTE* out, DWORD* out_len) {
+            if (!obj->m_card_handle) {
+                return (LONG)SCARD_E_INVALID_HANDLE;
+            }
+
+            return scard_transmit(obj, &send_pci, in, in_len, out, out_len, false);
+        }, si->out_len);
+    }
+
+    if (in_transaction) {
+        LONG result = SCardEndTransaction(obj->m_card_handle, SCARD_LEAVE_CARD);
+        if (sr->result == SCARD_S_SUCCESS && result != SCARD_S_SUCCESS) {
+            sr->result = result;
+            sr->method = "SCardEndTransaction";
+        }
+    }
+
+    recover_reset(baton, sr->result);
+
+    unlock_reader(baton);
+
+    baton->trace.result = sr->result;
+    baton->trace.apdus = si->script->CommandOffsets().size() - 1;
+    baton->trace.bytes_in = si->script->Commands().size();
+    baton->trace.bytes_out = si->script->Data().size();
+    baton->result = sr;
+}
+
+void CardReader::AfterRunScript(uv_work_t* req, int status) {
+    Baton* baton = static_cast<Baton*>(req->data);
+    ScriptInput *si = static_cast<ScriptInput*>(baton->input);
+    ScriptResult *sr = static_cast<ScriptResult*>(baton->result);
+    ApduScript* script = si->script.get();
+    Napi::Env env(baton->env);
+    Napi::HandleScope scope(env);
+
+    /* One transmission per command sent, the last one failed if there are more commands than responses */
+    if (si->record && baton->reader->m_recorder) {
+        const std::vector<uint32_t>& commands = script->CommandOffsets();
+        const std::vector<uint32_t>& offsets = script->Offsets();
+        for (size_t i = 0; i + 1 < commands.size(); i++) {
+            const BYTE* in_data = script->Commands().data() + commands[i];
+            DWORD in_len = commands[i + 1] - commands[i];
+            if (i + 1 < offsets.size()) {
+                baton->reader->record(baton, SESSION_TRANSMIT, SCARD_S_SUCCESS, si->card_protocol, in_data, in_len,
+                                      script->Data().data() + offsets[i], offsets[i + 1] - offsets[i]);
+            } else {
+                baton->reader->record(baton, SESSION_TRANSMIT, sr->result, si->card_protocol, in_data, in_len,
+                                      NULL, 0);
+            }
+        }
+    }
+
+    size_t count = script->Offsets().size() - 1;
+    if (sr->result) {
+        Napi::Object err = scard_error(env, baton, sr->method, sr->result);
+        /* Index of the command that failed */
+        if (strcmp(sr->method, "SCardTransmit") == 0) {
+            err.Set("index", Napi::Number::New(env, count));
+        }
+        std::vector<napi_value> argv = { err };
+        settle(baton, argv);
+    } else if (script->Fault()) {
+        Napi::Object err = Napi::Error::New(env, std::string("Script stopped: ") + script->Fault()).Value();
+        err.Set("pc", Napi::Number::New(env, script->Pc()));
+        err.Set("steps", Napi::Number::New(env, script->Steps()));
+        err.Set("index", Napi::Number::New(env, count));
+        std::vector<napi_value> argv = { err };
+        settle(baton, argv);
+    } else {
+        Napi::Uint32Array offsets = Napi::Uint32Array::New(env, script->Offsets().size());
+        memcpy(offsets.Data(), script->Offsets().data(), script->Offsets().size() * sizeof(uint32_t));
+
+        Napi::Array vars = Napi::Array::New(env, script->Vars().size());
+        for (size_t i = 0; i < script->Vars().size(); i++) {
+            const std::vector<BYTE>& var = script->Vars()[i];
+            vars.Set(i, Napi::Buffer<uint8_t>::Copy(env, var.data(), var.size()));
+        }
+
+        Napi::Object result = Napi::Object::New(env);
+        std::vector<BYTE>* data = new std::vector<BYTE>();
+        data->swap(script->Data());
+        result.Set("data", Napi::Buffer<uint8_t>::NewOrCopy(env, data->data(), data->size(),
+                                                            [](Napi::Env, uint8_t*, std::vector<BYTE>* data) {
+                                                                delete data;
+                                                            }, data));
+        result.Set("offsets", offsets);
+        result.Set("count", Napi::Number::New(env, count));
+        result.Set("vars", vars);
+        result.Set("steps", Napi::Number::New(env, script->Steps()));
+
+        std::vector<napi_value> argv = { env.Null(), result };
+        settle(baton, argv);
+    }
+
+    baton->callback.Reset();
+    delete si;
+    delete sr;
+    release_baton(baton);
 }
 
 void CardReader::DoControl(uv_work_t* req) {
@@ -554,24 +2477,28 @@ void CardReader::DoControl(uv_work_t* req) {
     ControlInput *ci = static_cast<ControlInput*>(baton->input);
     CardReader* obj = baton->reader;
 
-    ControlResult *cr = new ControlResult();
+    ControlResult *cr = static_cast<ControlResult*>(baton->result);
     LONG result = SCARD_E_INVALID_HANDLE;
 
-    uv_mutex_lock(&obj->m_mutex);
-    if (obj->m_card_handle) {
-        result = SCardControl(obj->m_card_handle,
-                              ci->control_code,
-                              ci->in_data,
-                              ci->in_len,
-                              ci->out_data,
-                              ci->out_len,
-                              &cr->len);
+    lock_reader(baton);
+    LONG expired = check_deadline(baton);
+    if (expired != SCARD_S_SUCCESS) {
+        result = expired;
+    } else if (obj->m_card_handle) {
+        baton->running = true;
+        result = scard_control(obj, ci->control_code, ci->in_data, ci->in_len, ci->out_data, ci->out_len,
+                               &cr->len);
+        baton->running = false;
     }
 
-    uv_mutex_unlock(&obj->m_mutex);
+    recover_reset(baton, result);
+
+    unlock_reader(baton);
 
+    baton->trace.result = result;
+    baton->trace.bytes_in = ci->in_len;
+    baton->trace.bytes_out = (result == SCARD_S_SUCCESS) ? cr->len : 0;
     cr->result = result;
-    baton->result = cr;
 }
 
 void CardReader::AfterControl(uv_work_t* req, int status) {
@@ -581,30 +2508,234 @@ void CardReader::AfterControl(uv_work_t* req, int status) {
     Napi::Env env(baton->env);
     Napi::HandleScope scope(env);
 
+    if (baton->reader->m_recorder) {
+        baton->reader->record(baton, SESSION_CONTROL, cr->result, ci->control_code,
+                              static_cast<const BYTE*>(ci->in_data), ci->in_len,
+                              static_cast<const BYTE*>(ci->out_data), cr->result ? 0 : cr->len);
+    }
+
     if (cr->result) {
-        Napi::Value err = Napi::Error::New(env, error_msg("SCardControl", cr->result)).Value();
+        Napi::Value err = scard_error(env, baton, "SCardControl", cr->result);
         std::vector<napi_value> argv = { err };
-        baton->callback.Call(argv);
+        settle(baton, argv);
     } else {
         std::vector<napi_value> argv = {
             env.Null(),
             Napi::Number::New(env, cr->len)
         };
 
-        baton->callback.Call(argv);
+        settle(baton, argv);
     }
 
     baton->callback.Reset();
-    delete ci;
-    delete cr;
-    delete baton;
+    baton->reader->m_control_inputs.Delete(ci);
+    baton->reader->m_control_results.Delete(cr);
+    release_baton(baton);
+}
+
+void CardReader::DoTransaction(uv_work_t* req) {
+    Baton* baton = static_cast<Baton*>(req->data);
+    TransactionInput *ti = static_cast<TransactionInput*>(baton->input);
+    CardReader* obj = baton->reader;
+
+    LONG result = SCARD_E_INVALID_HANDLE;
+
+    /*
+     * SCardBeginTransaction() blocks while another process holds the card,
+     * the reader's other requests wait behind it on the executor.
+     */
+    lock_reader(baton);
+    LONG expired = check_deadline(baton);
+    if (expired != SCARD_S_SUCCESS) {
+        result = expired;
+    } else if (obj->m_card_handle) {
+        result = scard_transaction(obj, ti->begin, ti->disposition);
+    }
+
+    recover_reset(baton, result);
+
+    unlock_reader(baton);
+
+    baton->trace.result = result;
+    baton->result = reinterpret_cast<void*>(new LONG(result));
+}
+
+void CardReader::AfterTransaction(uv_work_t* req, int status) {
+    Baton* baton = static_cast<Baton*>(req->data);
+    TransactionInput *ti = static_cast<TransactionInput*>(baton->input);
+    LONG* result = reinterpret_cast<LONG*>(baton->result);
+    Napi::Env env(baton->env);
+    Napi::HandleScope scope(env);
+
+    if (baton->reader->m_recorder) {
+        baton->reader->record(baton, ti->begin ? SESSION_BEGIN_TRANSACTION : SESSION_END_TRANSACTION, *result,
+                              ti->begin ? 0 : ti->disposition, NULL, 0, NULL, 0);
+    }
+
+    if (*result) {
+        const char* method = ti->begin ? "SCardBeginTransaction" : "SCardEndTransaction";
+        Napi::Value err = scard_error(env, baton, method, *result);
+        std::vector<napi_value> argv = { err };
+        settle(baton, argv);
+    } else {
+        std::vector<napi_value> argv = { env.Null() };
+        settle(baton, argv);
+    }
+
+    baton->callback.Reset();
+    delete ti;
+    delete result;
+    release_baton(baton);
+}
+
+void CardReader::DoSecureChannel(uv_work_t* req) {
+    Baton* baton = static_cast<Baton*>(req->data);
+    CardReader* obj = baton->reader;
+
+    lock_reader(baton);
+    obj->m_secure_channel.reset(static_cast<SecureChannel*>(baton->input));
+    unlock_reader(baton);
+}
+
+void CardReader::AfterSecureChannel(uv_work_t* req, int status) {
+    Baton* baton = static_cast<Baton*>(req->data);
+    Napi::Env env(baton->env);
+    Napi::HandleScope scope(env);
+
+    std::vector<napi_value> argv = { env.Null() };
+    settle(baton, argv);
+
+    baton->callback.Reset();
+    release_baton(baton);
+}
+
+void CardReader::DoReadBinary(uv_work_t* req) {
+    Baton* baton = static_cast<Baton*>(req->data);
+    ReadBinaryStream* stream = static_cast<ReadBinaryStream*>(baton->input);
+    CardReader* obj = baton->reader;
+
+    DWORD le = read_binary_le(stream);
+    BYTE command[MAX_READ_BINARY_COMMAND];
+    DWORD command_len = read_binary_command(stream->offset, le, command);
+
+    /* Room for the data, the status word and the 53 DO header of B1 */
+    TransmitResult *tr = new TransmitResult();
+    tr->len = le + 6;
+    tr->data = new unsigned char[tr->len];
+    tr->result = SCARD_E_INVALID_HANDLE;
+
+    lock_reader(baton);
+    if (obj->m_card_handle) {
+        SCARD_IO_REQUEST send_pci = { stream->card_protocol, sizeof(SCARD_IO_REQUEST) };
+        tr->result = scard_transmit(obj, &send_pci, command, command_len, tr->data, &tr->len, true);
+    }
+
+    recover_reset(baton, tr->result);
+
+    unlock_reader(baton);
+
+    baton->trace.result = tr->result;
+    baton->trace.apdus = 1;
+    baton->trace.bytes_in = command_len;
+    baton->trace.bytes_out = (tr->result == SCARD_S_SUCCESS) ? tr->len : 0;
+    baton->result = tr;
 }
 
-void CardReader::CloseCallback(uv_handle_t *handle) {
-    AsyncBaton* async_baton = static_cast<AsyncBaton*>(handle->data);
-    AsyncResult* ar = async_baton->async_result;
-    delete ar;
-    async_baton->callback.Reset();
-    SCardReleaseContext(async_baton->reader->m_status_card_context);
-    delete async_baton;
+void CardReader::AfterReadBinary(uv_work_t* req, int status) {
+    Baton* baton = static_cast<Baton*>(req->data);
+    ReadBinaryStream* stream = static_cast<ReadBinaryStream*>(baton->input);
+    TransmitResult *tr = static_cast<TransmitResult*>(baton->result);
+    CardReader* obj = baton->reader;
+    Napi::Env env(baton->env);
+    Napi::HandleScope scope(env);
+
+    stream->reading = false;
+
+    /* The chunk went to the card even when nobody reads it anymore */
+    if (obj->m_recorder) {
+        BYTE command[MAX_READ_BINARY_COMMAND];
+        DWORD command_len = read_binary_command(stream->offset, read_binary_le(stream), command);
+        obj->record(baton, SESSION_TRANSMIT, tr->result, stream->card_protocol, command, command_len,
+                    tr->data, tr->result ? 0 : tr->len);
+    }
+
+    if (stream->destroyed) {
+        obj->erase_stream(stream);
+        delete [] tr->data;
+        delete tr;
+        release_baton(baton);
+        return;
+    }
+
+    std::vector<napi_value> argv;
+    Napi::Value chunk;
+    uint16_t sw = (tr->len >= 2) ? (tr->data[tr->len - 2] << 8) | tr->data[tr->len - 1] : 0;
+
+    if (tr->result) {
+        argv.push_back(scard_error(env, baton, "SCardTransmit", tr->result));
+    } else if (sw == 0x9000 || sw == 0x6282) {
+        DWORD requested = read_binary_le(stream);
+        DWORD data_offset, data_len;
+        read_binary_data(stream->offset, tr->data, tr->len - 2, &data_offset, &data_len);
+
+        if (data_len > 0) {
+            chunk = Napi::Buffer<uint8_t>::NewOrCopy(env, tr->data + data_offset, data_len,
+                                                     [](Napi::Env, uint8_t*, BYTE* data) {
+                                                         delete [] data;
+                                                     }, tr->data);
+            tr->data = NULL;
+        }
+
+        /*
+         * End of file reached before reading Le bytes: 6282, or a short
+         * response, less the header of the 53 DO of B1. The stream also ends
+         * before going past the offsets B1 can address.
+         */
+        bool short_response = data_len < read_binary_room(stream->offset, requested);
+        stream->offset += data_len;
+        stream->done = sw == 0x6282 || short_response || stream->offset == stream->end ||
+                       stream->offset > MAX_EF_OFFSET;
+    } else if (sw == 0x6B00 && !stream->end) {
+        /* Offset past the end: the previous chunk ended the file */
+        stream->done = true;
+    } else {
+        char msg[64];
+        snprintf(msg, sizeof(msg), "READ BINARY error: SW %.4X", sw);
+        Napi::Object err = Napi::Error::New(env, msg).Value();
+        err.Set("sw", Napi::Number::New(env, sw));
+        argv.push_back(err);
+    }
+
+    delete [] tr->data;
+    delete tr;
+
+    /* Read the next chunk while JS consumes this one */
+    if (argv.empty() && !stream->done && !stream->paused) {
+        obj->queue_read_binary(env, stream);
+    }
+
+    stream->delivering = true;
+    if (!argv.empty()) {
+        stream->done = true;
+        stream->callback.Call(argv);
+    } else {
+        if (!chunk.IsEmpty()) {
+            Napi::Value more = stream->callback.Call({ env.Null(), chunk });
+            if (!stream->done && more.IsBoolean() && !more.As<Napi::Boolean>().Value()) {
+                stream->paused = true;
+            }
+        }
+
+        if (stream->done && !stream->destroyed) {
+            stream->callback.Call({ env.Null(), env.Null() });
+        }
+    }
+
+    stream->delivering = false;
+
+    if ((stream->done || stream->destroyed) && !stream->reading) {
+        obj->erase_stream(stream);
+    }
+
+    release_baton(baton);
 }
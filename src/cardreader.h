@@ -4,25 +4,46 @@
 #include <napi.h>
 #include <uv.h>
 #include <node_version.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <set>
 #include <string>
+#include <vector>
 #ifdef __APPLE__
 #include <PCSC/winscard.h>
 #include <PCSC/wintypes.h>
 #else
 #include <winscard.h>
 #endif
+#include "pcsclite.h"
+#include "executor.h"
+#include "contextregistry.h"
+#include "stats.h"
+#include "session.h"
+#include "responsecache.h"
+#include "securechannel.h"
+#include "apduscript.h"
+#include "pool.h"
 
-#ifdef _WIN32
-#define MAX_ATR_SIZE 33
-#endif
 #ifdef WIN32
 #define IOCTL_CCID_ESCAPE (0x42000000 + 3500)
 #else
 #define IOCTL_CCID_ESCAPE (0x42000000 + 1)
 #endif
 
+// Responses allocated bigger than this are copied when mostly unused
+#define RESPONSE_COPY_THRESHOLD 4096
+
 class CardReader: public Napi::ObjectWrap<CardReader> {
 
+    // The batches of a transmitMany(), reported together
+    struct TransmitManyGroup {
+        size_t pending;
+        Napi::ObjectReference results;      // Array, an Error or a result per reader
+        Napi::FunctionReference callback;
+    };
+
     // We use a struct to store information about the asynchronous "work request".
     struct Baton {
         uv_work_t request;
@@ -31,6 +52,25 @@ class CardReader: public Napi::ObjectWrap<CardReader> {
         void *input;
         void *result;
         napi_env env;
+        // Named by the errors of cancel_baton(), NULL for the requests which can't fail early
+        const char *method = NULL;
+        bool settled = false;               // JS thread only
+        // Promise based requests only
+        Napi::Promise::Deferred *deferred = NULL;
+        uint32_t id = 0;
+        uint64_t deadline = 0;              // uv_hrtime(), 0 when none
+        uv_timer_t *timer = NULL;
+        std::atomic<bool> cancelled{false};
+        std::atomic<bool> running{false};
+        // Protocol of the handle when it was reconnected after a reset, or 0
+        DWORD reconnected_protocol = 0;
+        // Timestamps and exchanges, recorded in the reader stats
+        RequestTrace trace;
+        uv_work_cb work_cb = NULL;
+        uv_after_work_cb after_work_cb = NULL;
+        // Batch of a transmitMany(), settled into its group
+        TransmitManyGroup *group = NULL;
+        uint32_t group_index = 0;
     };
 
     struct ConnectInput {
@@ -43,17 +83,97 @@ class CardReader: public Napi::ObjectWrap<CardReader> {
         DWORD card_protocol;
     };
 
+    struct DisconnectInput {
+        DWORD disposition;
+    };
+
+    // What a reader gone leaves to its lane's thread, see ~CardReader()
+    struct ReleaseJob {
+        uv_work_t request;
+        SCARDHANDLE card_handle;
+        SCARDCONTEXT card_context;
+        // Alive until the job is done
+        std::shared_ptr<Executor> executor;
+    };
+
+    struct ReconnectInput {
+        bool same_share_mode;               // the one of the last connection
+        DWORD share_mode;
+        bool same_protocol;
+        DWORD pref_protocol;
+        DWORD initialization;
+    };
+
     struct TransmitInput {
         DWORD card_protocol;
         LPBYTE in_data;
         DWORD in_len;
+        LPBYTE out_data;                    // caller's Buffer, or NULL
         DWORD out_len;
+        bool chaining;                      // see transmit_chained()
+        bool cache;                         // see ResponseCache
+        uint64_t cache_generation;
+        bool tlv;                           // index the response, see tlv_index()
+        Napi::ObjectReference in_ref;
+        Napi::ObjectReference out_ref;
     };
 
     struct TransmitResult {
         LONG result;
         LPBYTE data;
         DWORD len;
+        std::vector<uint32_t> tlv;
+        bool tlv_valid;
+    };
+
+    struct TransmitBatchInput {
+        DWORD card_protocol;
+        std::vector<BYTE> in_data;          // all the commands, back to back
+        std::vector<DWORD> in_lens;
+        DWORD out_len;                      // max. length of each response
+        std::vector<uint16_t> expected_sw;  // stop at the first other SW, if any
+        bool transaction;                   // run inside SCardBeginTransaction()
+    };
+
+    struct TransmitBatchResult {
+        LONG result;
+        const char *method;                 // SCard function which failed
+        std::vector<BYTE> data;             // all the responses, back to back
+        std::vector<uint32_t> offsets;      // one more than the responses
+        bool stopped;
+    };
+
+    struct ScriptInput {
+        DWORD card_protocol;
+        DWORD out_len;                      // max. length of each response
+        bool transaction;                   // run inside SCardBeginTransaction()
+        bool record;                        // the session is being recorded, see record()
+        std::unique_ptr<ApduScript> script; // with its results once run
+    };
+
+    struct ScriptResult {
+        LONG result;
+        const char *method;                 // SCard function which failed
+    };
+
+    struct TransactionInput {
+        bool begin;
+        DWORD disposition;                  // SCardEndTransaction() only
+    };
+
+    // State of a READ BINARY stream, kept across its chunks
+    struct ReadBinaryStream {
+        uint32_t id;
+        DWORD card_protocol;
+        DWORD offset;                       // of the next chunk
+        DWORD end;                          // 0 to read up to the end of the file
+        DWORD chunk_size;
+        bool reading;                       // a chunk is in flight
+        bool paused;                        // the consumer is full
+        bool delivering;                    // calling back into JS
+        bool done;
+        bool destroyed;
+        Napi::FunctionReference callback;
     };
 
     struct ControlInput {
@@ -62,6 +182,8 @@ class CardReader: public Napi::ObjectWrap<CardReader> {
         DWORD in_len;
         LPVOID out_data;
         DWORD out_len;
+        Napi::ObjectReference in_ref;
+        Napi::ObjectReference out_ref;
     };
 
     struct ControlResult {
@@ -69,22 +191,6 @@ class CardReader: public Napi::ObjectWrap<CardReader> {
         DWORD len;
     };
 
-    struct AsyncResult {
-        LONG result;
-        DWORD status;
-        BYTE atr[MAX_ATR_SIZE];
-        DWORD atrlen;
-        bool do_exit;
-    };
-
-    struct AsyncBaton {
-        uv_async_t async;
-        Napi::FunctionReference callback;
-        CardReader *reader;
-        AsyncResult *async_result;
-        napi_env env;
-    };
-
     public:
 
         static Napi::Object Init(Napi::Env env, Napi::Object exports);
@@ -92,39 +198,174 @@ class CardReader: public Napi::ObjectWrap<CardReader> {
         ~CardReader();
 
         const SCARDHANDLE& GetHandler() const { return m_card_handle; };
+        const std::string& GetName() const { return m_name; };
+
+        // Called by the PCSCLite monitor on the JS thread.
+        void EmitStatus(Napi::Env env, DWORD status, const BYTE* atr, DWORD atrlen,
+                        uint64_t seq, uint64_t timestamp);
+        void EmitEnd(Napi::Env env);
+        void DetachMonitor() { m_pcsclite = NULL; };
+
+        const IoStats& GetIoStats() const { return m_stats; };
+        void ResetIoStats() { m_stats.Reset(); };
 
     private:
 
         Napi::Value GetStatus(const Napi::CallbackInfo& info);
         Napi::Value Connect(const Napi::CallbackInfo& info);
+        Napi::Value Reconnect(const Napi::CallbackInfo& info);
         Napi::Value Disconnect(const Napi::CallbackInfo& info);
         Napi::Value Transmit(const Napi::CallbackInfo& info);
+        Napi::Value TransmitBatch(const Napi::CallbackInfo& info);
+        Napi::Value RunScript(const Napi::CallbackInfo& info);
         Napi::Value Control(const Napi::CallbackInfo& info);
+        Napi::Value BeginTransaction(const Napi::CallbackInfo& info);
+        Napi::Value EndTransaction(const Napi::CallbackInfo& info);
+        Napi::Value ReadBinary(const Napi::CallbackInfo& info);
+        Napi::Value ReadBinaryResume(const Napi::CallbackInfo& info);
+        Napi::Value ReadBinaryDestroy(const Napi::CallbackInfo& info);
+        Napi::Value ConnectAsync(const Napi::CallbackInfo& info);
+        Napi::Value TransmitAsync(const Napi::CallbackInfo& info);
+        Napi::Value ControlAsync(const Napi::CallbackInfo& info);
+        Napi::Value Cancel(const Napi::CallbackInfo& info);
         Napi::Value Close(const Napi::CallbackInfo& info);
+        Napi::Value GetStats(const Napi::CallbackInfo& info);
+        Napi::Value ResetStats(const Napi::CallbackInfo& info);
+        Napi::Value ClearCache(const Napi::CallbackInfo& info);
+        Napi::Value StartRecording(const Napi::CallbackInfo& info);
+        Napi::Value StopRecording(const Napi::CallbackInfo& info);
+        Napi::Value Replay(const Napi::CallbackInfo& info);
+        static Napi::Value ReplayReader(const Napi::CallbackInfo& info);
+        static Napi::Value TransmitMany(const Napi::CallbackInfo& info);
+        Napi::Value SetSecureChannel(const Napi::CallbackInfo& info);
+        static Napi::Value IndexTlv(const Napi::CallbackInfo& info);
+
+        static TransmitBatchInput* batch_input(Napi::Env env, Napi::Array apdus, DWORD out_len,
+                                               Napi::Value expected_sw, bool transaction, const char* type_error);
+        static Napi::Value tlv_array(Napi::Env env, const std::vector<uint32_t>& index, bool valid);
+        static Napi::Value response_buffer(Napi::Env env, LPBYTE data, DWORD len, DWORD capacity);
+        TransmitResult* transmit_result(TransmitInput* ti);
+        Napi::Value cached_response(Napi::Env env, DWORD protocol, Napi::Buffer<uint8_t> command, Napi::Value output);
+        // Counts a response from the cache in the stats, and records it to the session log
+        void record_cached(DWORD protocol, Napi::Buffer<uint8_t> command, const std::string& response);
+        void queue_work(Baton* baton, uv_work_cb work_cb, uv_after_work_cb after_work_cb);
+        Baton* new_async_baton(const Napi::CallbackInfo& info, size_t index, const char* method);
+        void cancel_baton(Baton* baton, LONG reason);
+        void queue_read_binary(Napi::Env env, ReadBinaryStream* stream);
+        void erase_stream(ReadBinaryStream* stream);
+
+        static LONG check_deadline(Baton* baton);
+        static void recover_reset(Baton* baton, LONG result);
+        static Napi::Object scard_error(Napi::Env env, Baton* baton, const char* method, LONG result);
+        static void settle(Baton* baton, const std::vector<napi_value>& argv);
+        static void settle_group(TransmitManyGroup* group, Napi::Env env, uint32_t index, Napi::Value result);
+        static void release_baton(Baton* baton);
+        static void DeadlineCallback(uv_timer_t* timer);
+        static void UnavailableCallback(uv_timer_t* timer);
+        static void lock_reader(Baton* baton);
+        static void unlock_reader(Baton* baton);
+        static DWORD read_binary_le(const ReadBinaryStream* stream);
+
+        // SCard calls of the requests, answered from the session log when replaying
+        static LONG scard_connect(CardReader* obj, DWORD share_mode, DWORD pref_protocol, DWORD* card_protocol);
+        static LONG scard_reconnect(CardReader* obj, DWORD share_mode, DWORD pref_protocol,
+                                    DWORD initialization, DWORD* card_protocol);
+        static LONG scard_disconnect(CardReader* obj, DWORD disposition);
+        static LONG scard_transmit(CardReader* obj, const SCARD_IO_REQUEST* send_pci, const BYTE* in_data,
+                                   DWORD in_len, BYTE* out_data, DWORD* out_len, bool chaining);
+        static LONG scard_control(CardReader* obj, DWORD control_code, LPCVOID in_data, DWORD in_len,
+                                  LPVOID out_data, DWORD out_len, DWORD* len);
+        static LONG scard_transaction(CardReader* obj, bool begin, DWORD disposition);
+        static LONG secure_transmit(CardReader* obj, const SCARD_IO_REQUEST* send_pci, const BYTE* in_data,
+                                    DWORD in_len, BYTE* out_data, DWORD* out_len, bool chaining);
+
+        void record(Baton* baton, uint8_t type, LONG result, uint32_t arg, const BYTE* in_data, size_t in_len,
+                    const BYTE* out_data, size_t out_len);
+        void schedule_replay_status();
+        void stop_replay_status();
+        static void ReplayStatusCallback(uv_timer_t* timer);
+        static void EnvCleanup(void* arg);
+
+        static void DoWork(uv_work_t* req);
+        static void AfterWork(uv_work_t* req, int status);
 
-        static void HandleReaderStatusChange(uv_async_t *handle);
-        static void HandlerFunction(void* arg);
         static void DoConnect(uv_work_t* req);
+        static void DoReconnect(uv_work_t* req);
         static void DoDisconnect(uv_work_t* req);
         static void DoTransmit(uv_work_t* req);
+        static void DoTransmitBatch(uv_work_t* req);
+        static void DoRunScript(uv_work_t* req);
         static void DoControl(uv_work_t* req);
-        static void CloseCallback(uv_handle_t *handle);
+        static void DoTransaction(uv_work_t* req);
+        static void DoReadBinary(uv_work_t* req);
+        static void DoSecureChannel(uv_work_t* req);
+        static void DoRelease(uv_work_t* req);
 
         static void AfterConnect(uv_work_t* req, int status);
+        static void AfterReconnect(uv_work_t* req, int status);
         static void AfterDisconnect(uv_work_t* req, int status);
         static void AfterTransmit(uv_work_t* req, int status);
+        static void AfterTransmitBatch(uv_work_t* req, int status);
+        static void AfterRunScript(uv_work_t* req, int status);
         static void AfterControl(uv_work_t* req, int status);
+        static void AfterTransaction(uv_work_t* req, int status);
+        static void AfterReadBinary(uv_work_t* req, int status);
+        static void AfterSecureChannel(uv_work_t* req, int status);
+        static void AfterRelease(uv_work_t* req, int status);
 
     private:
 
         SCARDCONTEXT m_card_context;
-        SCARDCONTEXT m_status_card_context;
         SCARDHANDLE m_card_handle;
+        // Parameters of the last (re)connection, for the recovery of a reset
+        DWORD m_share_mode;
+        DWORD m_pref_protocol;
         std::string m_name;
-        uv_thread_t m_status_thread;
         uv_mutex_t m_mutex;
-        uv_cond_t m_cond;
-        int m_state;
+        // The PCSCLite instance whose monitor thread reports our status
+        PCSCLite *m_pcsclite;
+        Napi::FunctionReference m_status_callback;
+        // Promise based requests which can still be cancelled, by id
+        std::map<uint32_t, Baton*> m_pending;
+        // READ BINARY streams, by id
+        std::map<uint32_t, ReadBinaryStream*> m_streams;
+        // Runs the SCard calls of this reader, started with the first one
+        std::shared_ptr<Executor> m_executor;
+        // Lane of the executor: the thread running all our requests, in order, whose I/O context we share
+        unsigned int m_lane;
+        // Requests done, JS thread only
+        IoStats m_stats;
+        // Requests queued and not completed yet, JS thread only
+        std::set<Baton*> m_queued;
+        // Request given up while blocked in PC/SC, until its worker returns: the reader is unusable
+        // meanwhile, the requests queued behind it fail right away. JS thread only
+        Baton* m_hung;
+        // See EnvCleanup()
+        bool m_cleanup_hook;
+        // Responses of the cacheable commands, JS thread only
+        ResponseCache m_cache;
+        // Session log being written, JS thread only
+        SessionRecorder* m_recorder;
+        // Session log played back instead of talking to the reader
+        SessionReplay* m_replay;
+        uv_timer_t* m_replay_timer;
+        size_t m_replay_status;             // next status change due
+        uint64_t m_replay_start;
+        uint64_t m_replay_seq;
+        // SCP03 session wrapping the transmissions, under m_mutex
+        std::unique_ptr<SecureChannel> m_secure_channel;
+        // Request objects and response buffers reused from one request to the next, JS thread only
+        ObjectPool<Baton> m_batons;
+        ObjectPool<ConnectInput> m_connect_inputs;
+        ObjectPool<ConnectResult> m_connect_results;
+        ObjectPool<DisconnectInput> m_disconnect_inputs;
+        ObjectPool<TransmitInput> m_transmit_inputs;
+        ObjectPool<TransmitResult> m_transmit_results;
+        ObjectPool<ControlInput> m_control_inputs;
+        ObjectPool<ControlResult> m_control_results;
+        // The one of the environment, our own use of it counted in m_buffer_counters
+        std::shared_ptr<BufferPool> m_buffers;
+        PoolCounters m_buffer_counters;
 };
 
 #endif /* CARDREADER_H */
@@ -55,6 +55,17 @@ namespace {
 
         return msg;
     }
+
+    /*
+     * JS callbacks invoked straight from a libuv handle have no JS caller to
+     * propagate an exception to, so report it as an uncaught one instead of
+     * leaving it pending for the next callback.
+     */
+    inline void report_pending_exception(Napi::Env env) {
+        if (env.IsExceptionPending()) {
+            napi_fatal_exception(env, env.GetAndClearPendingException().Value());
+        }
+    }
 }
 
 #endif /* COMMON_H */
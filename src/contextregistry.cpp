@@ -0,0 +1,112 @@
+#include "contextregistry.h"
+#include <cassert>
+#include <map>
+#include <thread>
+#include <tuple>
+
+namespace {
+
+    struct Key {
+        int kind;
+        const void* owner;
+        // Of the thread using an I/O context, a default one for status contexts
+        std::thread::id thread;
+
+        bool operator<(const Key& other) const {
+            return std::tie(kind, owner, thread) < std::tie(other.kind, other.owner, other.thread);
+        }
+    };
+
+    struct Entry {
+        SCARDCONTEXT context;
+        unsigned int refs;
+    };
+
+    struct Registry {
+        Registry() {
+            assert(uv_mutex_init(&mutex) == 0);
+        }
+
+        uv_mutex_t mutex;
+        std::map<Key, Entry> entries;
+        std::map<SCARDCONTEXT, Key> keys;
+    };
+
+    Registry& registry() {
+        // Never destroyed: contexts may still be released during exit
+        static Registry* registry = new Registry();
+        return *registry;
+    }
+}
+
+LONG ContextRegistry::Acquire(ContextKind kind, const void* owner, SCARDCONTEXT* context) {
+    Registry& r = registry();
+    Key key = { kind, NULL, std::thread::id() };
+    if (kind == CONTEXT_IO) {
+        key.thread = std::this_thread::get_id();
+    } else {
+        key.owner = owner;
+    }
+
+    LONG result = SCARD_S_SUCCESS;
+
+    uv_mutex_lock(&r.mutex);
+    std::map<Key, Entry>::iterator it = r.entries.find(key);
+    if (it != r.entries.end()) {
+        it->second.refs++;
+        *context = it->second.context;
+    } else {
+        // TODO: make dwScope (now hard-coded to SCARD_SCOPE_SYSTEM) customisable
+        result = SCardEstablishContext(SCARD_SCOPE_SYSTEM, NULL, NULL, context);
+        if (result == SCARD_S_SUCCESS) {
+            Entry entry = { *context, 1 };
+            r.entries[key] = entry;
+            r.keys[*context] = key;
+        }
+    }
+
+    uv_mutex_unlock(&r.mutex);
+
+    return result;
+}
+
+void ContextRegistry::Release(SCARDCONTEXT context) {
+    Registry& r = registry();
+    bool last = false;
+
+    uv_mutex_lock(&r.mutex);
+    std::map<SCARDCONTEXT, Key>::iterator it = r.keys.find(context);
+    if (it != r.keys.end()) {
+        std::map<Key, Entry>::iterator entry = r.entries.find(it->second);
+        if (--entry->second.refs == 0) {
+            r.entries.erase(entry);
+            r.keys.erase(it);
+            last = true;
+        }
+    }
+
+    uv_mutex_unlock(&r.mutex);
+
+    if (last) {
+        SCardReleaseContext(context);
+    }
+}
+
+bool ContextRegistry::Cancel(SCARDCONTEXT context) {
+    Registry& r = registry();
+    bool cancel = false;
+
+    /* Under the lock, so that no other user can show up meanwhile */
+    uv_mutex_lock(&r.mutex);
+    std::map<SCARDCONTEXT, Key>::iterator it = r.keys.find(context);
+    if (it != r.keys.end()) {
+        cancel = r.entries[it->second].refs == 1;
+        if (cancel) {
+            SCardCancel(context);
+        }
+    }
+
+    uv_mutex_unlock(&r.mutex);
+
+    return cancel;
+}
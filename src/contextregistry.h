@@ -0,0 +1,44 @@
+#ifndef CONTEXTREGISTRY_H
+#define CONTEXTREGISTRY_H
+
+#include <uv.h>
+#ifdef __APPLE__
+#include <PCSC/winscard.h>
+#include <PCSC/wintypes.h>
+#else
+#include <winscard.h>
+#endif
+
+/*
+ * Process wide registry of reference-counted PC/SC contexts, so that every
+ * reader does not pay for a context (a pcscd client session) of its own.
+ *
+ * I/O contexts are handed out per thread: the readers on the same lane of an
+ * executor (see Executor) share the context of its thread, which only ever
+ * makes one call at a time. A reader with an executor of its own, the default
+ * without ioThreads, has a thread and so a context of its own. Status contexts
+ * block in SCardGetStatusChange(), which holds the context, so each monitor
+ * thread (owner) has its own.
+ *
+ * Acquire() and Release() may be called from any thread.
+ */
+class ContextRegistry {
+
+    public:
+
+        enum ContextKind {
+            CONTEXT_IO,
+            CONTEXT_STATUS
+        };
+
+        // Returns the I/O context of the calling thread, or the status context of owner,
+        // established on first use.
+        static LONG Acquire(ContextKind kind, const void* owner, SCARDCONTEXT* context);
+        // Drops a reference, the last one releases the context.
+        static void Release(SCARDCONTEXT context);
+        // SCardCancel() on a context with a single user, false when shared: it would also abort
+        // the calls of the other users.
+        static bool Cancel(SCARDCONTEXT context);
+};
+
+#endif /* CONTEXTREGISTRY_H */
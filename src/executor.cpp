@@ -0,0 +1,101 @@
+#include "executor.h"
+#include <cassert>
+
+Executor::Executor(Napi::Env env, unsigned int threads)
+    : m_env(env),
+      m_stopping(false),
+      m_pending(0),
+      m_next_lane(0) {
+
+    assert(uv_mutex_init(&m_mutex) == 0);
+
+    m_completion = Completion::New(env, "pcsclite:io", 0, 1, this);
+    // Only keep the loop alive while there is work in flight
+    m_completion.Unref(env);
+
+    m_lanes.resize(threads > 0 ? threads : 1);
+    for (Lane*& lane : m_lanes) {
+        lane = new Lane();
+        lane->executor = this;
+        assert(uv_cond_init(&lane->cond) == 0);
+        int ret = uv_thread_create(&lane->thread, WorkerFunction, lane);
+        assert(ret == 0);
+    }
+}
+
+Executor::~Executor() {
+    uv_mutex_lock(&m_mutex);
+    m_stopping = true;
+    for (Lane* lane : m_lanes) {
+        uv_cond_signal(&lane->cond);
+    }
+    uv_mutex_unlock(&m_mutex);
+
+    for (Lane* lane : m_lanes) {
+        assert(uv_thread_join(&lane->thread) == 0);
+        uv_cond_destroy(&lane->cond);
+        delete lane;
+    }
+
+    m_completion.Release();
+
+    uv_mutex_destroy(&m_mutex);
+}
+
+void Executor::Queue(unsigned int lane, uv_work_t* req, uv_work_cb work_cb, uv_after_work_cb after_work_cb) {
+    Job* job = new Job();
+    job->req = req;
+    job->work_cb = work_cb;
+    job->after_work_cb = after_work_cb;
+
+    if (m_pending++ == 0) {
+        m_completion.Ref(m_env);
+    }
+
+    Lane* target = m_lanes[lane % m_lanes.size()];
+    uv_mutex_lock(&m_mutex);
+    target->jobs.push_back(job);
+    uv_cond_signal(&target->cond);
+    uv_mutex_unlock(&m_mutex);
+}
+
+void Executor::WorkerFunction(void* arg) {
+    Lane* lane = static_cast<Lane*>(arg);
+    Executor* executor = lane->executor;
+
+    while (true) {
+        uv_mutex_lock(&executor->m_mutex);
+        while (!executor->m_stopping && lane->jobs.empty()) {
+            uv_cond_wait(&lane->cond, &executor->m_mutex);
+        }
+
+        /* Queued jobs are still run when stopping */
+        if (lane->jobs.empty()) {
+            uv_mutex_unlock(&executor->m_mutex);
+            break;
+        }
+
+        Job* job = lane->jobs.front();
+        lane->jobs.pop_front();
+        uv_mutex_unlock(&executor->m_mutex);
+
+        job->work_cb(job->req);
+        executor->m_completion.NonBlockingCall(job);
+    }
+}
+
+void Executor::CallJs(Napi::Env env, Napi::Function callback, Executor* executor, Job* job) {
+    if (env == NULL) {
+        // The environment is being torn down, nobody is left to call back
+        delete job;
+        return;
+    }
+
+    /* Done with the executor before after_work_cb, which may release it */
+    if (--executor->m_pending == 0) {
+        executor->m_completion.Unref(env);
+    }
+
+    job->after_work_cb(job->req, 0);
+    delete job;
+}
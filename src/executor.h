@@ -0,0 +1,66 @@
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include <napi.h>
+#include <uv.h>
+#include <deque>
+#include <vector>
+
+/*
+ * Runs reader I/O on threads of its own instead of the libuv threadpool, so
+ * that SCard calls blocking for a slow card never hold up fs, dns or zlib work.
+ *
+ * Queue() mirrors uv_queue_work(): work_cb runs on the thread of a lane and
+ * after_work_cb is called back on the JS thread, through a thread-safe
+ * function. Each lane has a thread and a FIFO queue of its own, so the jobs
+ * queued on one lane run one at a time, in the order they were given, however
+ * many threads the executor has.
+ */
+class Executor {
+
+    struct Job {
+        uv_work_t* req;
+        uv_work_cb work_cb;
+        uv_after_work_cb after_work_cb;
+    };
+
+    struct Lane {
+        Executor* executor;
+        uv_thread_t thread;
+        uv_cond_t cond;
+        std::deque<Job*> jobs;
+    };
+
+    static void CallJs(Napi::Env env, Napi::Function callback, Executor* executor, Job* job);
+
+    typedef Napi::TypedThreadSafeFunction<Executor, Job, CallJs> Completion;
+
+    public:
+
+        Executor(Napi::Env env, unsigned int threads);
+        ~Executor();
+
+        // Runs work_cb on the thread of a lane from NextLane(). May only be called from the JS thread.
+        void Queue(unsigned int lane, uv_work_t* req, uv_work_cb work_cb, uv_after_work_cb after_work_cb);
+
+        // Spreads its users over the lanes, JS thread only.
+        unsigned int NextLane() { return m_next_lane++ % m_lanes.size(); };
+
+    private:
+
+        static void WorkerFunction(void* arg);
+
+    private:
+
+        napi_env m_env;
+        Completion m_completion;
+        std::vector<Lane*> m_lanes;
+        // Guards the queues of all the lanes, and m_stopping
+        uv_mutex_t m_mutex;
+        bool m_stopping;
+        // Jobs whose after_work_cb has not run yet, owned by the JS thread
+        size_t m_pending;
+        unsigned int m_next_lane;
+};
+
+#endif /* EXECUTOR_H */
@@ -0,0 +1,2 @@
+/* macOS spelling of the include, see ../winscard.h */
+#include "../winscard.h"
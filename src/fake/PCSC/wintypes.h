@@ -0,0 +1,2 @@
+/* The types come with ../winscard.h */
+#include "../winscard.h"
@@ -0,0 +1,92 @@
+#include "testing.h"
+#include "../aes.h"
+
+namespace {
+
+    // Whether info[index] is a Buffer with a valid AES key
+    bool key_arg(const Napi::CallbackInfo& info, size_t index) {
+        if (!info[index].IsBuffer() || !Aes::ValidKeyLength(info[index].As<Napi::Buffer<uint8_t>>().Length())) {
+            Napi::TypeError::New(info.Env(), "Key of 16, 24 or 32 bytes required").ThrowAsJavaScriptException();
+            return false;
+        }
+
+        return true;
+    }
+
+    // Whether info[index] is a Buffer of whole blocks, exactly one if single
+    bool blocks_arg(const Napi::CallbackInfo& info, size_t index, bool single) {
+        size_t len = info[index].IsBuffer() ? info[index].As<Napi::Buffer<uint8_t>>().Length() : 1;
+        if (single ? len != AES_BLOCK_SIZE : len % AES_BLOCK_SIZE != 0) {
+            Napi::TypeError::New(info.Env(), "Buffer of whole blocks required").ThrowAsJavaScriptException();
+            return false;
+        }
+
+        return true;
+    }
+
+    Napi::Value AesBlock(const Napi::CallbackInfo& info) {
+        if (!key_arg(info, 0) || !blocks_arg(info, 1, true)) {
+            return info.Env().Undefined();
+        }
+
+        Napi::Buffer<uint8_t> key = info[0].As<Napi::Buffer<uint8_t>>();
+        Napi::Buffer<uint8_t> in = info[1].As<Napi::Buffer<uint8_t>>();
+        Napi::Buffer<uint8_t> out = Napi::Buffer<uint8_t>::New(info.Env(), AES_BLOCK_SIZE);
+
+        Aes aes(key.Data(), key.Length());
+        if (info[2].ToBoolean()) {
+            aes.Decrypt(in.Data(), out.Data());
+        } else {
+            aes.Encrypt(in.Data(), out.Data());
+        }
+
+        return out;
+    }
+
+    Napi::Value AesCbc(const Napi::CallbackInfo& info) {
+        if (!key_arg(info, 0) || !blocks_arg(info, 1, true) || !blocks_arg(info, 2, false)) {
+            return info.Env().Undefined();
+        }
+
+        Napi::Buffer<uint8_t> key = info[0].As<Napi::Buffer<uint8_t>>();
+        Napi::Buffer<uint8_t> iv = info[1].As<Napi::Buffer<uint8_t>>();
+        Napi::Buffer<uint8_t> in = info[2].As<Napi::Buffer<uint8_t>>();
+        Napi::Buffer<uint8_t> out = Napi::Buffer<uint8_t>::New(info.Env(), in.Length());
+
+        Aes aes(key.Data(), key.Length());
+        if (info[3].ToBoolean()) {
+            aes.CbcDecrypt(iv.Data(), in.Data(), out.Data(), in.Length());
+        } else {
+            aes.CbcEncrypt(iv.Data(), in.Data(), out.Data(), in.Length());
+        }
+
+        return out;
+    }
+
+    Napi::Value Cmac(const Napi::CallbackInfo& info) {
+        if (!key_arg(info, 0)) {
+            return info.Env().Undefined();
+        }
+
+        if (!info[1].IsBuffer()) {
+            Napi::TypeError::New(info.Env(), "Data must be a Buffer").ThrowAsJavaScriptException();
+            return info.Env().Undefined();
+        }
+
+        Napi::Buffer<uint8_t> key = info[0].As<Napi::Buffer<uint8_t>>();
+        Napi::Buffer<uint8_t> data = info[1].As<Napi::Buffer<uint8_t>>();
+        Napi::Buffer<uint8_t> mac = Napi::Buffer<uint8_t>::New(info.Env(), AES_BLOCK_SIZE);
+
+        Aes aes(key.Data(), key.Length());
+        aes.Cmac(data.Data(), data.Length(), mac.Data());
+        return mac;
+    }
+}
+
+void InitTesting(Napi::Env env, Napi::Object exports) {
+    Napi::Object testing = Napi::Object::New(env);
+    testing.Set("aes", Napi::Function::New(env, AesBlock, "aes"));
+    testing.Set("aesCbc", Napi::Function::New(env, AesCbc, "aesCbc"));
+    testing.Set("cmac", Napi::Function::New(env, Cmac, "cmac"));
+    exports.Set("_testing", testing);
+}
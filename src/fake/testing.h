@@ -0,0 +1,18 @@
+#ifndef FAKE_TESTING_H
+#define FAKE_TESTING_H
+
+#include <napi.h>
+
+/*
+ * Internals of the addon exposed to the tests of test/fake, as the _testing
+ * export of the pcsclite_fake target only (built with PCSC_FAKE defined):
+ *
+ *   aes(key, block, decrypt)          one block of AES (FIPS-197)
+ *   aesCbc(key, iv, data, decrypt)    AES-CBC without padding (SP 800-38A)
+ *   cmac(key, data)                   AES-CMAC (SP 800-38B, RFC 4493)
+ *
+ * so that the crypto of the secure channel is checked against known answers.
+ */
+void InitTesting(Napi::Env env, Napi::Object exports);
+
+#endif /* FAKE_TESTING_H */
@@ -0,0 +1,1090 @@
+#include "winscard.h"
+#include "../aes.h"
+#include <uv.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <time.h>
+#include <vector>
+
+/*
+ * Simulated PC/SC service: a farm of readers with a card each, so the addon
+ * can be benchmarked and exercised without pcscd or hardware.
+ *
+ * It is configured once, on first use, from the environment:
+ *
+ *   PCSC_FAKE_READERS      number of readers (1)
+ *   PCSC_FAKE_APDU_US      time spent by the card on every SCardTransmit() and
+ *                          SCardControl(), in microseconds (0)
+ *   PCSC_FAKE_PRESENT_MS   when both are set, every card stays PRESENT_MS in
+ *   PCSC_FAKE_ABSENT_MS    its reader then ABSENT_MS out of it, over and over,
+ *                          the readers staggered over the cycle. Otherwise
+ *                          the cards never leave.
+ *
+ * The card answers READ BINARY from a 48 KiB file whose byte at offset n is
+ * n & 0xFF, past 0x7FFF with the odd instruction (B1): the offset in a 54 DO,
+ * the data in a 53 DO whose header counts in Le. Any other command gets its
+ * own data field followed by 90 00. SCardControl() returns its input. To exercise the transport rules
+ * of ISO 7816-4 it also knows:
+ *
+ *   E0 P1 P2   a response of P1 << 8 | P2 bytes (the n-th being n & 0xFF),
+ *              in parts of up to 256 bytes, the next one announced by 61xx
+ *              and fetched by GET RESPONSE (C0)
+ *   E2 P1 P2   P2 bytes (0 for 256) the same way, but 6C P2 unless that's Le
+ *   E4 P1 P2   the card takes P1 << 8 | P2 ms more to answer, e.g. to stand
+ *              for a card which hangs
+ *
+ * and command chaining: the data of the commands with the CLA bit 0x10 set
+ * is kept, and prepended to the one of the next command.
+ *
+ * Commands with secure messaging go through the card side of SCP03, over
+ * the fixed AES-128 session keys SCP03_S_ENC, SCP03_S_MAC and SCP03_S_RMAC
+ * (as if INITIALIZE UPDATE had derived them): an EXTERNAL AUTHENTICATE (82)
+ * with a good C-MAC opens the session at the level of its P1, whatever the
+ * host cryptogram, and the later commands are checked, decrypted and
+ * answered as the level asks. A bad C-MAC gets 69 82 and ends the session.
+ */
+
+namespace {
+
+    const DWORD FILE_SIZE = 0xC000;
+
+    const BYTE CLA_CHAINING = 0x10;
+    const BYTE INS_GET_RESPONSE = 0xC0;
+    const BYTE INS_LONG_RESPONSE = 0xE0;
+    const BYTE INS_EXACT_LE = 0xE2;
+    const BYTE INS_SLOW = 0xE4;
+    const BYTE INS_EXTERNAL_AUTHENTICATE = 0x82;
+
+    // Session keys of the secure channel
+    const BYTE SCP03_S_ENC[] = { 0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47,
+                                 0x48, 0x49, 0x4A, 0x4B, 0x4C, 0x4D, 0x4E, 0x4F };
+    const BYTE SCP03_S_MAC[] = { 0x50, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57,
+                                 0x58, 0x59, 0x5A, 0x5B, 0x5C, 0x5D, 0x5E, 0x5F };
+    const BYTE SCP03_S_RMAC[] = { 0x60, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67,
+                                  0x68, 0x69, 0x6A, 0x6B, 0x6C, 0x6D, 0x6E, 0x6F };
+    // Security level bits, see SecureChannel
+    const BYTE SCP03_C_DECRYPTION = 0x02;
+    const BYTE SCP03_R_MAC = 0x10;
+    const BYTE SCP03_R_ENCRYPTION = 0x20;
+
+    // Contactless MIFARE Classic 1K, as reported by PC/SC part 3 readers
+    const BYTE CARD_ATR[] = { 0x3B, 0x8F, 0x80, 0x01, 0x80, 0x4F, 0x0C, 0xA0, 0x00, 0x00,
+                              0x03, 0x06, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x6A };
+
+    const char PNP_NOTIFICATION[] = "\\\\?PnP?\\Notification";
+
+    struct Context {
+        bool cancelled;
+    };
+
+    // A connection to the card of a reader
+    struct Card {
+        SCARDCONTEXT context;
+        size_t reader;
+        DWORD share_mode;
+        DWORD protocol;
+        // Event counter of the reader when connected, any change means the card was removed
+        uint64_t events;
+        // Data of the commands chained so far
+        std::vector<BYTE> chain;
+        // Rest of the response to be fetched by GET RESPONSE
+        std::vector<BYTE> pending;
+        // SCP03 session, open from a successful EXTERNAL AUTHENTICATE
+        bool scp03 = false;
+        BYTE level = 0;
+        uint32_t counter = 0;
+        BYTE chaining[AES_BLOCK_SIZE] = { 0 };
+    };
+
+    struct Reader {
+        std::string name;
+        // Where the reader starts in the insert/remove cycle
+        uint64_t offset;
+        size_t cards;
+        bool exclusive;
+        SCARDHANDLE transaction;
+    };
+
+    struct CardState {
+        bool present;
+        uint64_t events;
+        // uv_hrtime() of the next insertion or removal, 0 for never
+        uint64_t next_change;
+    };
+
+    // Never destroyed, the addon may call in while the process exits
+    struct Farm {
+        uv_mutex_t mutex;
+        // Signaled on cancellation and when a transaction or a card is released
+        uv_cond_t cond;
+        uint64_t start;
+        uint64_t present_ns;
+        uint64_t absent_ns;
+        uint64_t apdu_ns;
+        std::vector<Reader> readers;
+        std::map<std::string, size_t> reader_index;
+        // Multi-string returned by SCardListReaders()
+        std::string reader_list;
+        std::map<SCARDCONTEXT, Context> contexts;
+        std::map<SCARDHANDLE, Card> cards;
+        SCARDCONTEXT next_context;
+        SCARDHANDLE next_card;
+    };
+
+    uv_once_t farm_once = UV_ONCE_INIT;
+    Farm* farm = NULL;
+
+    uint64_t env_value(const char* name, uint64_t fallback) {
+        const char* value = getenv(name);
+        if (!value || !*value) {
+            return fallback;
+        }
+
+        return strtoull(value, NULL, 10);
+    }
+
+    void init_farm() {
+        Farm* f = new Farm();
+        uv_mutex_init(&f->mutex);
+        uv_cond_init(&f->cond);
+        f->start = uv_hrtime();
+        f->present_ns = env_value("PCSC_FAKE_PRESENT_MS", 0) * 1000000;
+        f->absent_ns = env_value("PCSC_FAKE_ABSENT_MS", 0) * 1000000;
+        f->apdu_ns = env_value("PCSC_FAKE_APDU_US", 0) * 1000;
+        f->next_context = 0x10000;
+        f->next_card = 0x20000;
+
+        size_t count = env_value("PCSC_FAKE_READERS", 1);
+        uint64_t period = f->present_ns + f->absent_ns;
+        for (size_t i = 0; i < count; i++) {
+            char name[MAX_READERNAME];
+            snprintf(name, sizeof(name), "Fake Reader %02u 00", (unsigned int)i);
+
+            Reader reader;
+            reader.name = name;
+            reader.offset = period * i / count;
+            reader.cards = 0;
+            reader.exclusive = false;
+            reader.transaction = 0;
+            f->readers.push_back(reader);
+            f->reader_index[reader.name] = i;
+
+            f->reader_list.append(reader.name);
+            f->reader_list.push_back('\0');
+        }
+
+        f->reader_list.push_back('\0');
+        farm = f;
+    }
+
+    Farm* get_farm() {
+        uv_once(&farm_once, init_farm);
+        return farm;
+    }
+
+    CardState card_state(const Farm* f, const Reader& reader, uint64_t now) {
+        CardState state = { true, 0, 0 };
+        if (!f->present_ns || !f->absent_ns) {
+            return state;
+        }
+
+        uint64_t period = f->present_ns + f->absent_ns;
+        uint64_t t = now - f->start + reader.offset;
+        uint64_t phase = t % period;
+        state.present = phase < f->present_ns;
+        state.events = 2 * (t / period) + (state.present ? 0 : 1);
+        state.next_change = now + (state.present ? f->present_ns - phase : period - phase);
+        return state;
+    }
+
+    /* Looks up a connection, failing once its card was removed. Farm locked. */
+    LONG find_card(Farm* f, SCARDHANDLE handle, Card** card) {
+        std::map<SCARDHANDLE, Card>::iterator it = f->cards.find(handle);
+        if (it == f->cards.end()) {
+            return SCARD_E_INVALID_HANDLE;
+        }
+
+        *card = &it->second;
+        if (it->second.share_mode == SCARD_SHARE_DIRECT) {
+            return SCARD_S_SUCCESS;
+        }
+
+        CardState state = card_state(f, f->readers[it->second.reader], uv_hrtime());
+        if (!state.present || state.events != it->second.events) {
+            return SCARD_W_REMOVED_CARD;
+        }
+
+        return SCARD_S_SUCCESS;
+    }
+
+    /* Waits for the transaction of another connection to the reader to end. Farm locked. */
+    LONG wait_transaction(Farm* f, SCARDHANDLE handle, Card** card) {
+        for (;;) {
+            LONG result = find_card(f, handle, card);
+            if (result != SCARD_S_SUCCESS) {
+                return result;
+            }
+
+            SCARDHANDLE owner = f->readers[(*card)->reader].transaction;
+            if (!owner || owner == handle) {
+                return SCARD_S_SUCCESS;
+            }
+
+            uv_cond_wait(&f->cond, &f->mutex);
+        }
+    }
+
+    void release_card(Farm* f, std::map<SCARDHANDLE, Card>::iterator it) {
+        Reader& reader = f->readers[it->second.reader];
+        reader.cards--;
+        if (it->second.share_mode == SCARD_SHARE_EXCLUSIVE) {
+            reader.exclusive = false;
+        }
+        if (reader.transaction == it->first) {
+            reader.transaction = 0;
+        }
+
+        f->cards.erase(it);
+        uv_cond_broadcast(&f->cond);
+    }
+
+    void card_sleep(uint64_t ns) {
+        if (!ns) {
+            return;
+        }
+
+        struct timespec ts;
+        ts.tv_sec = ns / 1000000000;
+        ts.tv_nsec = ns % 1000000000;
+        while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {
+        }
+    }
+
+    void status_word(std::vector<BYTE>& response, BYTE sw1, BYTE sw2) {
+        response.push_back(sw1);
+        response.push_back(sw2);
+    }
+
+    /* Up to le bytes of the pending response, followed by 61xx while some are left */
+    void pending_response(Card& card, size_t le, std::vector<BYTE>& response) {
+        size_t count = le < card.pending.size() ? le : card.pending.size();
+        response.insert(response.end(), card.pending.begin(), card.pending.begin() + count);
+        card.pending.erase(card.pending.begin(), card.pending.begin() + count);
+
+        if (card.pending.empty()) {
+            status_word(response, 0x90, 0x00);
+        } else {
+            status_word(response, 0x61, card.pending.size() > 0xFF ? 0x00 : (BYTE)card.pending.size());
+        }
+    }
+
+    // Fields of a command, cases 1 to 4, short or extended
+    struct Apdu {
+        const BYTE* data;
+        size_t lc;
+        // 0 when absent
+        size_t le;
+        bool extended;
+    };
+
+    bool parse_apdu(const BYTE* command, DWORD length, Apdu* apdu) {
+        apdu->data = NULL;
+        apdu->lc = 0;
+        apdu->le = 0;
+        apdu->extended = length >= 7 && command[4] == 0;
+        if (length == 5) {
+            apdu->le = command[4] ? command[4] : 256;
+        } else if (length == 7 && command[4] == 0) {
+            apdu->le = (command[5] << 8) | command[6];
+            apdu->le = apdu->le ? apdu->le : 65536;
+        } else if (length > 7 && command[4] == 0) {
+            apdu->lc = (command[5] << 8) | command[6];
+            apdu->data = command + 7;
+            if (length == 7 + apdu->lc + 2) {
+                apdu->le = (command[length - 2] << 8) | command[length - 1];
+                apdu->le = apdu->le ? apdu->le : 65536;
+            }
+        } else if (length > 5) {
+            apdu->lc = command[4];
+            apdu->data = command + 5;
+            if (length == 5 + apdu->lc + 1) {
+                apdu->le = command[length - 1] ? command[length - 1] : 256;
+            }
+        }
+
+        return length >= 4 && (!apdu->data || apdu->data + apdu->lc <= command + length);
+    }
+
+    void plain_response(Card& card, const BYTE* command, DWORD length, std::vector<BYTE>& response) {
+        Apdu apdu;
+        if (!parse_apdu(command, length, &apdu)) {
+            status_word(response, 0x67, 0x00);
+            return;
+        }
+
+        const BYTE* data = apdu.data;
+        size_t lc = apdu.lc;
+        size_t le = apdu.le;
+
+        BYTE ins = command[1];
+        if (ins != INS_GET_RESPONSE) {
+            card.pending.clear();
+        }
+
+        if (command[0] != 0xFF && (command[0] & CLA_CHAINING)) {
+            if (data) {
+                card.chain.insert(card.chain.end(), data, data + lc);
+            }
+
+            status_word(response, 0x90, 0x00);
+            return;
+        }
+
+        /* The last command of a chain gets the data of all of them */
+        std::vector<BYTE> chained;
+        if (!card.chain.empty()) {
+            chained.swap(card.chain);
+            if (data) {
+                chained.insert(chained.end(), data, data + lc);
+            }
+
+            data = chained.data();
+            lc = chained.size();
+        }
+
+        if (ins == INS_GET_RESPONSE) {
+            if (card.pending.empty()) {
+                status_word(response, 0x6A, 0x86);
+                return;
+            }
+
+            pending_response(card, le ? le : 256, response);
+            return;
+        }
+
+        if (ins == INS_LONG_RESPONSE || ins == INS_EXACT_LE) {
+            size_t count = (command[2] << 8) | command[3];
+            if (ins == INS_EXACT_LE) {
+                count = command[3] ? command[3] : 256;
+            }
+
+            if (ins == INS_EXACT_LE && le != count) {
+                status_word(response, 0x6C, command[3]);
+                return;
+            }
+
+            for (size_t i = 0; i < count; i++) {
+                card.pending.push_back((BYTE)i);
+            }
+
+            pending_response(card, 256, response);
+            return;
+        }
+
+        if (ins == 0xB0) {
+            /* Short EF identifier in P1, offset in P2, otherwise a 15 bits offset */
+            size_t offset = (command[2] & 0x80) ? command[3] : ((command[2] << 8) | command[3]);
+            if (offset >= FILE_SIZE) {
+                status_word(response, 0x6B, 0x00);
+                return;
+            }
+
+            size_t count = le < FILE_SIZE - offset ? le : FILE_SIZE - offset;
+            for (size_t i = 0; i < count; i++) {
+                response.push_back((BYTE)(offset + i));
+            }
+
+            /* 62 82: end of file reached before reading Le bytes */
+            status_word(response, count < le ? 0x62 : 0x90, count < le ? 0x82 : 0x00);
+            return;
+        }
+
+        if (ins == 0xB1) {
+            /* The offset in a 54 DO of 1 to 3 bytes */
+            if (!data || lc < 3 || data[0] != 0x54 || data[1] < 1 || data[1] > 3 || lc != 2u + data[1]) {
+                status_word(response, 0x6B, 0x00);
+                return;
+            }
+
+            size_t offset = 0;
+            for (BYTE i = 0; i < data[1]; i++) {
+                offset = (offset << 8) | data[2 + i];
+            }
+
+            if (offset >= FILE_SIZE) {
+                status_word(response, 0x6B, 0x00);
+                return;
+            }
+
+            if (le < 3) {
+                status_word(response, 0x67, 0x00);
+                return;
+            }
+
+            /* As much data as the 53 DO holds within Le, its header included */
+            size_t room = (le - 2 < 0x80) ? le - 2 : (le - 3 < 0x100) ? le - 3 : le - 4;
+            size_t count = room < FILE_SIZE - offset ? room : FILE_SIZE - offset;
+            response.push_back(0x53);
+            if (count >= 0x100) {
+                response.push_back(0x82);
+                response.push_back((BYTE)(count >> 8));
+            } else if (count >= 0x80) {
+                response.push_back(0x81);
+            }
+
+            response.push_back((BYTE)count);
+            for (size_t i = 0; i < count; i++) {
+                response.push_back((BYTE)(offset + i));
+            }
+
+            status_word(response, count < room ? 0x62 : 0x90, count < room ? 0x82 : 0x00);
+            return;
+        }
+
+        if (data) {
+            response.insert(response.end(), data, data + lc);
+        }
+
+        status_word(response, 0x90, 0x00);
+    }
+
+    bool secure_messaging(BYTE cla) {
+        return cla != 0xFF && ((cla & 0x40) ? (cla & 0x20) : (cla & 0x04));
+    }
+
+    /* ICV of the data of the commands (0x00) or of the responses (0x80) */
+    void scp03_icv(const Card& card, BYTE first, BYTE* icv) {
+        BYTE block[AES_BLOCK_SIZE] = { 0 };
+        block[0] = first;
+        block[12] = (BYTE)(card.counter >> 24);
+        block[13] = (BYTE)(card.counter >> 16);
+        block[14] = (BYTE)(card.counter >> 8);
+        block[15] = (BYTE)card.counter;
+        Aes(SCP03_S_ENC, sizeof(SCP03_S_ENC)).Encrypt(block, icv);
+    }
+
+    /* Card side of SCP03: checks and unprotects a command, answers it, and protects the response */
+    void scp03_response(Card& card, const BYTE* command, DWORD length, std::vector<BYTE>& response) {
+        Apdu apdu;
+        bool authenticate = command[1] == INS_EXTERNAL_AUTHENTICATE;
+        if (!parse_apdu(command, length, &apdu) || apdu.lc < 8 || (!authenticate && !card.scp03)) {
+            card.scp03 = false;
+            status_word(response, 0x69, 0x82);
+            return;
+        }
+
+        /* C-MAC over the chaining value and the command up to its data, the MAC excluded */
+        if (authenticate) {
+            memset(card.chaining, 0, sizeof(card.chaining));
+            card.counter = 0;
+        }
+
+        size_t data_len = apdu.lc - 8;
+        size_t data_offset = apdu.data - command;
+        std::vector<BYTE> input(card.chaining, card.chaining + AES_BLOCK_SIZE);
+        input.insert(input.end(), command, command + data_offset + data_len);
+        BYTE mac[AES_BLOCK_SIZE];
+        Aes(SCP03_S_MAC, sizeof(SCP03_S_MAC)).Cmac(input.data(), input.size(), mac);
+        if (memcmp(mac, apdu.data + data_len, 8)) {
+            card.scp03 = false;
+            status_word(response, 0x69, 0x82);
+            return;
+        }
+
+        memcpy(card.chaining, mac, sizeof(mac));
+        if (authenticate) {
+            card.scp03 = true;
+            card.level = command[2];
+            status_word(response, 0x90, 0x00);
+            return;
+        }
+
+        card.counter++;
+        std::vector<BYTE> data(apdu.data, apdu.data + data_len);
+        if ((card.level & SCP03_C_DECRYPTION) && !data.empty()) {
+            BYTE icv[AES_BLOCK_SIZE];
+            scp03_icv(card, 0x00, icv);
+            size_t end = data.size();
+            if (end % AES_BLOCK_SIZE == 0) {
+                Aes(SCP03_S_ENC, sizeof(SCP03_S_ENC)).CbcDecrypt(icv, data.data(), data.data(), end);
+                while (end > 0 && data[end - 1] == 0x00) {
+                    end--;
+                }
+            }
+
+            if (end == 0 || data[end - 1] != 0x80) {
+                card.scp03 = false;
+                status_word(response, 0x69, 0x82);
+                return;
+            }
+
+            data.resize(end - 1);
+        }
+
+        /* The plain command, Lc and Le as short as they can be */
+        std::vector<BYTE> plain(command, command + 4);
+        plain[0] &= (command[0] & 0x40) ? ~0x20 : ~0x04;
+        bool extended = data.size() > 0xFF || apdu.le > 256;
+        if (!data.empty() && extended) {
+            plain.push_back(0x00);
+            plain.push_back((BYTE)(data.size() >> 8));
+            plain.push_back((BYTE)data.size());
+        } else if (!data.empty()) {
+            plain.push_back((BYTE)data.size());
+        }
+
+        plain.insert(plain.end(), data.begin(), data.end());
+        if (apdu.le && extended) {
+            if (data.empty()) {
+                plain.push_back(0x00);
+            }
+            plain.push_back((BYTE)(apdu.le >> 8));
+            plain.push_back((BYTE)apdu.le);
+        } else if (apdu.le) {
+            plain.push_back((BYTE)apdu.le);
+        }
+
+        std::vector<BYTE> answer;
+        plain_response(card, plain.data(), plain.size(), answer);
+
+        /* Only 9000 and the warnings are protected */
+        BYTE sw1 = answer[answer.size() - 2];
+        BYTE sw2 = answer[answer.size() - 1];
+        if (!(sw1 == 0x90 && sw2 == 0x00) && sw1 != 0x62 && sw1 != 0x63) {
+            response.insert(response.end(), answer.end() - 2, answer.end());
+            return;
+        }
+
+        answer.resize(answer.size() - 2);
+        if ((card.level & SCP03_R_ENCRYPTION) && !answer.empty()) {
+            answer.push_back(0x80);
+            answer.resize((answer.size() + AES_BLOCK_SIZE - 1) / AES_BLOCK_SIZE * AES_BLOCK_SIZE, 0x00);
+            BYTE icv[AES_BLOCK_SIZE];
+            scp03_icv(card, 0x80, icv);
+            Aes(SCP03_S_ENC, sizeof(SCP03_S_ENC)).CbcEncrypt(icv, answer.data(), answer.data(), answer.size());
+        }
+
+        response.insert(response.end(), answer.begin(), answer.end());
+        if (card.level & SCP03_R_MAC) {
+            std::vector<BYTE> rmac_input(card.chaining, card.chaining + AES_BLOCK_SIZE);
+            rmac_input.insert(rmac_input.end(), answer.begin(), answer.end());
+            rmac_input.push_back(sw1);
+            rmac_input.push_back(sw2);
+            BYTE rmac[AES_BLOCK_SIZE];
+            Aes(SCP03_S_RMAC, sizeof(SCP03_S_RMAC)).Cmac(rmac_input.data(), rmac_input.size(), rmac);
+            response.insert(response.end(), rmac, rmac + 8);
+        }
+
+        status_word(response, sw1, sw2);
+    }
+
+    void card_response(Card& card, const BYTE* command, DWORD length, std::vector<BYTE>& response) {
+        if (length >= 4 && secure_messaging(command[0])) {
+            scp03_response(card, command, length, response);
+        } else {
+            plain_response(card, command, length, response);
+        }
+    }
+}
+
+LONG SCardEstablishContext(DWORD dwScope, LPCVOID pvReserved1, LPCVOID pvReserved2, LPSCARDCONTEXT phContext) {
+    if (!phContext) {
+        return SCARD_E_INVALID_PARAMETER;
+    }
+
+    Farm* f = get_farm();
+    uv_mutex_lock(&f->mutex);
+    SCARDCONTEXT context = f->next_context++;
+    f->contexts[context].cancelled = false;
+    uv_mutex_unlock(&f->mutex);
+
+    *phContext = context;
+    return SCARD_S_SUCCESS;
+}
+
+LONG SCardReleaseContext(SCARDCONTEXT hContext) {
+    Farm* f = get_farm();
+    uv_mutex_lock(&f->mutex);
+    if (!f->contexts.erase(hContext)) {
+        uv_mutex_unlock(&f->mutex);
+        return SCARD_E_INVALID_HANDLE;
+    }
+
+    /* Like pcscd, drop the connections left open with the context */
+    std::map<SCARDHANDLE, Card>::iterator it = f->cards.begin();
+    while (it != f->cards.end()) {
+        std::map<SCARDHANDLE, Card>::iterator next = it;
+        ++next;
+        if (it->second.context == hContext) {
+            release_card(f, it);
+        }
+        it = next;
+    }
+
+    uv_cond_broadcast(&f->cond);
+    uv_mutex_unlock(&f->mutex);
+    return SCARD_S_SUCCESS;
+}
+
+LONG SCardIsValidContext(SCARDCONTEXT hContext) {
+    Farm* f = get_farm();
+    uv_mutex_lock(&f->mutex);
+    bool valid = f->contexts.count(hContext) > 0;
+    uv_mutex_unlock(&f->mutex);
+
+    return valid ? SCARD_S_SUCCESS : SCARD_E_INVALID_HANDLE;
+}
+
+LONG SCardConnect(SCARDCONTEXT hContext, LPCSTR szReader, DWORD dwShareMode, DWORD dwPreferredProtocols,
+                  LPSCARDHANDLE phCard, LPDWORD pdwActiveProtocol) {
+    if (!szReader || !phCard || !pdwActiveProtocol) {
+        return SCARD_E_INVALID_PARAMETER;
+    }
+
+    if (dwShareMode != SCARD_SHARE_EXCLUSIVE && dwShareMode != SCARD_SHARE_SHARED &&
+        dwShareMode != SCARD_SHARE_DIRECT) {
+        return SCARD_E_INVALID_VALUE;
+    }
+
+    Farm* f = get_farm();
+    LONG result = SCARD_S_SUCCESS;
+    uv_mutex_lock(&f->mutex);
+
+    std::map<std::string, size_t>::const_iterator index = f->reader_index.find(szReader);
+    if (!f->contexts.count(hContext)) {
+        result = SCARD_E_INVALID_HANDLE;
+    } else if (index == f->reader_index.end()) {
+        result = SCARD_E_UNKNOWN_READER;
+    } else {
+        Reader& reader = f->readers[index->second];
+        CardState state = card_state(f, reader, uv_hrtime());
+        DWORD protocol = 0;
+        if (dwPreferredProtocols & SCARD_PROTOCOL_T1) {
+            protocol = SCARD_PROTOCOL_T1;
+        } else if (dwPreferredProtocols & SCARD_PROTOCOL_T0) {
+            protocol = SCARD_PROTOCOL_T0;
+        } else if (dwPreferredProtocols & SCARD_PROTOCOL_RAW) {
+            protocol = SCARD_PROTOCOL_RAW;
+        }
+
+        if (dwShareMode != SCARD_SHARE_DIRECT && !state.present) {
+            result = SCARD_E_NO_SMARTCARD;
+        } else if (dwShareMode != SCARD_SHARE_DIRECT && !protocol) {
+            result = SCARD_E_PROTO_MISMATCH;
+        } else if (reader.exclusive || (dwShareMode == SCARD_SHARE_EXCLUSIVE && reader.cards)) {
+            result = SCARD_E_SHARING_VIOLATION;
+        } else {
+            Card card;
+            card.context = hContext;
+            card.reader = index->second;
+            card.share_mode = dwShareMode;
+            card.protocol = protocol;
+            card.events = state.events;
+
+            SCARDHANDLE handle = f->next_card++;
+            f->cards[handle] = card;
+            reader.cards++;
+            reader.exclusive = dwShareMode == SCARD_SHARE_EXCLUSIVE;
+
+            *phCard = handle;
+            *pdwActiveProtocol = protocol;
+        }
+    }
+
+    uv_mutex_unlock(&f->mutex);
+    return result;
+}
+
+LONG SCardReconnect(SCARDHANDLE hCard, DWORD dwShareMode, DWORD dwPreferredProtocols, DWORD dwInitialization,
+                    LPDWORD pdwActiveProtocol) {
+    if (!pdwActiveProtocol) {
+        return SCARD_E_INVALID_PARAMETER;
+    }
+
+    Farm* f = get_farm();
+    LONG result = SCARD_S_SUCCESS;
+    uv_mutex_lock(&f->mutex);
+
+    std::map<SCARDHANDLE, Card>::iterator it = f->cards.find(hCard);
+    if (it == f->cards.end()) {
+        result = SCARD_E_INVALID_HANDLE;
+    } else {
+        Card& card = it->second;
+        Reader& reader = f->readers[card.reader];
+        CardState state = card_state(f, reader, uv_hrtime());
+        if (dwShareMode != SCARD_SHARE_DIRECT && !state.present) {
+            result = SCARD_E_NO_SMARTCARD;
+        } else if (dwShareMode == SCARD_SHARE_EXCLUSIVE && reader.cards > 1) {
+            result = SCARD_E_SHARING_VIOLATION;
+        } else {
+            /* Reconnecting picks up the card inserted since, if any */
+            card.events = state.events;
+            card.share_mode = dwShareMode;
+            reader.exclusive = dwShareMode == SCARD_SHARE_EXCLUSIVE;
+            if (dwPreferredProtocols & SCARD_PROTOCOL_T1) {
+                card.protocol = SCARD_PROTOCOL_T1;
+            } else if (dwPreferredProtocols & SCARD_PROTOCOL_T0) {
+                card.protocol = SCARD_PROTOCOL_T0;
+            }
+
+            *pdwActiveProtocol = card.protocol;
+        }
+    }
+
+    uv_mutex_unlock(&f->mutex);
+    return result;
+}
+
+LONG SCardDisconnect(SCARDHANDLE hCard, DWORD dwDisposition) {
+    Farm* f = get_farm();
+    LONG result = SCARD_S_SUCCESS;
+    uv_mutex_lock(&f->mutex);
+
+    std::map<SCARDHANDLE, Card>::iterator it = f->cards.find(hCard);
+    if (it == f->cards.end()) {
+        result = SCARD_E_INVALID_HANDLE;
+    } else {
+        release_card(f, it);
+    }
+
+    uv_mutex_unlock(&f->mutex);
+    return result;
+}
+
+LONG SCardBeginTransaction(SCARDHANDLE hCard) {
+    Farm* f = get_farm();
+    Card* card;
+    uv_mutex_lock(&f->mutex);
+
+    LONG result = wait_transaction(f, hCard, &card);
+    if (result == SCARD_S_SUCCESS) {
+        f->readers[card->reader].transaction = hCard;
+    }
+
+    uv_mutex_unlock(&f->mutex);
+    return result;
+}
+
+LONG SCardEndTransaction(SCARDHANDLE hCard, DWORD dwDisposition) {
+    Farm* f = get_farm();
+    LONG result = SCARD_S_SUCCESS;
+    uv_mutex_lock(&f->mutex);
+
+    std::map<SCARDHANDLE, Card>::iterator it = f->cards.find(hCard);
+    if (it == f->cards.end()) {
+        result = SCARD_E_INVALID_HANDLE;
+    } else if (f->readers[it->second.reader].transaction != hCard) {
+        result = SCARD_E_NOT_TRANSACTED;
+    } else {
+        f->readers[it->second.reader].transaction = 0;
+        uv_cond_broadcast(&f->cond);
+    }
+
+    uv_mutex_unlock(&f->mutex);
+    return result;
+}
+
+LONG SCardStatus(SCARDHANDLE hCard, LPSTR szReaderName, LPDWORD pcchReaderLen, LPDWORD pdwState,
+                 LPDWORD pdwProtocol, LPBYTE pbAtr, LPDWORD pcbAtrLen) {
+    Farm* f = get_farm();
+    Card* card;
+    uv_mutex_lock(&f->mutex);
+
+    LONG result = find_card(f, hCard, &card);
+    if (result == SCARD_S_SUCCESS) {
+        const std::string& name = f->readers[card->reader].name;
+        if (pcchReaderLen) {
+            if (szReaderName && *pcchReaderLen < name.size() + 1) {
+                result = SCARD_E_INSUFFICIENT_BUFFER;
+            } else if (szReaderName) {
+                memcpy(szReaderName, name.c_str(), name.size() + 1);
+            }
+            *pcchReaderLen = name.size() + 1;
+        }
+
+        if (pcbAtrLen) {
+            if (pbAtr && *pcbAtrLen < sizeof(CARD_ATR)) {
+                result = SCARD_E_INSUFFICIENT_BUFFER;
+            } else if (pbAtr) {
+                memcpy(pbAtr, CARD_ATR, sizeof(CARD_ATR));
+            }
+            *pcbAtrLen = sizeof(CARD_ATR);
+        }
+
+        if (pdwState) {
+            *pdwState = SCARD_PRESENT | SCARD_POWERED | SCARD_NEGOTIABLE | SCARD_SPECIFIC;
+        }
+        if (pdwProtocol) {
+            *pdwProtocol = card->protocol;
+        }
+    }
+
+    uv_mutex_unlock(&f->mutex);
+    return result;
+}
+
+LONG SCardGetStatusChange(SCARDCONTEXT hContext, DWORD dwTimeout, SCARD_READERSTATE *rgReaderStates, DWORD cReaders) {
+    if (cReaders && !rgReaderStates) {
+        return SCARD_E_INVALID_PARAMETER;
+    }
+
+    Farm* f = get_farm();
+    uint64_t deadline = (dwTimeout == INFINITE) ? 0 : uv_hrtime() + (uint64_t)dwTimeout * 1000000;
+    LONG result = SCARD_S_SUCCESS;
+    uv_mutex_lock(&f->mutex);
+
+    for (;;) {
+        std::map<SCARDCONTEXT, Context>::iterator context = f->contexts.find(hContext);
+        if (context == f->contexts.end()) {
+            result = SCARD_E_INVALID_HANDLE;
+            break;
+        }
+
+        if (context->second.cancelled) {
+            context->second.cancelled = false;
+            result = SCARD_E_CANCELLED;
+            break;
+        }
+
+        uint64_t now = uv_hrtime();
+        uint64_t wakeup = deadline;
+        bool changed = false;
+        for (DWORD i = 0; i < cReaders && result == SCARD_S_SUCCESS; i++) {
+            SCARD_READERSTATE& rs = rgReaderStates[i];
+            if (rs.dwCurrentState & SCARD_STATE_IGNORE) {
+                continue;
+            }
+
+            DWORD event_state;
+            bool reader_changed;
+            if (!strcmp(rs.szReader, PNP_NOTIFICATION)) {
+                /* The reader list never changes, the entry only carries its size */
+                event_state = (DWORD)f->readers.size() << 16;
+                reader_changed = (rs.dwCurrentState >> 16) != f->readers.size();
+            } else {
+                std::map<std::string, size_t>::const_iterator index = f->reader_index.find(rs.szReader);
+                if (index == f->reader_index.end()) {
+                    result = SCARD_E_UNKNOWN_READER;
+                    break;
+                }
+
+                CardState state = card_state(f, f->readers[index->second], now);
+                event_state = ((DWORD)(state.events & 0xFFFF) << 16) |
+                              (state.present ? SCARD_STATE_PRESENT : SCARD_STATE_EMPTY);
+                DWORD mask = 0xFFFF0000 | SCARD_STATE_PRESENT | SCARD_STATE_EMPTY;
+                reader_changed = (rs.dwCurrentState & mask) != event_state;
+
+                rs.cbAtr = state.present ? sizeof(CARD_ATR) : 0;
+                memcpy(rs.rgbAtr, CARD_ATR, rs.cbAtr);
+
+                if (state.next_change && (!wakeup || state.next_change < wakeup)) {
+                    wakeup = state.next_change;
+                }
+            }
+
+            rs.dwEventState = event_state | (reader_changed ? SCARD_STATE_CHANGED : 0);
+            changed = changed || reader_changed;
+        }
+
+        if (result != SCARD_S_SUCCESS || changed) {
+            break;
+        }
+
+        if (deadline && now >= deadline) {
+            result = SCARD_E_TIMEOUT;
+            break;
+        }
+
+        if (!wakeup) {
+            uv_cond_wait(&f->cond, &f->mutex);
+        } else if (wakeup > now) {
+            uv_cond_timedwait(&f->cond, &f->mutex, wakeup - now);
+        }
+    }
+
+    uv_mutex_unlock(&f->mutex);
+    return result;
+}
+
+LONG SCardControl(SCARDHANDLE hCard, DWORD dwControlCode, LPCVOID pbSendBuffer, DWORD cbSendLength,
+                  LPVOID pbRecvBuffer, DWORD cbRecvLength, LPDWORD lpBytesReturned) {
+    if (!lpBytesReturned || (cbSendLength && !pbSendBuffer)) {
+        return SCARD_E_INVALID_PARAMETER;
+    }
+
+    Farm* f = get_farm();
+    Card* card;
+    uv_mutex_lock(&f->mutex);
+    LONG result = wait_transaction(f, hCard, &card);
+    uint64_t apdu_ns = f->apdu_ns;
+    uv_mutex_unlock(&f->mutex);
+
+    if (result != SCARD_S_SUCCESS) {
+        return result;
+    }
+
+    card_sleep(apdu_ns);
+
+    if (cbRecvLength < cbSendLength) {
+        return SCARD_E_INSUFFICIENT_BUFFER;
+    }
+
+    if (cbSendLength) {
+        memcpy(pbRecvBuffer, pbSendBuffer, cbSendLength);
+    }
+    *lpBytesReturned = cbSendLength;
+    return SCARD_S_SUCCESS;
+}
+
+LONG SCardTransmit(SCARDHANDLE hCard, const SCARD_IO_REQUEST *pioSendPci, LPCBYTE pbSendBuffer, DWORD cbSendLength,
+                   SCARD_IO_REQUEST *pioRecvPci, LPBYTE pbRecvBuffer, LPDWORD pcbRecvLength) {
+    if (!pbSendBuffer || !cbSendLength || !pbRecvBuffer || !pcbRecvLength) {
+        return SCARD_E_INVALID_PARAMETER;
+    }
+
+    Farm* f = get_farm();
+    Card* card;
+    uv_mutex_lock(&f->mutex);
+    LONG result = wait_transaction(f, hCard, &card);
+    if (result == SCARD_S_SUCCESS && pioSendPci && pioSendPci->dwProtocol != card->protocol) {
+        result = SCARD_E_PROTO_MISMATCH;
+    }
+    uint64_t apdu_ns = f->apdu_ns;
+    uv_mutex_unlock(&f->mutex);
+
+    if (result != SCARD_S_SUCCESS) {
+        return result;
+    }
+
+    if (cbSendLength >= 4 && pbSendBuffer[0] != 0xFF && pbSendBuffer[1] == INS_SLOW) {
+        apdu_ns += (uint64_t)((pbSendBuffer[2] << 8) | pbSendBuffer[3]) * 1000000;
+    }
+
+    card_sleep(apdu_ns);
+
+    /* The card may have been removed or released meanwhile */
+    std::vector<BYTE> response;
+    uv_mutex_lock(&f->mutex);
+    result = find_card(f, hCard, &card);
+    if (result == SCARD_S_SUCCESS) {
+        card_response(*card, pbSendBuffer, cbSendLength, response);
+    }
+    uv_mutex_unlock(&f->mutex);
+
+    if (result != SCARD_S_SUCCESS) {
+        return result;
+    }
+
+    if (*pcbRecvLength < response.size()) {
+        *pcbRecvLength = response.size();
+        return SCARD_E_INSUFFICIENT_BUFFER;
+    }
+
+    memcpy(pbRecvBuffer, response.data(), response.size());
+    *pcbRecvLength = response.size();
+    if (pioRecvPci && pioSendPci) {
+        *pioRecvPci = *pioSendPci;
+    }
+
+    return SCARD_S_SUCCESS;
+}
+
+LONG SCardListReaders(SCARDCONTEXT hContext, LPCSTR mszGroups, LPSTR mszReaders, LPDWORD pcchReaders) {
+    if (!pcchReaders) {
+        return SCARD_E_INVALID_PARAMETER;
+    }
+
+    Farm* f = get_farm();
+    LONG result = SCARD_S_SUCCESS;
+    uv_mutex_lock(&f->mutex);
+
+    DWORD length = f->reader_list.size();
+    if (!f->contexts.count(hContext)) {
+        result = SCARD_E_INVALID_HANDLE;
+    } else if (f->readers.empty()) {
+        result = SCARD_E_NO_READERS_AVAILABLE;
+    } else if (*pcchReaders == SCARD_AUTOALLOCATE) {
+        if (!mszReaders) {
+            result = SCARD_E_INVALID_PARAMETER;
+        } else {
+            char* readers = static_cast<char*>(malloc(length));
+            memcpy(readers, f->reader_list.data(), length);
+            *reinterpret_cast<char**>(mszReaders) = readers;
+        }
+    } else if (mszReaders && *pcchReaders < length) {
+        result = SCARD_E_INSUFFICIENT_BUFFER;
+    } else if (mszReaders) {
+        memcpy(mszReaders, f->reader_list.data(), length);
+    }
+
+    if (result == SCARD_S_SUCCESS || result == (LONG)SCARD_E_INSUFFICIENT_BUFFER) {
+        *pcchReaders = length;
+    }
+
+    uv_mutex_unlock(&f->mutex);
+    return result;
+}
+
+LONG SCardFreeMemory(SCARDCONTEXT hContext, LPCVOID pvMem) {
+    free(const_cast<void*>(pvMem));
+    return SCARD_S_SUCCESS;
+}
+
+LONG SCardCancel(SCARDCONTEXT hContext) {
+    Farm* f = get_farm();
+    LONG result = SCARD_S_SUCCESS;
+    uv_mutex_lock(&f->mutex);
+
+    std::map<SCARDCONTEXT, Context>::iterator context = f->contexts.find(hContext);
+    if (context == f->contexts.end()) {
+        result = SCARD_E_INVALID_HANDLE;
+    } else {
+        /*
+         * Unlike pcscd the cancellation is kept until the next SCardGetStatusChange()
+         * when none is blocked yet, so a close racing the monitor can't hang.
+         */
+        context->second.cancelled = true;
+        uv_cond_broadcast(&f->cond);
+    }
+
+    uv_mutex_unlock(&f->mutex);
+    return result;
+}
+
+LONG SCardGetAttrib(SCARDHANDLE hCard, DWORD dwAttrId, LPBYTE pbAttr, LPDWORD pcbAttrLen) {
+    return SCARD_E_UNSUPPORTED_FEATURE;
+}
+
+const char *pcsc_stringify_error(const LONG pcscError) {
+    switch (pcscError) {
+        case SCARD_S_SUCCESS: return "Command successful.";
+        case SCARD_F_INTERNAL_ERROR: return "Internal error.";
+        case SCARD_E_CANCELLED: return "Command cancelled.";
+        case SCARD_E_INVALID_HANDLE: return "Invalid handle.";
+        case SCARD_E_INVALID_PARAMETER: return "Invalid parameter given.";
+        case SCARD_E_NO_MEMORY: return "Not enough memory.";
+        case SCARD_E_INSUFFICIENT_BUFFER: return "Insufficient buffer.";
+        case SCARD_E_UNKNOWN_READER: return "Unknown reader specified.";
+        case SCARD_E_TIMEOUT: return "Command timeout.";
+        case SCARD_E_SHARING_VIOLATION: return "Sharing violation.";
+        case SCARD_E_NO_SMARTCARD: return "No smart card inserted.";
+        case SCARD_E_PROTO_MISMATCH: return "Card protocol mismatch.";
+        case SCARD_E_INVALID_VALUE: return "Invalid value given.";
+        case SCARD_E_NOT_TRANSACTED: return "Transaction failed.";
+        case SCARD_E_NO_SERVICE: return "Service not available.";
+        case SCARD_E_NO_READERS_AVAILABLE: return "Cannot find a smart card reader.";
+        case SCARD_E_UNSUPPORTED_FEATURE: return "Feature not supported.";
+        case SCARD_W_REMOVED_CARD: return "Card was removed.";
+        case SCARD_W_SECURITY_VIOLATION: return "Access was denied because of a security violation.";
+        case SCARD_W_RESET_CARD: return "Card was reset.";
+        default: break;
+    }
+
+    static thread_local char unknown[40];
+    snprintf(unknown, sizeof(unknown), "Unknown error: 0x%08lX", (unsigned long)(uint32_t)pcscError);
+    return unknown;
+}
@@ -0,0 +1,175 @@
+#ifndef FAKE_WINSCARD_H
+#define FAKE_WINSCARD_H
+
+/*
+ * Stand-in for the pcsc-lite <winscard.h>, implemented by winscard.cpp with a
+ * farm of simulated readers instead of pcscd. Only built into the
+ * pcsclite_fake target (see binding.gyp), which puts this directory ahead of
+ * the system include path.
+ *
+ * The types follow pcsc-lite on the same platform, so the addon sources
+ * compile unchanged against either header.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __APPLE__
+typedef int32_t LONG;
+typedef uint32_t DWORD;
+#else
+typedef long LONG;
+typedef unsigned long DWORD;
+#endif
+typedef DWORD *LPDWORD;
+typedef unsigned char BYTE;
+typedef BYTE *LPBYTE;
+typedef const BYTE *LPCBYTE;
+typedef char *LPSTR;
+typedef const char *LPCSTR;
+typedef char *LPTSTR;
+typedef const char *LPCTSTR;
+typedef void *LPVOID;
+typedef const void *LPCVOID;
+
+typedef LONG SCARDCONTEXT;
+typedef SCARDCONTEXT *PSCARDCONTEXT;
+typedef SCARDCONTEXT *LPSCARDCONTEXT;
+typedef LONG SCARDHANDLE;
+typedef SCARDHANDLE *PSCARDHANDLE;
+typedef SCARDHANDLE *LPSCARDHANDLE;
+
+#define MAX_ATR_SIZE 33
+#define MAX_READERNAME 128
+
+typedef struct {
+    const char *szReader;
+    void *pvUserData;
+    DWORD dwCurrentState;
+    DWORD dwEventState;
+    DWORD cbAtr;
+    unsigned char rgbAtr[MAX_ATR_SIZE];
+} SCARD_READERSTATE, *LPSCARD_READERSTATE;
+
+typedef struct {
+    unsigned long dwProtocol;
+    unsigned long cbPciLength;
+} SCARD_IO_REQUEST, *PSCARD_IO_REQUEST, *LPSCARD_IO_REQUEST;
+typedef const SCARD_IO_REQUEST *LPCSCARD_IO_REQUEST;
+
+#define SCARD_AUTOALLOCATE (DWORD)(-1)
+
+#define SCARD_SCOPE_USER 0x0000
+#define SCARD_SCOPE_TERMINAL 0x0001
+#define SCARD_SCOPE_SYSTEM 0x0002
+
+#define SCARD_PROTOCOL_UNDEFINED 0x0000
+#define SCARD_PROTOCOL_T0 0x0001
+#define SCARD_PROTOCOL_T1 0x0002
+#define SCARD_PROTOCOL_RAW 0x0004
+#define SCARD_PROTOCOL_T15 0x0008
+#define SCARD_PROTOCOL_ANY (SCARD_PROTOCOL_T0 | SCARD_PROTOCOL_T1)
+
+#define SCARD_SHARE_EXCLUSIVE 0x0001
+#define SCARD_SHARE_SHARED 0x0002
+#define SCARD_SHARE_DIRECT 0x0003
+
+#define SCARD_LEAVE_CARD 0x0000
+#define SCARD_RESET_CARD 0x0001
+#define SCARD_UNPOWER_CARD 0x0002
+#define SCARD_EJECT_CARD 0x0003
+
+#define SCARD_UNKNOWN 0x0001
+#define SCARD_ABSENT 0x0002
+#define SCARD_PRESENT 0x0004
+#define SCARD_SWALLOWED 0x0008
+#define SCARD_POWERED 0x0010
+#define SCARD_NEGOTIABLE 0x0020
+#define SCARD_SPECIFIC 0x0040
+
+#define SCARD_STATE_UNAWARE 0x0000
+#define SCARD_STATE_IGNORE 0x0001
+#define SCARD_STATE_CHANGED 0x0002
+#define SCARD_STATE_UNKNOWN 0x0004
+#define SCARD_STATE_UNAVAILABLE 0x0008
+#define SCARD_STATE_EMPTY 0x0010
+#define SCARD_STATE_PRESENT 0x0020
+#define SCARD_STATE_ATRMATCH 0x0040
+#define SCARD_STATE_EXCLUSIVE 0x0080
+#define SCARD_STATE_INUSE 0x0100
+#define SCARD_STATE_MUTE 0x0200
+#define SCARD_STATE_UNPOWERED 0x0400
+
+#ifndef INFINITE
+#define INFINITE 0xFFFFFFFF
+#endif
+
+#define SCARD_S_SUCCESS ((LONG)0x00000000)
+#define SCARD_F_INTERNAL_ERROR ((LONG)0x80100001)
+#define SCARD_E_CANCELLED ((LONG)0x80100002)
+#define SCARD_E_INVALID_HANDLE ((LONG)0x80100003)
+#define SCARD_E_INVALID_PARAMETER ((LONG)0x80100004)
+#define SCARD_E_INVALID_TARGET ((LONG)0x80100005)
+#define SCARD_E_NO_MEMORY ((LONG)0x80100006)
+#define SCARD_F_WAITED_TOO_LONG ((LONG)0x80100007)
+#define SCARD_E_INSUFFICIENT_BUFFER ((LONG)0x80100008)
+#define SCARD_E_UNKNOWN_READER ((LONG)0x80100009)
+#define SCARD_E_TIMEOUT ((LONG)0x8010000A)
+#define SCARD_E_SHARING_VIOLATION ((LONG)0x8010000B)
+#define SCARD_E_NO_SMARTCARD ((LONG)0x8010000C)
+#define SCARD_E_UNKNOWN_CARD ((LONG)0x8010000D)
+#define SCARD_E_CANT_DISPOSE ((LONG)0x8010000E)
+#define SCARD_E_PROTO_MISMATCH ((LONG)0x8010000F)
+#define SCARD_E_NOT_READY ((LONG)0x80100010)
+#define SCARD_E_INVALID_VALUE ((LONG)0x80100011)
+#define SCARD_E_SYSTEM_CANCELLED ((LONG)0x80100012)
+#define SCARD_F_COMM_ERROR ((LONG)0x80100013)
+#define SCARD_F_UNKNOWN_ERROR ((LONG)0x80100014)
+#define SCARD_E_INVALID_ATR ((LONG)0x80100015)
+#define SCARD_E_NOT_TRANSACTED ((LONG)0x80100016)
+#define SCARD_E_READER_UNAVAILABLE ((LONG)0x80100017)
+#define SCARD_E_NO_SERVICE ((LONG)0x8010001D)
+#define SCARD_E_SERVICE_STOPPED ((LONG)0x8010001E)
+#define SCARD_E_UNEXPECTED ((LONG)0x8010001F)
+#define SCARD_E_UNSUPPORTED_FEATURE ((LONG)0x80100022)
+#define SCARD_E_NO_READERS_AVAILABLE ((LONG)0x8010002E)
+#define SCARD_W_UNSUPPORTED_CARD ((LONG)0x80100065)
+#define SCARD_W_UNRESPONSIVE_CARD ((LONG)0x80100066)
+#define SCARD_W_UNPOWERED_CARD ((LONG)0x80100067)
+#define SCARD_W_RESET_CARD ((LONG)0x80100068)
+#define SCARD_W_REMOVED_CARD ((LONG)0x80100069)
+#define SCARD_W_SECURITY_VIOLATION ((LONG)0x8010006A)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+LONG SCardEstablishContext(DWORD dwScope, LPCVOID pvReserved1, LPCVOID pvReserved2, LPSCARDCONTEXT phContext);
+LONG SCardReleaseContext(SCARDCONTEXT hContext);
+LONG SCardIsValidContext(SCARDCONTEXT hContext);
+LONG SCardConnect(SCARDCONTEXT hContext, LPCSTR szReader, DWORD dwShareMode, DWORD dwPreferredProtocols,
+                  LPSCARDHANDLE phCard, LPDWORD pdwActiveProtocol);
+LONG SCardReconnect(SCARDHANDLE hCard, DWORD dwShareMode, DWORD dwPreferredProtocols, DWORD dwInitialization,
+                    LPDWORD pdwActiveProtocol);
+LONG SCardDisconnect(SCARDHANDLE hCard, DWORD dwDisposition);
+LONG SCardBeginTransaction(SCARDHANDLE hCard);
+LONG SCardEndTransaction(SCARDHANDLE hCard, DWORD dwDisposition);
+LONG SCardStatus(SCARDHANDLE hCard, LPSTR szReaderName, LPDWORD pcchReaderLen, LPDWORD pdwState,
+                 LPDWORD pdwProtocol, LPBYTE pbAtr, LPDWORD pcbAtrLen);
+LONG SCardGetStatusChange(SCARDCONTEXT hContext, DWORD dwTimeout, SCARD_READERSTATE *rgReaderStates, DWORD cReaders);
+LONG SCardControl(SCARDHANDLE hCard, DWORD dwControlCode, LPCVOID pbSendBuffer, DWORD cbSendLength,
+                  LPVOID pbRecvBuffer, DWORD cbRecvLength, LPDWORD lpBytesReturned);
+LONG SCardTransmit(SCARDHANDLE hCard, const SCARD_IO_REQUEST *pioSendPci, LPCBYTE pbSendBuffer, DWORD cbSendLength,
+                   SCARD_IO_REQUEST *pioRecvPci, LPBYTE pbRecvBuffer, LPDWORD pcbRecvLength);
+LONG SCardListReaders(SCARDCONTEXT hContext, LPCSTR mszGroups, LPSTR mszReaders, LPDWORD pcchReaders);
+LONG SCardFreeMemory(SCARDCONTEXT hContext, LPCVOID pvMem);
+LONG SCardCancel(SCARDCONTEXT hContext);
+LONG SCardGetAttrib(SCARDHANDLE hCard, DWORD dwAttrId, LPBYTE pbAttr, LPDWORD pcbAttrLen);
+
+const char *pcsc_stringify_error(const LONG pcscError);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FAKE_WINSCARD_H */
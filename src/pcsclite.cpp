@@ -1,16 +1,43 @@
 #include "pcsclite.h"
+#include "addon.h"
+#include "cardreader.h"
 #include "common.h"
+#include "contextregistry.h"
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <unordered_map>
+
+namespace {
+
+    /* Splits the multi-string returned by SCardListReaders() */
+    void split_readers(const std::string& readers_name, std::vector<std::string>& names) {
+        size_t pos = 0;
+        while (pos < readers_name.size() && readers_name[pos] != '\0') {
+            size_t end = readers_name.find('\0', pos);
+            if (end == std::string::npos) {
+                end = readers_name.size();
+            }
+
+            names.push_back(readers_name.substr(pos, end - pos));
+            pos = end + 1;
+        }
+    }
+}
 
 Napi::Object PCSCLite::Init(Napi::Env env, Napi::Object exports) {
     Napi::Function func = DefineClass(env, "PCSCLite", {
         InstanceMethod("start", &PCSCLite::Start),
-        InstanceMethod("close", &PCSCLite::Close)
+        InstanceMethod("_close", &PCSCLite::Close),
+        InstanceMethod("dropped_events", &PCSCLite::DroppedEvents),
+        InstanceMethod("getStats", &PCSCLite::GetStats),
+        InstanceMethod("resetStats", &PCSCLite::ResetStats),
+        InstanceMethod("_set_atr_patterns", &PCSCLite::SetAtrPatterns),
+        InstanceMethod("_attach_state_table", &PCSCLite::AttachStateTable),
+        InstanceMethod("_own", &PCSCLite::Own)
     });
 
-    Napi::FunctionReference* constructor = new Napi::FunctionReference();
-    *constructor = Napi::Persistent(func);
-    env.SetInstanceData(constructor);
+    AddonData::Get(env)->pcsclite_constructor = Napi::Persistent(func);
 
     exports.Set("PCSCLite", func);
     return exports;
@@ -21,10 +48,25 @@ PCSCLite::PCSCLite(const Napi::CallbackInfo& info)
       m_card_context(0),
       m_card_reader_state(),
       m_status_thread(0),
-      m_state(0) {
+      m_state(0),
+      m_async_baton(NULL),
+      m_seq(0),
+      m_dropped_events(0),
+      m_filtered(false),
+      m_rewatch(false),
+      m_deciding(false),
+      m_tearing_down(false) {
 
     assert(uv_mutex_init(&m_mutex) == 0);
-    assert(uv_cond_init(&m_cond) == 0);
+
+    if (info.Length() > 0 && !info[0].IsUndefined()) {
+        if (!info[0].IsNumber() || info[0].As<Napi::Number>().Int64Value() < 1) {
+            Napi::TypeError::New(info.Env(), "First argument must be a positive integer").ThrowAsJavaScriptException();
+            return;
+        }
+
+        m_executor = std::make_shared<Executor>(info.Env(), info[0].As<Napi::Number>().Uint32Value());
+    }
 
     // TODO: consider removing this Windows workaround that should not be needed anymore
 #ifdef _WIN32
@@ -65,11 +107,7 @@ postServiceCheck:
     LONG result;
     // TODO: consider removing this do-while Windows workaround that should not be needed anymore
     do {
-        // TODO: make dwScope (now hard-coded to SCARD_SCOPE_SYSTEM) customisable
-        result = SCardEstablishContext(SCARD_SCOPE_SYSTEM,
-                                            NULL,
-                                            NULL,
-                                            &m_card_context);
+        result = ContextRegistry::Acquire(ContextRegistry::CONTEXT_STATUS, this, &m_card_context);
     } while(result == SCARD_E_NO_SERVICE || result == SCARD_E_SERVICE_STOPPED);
 
     if (result != SCARD_S_SUCCESS) {
@@ -91,19 +129,58 @@ postServiceCheck:
 }
 
 PCSCLite::~PCSCLite() {
+    /* Only when the environment is torn down with the monitor running */
     if (m_status_thread) {
+        m_state = 1;
         SCardCancel(m_card_context);
         assert(uv_thread_join(&m_status_thread) == 0);
     }
 
     if (m_card_context) {
-        SCardReleaseContext(m_card_context);
+        ContextRegistry::Release(m_card_context);
+    }
+
+    for (CardReader* reader : m_readers) {
+        reader->DetachMonitor();
     }
 
-    uv_cond_destroy(&m_cond);
     uv_mutex_destroy(&m_mutex);
 }
 
+void PCSCLite::Attach(CardReader* reader) {
+    m_readers.insert(reader);
+}
+
+void PCSCLite::Detach(CardReader* reader) {
+    Unwatch(reader, false);
+    m_ended.erase(std::remove(m_ended.begin(), m_ended.end(), reader), m_ended.end());
+    m_readers.erase(reader);
+    m_retired_stats.Merge(reader->GetIoStats());
+}
+
+void PCSCLite::Watch(CardReader* reader) {
+    m_watched[reader->GetName()] = reader;
+}
+
+bool PCSCLite::Unwatch(CardReader* reader, bool notify) {
+    std::map<std::string, CardReader*>::iterator it = m_watched.find(reader->GetName());
+    if (it == m_watched.end() || it->second != reader) {
+        /* Already ending */
+        return std::find(m_ended.begin(), m_ended.end(), reader) != m_ended.end();
+    }
+
+    m_watched.erase(it);
+
+    /* The '_end' event is emitted from the loop, as the monitor thread would do */
+    if (notify && m_async_baton) {
+        m_ended.push_back(reader);
+        uv_async_send(&m_async_baton->async);
+        return true;
+    }
+
+    return false;
+}
+
 Napi::Value PCSCLite::Start(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
 
@@ -112,16 +189,37 @@ Napi::Value PCSCLite::Start(const Napi::CallbackInfo& info) {
         return env.Undefined();
     }
 
+    if (info.Length() > 1 && !info[1].IsUndefined() &&
+        (!info[1].IsNumber() || info[1].As<Napi::Number>().Int64Value() < 1)) {
+        Napi::TypeError::New(env, "Second argument must be a positive integer").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
     Napi::Function cb = info[0].As<Napi::Function>();
+    size_t queue_size = STATUS_QUEUE_SIZE;
+    if (info.Length() > 1 && info[1].IsNumber()) {
+        queue_size = info[1].As<Napi::Number>().Uint32Value();
+    }
+
+    /* The callback takes the readers to watch with _own() */
+    m_filtered = info.Length() > 2 && info[2].ToBoolean().Value();
 
     AsyncBaton *async_baton = new AsyncBaton();
     async_baton->async.data = async_baton;
     async_baton->callback.Reset();
     async_baton->callback = Napi::Persistent(cb);
     async_baton->pcsclite = this;
+    async_baton->async_result = new AsyncResult(queue_size);
     async_baton->env = env;
+    m_async_baton = async_baton;
 
-    uv_async_init(uv_default_loop(), &async_baton->async, (uv_async_cb)HandleReaderStatusChange);
+    // Keep this instance alive until the monitor has shut down
+    Ref();
+
+    // The monitor must not outlive the environment, e.g. a worker thread being terminated
+    napi_add_env_cleanup_hook(env, EnvCleanup, this);
+
+    uv_async_init(AddonData::Get(env)->loop, &async_baton->async, (uv_async_cb)HandleReaderStatusChange);
     int ret = uv_thread_create(&m_status_thread, HandlerFunction, async_baton);
     assert(ret == 0);
 
@@ -131,169 +229,620 @@ Napi::Value PCSCLite::Start(const Napi::CallbackInfo& info) {
 Napi::Value PCSCLite::Close(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
 
-    LONG result = SCARD_S_SUCCESS;
+    /*
+     * Nothing here waits for the monitor thread: it is told to stop and its
+     * last wakeup ends the readers, then '_closed' is emitted once the thread
+     * is done (see CloseCallback).
+     */
     if (m_pnp) {
         if (m_status_thread) {
             uv_mutex_lock(&m_mutex);
             if (m_state == 0) {
-                int ret;
-                int times = 0;
                 m_state = 1;
-                do {
-                    result = SCardCancel(m_card_context);
-                    ret = uv_cond_timedwait(&m_cond, &m_mutex, 10000000);
-                } while ((ret != 0) && (++ times < 5));
+                SCardCancel(m_card_context);
             }
 
             uv_mutex_unlock(&m_mutex);
         }
     } else {
-        m_state = 1;
+        uv_mutex_lock(&m_mutex);
+        if (m_state == 0) {
+            m_state = 1;
+        }
+
+        uv_mutex_unlock(&m_mutex);
     }
 
-    if (m_status_thread) {
-        assert(uv_thread_join(&m_status_thread) == 0);
-        m_status_thread = 0;
+    /* Whether '_closed' is still to come */
+    return Napi::Boolean::New(env, m_status_thread != 0);
+}
+
+Napi::Value PCSCLite::DroppedEvents(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    uint64_t dropped = m_dropped_events;
+    if (m_async_baton) {
+        dropped = m_async_baton->async_result->events.Dropped();
+    }
+
+    return Napi::Number::New(env, dropped);
+}
+
+Napi::Value PCSCLite::GetStats(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    /* All the readers of this instance, including the ones gone */
+    IoStats stats = m_retired_stats;
+    for (CardReader* reader : m_readers) {
+        stats.Merge(reader->GetIoStats());
     }
 
-    return Napi::Number::New(env, result);
+    Napi::Object obj = stats.ToObject(env);
+    obj.Set("readers", Napi::Number::New(env, m_readers.size()));
+    obj.Set("dropped_events", DroppedEvents(info));
+    return obj;
+}
+
+Napi::Value PCSCLite::ResetStats(const Napi::CallbackInfo& info) {
+    m_retired_stats.Reset();
+    for (CardReader* reader : m_readers) {
+        reader->ResetIoStats();
+    }
+
+    return info.Env().Undefined();
+}
+
+Napi::Value PCSCLite::SetAtrPatterns(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (!info[0].IsArray() || !info[1].IsArray() ||
+        info[0].As<Napi::Array>().Length() != info[1].As<Napi::Array>().Length()) {
+        Napi::TypeError::New(env, "ATRs and masks must be Arrays of Buffers of the same length")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    Napi::Array atr_array = info[0].As<Napi::Array>();
+    Napi::Array mask_array = info[1].As<Napi::Array>();
+    std::vector<std::vector<BYTE> > atrs(atr_array.Length());
+    std::vector<std::vector<BYTE> > masks(mask_array.Length());
+
+    for (uint32_t i = 0; i < atr_array.Length(); i++) {
+        Napi::Value atr = atr_array.Get(i);
+        Napi::Value mask = mask_array.Get(i);
+        if (!atr.IsBuffer() || atr.As<Napi::Buffer<uint8_t>>().Length() > MAX_ATR_SIZE ||
+            (!mask.IsUndefined() && !mask.IsBuffer())) {
+            Napi::TypeError::New(env, "Invalid ATR pattern at index " + std::to_string(i))
+                .ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+
+        Napi::Buffer<uint8_t> atr_buf = atr.As<Napi::Buffer<uint8_t>>();
+        atrs[i].assign(atr_buf.Data(), atr_buf.Data() + atr_buf.Length());
+        if (mask.IsBuffer()) {
+            Napi::Buffer<uint8_t> mask_buf = mask.As<Napi::Buffer<uint8_t>>();
+            masks[i].assign(mask_buf.Data(), mask_buf.Data() + mask_buf.Length());
+        }
+    }
+
+    m_atr_matcher.Set(atrs, masks);
+    return env.Undefined();
+}
+
+Napi::Value PCSCLite::AttachStateTable(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (!info[0].IsTypedArray() || info[0].As<Napi::TypedArray>().TypedArrayType() != napi_uint8_array) {
+        Napi::TypeError::New(env, "First argument must be a Uint8Array").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    /* The monitor thread fills the table from its first pass */
+    if (m_status_thread || m_state_table.Attached()) {
+        Napi::Error::New(env, "State table must be attached once, before start()").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    Napi::Uint8Array bytes = info[0].As<Napi::Uint8Array>();
+    m_state_table_ref = Napi::Persistent(bytes.As<Napi::Object>());
+    size_t slots = m_state_table.Attach(bytes.Data(), bytes.ByteLength());
+
+    return Napi::Number::New(env, slots);
+}
+
+Napi::Value PCSCLite::Own(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (!info[0].IsArray()) {
+        Napi::TypeError::New(env, "First argument must be an Array of reader names").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    Napi::Array names = info[0].As<Napi::Array>();
+    std::vector<std::string> owned;
+    for (uint32_t i = 0; i < names.Length(); i++) {
+        Napi::Value name = names.Get(i);
+        if (!name.IsString()) {
+            Napi::TypeError::New(env, "First argument must be an Array of reader names").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+
+        owned.push_back(name.As<Napi::String>().Utf8Value());
+    }
+
+    /* Watched from the next pass of the monitor thread, see emit_readers() */
+    uv_mutex_lock(&m_mutex);
+    m_owned.insert(owned.begin(), owned.end());
+    m_rewatch = m_rewatch || !owned.empty();
+    uv_mutex_unlock(&m_mutex);
+
+    return env.Undefined();
 }
 
 void PCSCLite::HandleReaderStatusChange(uv_async_t *handle) {
     AsyncBaton* async_baton = static_cast<AsyncBaton*>(handle->data);
+    PCSCLite* pcsclite = async_baton->pcsclite;
     AsyncResult* ar = async_baton->async_result;
     Napi::Env env(async_baton->env);
     Napi::HandleScope scope(env);
 
-    if (async_baton->pcsclite->m_state == 1) {
-        // Swallow events : Listening thread was cancelled by user.
-    } else if ((ar->result == SCARD_S_SUCCESS) ||
-               (ar->result == (LONG)SCARD_E_NO_READERS_AVAILABLE)) {
-        std::vector<napi_value> argv = {
-            env.Undefined(),
-            Napi::Buffer<char>::Copy(env, ar->readers_name, ar->readers_name_length)
-        };
+    uv_mutex_lock(&pcsclite->m_mutex);
+    LONG result = ar->result;
+    std::string err_msg = ar->err_msg;
+    bool do_exit = ar->do_exit;
+    ar->result = SCARD_S_SUCCESS;
+    uv_mutex_unlock(&pcsclite->m_mutex);
 
-        async_baton->callback.Call(argv);
-    } else {
-        std::vector<napi_value> argv = { Napi::Error::New(env, ar->err_msg).Value() };
-        async_baton->callback.Call(argv);
+    /*
+     * Drain every record queued since the last wakeup, libuv coalesces
+     * uv_async_send() calls so there may be many of them.
+     */
+    StatusRecord record;
+    while (ar->events.Pop(record)) {
+        if (pcsclite->m_state == 1) {
+            // Swallow events : Listening thread was cancelled by user.
+            continue;
+        }
+
+        if (record.type == STATUS_READERS) {
+            pcsclite->emit_readers(env, async_baton);
+            continue;
+        }
+
+        std::map<std::string, CardReader*>::iterator it = pcsclite->m_watched.find(record.name);
+        if (it != pcsclite->m_watched.end()) {
+            Napi::HandleScope event_scope(env);
+            it->second->EmitStatus(env, record.status, record.atr, record.atrlen,
+                                   record.seq, record.timestamp);
+        }
+    }
+
+    if (pcsclite->m_state != 1) {
+        /* The reader list record may have been dropped on overflow */
+        pcsclite->emit_readers(env, async_baton);
+
+        if (result != SCARD_S_SUCCESS) {
+            std::vector<napi_value> argv = { Napi::Error::New(env, err_msg).Value() };
+            async_baton->callback.Call(argv);
+            report_pending_exception(env);
+        }
+    }
+
+    /* Readers closed by the user */
+    std::vector<CardReader*> ended;
+    ended.swap(pcsclite->m_ended);
+    for (CardReader* reader : ended) {
+        reader->EmitEnd(env);
     }
 
     // Do exit, after throwing last events
-    if (ar->do_exit) {
+    if (do_exit) {
+        /* Nobody is left to report the status of the watched readers */
+        std::vector<CardReader*> watched;
+        for (const auto& it : pcsclite->m_watched) {
+            watched.push_back(it.second);
+        }
+
+        pcsclite->m_watched.clear();
+        pcsclite->m_ended.clear();
+        pcsclite->m_async_baton = NULL;
+        pcsclite->m_dropped_events = ar->events.Dropped();
+        for (CardReader* reader : watched) {
+            reader->EmitEnd(env);
+        }
+
         // necessary otherwise UV will block
         uv_close(reinterpret_cast<uv_handle_t*>(&async_baton->async), CloseCallback);
+    }
+}
+
+void PCSCLite::emit_readers(Napi::Env env, AsyncBaton* async_baton) {
+    AsyncResult* ar = async_baton->async_result;
+    std::vector<std::string> added;
+    std::vector<std::string> removed;
+
+    uv_mutex_lock(&m_mutex);
+    bool readers_changed = ar->readers_changed;
+    added.swap(ar->readers_added);
+    removed.swap(ar->readers_removed);
+    ar->readers_changed = false;
+    /* A reader gone is filtered again if it comes back */
+    for (const std::string& name : removed) {
+        m_owned.erase(name);
+    }
+
+    uv_mutex_unlock(&m_mutex);
+
+    if (!readers_changed) {
         return;
     }
 
-    /* reset AsyncResult */
-#ifdef SCARD_AUTOALLOCATE
-    PCSCLite* pcsclite = async_baton->pcsclite;
-    SCardFreeMemory(pcsclite->m_card_context, ar->readers_name);
-#else
-    delete [] ar->readers_name;
-#endif
-    ar->readers_name = NULL;
-    ar->readers_name_length = 0;
-    ar->result = SCARD_S_SUCCESS;
+    /* Only the names which changed cross over to JS */
+    Napi::Array added_names = Napi::Array::New(env, added.size());
+    for (size_t i = 0; i < added.size(); i++) {
+        added_names.Set(i, Napi::String::New(env, added[i]));
+    }
+
+    Napi::Array removed_names = Napi::Array::New(env, removed.size());
+    for (size_t i = 0; i < removed.size(); i++) {
+        removed_names.Set(i, Napi::String::New(env, removed[i]));
+    }
+
+    std::vector<napi_value> argv = {
+        env.Undefined(),
+        added_names,
+        removed_names
+    };
+
+    async_baton->callback.Call(argv);
+    report_pending_exception(env);
+
+    /*
+     * The callback took the new readers it wants with _own(), if any, and
+     * the monitor thread may be blocked on the readers of before: it is woken
+     * up to watch them. Until then it doesn't block for long (see m_deciding).
+     */
+    if (m_filtered) {
+        uv_mutex_lock(&m_mutex);
+        m_deciding = !ar->readers_added.empty();
+        if (m_rewatch && m_state == 0) {
+            SCardCancel(m_card_context);
+        }
+
+        uv_mutex_unlock(&m_mutex);
+    }
+}
+
+void PCSCLite::push_status(AsyncResult* ar, int type, const SCARD_READERSTATE* state, const std::string& name) {
+    StatusRecord record;
+    record.type = type;
+    record.seq = ++m_seq;
+    record.timestamp = uv_hrtime();
+    record.status = state ? state->dwEventState : 0;
+    record.atrlen = state ? state->cbAtr : 0;
+    if (record.atrlen > MAX_ATR_SIZE) {
+        record.atrlen = MAX_ATR_SIZE;
+    }
+
+    if (state) {
+        memcpy(record.atr, state->rgbAtr, record.atrlen);
+    }
+
+    size_t len = name.size() < MAX_READER_NAME_LEN - 1 ? name.size() : MAX_READER_NAME_LEN - 1;
+    memcpy(record.name, name.c_str(), len);
+    record.name[len] = '\0';
+
+    if (type == STATUS_CHANGE) {
+        m_state_table.Update(name, record.status, record.atr, record.atrlen, record.seq, record.timestamp);
+    }
+
+    ar->events.Push(record);
 }
 
 void PCSCLite::HandlerFunction(void* arg) {
     LONG result = SCARD_S_SUCCESS;
     AsyncBaton* async_baton = static_cast<AsyncBaton*>(arg);
     PCSCLite* pcsclite = async_baton->pcsclite;
-    async_baton->async_result = new AsyncResult();
+    AsyncResult* ar = async_baton->async_result;
+    bool relist = true;
+    bool first = true;
 
     while (!pcsclite->m_state) {
-        /* Get card readers */
-        result = pcsclite->get_card_readers(pcsclite, async_baton->async_result);
-        if (result == (LONG)SCARD_E_NO_READERS_AVAILABLE) {
-            result = SCARD_S_SUCCESS;
+        if (relist) {
+            /* Get card readers */
+            std::string readers_name;
+            std::vector<std::string> names;
+            result = pcsclite->get_card_readers(readers_name);
+            if (result == (LONG)SCARD_E_NO_READERS_AVAILABLE) {
+                result = SCARD_S_SUCCESS;
+            }
+
+            /* Store the result in the baton */
+            uv_mutex_lock(&pcsclite->m_mutex);
+            ar->result = result;
+            bool changed = false;
+            if (result != SCARD_S_SUCCESS) {
+                ar->err_msg = error_msg("SCardListReaders", result);
+                /* Error on last card access, stop monitoring */
+                pcsclite->m_state = 2;
+            } else {
+                split_readers(readers_name, names);
+                changed = pcsclite->diff_readers(ar, names) || first;
+                ar->readers_changed = ar->readers_changed || changed;
+
+                /* Only the readers taken by JS get a state, the others are left to the other instances */
+                if (pcsclite->m_filtered) {
+                    const std::unordered_set<std::string>& owned = pcsclite->m_owned;
+                    names.erase(std::remove_if(names.begin(), names.end(), [&owned](const std::string& name) {
+                        return !owned.count(name);
+                    }), names.end());
+                    pcsclite->m_deciding = pcsclite->m_deciding || !ar->readers_added.empty();
+                    pcsclite->m_rewatch = false;
+                }
+            }
+
+            uv_mutex_unlock(&pcsclite->m_mutex);
+
+            /* Keeps the new list ordered with the status of the new readers */
+            if (changed) {
+                pcsclite->push_status(ar, STATUS_READERS, NULL, std::string());
+            }
+
+            /* Notify the nodejs thread */
+            uv_async_send(&async_baton->async);
+
+            if (result != SCARD_S_SUCCESS) {
+                break;
+            }
+
+            pcsclite->update_reader_states(names);
+            relist = false;
+            first = false;
         }
 
-        /* Store the result in the baton */
-        async_baton->async_result->result = result;
-        if (result != SCARD_S_SUCCESS) {
-            async_baton->async_result->err_msg = error_msg("SCardListReaders",
-                                                           result);
+        /* Readers taken meanwhile, or still to be decided on */
+        uv_mutex_lock(&pcsclite->m_mutex);
+        bool rewatch = pcsclite->m_rewatch;
+        bool deciding = pcsclite->m_deciding;
+        uv_mutex_unlock(&pcsclite->m_mutex);
+
+        if (rewatch) {
+            relist = true;
+            continue;
         }
 
-        /* Notify the nodejs thread */
-        uv_async_send(&async_baton->async);
+        std::vector<SCARD_READERSTATE>& states = pcsclite->m_reader_states;
+        if (states.empty()) {
+            /*  If PnP is not supported and there are no readers, just wait for 1 second */
+            Sleep(1000);
+            relist = true;
+            continue;
+        }
 
-        if (result == SCARD_S_SUCCESS) {
-            if (pcsclite->m_pnp) {
-                /* Set current status */
-                pcsclite->m_card_reader_state.dwCurrentState =
-                    pcsclite->m_card_reader_state.dwEventState;
-                /* Start checking for status change */
-                result = SCardGetStatusChange(pcsclite->m_card_context,
-                                              INFINITE,
-                                              &pcsclite->m_card_reader_state,
-                                              1);
-
-                uv_mutex_lock(&pcsclite->m_mutex);
-                async_baton->async_result->result = result;
-                if (pcsclite->m_state) {
-                    uv_cond_signal(&pcsclite->m_cond);
+        /*
+         * Wait for a change of any of the readers (or of the reader list) at once,
+         * without PnP support the reader list is refreshed every second.
+         */
+        result = SCardGetStatusChange(pcsclite->m_card_context,
+                                      pcsclite->m_pnp && !deciding ? INFINITE : 1000,
+                                      states.data(),
+                                      states.size());
+
+        uv_mutex_lock(&pcsclite->m_mutex);
+        if (pcsclite->m_state) {
+            uv_mutex_unlock(&pcsclite->m_mutex);
+            break;
+        }
+
+        /* Cancelled to watch the readers taken, see emit_readers() */
+        bool rewoken = pcsclite->m_filtered && result == (LONG)SCARD_E_CANCELLED;
+        if (result != SCARD_S_SUCCESS && result != (LONG)SCARD_E_TIMEOUT &&
+            result != (LONG)SCARD_E_UNKNOWN_READER && !rewoken) {
+            pcsclite->m_state = 2;
+            ar->result = result;
+            ar->err_msg = error_msg("SCardGetStatusChange", result);
+        }
+
+        uv_mutex_unlock(&pcsclite->m_mutex);
+
+        if (result == (LONG)SCARD_E_TIMEOUT) {
+            relist = !pcsclite->m_pnp;
+        } else if (result == (LONG)SCARD_E_UNKNOWN_READER) {
+            /* A reader went away before we noticed it */
+            relist = true;
+        } else if (result == SCARD_S_SUCCESS) {
+            size_t first_reader = pcsclite->m_pnp ? 1 : 0;
+            for (size_t i = 0; i < states.size(); i++) {
+                SCARD_READERSTATE& state = states[i];
+                if (!(state.dwEventState & SCARD_STATE_CHANGED)) {
+                    continue;
                 }
 
-                if (result != SCARD_S_SUCCESS) {
-                    pcsclite->m_state = 2;
-                    async_baton->async_result->err_msg =
-                      error_msg("SCardGetStatusChange", result);
+                if (i < first_reader) {
+                    relist = true;
+                } else {
+                    pcsclite->push_status(ar, STATUS_CHANGE, &state,
+                                          pcsclite->m_reader_names[i - first_reader]);
                 }
 
-                uv_mutex_unlock(&pcsclite->m_mutex);
-            } else {
-                /*  If PnP is not supported, just wait for 1 second */
-                Sleep(1000);
+                /* Set current status */
+                state.dwCurrentState = state.dwEventState;
             }
-        } else {
-            /* Error on last card access, stop monitoring */
-            pcsclite->m_state = 2;
         }
+
+        uv_async_send(&async_baton->async);
     }
 
-    async_baton->async_result->do_exit = true;
+    /* Nothing watched anymore */
+    pcsclite->m_state_table.Clear();
+
+    uv_mutex_lock(&pcsclite->m_mutex);
+    ar->do_exit = true;
+    uv_mutex_unlock(&pcsclite->m_mutex);
     uv_async_send(&async_baton->async);
 }
 
+void PCSCLite::EnvCleanup(void* arg) {
+    PCSCLite* pcsclite = static_cast<PCSCLite*>(arg);
+
+    /* No JS can run anymore: stop the monitor thread and close its handle quietly */
+    pcsclite->m_tearing_down = true;
+    if (pcsclite->m_status_thread) {
+        uv_mutex_lock(&pcsclite->m_mutex);
+        pcsclite->m_state = 1;
+        SCardCancel(pcsclite->m_card_context);
+        uv_mutex_unlock(&pcsclite->m_mutex);
+
+        assert(uv_thread_join(&pcsclite->m_status_thread) == 0);
+        pcsclite->m_status_thread = 0;
+    }
+
+    /* Unless the last wakeup already got to close it */
+    if (pcsclite->m_async_baton) {
+        AsyncBaton* async_baton = pcsclite->m_async_baton;
+        pcsclite->m_async_baton = NULL;
+        pcsclite->m_dropped_events = async_baton->async_result->events.Dropped();
+        uv_close(reinterpret_cast<uv_handle_t*>(&async_baton->async), CloseCallback);
+    }
+}
+
 void PCSCLite::CloseCallback(uv_handle_t *handle) {
     /* cleanup process */
     AsyncBaton* async_baton = static_cast<AsyncBaton*>(handle->data);
-    AsyncResult* ar = async_baton->async_result;
-#ifdef SCARD_AUTOALLOCATE
     PCSCLite* pcsclite = async_baton->pcsclite;
-    SCardFreeMemory(pcsclite->m_card_context, ar->readers_name);
-#else
-    delete [] ar->readers_name;
-#endif
-    delete ar;
+    Napi::Env env(async_baton->env);
+
+    if (pcsclite->m_tearing_down) {
+        delete async_baton->async_result;
+        async_baton->callback.Reset();
+        delete async_baton;
+        return;
+    }
+
+    napi_remove_env_cleanup_hook(env, EnvCleanup, pcsclite);
+
+    Napi::HandleScope scope(env);
+
+    /* The thread sent its very last wakeup before exiting, this returns at once */
+    if (pcsclite->m_status_thread) {
+        assert(uv_thread_join(&pcsclite->m_status_thread) == 0);
+        pcsclite->m_status_thread = 0;
+    }
+
+    delete async_baton->async_result;
     async_baton->callback.Reset();
     delete async_baton;
+
+    // Emit closed event
+    std::vector<napi_value> argv = { Napi::String::New(env, "_closed") };
+    Napi::Object obj = pcsclite->Value();
+    Napi::Function emit = obj.Get("emit").As<Napi::Function>();
+    emit.Call(obj, argv);
+    report_pending_exception(env);
+
+    pcsclite->Unref();
 }
 
-LONG PCSCLite::get_card_readers(PCSCLite* pcsclite, AsyncResult* async_result) {
+bool PCSCLite::diff_readers(AsyncResult* ar, const std::vector<std::string>& names) {
+    bool changed = false;
+
+    /*
+     * Hashed lookups against the previous list: the changes are queued in
+     * O(1) each, net of the ones JS has not seen yet (a reader which went
+     * away and came back in between is left alone).
+     */
+    std::unordered_set<std::string> current(names.begin(), names.end());
+    for (const std::string& name : names) {
+        if (m_known_readers.count(name)) {
+            continue;
+        }
+
+        std::vector<std::string>::iterator it = std::find(ar->readers_removed.begin(), ar->readers_removed.end(), name);
+        if (it != ar->readers_removed.end()) {
+            ar->readers_removed.erase(it);
+        } else {
+            ar->readers_added.push_back(name);
+        }
+
+        changed = true;
+    }
+
+    for (const std::string& name : m_known_readers) {
+        if (current.count(name)) {
+            continue;
+        }
+
+        std::vector<std::string>::iterator it = std::find(ar->readers_added.begin(), ar->readers_added.end(), name);
+        if (it != ar->readers_added.end()) {
+            ar->readers_added.erase(it);
+        } else {
+            ar->readers_removed.push_back(name);
+        }
+
+        changed = true;
+    }
+
+    m_known_readers.swap(current);
+    return changed;
+}
+
+void PCSCLite::update_reader_states(std::vector<std::string>& names) {
+    size_t first_reader = m_pnp ? 1 : 0;
+
+    /* Keep the last known state of the readers we already watch */
+    std::unordered_map<std::string, DWORD> known;
+    for (size_t i = first_reader; i < m_reader_states.size(); i++) {
+        known[m_reader_names[i - first_reader]] = m_reader_states[i].dwCurrentState;
+    }
+
+    /* The readers gone lose their slot of the state table */
+    if (m_state_table.Attached()) {
+        std::unordered_set<std::string> current(names.begin(), names.end());
+        for (const auto& it : known) {
+            if (!current.count(it.first)) {
+                m_state_table.Remove(it.first);
+            }
+        }
+    }
+
+    std::vector<SCARD_READERSTATE> states(first_reader + names.size(), SCARD_READERSTATE());
+    if (m_pnp) {
+        if (m_reader_states.empty()) {
+            states[0] = m_card_reader_state;
+            states[0].dwCurrentState = m_card_reader_state.dwEventState;
+        } else {
+            states[0] = m_reader_states[0];
+        }
+    }
+
+    for (size_t i = 0; i < names.size(); i++) {
+        std::unordered_map<std::string, DWORD>::const_iterator it = known.find(names[i]);
+        states[first_reader + i].szReader = names[i].c_str();
+        states[first_reader + i].dwCurrentState = (it != known.end()) ? it->second : SCARD_STATE_UNAWARE;
+    }
+
+    /* Swapping keeps the strings in place, so szReader stays valid */
+    m_reader_names.swap(names);
+    m_reader_states.swap(states);
+}
+
+LONG PCSCLite::get_card_readers(std::string& readers_name) {
     DWORD readers_name_length;
-    LPTSTR readers_name;
+    LPTSTR readers;
 
     LONG result = SCARD_S_SUCCESS;
 
-    /* Reset the readers_name in the baton */
-    async_result->readers_name = NULL;
-    async_result->readers_name_length = 0;
+    readers_name.clear();
 
 #ifdef SCARD_AUTOALLOCATE
     readers_name_length = SCARD_AUTOALLOCATE;
-    result = SCardListReaders(pcsclite->m_card_context,
+    result = SCardListReaders(m_card_context,
                               NULL,
-                              (LPTSTR)&readers_name,
+                              (LPTSTR)&readers,
                               &readers_name_length);
 #else
     /* Find out ReaderNameLength */
-    result = SCardListReaders(pcsclite->m_card_context,
+    result = SCardListReaders(m_card_context,
                               NULL,
                               NULL,
                               &readers_name_length);
@@ -304,34 +853,33 @@ LONG PCSCLite::get_card_readers(PCSCLite* pcsclite, AsyncResult* async_result) {
     /*
      * Allocate Memory for ReaderName and retrieve all readers in the terminal
      */
-    readers_name = new char[readers_name_length];
-    result = SCardListReaders(pcsclite->m_card_context,
+    readers = new char[readers_name_length];
+    result = SCardListReaders(m_card_context,
                               NULL,
-                              readers_name,
+                              readers,
                               &readers_name_length);
 #endif
 
     if (result != SCARD_S_SUCCESS) {
 #ifndef SCARD_AUTOALLOCATE
-        delete [] readers_name;
-#endif
-        readers_name = NULL;
-        readers_name_length = 0;
-#ifndef SCARD_AUTOALLOCATE
+        delete [] readers;
         /* Retry in case of insufficient buffer error */
         if (result == (LONG)SCARD_E_INSUFFICIENT_BUFFER) {
-            result = get_card_readers(pcsclite, async_result);
+            result = get_card_readers(readers_name);
         }
 #endif
         if (result == SCARD_E_NO_SERVICE || result == SCARD_E_SERVICE_STOPPED) {
-            SCardReleaseContext(pcsclite->m_card_context);
-            SCardEstablishContext(SCARD_SCOPE_SYSTEM, NULL, NULL, &pcsclite->m_card_context);
-            result = get_card_readers(pcsclite, async_result);
+            ContextRegistry::Release(m_card_context);
+            ContextRegistry::Acquire(ContextRegistry::CONTEXT_STATUS, this, &m_card_context);
+            result = get_card_readers(readers_name);
         }
     } else {
-        /* Store the readers_name in the baton */
-        async_result->readers_name = readers_name;
-        async_result->readers_name_length = readers_name_length;
+        readers_name.assign(readers, readers_name_length);
+#ifdef SCARD_AUTOALLOCATE
+        SCardFreeMemory(m_card_context, readers);
+#else
+        delete [] readers;
+#endif
     }
 
     return result;
@@ -3,6 +3,12 @@
 
 #include <napi.h>
 #include <uv.h>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_set>
+#include <vector>
 #ifdef __APPLE__
 #include <PCSC/winscard.h>
 #include <PCSC/wintypes.h>
@@ -10,12 +16,51 @@
 #include <winscard.h>
 #endif
 
+#include "atrmatcher.h"
+#include "executor.h"
+#include "statusqueue.h"
+#include "stats.h"
+#include "statetable.h"
+
+#ifdef _WIN32
+#define MAX_ATR_SIZE 33
+#endif
+#define MAX_READER_NAME_LEN 256
+#define STATUS_QUEUE_SIZE 256
+
+class CardReader;
+
 class PCSCLite: public Napi::ObjectWrap<PCSCLite> {
 
+    enum StatusRecordType {
+        STATUS_READERS,     // the reader list changed
+        STATUS_CHANGE       // the state of a single reader changed
+    };
+
+    // Event passed from the monitor thread to the JS thread.
+    struct StatusRecord {
+        int type;
+        uint64_t seq;
+        uint64_t timestamp;
+        DWORD status;
+        DWORD atrlen;
+        BYTE atr[MAX_ATR_SIZE];
+        char name[MAX_READER_NAME_LEN];
+    };
+
     struct AsyncResult {
+        explicit AsyncResult(size_t queue_size)
+            : result(SCARD_S_SUCCESS),
+              readers_changed(false),
+              events(queue_size),
+              do_exit(false) {}
+
         LONG result;
-        LPSTR readers_name;
-        DWORD readers_name_length;
+        // Changes of the reader list not delivered yet, net of each other
+        std::vector<std::string> readers_added;
+        std::vector<std::string> readers_removed;
+        bool readers_changed;
+        StatusQueue<StatusRecord> events;
         bool do_exit;
         std::string err_msg;
     };
@@ -34,16 +79,45 @@ class PCSCLite: public Napi::ObjectWrap<PCSCLite> {
         PCSCLite(const Napi::CallbackInfo& info);
         ~PCSCLite();
 
+        // Called by CardReader (on the JS thread) to register itself with
+        // this instance and to (un)subscribe to its status events. Unwatch()
+        // returns whether the reader is still to receive '_end'.
+        void Attach(CardReader* reader);
+        void Detach(CardReader* reader);
+        void Watch(CardReader* reader);
+        bool Unwatch(CardReader* reader, bool notify);
+
+        // Pool shared by the readers for their I/O, NULL for a thread per reader.
+        std::shared_ptr<Executor> GetExecutor() const { return m_executor; };
+
+        // Card types of the status events, JS thread only.
+        const AtrMatcher& GetAtrMatcher() const { return m_atr_matcher; };
+
+        // Shared state of the readers, if attached.
+        StateTable& GetStateTable() { return m_state_table; };
+
     private:
 
         Napi::Value Start(const Napi::CallbackInfo& info);
         Napi::Value Close(const Napi::CallbackInfo& info);
+        Napi::Value DroppedEvents(const Napi::CallbackInfo& info);
+        Napi::Value GetStats(const Napi::CallbackInfo& info);
+        Napi::Value ResetStats(const Napi::CallbackInfo& info);
+        Napi::Value SetAtrPatterns(const Napi::CallbackInfo& info);
+        Napi::Value AttachStateTable(const Napi::CallbackInfo& info);
+        Napi::Value Own(const Napi::CallbackInfo& info);
 
         static void HandleReaderStatusChange(uv_async_t *handle);
         static void HandlerFunction(void* arg);
         static void CloseCallback(uv_handle_t *handle);
+        static void EnvCleanup(void* arg);
+
+        void emit_readers(Napi::Env env, AsyncBaton* async_baton);
+        void push_status(AsyncResult* ar, int type, const SCARD_READERSTATE* state, const std::string& name);
 
-        LONG get_card_readers(PCSCLite* pcsclite, AsyncResult* async_result);
+        LONG get_card_readers(std::string& readers_name);
+        bool diff_readers(AsyncResult* ar, const std::vector<std::string>& names);
+        void update_reader_states(std::vector<std::string>& names);
 
     private:
 
@@ -51,9 +125,37 @@ class PCSCLite: public Napi::ObjectWrap<PCSCLite> {
         SCARD_READERSTATE m_card_reader_state;
         uv_thread_t m_status_thread;
         uv_mutex_t m_mutex;
-        uv_cond_t m_cond;
         bool m_pnp;
         int m_state;
+        AsyncBaton *m_async_baton;
+        uint64_t m_seq;
+        uint64_t m_dropped_events;
+        // Owned by the monitor thread: one entry per reader, preceded by the
+        // PnP notification entry when PnP is supported.
+        std::vector<std::string> m_reader_names;
+        std::vector<SCARD_READERSTATE> m_reader_states;
+        std::unordered_set<std::string> m_known_readers;
+        // With a filter, only the readers taken by JS (see Own()) are watched, under m_mutex:
+        // m_rewatch asks the monitor thread to rebuild its states, m_deciding tells it that new
+        // readers are on their way to JS, so that they may be taken any time.
+        bool m_filtered;
+        std::unordered_set<std::string> m_owned;
+        bool m_rewatch;
+        bool m_deciding;
+        // Owned by the JS thread.
+        std::set<CardReader*> m_readers;
+        std::map<std::string, CardReader*> m_watched;
+        std::vector<CardReader*> m_ended;
+        std::shared_ptr<Executor> m_executor;
+        // Stats of the readers gone, JS thread only
+        IoStats m_retired_stats;
+        // JS thread only
+        AtrMatcher m_atr_matcher;
+        // The environment is going away, see EnvCleanup()
+        bool m_tearing_down;
+        // Written by the monitor thread, keeps its SharedArrayBuffer alive
+        StateTable m_state_table;
+        Napi::ObjectReference m_state_table_ref;
 };
 
 #endif /* PCSCLITE_H */
@@ -0,0 +1,97 @@
+#include "pool.h"
+
+Napi::Object PoolCounters::ToObject(Napi::Env env, size_t free) const {
+    Napi::Object obj = Napi::Object::New(env);
+    obj.Set("hits", Napi::Number::New(env, hits));
+    obj.Set("misses", Napi::Number::New(env, misses));
+    obj.Set("free", Napi::Number::New(env, free));
+    return obj;
+}
+
+BufferPool::BufferPool() {
+    static_assert(sizeof(Header) <= BUFFER_POOL_HEADER, "Header of the buffers too big");
+
+    for (size_t i = 0; i < BUFFER_POOL_CLASSES; i++) {
+        m_free[i].reserve(BUFFER_POOL_CAPACITY);
+    }
+}
+
+BufferPool::~BufferPool() {
+    for (size_t i = 0; i < BUFFER_POOL_CLASSES; i++) {
+        for (size_t j = 0; j < m_free[i].size(); j++) {
+            release(m_free[i][j]);
+        }
+    }
+}
+
+size_t BufferPool::size_class(size_t len) {
+    size_t index = 0;
+    for (size_t size = BUFFER_POOL_MIN_SIZE; size < len; size <<= 1) {
+        index++;
+    }
+
+    return index;
+}
+
+void BufferPool::release(uint8_t* data) {
+    header(data)->~Header();
+    delete [] (data - BUFFER_POOL_HEADER);
+}
+
+uint8_t* BufferPool::Get(size_t len, PoolCounters& counters) {
+    if (!Pooled(len)) {
+        return NULL;
+    }
+
+    size_t index = size_class(len);
+    std::vector<uint8_t*>& free = m_free[index];
+    if (free.empty()) {
+        counters.misses++;
+        uint8_t* block = new uint8_t[BUFFER_POOL_HEADER + ((size_t)BUFFER_POOL_MIN_SIZE << index)];
+        Header* h = new (block) Header();
+        h->size_class = index;
+        return block + BUFFER_POOL_HEADER;
+    }
+
+    counters.hits++;
+    uint8_t* data = free.back();
+    free.pop_back();
+    return data;
+}
+
+void BufferPool::Put(uint8_t* data) {
+    std::vector<uint8_t*>& free = m_free[header(data)->size_class];
+    if (free.size() < BUFFER_POOL_CAPACITY) {
+        free.push_back(data);
+    } else {
+        release(data);
+    }
+}
+
+Napi::Value BufferPool::ToBuffer(Napi::Env env, uint8_t* data, size_t len) {
+    if (len < ((size_t)BUFFER_POOL_MIN_SIZE << header(data)->size_class) / 2) {
+        Napi::Buffer<uint8_t> buffer = Napi::Buffer<uint8_t>::Copy(env, data, len);
+        Put(data);
+        return buffer;
+    }
+
+    /* Called right away when the data has to be copied anyway (no external buffers) */
+    header(data)->owner = shared_from_this();
+    return Napi::Buffer<uint8_t>::NewOrCopy(env, data, len, Finalize);
+}
+
+void BufferPool::Finalize(Napi::Env env, uint8_t* data) {
+    /* The last reference to the pool may be this one, released once the buffer is back */
+    std::shared_ptr<BufferPool> owner;
+    owner.swap(header(data)->owner);
+    owner->Put(data);
+}
+
+size_t BufferPool::Free() const {
+    size_t free = 0;
+    for (size_t i = 0; i < BUFFER_POOL_CLASSES; i++) {
+        free += m_free[i].size();
+    }
+
+    return free;
+}
@@ -0,0 +1,146 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <napi.h>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+// Objects of a type kept for reuse by an ObjectPool
+#define OBJECT_POOL_CAPACITY 64
+// Size classes of a BufferPool: 256, 512, ... BUFFER_POOL_MAX_SIZE bytes
+#define BUFFER_POOL_MIN_SIZE 256
+#define BUFFER_POOL_MAX_SIZE 4096
+#define BUFFER_POOL_CLASSES 5
+// Buffers of a size class kept for reuse
+#define BUFFER_POOL_CAPACITY 16
+// Room for the header in front of every buffer, keeping the data 16 bytes aligned
+#define BUFFER_POOL_HEADER 32
+
+// Requests served from a pool, and the ones which had to allocate
+struct PoolCounters {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+
+    void Reset() { hits = 0; misses = 0; };
+    void Add(const PoolCounters& other) { hits += other.hits; misses += other.misses; };
+    Napi::Object ToObject(Napi::Env env, size_t free) const;
+};
+
+/*
+ * Free list of the memory of the objects of a type: New() constructs in a
+ * block released by Delete() when there is one, so that a steady flow of
+ * requests stops going to the allocator. Up to OBJECT_POOL_CAPACITY blocks
+ * are kept, the others freed. Not thread safe.
+ */
+template <typename T>
+class ObjectPool {
+
+    public:
+
+        ObjectPool() { m_free.reserve(OBJECT_POOL_CAPACITY); };
+
+        ~ObjectPool() {
+            for (size_t i = 0; i < m_free.size(); i++) {
+                ::operator delete(m_free[i]);
+            }
+        };
+
+        T* New() {
+            void* block;
+            if (m_free.empty()) {
+                block = ::operator new(sizeof(T));
+                m_counters.misses++;
+            } else {
+                block = m_free.back();
+                m_free.pop_back();
+                m_counters.hits++;
+            }
+
+            return new (block) T();
+        };
+
+        void Delete(T* obj) {
+            if (!obj) {
+                return;
+            }
+
+            obj->~T();
+            if (m_free.size() < OBJECT_POOL_CAPACITY) {
+                m_free.push_back(obj);
+            } else {
+                ::operator delete(obj);
+            }
+        };
+
+        const PoolCounters& Counters() const { return m_counters; };
+        size_t Free() const { return m_free.size(); };
+        void ResetCounters() { m_counters.Reset(); };
+
+    private:
+
+        ObjectPool(const ObjectPool&);
+        ObjectPool& operator=(const ObjectPool&);
+
+    private:
+
+        std::vector<void*> m_free;
+        PoolCounters m_counters;
+};
+
+/*
+ * Buffers of power of two size classes, from BUFFER_POOL_MIN_SIZE to
+ * BUFFER_POOL_MAX_SIZE bytes, for the responses of the requests. Bigger ones
+ * are left to the caller.
+ *
+ * A pool belongs to an environment (see AddonData), rather than to a reader:
+ * the buffers handed over to JS by ToBuffer() keep it alive and come back to
+ * it once collected, which may well be after their reader is gone. Not thread
+ * safe, JS thread only.
+ */
+class BufferPool : public std::enable_shared_from_this<BufferPool> {
+
+    public:
+
+        BufferPool();
+        ~BufferPool();
+
+        // A buffer of at least len bytes, NULL over BUFFER_POOL_MAX_SIZE. Counted in counters.
+        uint8_t* Get(size_t len, PoolCounters& counters);
+        // Gives back a buffer from Get().
+        void Put(uint8_t* data);
+        // The first len bytes of a buffer from Get(), as a Buffer: they are copied out when they fill
+        // less than half of it, so that it is reused right away. Otherwise it is handed over without a
+        // copy and only comes back once the Buffer is collected.
+        Napi::Value ToBuffer(Napi::Env env, uint8_t* data, size_t len);
+
+        static bool Pooled(size_t len) { return len <= BUFFER_POOL_MAX_SIZE; };
+
+        size_t Free() const;
+
+    private:
+
+        // In front of the data of every buffer
+        struct Header {
+            // Index of its size class
+            size_t size_class;
+            // While handed over to JS
+            std::shared_ptr<BufferPool> owner;
+        };
+
+        static size_t size_class(size_t len);
+        static Header* header(uint8_t* data) { return reinterpret_cast<Header*>(data - BUFFER_POOL_HEADER); };
+        static void release(uint8_t* data);
+        static void Finalize(Napi::Env env, uint8_t* data);
+
+        BufferPool(const BufferPool&);
+        BufferPool& operator=(const BufferPool&);
+
+    private:
+
+        std::vector<uint8_t*> m_free[BUFFER_POOL_CLASSES];
+};
+
+#endif /* POOL_H */
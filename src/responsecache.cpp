@@ -0,0 +1,62 @@
+#include "responsecache.h"
+
+std::string ResponseCache::key(DWORD protocol, const BYTE* command, size_t command_len) {
+    std::string key(reinterpret_cast<const char*>(&protocol), sizeof(protocol));
+    key.append(reinterpret_cast<const char*>(command), command_len);
+    return key;
+}
+
+const std::string* ResponseCache::Find(DWORD protocol, const BYTE* command, size_t command_len) {
+    std::unordered_map<std::string, std::list<Entry>::iterator>::iterator it =
+        m_index.find(key(protocol, command, command_len));
+    if (it == m_index.end()) {
+        m_misses++;
+        return NULL;
+    }
+
+    m_hits++;
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    return &it->second->second;
+}
+
+void ResponseCache::Insert(uint64_t generation, DWORD protocol, const BYTE* command, size_t command_len,
+                           const BYTE* response, size_t response_len) {
+    if (generation != m_generation || command_len + response_len > MAX_BYTES) {
+        return;
+    }
+
+    std::string k = key(protocol, command, command_len);
+    std::unordered_map<std::string, std::list<Entry>::iterator>::iterator it = m_index.find(k);
+    if (it != m_index.end()) {
+        m_bytes -= it->second->first.size() + it->second->second.size();
+        m_entries.erase(it->second);
+        m_index.erase(it);
+    }
+
+    m_entries.push_front(Entry(k, std::string(reinterpret_cast<const char*>(response), response_len)));
+    m_index[k] = m_entries.begin();
+    m_bytes += k.size() + response_len;
+
+    while (m_entries.size() > MAX_ENTRIES || m_bytes > MAX_BYTES) {
+        const Entry& last = m_entries.back();
+        m_bytes -= last.first.size() + last.second.size();
+        m_index.erase(last.first);
+        m_entries.pop_back();
+    }
+}
+
+void ResponseCache::Clear() {
+    m_entries.clear();
+    m_index.clear();
+    m_bytes = 0;
+    m_generation++;
+}
+
+Napi::Object ResponseCache::ToObject(Napi::Env env) const {
+    Napi::Object obj = Napi::Object::New(env);
+    obj.Set("entries", Napi::Number::New(env, m_entries.size()));
+    obj.Set("bytes", Napi::Number::New(env, m_bytes));
+    obj.Set("hits", Napi::Number::New(env, m_hits));
+    obj.Set("misses", Napi::Number::New(env, m_misses));
+    return obj;
+}
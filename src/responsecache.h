@@ -0,0 +1,61 @@
+#ifndef RESPONSECACHE_H
+#define RESPONSECACHE_H
+
+#include <napi.h>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#ifdef __APPLE__
+#include <PCSC/winscard.h>
+#include <PCSC/wintypes.h>
+#else
+#include <winscard.h>
+#endif
+
+/*
+ * LRU of the responses of the commands marked cacheable, keyed by protocol
+ * and command bytes, bounded in entries and in bytes. JS thread only.
+ *
+ * Whatever invalidates the card state (status change, disconnection, reset)
+ * clears it and bumps the generation: a response to a command sent before
+ * that is not stored.
+ */
+class ResponseCache {
+
+    public:
+
+        static const size_t MAX_ENTRIES = 64;
+        static const size_t MAX_BYTES = 256 * 1024;
+
+        ResponseCache() : m_bytes(0), m_generation(0), m_hits(0), m_misses(0) {};
+
+        // The cached response, NULL when none.
+        const std::string* Find(DWORD protocol, const BYTE* command, size_t command_len);
+        // Stores a response unless the cache was cleared since generation.
+        void Insert(uint64_t generation, DWORD protocol, const BYTE* command, size_t command_len,
+                    const BYTE* response, size_t response_len);
+        void Clear();
+
+        uint64_t Generation() const { return m_generation; };
+
+        Napi::Object ToObject(Napi::Env env) const;
+
+    private:
+
+        static std::string key(DWORD protocol, const BYTE* command, size_t command_len);
+
+    private:
+
+        typedef std::pair<std::string, std::string> Entry;
+
+        // Most recently used first
+        std::list<Entry> m_entries;
+        std::unordered_map<std::string, std::list<Entry>::iterator> m_index;
+        size_t m_bytes;
+        uint64_t m_generation;
+        uint64_t m_hits;
+        uint64_t m_misses;
+};
+
+#endif /* RESPONSECACHE_H */
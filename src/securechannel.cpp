@@ -0,0 +1,265 @@
+#include "securechannel.h"
+#include <cstring>
+
+namespace {
+
+    // Fields of a command, see ISO 7816-3 12.1
+    struct Command {
+        const BYTE* data;
+        DWORD lc;
+        bool has_le;
+        DWORD le;                           // 1 to 65536
+        bool extended;
+    };
+
+    bool parse_command(const BYTE* in_data, DWORD in_len, Command* command) {
+        memset(command, 0, sizeof(*command));
+        if (in_len < 4) {
+            return false;
+        }
+
+        const BYTE* body = in_data + 4;
+        DWORD len = in_len - 4;
+        if (len == 0) {
+            return true;
+        }
+
+        if (len == 1) {
+            command->has_le = true;
+            command->le = body[0] ? body[0] : 256;
+            return true;
+        }
+
+        if (body[0]) {
+            command->lc = body[0];
+            command->data = body + 1;
+            if (len == 2 + command->lc) {
+                command->has_le = true;
+                command->le = body[len - 1] ? body[len - 1] : 256;
+            }
+
+            return len == 1 + command->lc || command->has_le;
+        }
+
+        if (len < 3) {
+            return false;
+        }
+
+        command->extended = true;
+        DWORD value = (body[1] << 8) | body[2];
+        if (len == 3) {
+            command->has_le = true;
+            command->le = value ? value : 65536;
+            return true;
+        }
+
+        command->lc = value;
+        command->data = body + 3;
+        if (value && len == 5 + value) {
+            DWORD le = (body[len - 2] << 8) | body[len - 1];
+            command->has_le = true;
+            command->le = le ? le : 65536;
+        }
+
+        return value && (len == 3 + value || command->has_le);
+    }
+
+    LONG copy_response(const BYTE* in_data, DWORD in_len, BYTE* out_data, DWORD* out_len) {
+        if (in_len > *out_len) {
+            return SCARD_E_INSUFFICIENT_BUFFER;
+        }
+
+        memcpy(out_data, in_data, in_len);
+        *out_len = in_len;
+        return SCARD_S_SUCCESS;
+    }
+
+    bool equal_mac(const uint8_t* a, const uint8_t* b, size_t len) {
+        uint8_t diff = 0;
+        for (size_t i = 0; i < len; i++) {
+            diff |= a[i] ^ b[i];
+        }
+
+        return diff == 0;
+    }
+}
+
+SecureChannel::SecureChannel(const uint8_t* enc, const uint8_t* mac, const uint8_t* rmac, size_t key_len,
+                             uint8_t level)
+    : m_enc(enc, key_len),
+      m_mac(mac, key_len),
+      m_rmac(rmac, key_len),
+      m_level(level),
+      m_authenticated(false),
+      m_failed(false),
+      m_counter(0) {
+
+    memset(m_chaining, 0, sizeof(m_chaining));
+}
+
+SecureChannel::~SecureChannel() {
+    secure_zero(m_chaining, sizeof(m_chaining));
+}
+
+void SecureChannel::counter_block(uint8_t first, uint8_t* icv) const {
+    uint8_t block[AES_BLOCK_SIZE] = { 0 };
+    block[0] = first;
+    block[12] = (uint8_t)(m_counter >> 24);
+    block[13] = (uint8_t)(m_counter >> 16);
+    block[14] = (uint8_t)(m_counter >> 8);
+    block[15] = (uint8_t)m_counter;
+    m_enc.Encrypt(block, icv);
+}
+
+LONG SecureChannel::Wrap(const BYTE* in_data, DWORD in_len, std::vector<BYTE>* out) {
+    if (m_failed) {
+        return SCARD_W_SECURITY_VIOLATION;
+    }
+
+    Command command;
+    if (!parse_command(in_data, in_len, &command)) {
+        return SCARD_E_INVALID_PARAMETER;
+    }
+
+    /* EXTERNAL AUTHENTICATE first, C-MAC only */
+    uint8_t level = m_authenticated ? m_level : C_MAC;
+    bool encrypt = (level & C_DECRYPTION) && command.lc;
+    size_t data_len = encrypt ? (command.lc / AES_BLOCK_SIZE + 1) * AES_BLOCK_SIZE : command.lc;
+    size_t lc = data_len + ((level & C_MAC) ? 8 : 0);
+    if (lc > 0xFFFF) {
+        return SCARD_E_INVALID_PARAMETER;
+    }
+
+    bool extended = command.extended || lc > 0xFF;
+    BYTE cla = in_data[0];
+    if (level & C_MAC) {
+        /* Secure messaging indication of the first or the further interindustry classes */
+        cla |= (cla & 0x40) ? 0x20 : 0x04;
+    }
+
+    out->clear();
+    out->reserve(4 + 3 + lc + 3);
+    out->push_back(cla);
+    out->insert(out->end(), in_data + 1, in_data + 4);
+    if (lc && extended) {
+        out->push_back(0x00);
+        out->push_back((BYTE)(lc >> 8));
+        out->push_back((BYTE)lc);
+    } else if (lc) {
+        out->push_back((BYTE)lc);
+    }
+
+    if (m_authenticated) {
+        m_counter++;
+    }
+
+    size_t data_offset = out->size();
+    if (command.lc) {
+        out->insert(out->end(), command.data, command.data + command.lc);
+    }
+
+    if (encrypt) {
+        /* Padded with 80 00..., to a whole number of blocks */
+        out->push_back(0x80);
+        out->resize(data_offset + data_len, 0x00);
+
+        uint8_t icv[AES_BLOCK_SIZE];
+        counter_block(0x00, icv);
+        m_enc.CbcEncrypt(icv, out->data() + data_offset, out->data() + data_offset, data_len);
+    }
+
+    if (level & C_MAC) {
+        /* Over the chaining value (the last C-MAC) and the command so far */
+        std::vector<BYTE> input(m_chaining, m_chaining + AES_BLOCK_SIZE);
+        input.insert(input.end(), out->begin(), out->end());
+        m_mac.Cmac(input.data(), input.size(), m_chaining);
+        out->insert(out->end(), m_chaining, m_chaining + 8);
+    }
+
+    if (command.has_le && extended) {
+        if (!lc) {
+            out->push_back(0x00);
+        }
+
+        out->push_back((BYTE)(command.le >> 8));
+        out->push_back((BYTE)command.le);
+    } else if (command.has_le) {
+        out->push_back((BYTE)command.le);
+    }
+
+    return SCARD_S_SUCCESS;
+}
+
+LONG SecureChannel::Unwrap(const BYTE* in_data, DWORD in_len, BYTE* out_data, DWORD* out_len) {
+    if (in_len < 2) {
+        m_failed = true;
+        return SCARD_W_SECURITY_VIOLATION;
+    }
+
+    uint16_t sw = (in_data[in_len - 2] << 8) | in_data[in_len - 1];
+
+    /* Response of EXTERNAL AUTHENTICATE, never protected */
+    if (!m_authenticated) {
+        if (sw == 0x9000) {
+            m_authenticated = true;
+        } else {
+            m_failed = true;
+        }
+
+        return copy_response(in_data, in_len, out_data, out_len);
+    }
+
+    /* Only 9000 and the warnings (62xx, 63xx) are protected */
+    bool error = sw != 0x9000 && (sw >> 8) != 0x62 && (sw >> 8) != 0x63;
+    if (!(m_level & R_MAC) || error) {
+        return copy_response(in_data, in_len, out_data, out_len);
+    }
+
+    if (in_len < 10) {
+        m_failed = true;
+        return SCARD_W_SECURITY_VIOLATION;
+    }
+
+    DWORD data_len = in_len - 10;
+    std::vector<BYTE> input(m_chaining, m_chaining + AES_BLOCK_SIZE);
+    input.insert(input.end(), in_data, in_data + data_len);
+    input.insert(input.end(), in_data + in_len - 2, in_data + in_len);
+
+    uint8_t mac[AES_BLOCK_SIZE];
+    m_rmac.Cmac(input.data(), input.size(), mac);
+    if (!equal_mac(mac, in_data + data_len, 8)) {
+        m_failed = true;
+        return SCARD_W_SECURITY_VIOLATION;
+    }
+
+    std::vector<BYTE> data(in_data, in_data + data_len);
+    if ((m_level & R_ENCRYPTION) && data_len) {
+        if (data_len % AES_BLOCK_SIZE) {
+            m_failed = true;
+            return SCARD_W_SECURITY_VIOLATION;
+        }
+
+        uint8_t icv[AES_BLOCK_SIZE];
+        counter_block(0x80, icv);
+        m_enc.CbcDecrypt(icv, data.data(), data.data(), data_len);
+
+        /* Padding 80 00..., within the last block */
+        size_t end = data.size();
+        while (end > 0 && data[end - 1] == 0x00 && data.size() - end < AES_BLOCK_SIZE - 1) {
+            end--;
+        }
+
+        if (end == 0 || data[end - 1] != 0x80) {
+            m_failed = true;
+            secure_zero(data.data(), data.size());
+            return SCARD_W_SECURITY_VIOLATION;
+        }
+
+        data.resize(end - 1);
+    }
+
+    data.insert(data.end(), in_data + in_len - 2, in_data + in_len);
+    LONG result = copy_response(data.data(), data.size(), out_data, out_len);
+    secure_zero(data.data(), data.size());
+    return result;
+}
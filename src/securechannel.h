@@ -0,0 +1,78 @@
+#ifndef SECURECHANNEL_H
+#define SECURECHANNEL_H
+
+#include <cstdint>
+#include <vector>
+#ifdef __APPLE__
+#include <PCSC/winscard.h>
+#include <PCSC/wintypes.h>
+#else
+#include <winscard.h>
+#endif
+#include "aes.h"
+
+// Most a protected response adds to the plain one: R-MAC and padding
+#define SECURE_CHANNEL_OVERHEAD (8 + AES_BLOCK_SIZE)
+
+/*
+ * GlobalPlatform Secure Channel Protocol 03 (Card Specification v2.3,
+ * Amendment D) messaging over the session keys of a channel whose
+ * INITIALIZE UPDATE was done by the caller:
+ *
+ *  - the first command wrapped is the EXTERNAL AUTHENTICATE, C-MACed only
+ *    whatever the level. Its 9000 opens the channel, any other status word
+ *    fails it,
+ *  - every later command increments the encryption counter, its data is
+ *    encrypted (C-DECRYPTION, AES-CBC with S-ENC and an ICV derived from
+ *    the counter) then C-MACed (CMAC with S-MAC over the MAC chaining
+ *    value, the header and the data) as the level asks,
+ *  - their responses are checked (R-MAC, with S-RMAC) and decrypted
+ *    (R-ENCRYPTION), but for the ones with an error status word, which
+ *    carry nothing else.
+ *
+ * A failed channel, on a bad response or a transmission whose outcome is
+ * unknown, refuses to wrap anything: the card and us can't agree on the
+ * counter and the chaining value anymore, nor should plain commands go out
+ * in its place.
+ */
+class SecureChannel {
+
+    public:
+
+        // Security level, as the P1 of EXTERNAL AUTHENTICATE
+        static const uint8_t C_MAC = 0x01;
+        static const uint8_t C_DECRYPTION = 0x02;
+        static const uint8_t R_MAC = 0x10;
+        static const uint8_t R_ENCRYPTION = 0x20;
+
+        // Keys of key_len bytes, see Aes::ValidKeyLength().
+        SecureChannel(const uint8_t* enc, const uint8_t* mac, const uint8_t* rmac, size_t key_len, uint8_t level);
+        ~SecureChannel();
+
+        // Protects a command (short or extended) into out. SCARD_E_INVALID_PARAMETER if it
+        // isn't a well-formed one, SCARD_W_SECURITY_VIOLATION once the channel failed.
+        LONG Wrap(const BYTE* in_data, DWORD in_len, std::vector<BYTE>* out);
+
+        // Checks and unprotects the response of the last command wrapped into out_data, of
+        // *out_len bytes. SCARD_W_SECURITY_VIOLATION if it doesn't check.
+        LONG Unwrap(const BYTE* in_data, DWORD in_len, BYTE* out_data, DWORD* out_len);
+
+        void Fail() { m_failed = true; };
+
+    private:
+
+        void counter_block(uint8_t first, uint8_t* icv) const;
+
+    private:
+
+        Aes m_enc;
+        Aes m_mac;
+        Aes m_rmac;
+        uint8_t m_level;
+        bool m_authenticated;
+        bool m_failed;
+        uint32_t m_counter;
+        uint8_t m_chaining[AES_BLOCK_SIZE];
+};
+
+#endif /* SECURECHANNEL_H */
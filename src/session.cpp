@@ -0,0 +1,285 @@
+#include "session.h"
+#include <cerrno>
+#include <cstring>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+namespace {
+
+    const BYTE MAGIC[] = { 'P', 'C', 'S', 'C', 'L', 'O', 'G', 0x01 };
+
+    // Buffered records are handed to the writer past this size
+    const size_t FLUSH_SIZE = 64 * 1024;
+
+    void put_varint(std::vector<BYTE>& out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back((BYTE)(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back((BYTE)value);
+    }
+
+    void put_bytes(std::vector<BYTE>& out, const BYTE* data, size_t len) {
+        put_varint(out, len);
+        if (len) {
+            out.insert(out.end(), data, data + len);
+        }
+    }
+
+    inline uint64_t zigzag(int64_t value) {
+        return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+    }
+
+    inline int64_t unzigzag(uint64_t value) {
+        return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+    }
+
+    /* Reads the log sequentially, any overrun fails the whole reader */
+    struct LogReader {
+        const BYTE* data;
+        size_t len;
+        size_t pos;
+        bool failed;
+
+        bool done() const { return failed || pos >= len; };
+
+        uint64_t varint() {
+            uint64_t value = 0;
+            for (int shift = 0; shift < 64; shift += 7) {
+                if (pos >= len) {
+                    break;
+                }
+
+                BYTE byte = data[pos++];
+                value |= (uint64_t)(byte & 0x7F) << shift;
+                if (!(byte & 0x80)) {
+                    return value;
+                }
+            }
+
+            failed = true;
+            return 0;
+        }
+
+        void bytes(std::vector<BYTE>& out) {
+            uint64_t n = varint();
+            if (failed || n > len - pos) {
+                failed = true;
+                return;
+            }
+
+            out.assign(data + pos, data + pos + n);
+            pos += n;
+        }
+    };
+
+    bool read_header(LogReader& log, std::string* name) {
+        if (log.len < sizeof(MAGIC) || memcmp(log.data, MAGIC, sizeof(MAGIC)) != 0) {
+            return false;
+        }
+
+        log.pos = sizeof(MAGIC);
+        std::vector<BYTE> bytes;
+        log.bytes(bytes);
+        if (log.failed) {
+            return false;
+        }
+
+        name->assign(bytes.begin(), bytes.end());
+        return true;
+    }
+
+    void sleep_ns(uint64_t ns) {
+        if (!ns) {
+            return;
+        }
+
+#ifdef _WIN32
+        Sleep((DWORD)(ns / 1000000));
+#else
+        struct timespec ts;
+        ts.tv_sec = ns / 1000000000;
+        ts.tv_nsec = ns % 1000000000;
+        while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {
+        }
+#endif
+    }
+}
+
+SessionRecorder::SessionRecorder(uv_loop_t* loop, FILE* file)
+    : m_loop(loop),
+      m_file(file),
+      m_last(uv_hrtime()),
+      m_writing(false),
+      m_closing(false),
+      m_close_file(false),
+      m_error(0),
+      m_env(NULL) {
+
+    m_work.data = this;
+}
+
+SessionRecorder* SessionRecorder::Open(uv_loop_t* loop, const std::string& path, const std::string& reader,
+                                       std::string* error) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        *error = path + ": " + strerror(errno);
+        return NULL;
+    }
+
+    SessionRecorder* recorder = new SessionRecorder(loop, file);
+    recorder->m_buffer.insert(recorder->m_buffer.end(), MAGIC, MAGIC + sizeof(MAGIC));
+    put_bytes(recorder->m_buffer, reinterpret_cast<const BYTE*>(reader.data()), reader.size());
+    return recorder;
+}
+
+void SessionRecorder::Record(uint8_t type, uint64_t timestamp, uint64_t duration, LONG result, uint32_t arg,
+                             const BYTE* in_data, size_t in_len, const BYTE* out_data, size_t out_len) {
+    m_buffer.push_back(type);
+    put_varint(m_buffer, zigzag((int64_t)(timestamp - m_last)));
+    put_varint(m_buffer, duration);
+    put_varint(m_buffer, (uint32_t)result);
+    put_varint(m_buffer, arg);
+    put_bytes(m_buffer, in_data, in_len);
+    put_bytes(m_buffer, out_data, out_len);
+    m_last = timestamp;
+
+    if (m_buffer.size() >= FLUSH_SIZE) {
+        m_queue.push_back(std::vector<BYTE>());
+        m_queue.back().swap(m_buffer);
+        schedule();
+    }
+}
+
+void SessionRecorder::Close(Napi::Env env, Napi::Function callback) {
+    m_env = env;
+    if (!callback.IsEmpty()) {
+        m_callback = Napi::Persistent(callback);
+    }
+
+    if (!m_buffer.empty()) {
+        m_queue.push_back(std::vector<BYTE>());
+        m_queue.back().swap(m_buffer);
+    }
+
+    m_closing = true;
+    schedule();
+}
+
+void SessionRecorder::schedule() {
+    if (m_writing || (m_queue.empty() && !m_closing)) {
+        return;
+    }
+
+    if (!m_queue.empty()) {
+        m_chunk.swap(m_queue.front());
+        m_queue.pop_front();
+    }
+
+    m_close_file = m_closing && m_queue.empty();
+    m_writing = true;
+    uv_queue_work(m_loop, &m_work, DoWrite, AfterWrite);
+}
+
+void SessionRecorder::DoWrite(uv_work_t* req) {
+    SessionRecorder* recorder = static_cast<SessionRecorder*>(req->data);
+    std::vector<BYTE>& chunk = recorder->m_chunk;
+
+    if (!chunk.empty() && fwrite(chunk.data(), 1, chunk.size(), recorder->m_file) != chunk.size() &&
+        !recorder->m_error) {
+        recorder->m_error = errno;
+    }
+
+    if (recorder->m_close_file) {
+        if (fclose(recorder->m_file) != 0 && !recorder->m_error) {
+            recorder->m_error = errno;
+        }
+        recorder->m_file = NULL;
+    }
+}
+
+void SessionRecorder::AfterWrite(uv_work_t* req, int status) {
+    SessionRecorder* recorder = static_cast<SessionRecorder*>(req->data);
+    recorder->m_writing = false;
+    recorder->m_chunk.clear();
+
+    if (recorder->m_file) {
+        recorder->schedule();
+        return;
+    }
+
+    if (!recorder->m_callback.IsEmpty()) {
+        Napi::Env env(recorder->m_env);
+        Napi::HandleScope scope(env);
+        Napi::Value err = env.Null();
+        if (recorder->m_error) {
+            err = Napi::Error::New(env, std::string("Session log error: ") + strerror(recorder->m_error)).Value();
+        }
+
+        recorder->m_callback.Call({ err });
+        if (env.IsExceptionPending()) {
+            napi_fatal_exception(env, env.GetAndClearPendingException().Value());
+        }
+    }
+
+    delete recorder;
+}
+
+bool SessionReplay::ReaderName(const BYTE* data, size_t len, std::string* name) {
+    LogReader log = { data, len, 0, false };
+    return read_header(log, name);
+}
+
+SessionReplay* SessionReplay::Parse(const BYTE* data, size_t len, double speed, std::string* error) {
+    LogReader log = { data, len, 0, false };
+    std::string name;
+    if (!read_header(log, &name)) {
+        *error = "Not a session log";
+        return NULL;
+    }
+
+    SessionReplay* replay = new SessionReplay(speed);
+    int64_t time = 0;
+    while (!log.done()) {
+        Event event;
+        event.type = log.data[log.pos++];
+        time += unzigzag(log.varint());
+        event.time = time > 0 ? time : 0;
+        event.duration = log.varint();
+        event.result = (LONG)(uint32_t)log.varint();
+        event.arg = log.varint();
+        log.bytes(event.in_data);
+        log.bytes(event.out_data);
+
+        if (log.failed || event.type < SESSION_CONNECT || event.type > SESSION_CACHED_TRANSMIT) {
+            *error = "Truncated or corrupted session log";
+            delete replay;
+            return NULL;
+        }
+
+        if (event.type == SESSION_STATUS) {
+            replay->m_status.push_back(event);
+        } else if (event.type != SESSION_CACHED_TRANSMIT) {
+            replay->m_requests.push_back(event);
+        }
+    }
+
+    return replay;
+}
+
+LONG SessionReplay::Request(uint8_t type, const Event** event) {
+    if (m_next >= m_requests.size() || m_requests[m_next].type != type) {
+        return SCARD_E_UNEXPECTED;
+    }
+
+    *event = &m_requests[m_next++];
+    sleep_ns(Scale((*event)->duration));
+    return (*event)->result;
+}
+
+uint64_t SessionReplay::Scale(uint64_t ns) const {
+    return m_speed > 0 ? (uint64_t)(ns / m_speed) : 0;
+}
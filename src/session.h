@@ -0,0 +1,139 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <napi.h>
+#include <uv.h>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <vector>
+#ifdef __APPLE__
+#include <PCSC/winscard.h>
+#include <PCSC/wintypes.h>
+#else
+#include <winscard.h>
+#endif
+
+/*
+ * Session log of a reader: what it exchanged with the card and when, as an
+ * append-only binary file.
+ *
+ *   header:  "PCSCLOG" 0x01, varint length of the reader name, name
+ *   record:  type (1 byte), then varints: zigzag delta in ns of its start to
+ *            the previous one (to the start of the recording for the first),
+ *            time spent in SCard in ns, result, arg, length of the input,
+ *            input bytes, length of the output, output bytes
+ *
+ * Varints are LEB128. arg is the protocol of connections and transmissions,
+ * the control code, the disposition or the reader state.
+ *
+ * Transmissions answered from the response cache of the reader are recorded
+ * as SESSION_CACHED_TRANSMIT, without a duration: they never reached the
+ * card, and are left out on replay, where the cache answers them again.
+ */
+enum SessionEventType {
+    SESSION_CONNECT = 1,
+    SESSION_RECONNECT,
+    SESSION_DISCONNECT,
+    SESSION_TRANSMIT,
+    SESSION_CONTROL,
+    SESSION_BEGIN_TRANSACTION,
+    SESSION_END_TRANSACTION,
+    SESSION_STATUS,
+    SESSION_CACHED_TRANSMIT
+};
+
+/*
+ * Writes a session log. Record() is called on the JS thread and only buffers,
+ * full buffers are written by the libuv threadpool one at a time, in order.
+ */
+class SessionRecorder {
+
+    public:
+
+        // NULL with an error message when the file can't be created.
+        static SessionRecorder* Open(uv_loop_t* loop, const std::string& path, const std::string& reader,
+                                     std::string* error);
+
+        void Record(uint8_t type, uint64_t timestamp, uint64_t duration, LONG result, uint32_t arg,
+                    const BYTE* in_data, size_t in_len, const BYTE* out_data, size_t out_len);
+
+        // Writes what is left and closes the file, then calls back (if not empty)
+        // with the first write error, if any, and deletes itself.
+        void Close(Napi::Env env, Napi::Function callback);
+
+    private:
+
+        SessionRecorder(uv_loop_t* loop, FILE* file);
+
+        void schedule();
+
+        static void DoWrite(uv_work_t* req);
+        static void AfterWrite(uv_work_t* req, int status);
+
+    private:
+
+        uv_loop_t* m_loop;
+        FILE* m_file;
+        uint64_t m_last;
+        std::vector<BYTE> m_buffer;
+        // Full buffers waiting for the writer
+        std::deque<std::vector<BYTE> > m_queue;
+        // Written by the threadpool while m_writing
+        uv_work_t m_work;
+        std::vector<BYTE> m_chunk;
+        bool m_writing;
+        bool m_closing;
+        bool m_close_file;
+        int m_error;
+        napi_env m_env;
+        Napi::FunctionReference m_callback;
+};
+
+/*
+ * Plays a session log back: the requests of the reader are answered in the
+ * recorded order and time, its status changes are due at their recorded
+ * offsets. Both scaled by the speed, 0 for no waiting at all.
+ */
+class SessionReplay {
+
+    public:
+
+        struct Event {
+            uint8_t type;
+            uint64_t time;                  // ns since the start of the recording
+            uint64_t duration;
+            LONG result;
+            uint32_t arg;
+            std::vector<BYTE> in_data;
+            std::vector<BYTE> out_data;
+        };
+
+        // NULL with an error message when data is not a session log.
+        static SessionReplay* Parse(const BYTE* data, size_t len, double speed, std::string* error);
+        // Reader name of a log, false when data is not one.
+        static bool ReaderName(const BYTE* data, size_t len, std::string* name);
+
+        // Next recorded request, waited for as long as the card took. It must be of the
+        // given type, SCARD_E_UNEXPECTED otherwise or past the end of the log. Worker
+        // thread, under the reader lock.
+        LONG Request(uint8_t type, const Event** event);
+
+        // Status changes, JS thread only.
+        const std::vector<Event>& StatusEvents() const { return m_status; };
+        uint64_t Scale(uint64_t ns) const;
+
+    private:
+
+        SessionReplay(double speed) : m_speed(speed), m_next(0) {};
+
+    private:
+
+        double m_speed;
+        std::vector<Event> m_requests;
+        size_t m_next;
+        std::vector<Event> m_status;
+};
+
+#endif /* SESSION_H */
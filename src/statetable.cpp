@@ -0,0 +1,152 @@
+#include "statetable.h"
+#include <atomic>
+#include <cassert>
+#include <cstring>
+
+namespace {
+
+    /* JS reads the table through typed arrays, i.e. in the native byte order */
+    inline void put32(uint8_t* p, uint32_t value) {
+        memcpy(p, &value, sizeof(value));
+    }
+
+    inline void put64(uint8_t* p, uint64_t value) {
+        memcpy(p, &value, sizeof(value));
+    }
+
+    inline uint32_t get32(const uint8_t* p) {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    inline std::atomic<uint32_t>* seq_of(uint8_t* slot) {
+        static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "lock-free 32 bit atomics required");
+        return reinterpret_cast<std::atomic<uint32_t>*>(slot);
+    }
+}
+
+StateTable::StateTable() : m_data(NULL), m_slots(0), m_next_id(0) {
+    assert(uv_mutex_init(&m_mutex) == 0);
+}
+
+StateTable::~StateTable() {
+    uv_mutex_destroy(&m_mutex);
+}
+
+size_t StateTable::Attach(uint8_t* data, size_t len) {
+    uv_mutex_lock(&m_mutex);
+    m_data = data;
+    m_slots = len < HEADER_SIZE ? 0 : (len - HEADER_SIZE) / SLOT_SIZE;
+    m_index.clear();
+    memset(m_data, 0, len);
+    put32(m_data, MAGIC);
+    put32(m_data + 4, VERSION);
+    put32(m_data + 8, SLOT_SIZE);
+    put32(m_data + 12, m_slots);
+    uv_mutex_unlock(&m_mutex);
+
+    return m_slots;
+}
+
+void StateTable::begin_write(uint8_t* slot) {
+    std::atomic<uint32_t>* seq = seq_of(slot);
+    seq->store(seq->load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void StateTable::end_write(uint8_t* slot) {
+    std::atomic<uint32_t>* seq = seq_of(slot);
+    seq->store(seq->load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void StateTable::Update(const std::string& name, DWORD state, const BYTE* atr, DWORD atrlen,
+                        uint64_t event, uint64_t timestamp) {
+    uv_mutex_lock(&m_mutex);
+    if (!m_data) {
+        uv_mutex_unlock(&m_mutex);
+        return;
+    }
+
+    uint32_t index;
+    bool fresh = false;
+    std::map<std::string, uint32_t>::iterator it = m_index.find(name);
+    if (it != m_index.end()) {
+        index = it->second;
+    } else {
+        for (index = 0; index < m_slots; index++) {
+            if (!(get32(slot(index) + OFFSET_FLAGS) & FLAG_USED)) {
+                break;
+            }
+        }
+
+        if (index == m_slots) {
+            uv_mutex_unlock(&m_mutex);
+            return;
+        }
+
+        m_index[name] = index;
+        fresh = true;
+    }
+
+    uint8_t* s = slot(index);
+    begin_write(s);
+    if (fresh) {
+        size_t namelen = name.size() < NAME_SIZE ? name.size() : NAME_SIZE;
+        put32(s + OFFSET_FLAGS, FLAG_USED);
+        put32(s + OFFSET_ID, ++m_next_id);
+        put32(s + OFFSET_NAMELEN, namelen);
+        memcpy(s + OFFSET_NAME, name.data(), namelen);
+    }
+
+    atrlen = atrlen < ATR_SIZE ? atrlen : ATR_SIZE;
+    put32(s + OFFSET_STATE, state);
+    put32(s + OFFSET_ATRLEN, atrlen);
+    put64(s + OFFSET_TIME, timestamp);
+    put64(s + OFFSET_EVENT, event);
+    memcpy(s + OFFSET_ATR, atr, atrlen);
+    end_write(s);
+    uv_mutex_unlock(&m_mutex);
+}
+
+void StateTable::clear_slot(uint32_t index) {
+    uint8_t* s = slot(index);
+    begin_write(s);
+    memset(s + OFFSET_FLAGS, 0, SLOT_SIZE - OFFSET_FLAGS);
+    end_write(s);
+}
+
+void StateTable::Remove(const std::string& name) {
+    uv_mutex_lock(&m_mutex);
+    std::map<std::string, uint32_t>::iterator it = m_index.find(name);
+    if (it != m_index.end()) {
+        clear_slot(it->second);
+        m_index.erase(it);
+    }
+
+    uv_mutex_unlock(&m_mutex);
+}
+
+void StateTable::Clear() {
+    uv_mutex_lock(&m_mutex);
+    for (std::map<std::string, uint32_t>::iterator it = m_index.begin(); it != m_index.end(); ++it) {
+        clear_slot(it->second);
+    }
+
+    m_index.clear();
+    uv_mutex_unlock(&m_mutex);
+}
+
+void StateTable::SetConnected(const std::string& name, bool connected) {
+    uv_mutex_lock(&m_mutex);
+    std::map<std::string, uint32_t>::iterator it = m_index.find(name);
+    if (it != m_index.end()) {
+        uint8_t* s = slot(it->second);
+        uint32_t flags = get32(s + OFFSET_FLAGS);
+        begin_write(s);
+        put32(s + OFFSET_FLAGS, connected ? (flags | FLAG_CONNECTED) : (flags & ~FLAG_CONNECTED));
+        end_write(s);
+    }
+
+    uv_mutex_unlock(&m_mutex);
+}
@@ -0,0 +1,92 @@
+#ifndef STATETABLE_H
+#define STATETABLE_H
+
+#include <uv.h>
+#include <cstdint>
+#include <map>
+#include <string>
+#ifdef __APPLE__
+#include <PCSC/winscard.h>
+#include <PCSC/wintypes.h>
+#else
+#include <winscard.h>
+#endif
+
+/*
+ * State of the readers of a PCSCLite instance, written in place into memory
+ * shared with JS (a SharedArrayBuffer, see ReaderStateTable in lib/) which any
+ * thread can read without locks nor calls into the addon. Native byte order:
+ *
+ *   header:  magic "PCST", version, slot size, slot count (uint32 each)
+ *   slot:    seq      uint32   seqlock, odd while the slot is being written
+ *            flags    uint32   FLAG_USED, FLAG_CONNECTED
+ *            state    uint32   dwEventState of the last change
+ *            atrlen   uint32
+ *            time     uint64   uv_hrtime() of the last change
+ *            event    uint64   seq of the status event of the last change
+ *            id       uint32   changes whenever the slot gets another reader
+ *            namelen  uint32
+ *            atr      36 bytes
+ *            name     up to NAME_SIZE bytes, UTF-8
+ *
+ * A reader gets the first free slot with its first status change and loses
+ * it when it goes away, readers past the last slot are left out.
+ */
+class StateTable {
+
+    public:
+
+        static const uint32_t MAGIC = 0x54534350;
+        static const uint32_t VERSION = 1;
+        static const size_t HEADER_SIZE = 16;
+        static const size_t SLOT_SIZE = 320;
+        static const uint32_t FLAG_USED = 1;
+        static const uint32_t FLAG_CONNECTED = 2;
+
+        StateTable();
+        ~StateTable();
+
+        // Before the monitor thread starts, JS thread. Returns the slot count.
+        size_t Attach(uint8_t* data, size_t len);
+        bool Attached() const { return m_data != NULL; };
+
+        // Monitor thread.
+        void Update(const std::string& name, DWORD state, const BYTE* atr, DWORD atrlen,
+                    uint64_t event, uint64_t timestamp);
+        void Remove(const std::string& name);
+        void Clear();
+
+        // JS thread.
+        void SetConnected(const std::string& name, bool connected);
+
+    private:
+
+        static const size_t OFFSET_SEQ = 0;
+        static const size_t OFFSET_FLAGS = 4;
+        static const size_t OFFSET_STATE = 8;
+        static const size_t OFFSET_ATRLEN = 12;
+        static const size_t OFFSET_TIME = 16;
+        static const size_t OFFSET_EVENT = 24;
+        static const size_t OFFSET_ID = 32;
+        static const size_t OFFSET_NAMELEN = 36;
+        static const size_t OFFSET_ATR = 40;
+        static const size_t ATR_SIZE = 36;
+        static const size_t OFFSET_NAME = OFFSET_ATR + ATR_SIZE;
+        static const size_t NAME_SIZE = SLOT_SIZE - OFFSET_NAME;
+
+        uint8_t* slot(uint32_t index) const { return m_data + HEADER_SIZE + index * SLOT_SIZE; };
+        static void begin_write(uint8_t* slot);
+        static void end_write(uint8_t* slot);
+        void clear_slot(uint32_t index);
+
+    private:
+
+        uint8_t* m_data;
+        uint32_t m_slots;
+        uint32_t m_next_id;
+        // Writers are serialized, readers never wait
+        uv_mutex_t m_mutex;
+        std::map<std::string, uint32_t> m_index;
+};
+
+#endif /* STATETABLE_H */
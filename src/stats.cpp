@@ -0,0 +1,221 @@
+#include "stats.h"
+#include <cstdio>
+#include <cstring>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+
+    /* Index of the most significant bit set, value > 0 */
+    inline int msb(uint64_t value) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanReverse64(&index, value);
+        return index;
+#else
+        return 63 - __builtin_clzll(value);
+#endif
+    }
+
+    /* Time between two marks, 0 when one of them was not reached */
+    inline bool elapsed(uint64_t from, uint64_t to, uint64_t* value) {
+        if (!from || !to || to < from) {
+            return false;
+        }
+
+        *value = to - from;
+        return true;
+    }
+}
+
+size_t Histogram::index_of(uint64_t value) {
+    if (value < (1u << SUB_BUCKET_BITS)) {
+        return value;
+    }
+
+    int exponent = msb(value);
+    if (exponent > MAX_EXPONENT) {
+        return BUCKETS - 1;
+    }
+
+    size_t sub_bucket = (value >> (exponent - SUB_BUCKET_BITS)) & ((1u << SUB_BUCKET_BITS) - 1);
+    return ((exponent - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS) + sub_bucket;
+}
+
+uint64_t Histogram::value_at(size_t index) {
+    /* Middle of the bucket */
+    if (index < (1u << SUB_BUCKET_BITS)) {
+        return index;
+    }
+
+    int exponent = (index >> SUB_BUCKET_BITS) + SUB_BUCKET_BITS - 1;
+    uint64_t sub_bucket = index & ((1u << SUB_BUCKET_BITS) - 1);
+    uint64_t width = (uint64_t)1 << (exponent - SUB_BUCKET_BITS);
+    return ((uint64_t)1 << exponent) + sub_bucket * width + width / 2;
+}
+
+void Histogram::Record(uint64_t value) {
+    m_counts[index_of(value)]++;
+    m_count++;
+    m_sum += value;
+    if (value < m_min) {
+        m_min = value;
+    }
+
+    if (value > m_max) {
+        m_max = value;
+    }
+}
+
+void Histogram::Merge(const Histogram& other) {
+    for (size_t i = 0; i < BUCKETS; i++) {
+        m_counts[i] += other.m_counts[i];
+    }
+
+    m_count += other.m_count;
+    m_sum += other.m_sum;
+    if (other.m_min < m_min) {
+        m_min = other.m_min;
+    }
+
+    if (other.m_max > m_max) {
+        m_max = other.m_max;
+    }
+}
+
+void Histogram::Reset() {
+    memset(m_counts, 0, sizeof(m_counts));
+    m_count = 0;
+    m_min = UINT64_MAX;
+    m_max = 0;
+    m_sum = 0;
+}
+
+uint64_t Histogram::percentile(double p) const {
+    if (!m_count) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(p / 100.0 * m_count + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        seen += m_counts[i];
+        if (seen >= rank) {
+            uint64_t value = value_at(i);
+            // Never report more than was recorded
+            return value > m_max ? m_max : value < m_min ? m_min : value;
+        }
+    }
+
+    return m_max;
+}
+
+Napi::Object Histogram::ToObject(Napi::Env env) const {
+    Napi::Object obj = Napi::Object::New(env);
+    obj.Set("count", Napi::Number::New(env, m_count));
+    obj.Set("min", Napi::Number::New(env, m_count ? m_min : 0));
+    obj.Set("max", Napi::Number::New(env, m_max));
+    obj.Set("mean", Napi::Number::New(env, m_count ? (double)m_sum / m_count : 0));
+    obj.Set("p50", Napi::Number::New(env, percentile(50)));
+    obj.Set("p90", Napi::Number::New(env, percentile(90)));
+    obj.Set("p99", Napi::Number::New(env, percentile(99)));
+    obj.Set("p999", Napi::Number::New(env, percentile(99.9)));
+    return obj;
+}
+
+void IoStats::Record(const RequestTrace& trace) {
+    m_requests++;
+    m_apdus += trace.apdus;
+    m_bytes_in += trace.bytes_in;
+    m_bytes_out += trace.bytes_out;
+    if (trace.result != SCARD_S_SUCCESS) {
+        m_errors[trace.result]++;
+    }
+
+    uint64_t value;
+    if (elapsed(trace.submitted, trace.started, &value)) {
+        m_queue.Record(value);
+    }
+
+    if (elapsed(trace.started, trace.locked, &value)) {
+        m_lock.Record(value);
+    }
+
+    if (elapsed(trace.locked, trace.returned, &value)) {
+        m_scard.Record(value);
+    }
+
+    if (elapsed(trace.returned, trace.completed, &value)) {
+        m_delivery.Record(value);
+    }
+
+    if (elapsed(trace.submitted, trace.completed, &value)) {
+        m_total.Record(value);
+    }
+}
+
+void IoStats::Merge(const IoStats& other) {
+    m_requests += other.m_requests;
+    m_apdus += other.m_apdus;
+    m_bytes_in += other.m_bytes_in;
+    m_bytes_out += other.m_bytes_out;
+    for (const auto& it : other.m_errors) {
+        m_errors[it.first] += it.second;
+    }
+
+    m_cached += other.m_cached;
+
+    m_queue.Merge(other.m_queue);
+    m_lock.Merge(other.m_lock);
+    m_scard.Merge(other.m_scard);
+    m_delivery.Merge(other.m_delivery);
+    m_total.Merge(other.m_total);
+}
+
+void IoStats::Reset() {
+    m_requests = 0;
+    m_apdus = 0;
+    m_bytes_in = 0;
+    m_bytes_out = 0;
+    m_errors.clear();
+    m_cached = 0;
+    m_queue.Reset();
+    m_lock.Reset();
+    m_scard.Reset();
+    m_delivery.Reset();
+    m_total.Reset();
+}
+
+Napi::Object IoStats::ToObject(Napi::Env env) const {
+    Napi::Object obj = Napi::Object::New(env);
+    obj.Set("requests", Napi::Number::New(env, m_requests));
+    obj.Set("apdus", Napi::Number::New(env, m_apdus));
+    obj.Set("bytes_in", Napi::Number::New(env, m_bytes_in));
+    obj.Set("bytes_out", Napi::Number::New(env, m_bytes_out));
+
+    /* By PC/SC error code, e.g. "0x80100068" */
+    Napi::Object errors = Napi::Object::New(env);
+    for (const auto& it : m_errors) {
+        char code[16];
+        snprintf(code, sizeof(code), "0x%.8lX", (unsigned long)(uint32_t)it.first);
+        errors.Set(code, Napi::Number::New(env, it.second));
+    }
+
+    obj.Set("errors", errors);
+    obj.Set("cached", Napi::Number::New(env, m_cached));
+
+    Napi::Object latency = Napi::Object::New(env);
+    latency.Set("queue", m_queue.ToObject(env));
+    latency.Set("lock", m_lock.ToObject(env));
+    latency.Set("scard", m_scard.ToObject(env));
+    latency.Set("delivery", m_delivery.ToObject(env));
+    latency.Set("total", m_total.ToObject(env));
+    obj.Set("latency", latency);
+
+    return obj;
+}
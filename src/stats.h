@@ -0,0 +1,99 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <napi.h>
+#include <cstdint>
+#include <map>
+#ifdef __APPLE__
+#include <PCSC/winscard.h>
+#include <PCSC/wintypes.h>
+#else
+#include <winscard.h>
+#endif
+
+/*
+ * HDR-style histogram of durations in nanoseconds: exact below 16ns, then 16
+ * linear sub-buckets per power of two, so any value is recorded within 6.25%
+ * in O(1) and a fixed amount of memory. Values above 2^40ns (18 minutes)
+ * land in the last bucket.
+ */
+class Histogram {
+
+    public:
+
+        Histogram() { Reset(); };
+
+        void Record(uint64_t value);
+        void Merge(const Histogram& other);
+        void Reset();
+
+        Napi::Object ToObject(Napi::Env env) const;
+
+    private:
+
+        static size_t index_of(uint64_t value);
+        static uint64_t value_at(size_t index);
+        uint64_t percentile(double p) const;
+
+    public:
+
+        static const int SUB_BUCKET_BITS = 4;
+        static const int MAX_EXPONENT = 40;
+        static const size_t BUCKETS = (MAX_EXPONENT - SUB_BUCKET_BITS + 2) << SUB_BUCKET_BITS;
+
+    private:
+
+        uint64_t m_counts[BUCKETS];
+        uint64_t m_count;
+        uint64_t m_min;
+        uint64_t m_max;
+        uint64_t m_sum;
+};
+
+/*
+ * Timestamps (uv_hrtime()) of a request through its life: queued on the JS
+ * thread, picked up by a worker, reader lock taken, SCard call returned,
+ * completion back on the JS thread. Plus what it exchanged with the card.
+ */
+struct RequestTrace {
+    uint64_t submitted = 0;
+    uint64_t started = 0;
+    uint64_t locked = 0;
+    uint64_t returned = 0;
+    uint64_t completed = 0;
+    LONG result = SCARD_S_SUCCESS;
+    uint32_t apdus = 0;
+    uint64_t bytes_in = 0;
+    uint64_t bytes_out = 0;
+};
+
+/* Counters and latencies of the requests of a reader, JS thread only */
+class IoStats {
+
+    public:
+
+        void Record(const RequestTrace& trace);
+        // A transmission answered from the response cache, without going to the card
+        void RecordCached() { m_cached++; };
+        void Merge(const IoStats& other);
+        void Reset();
+
+        Napi::Object ToObject(Napi::Env env) const;
+
+    private:
+
+        uint64_t m_requests = 0;
+        uint64_t m_apdus = 0;
+        uint64_t m_bytes_in = 0;
+        uint64_t m_bytes_out = 0;
+        std::map<LONG, uint64_t> m_errors;
+        uint64_t m_cached = 0;
+
+        Histogram m_queue;          // submitted -> started
+        Histogram m_lock;           // started -> locked
+        Histogram m_scard;          // locked -> returned
+        Histogram m_delivery;       // returned -> completed
+        Histogram m_total;          // submitted -> completed
+};
+
+#endif /* STATS_H */
@@ -0,0 +1,75 @@
+#ifndef STATUSQUEUE_H
+#define STATUSQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Bounded lock-free single-producer / single-consumer ring buffer.
+ *
+ * Push() must only be called from one thread (the monitor thread) and Pop()
+ * from one other thread (the JS thread). Records pushed while the ring is full
+ * are dropped and counted, the producer never blocks.
+ */
+template <typename T>
+class StatusQueue {
+
+    public:
+
+        explicit StatusQueue(size_t capacity)
+            : m_items(round_up(capacity)),
+              m_mask(m_items.size() - 1),
+              m_head(0),
+              m_tail(0),
+              m_dropped(0) {}
+
+        bool Push(const T& item) {
+            size_t tail = m_tail.load(std::memory_order_relaxed);
+            if (tail - m_head.load(std::memory_order_acquire) > m_mask) {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+
+            m_items[tail & m_mask] = item;
+            m_tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool Pop(T& item) {
+            size_t head = m_head.load(std::memory_order_relaxed);
+            if (head == m_tail.load(std::memory_order_acquire)) {
+                return false;
+            }
+
+            item = m_items[head & m_mask];
+            m_head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        uint64_t Dropped() const { return m_dropped.load(std::memory_order_relaxed); };
+        size_t Capacity() const { return m_mask + 1; };
+
+    private:
+
+        static size_t round_up(size_t capacity) {
+            size_t size = 2;
+            while (size < capacity) {
+                size <<= 1;
+            }
+
+            return size;
+        }
+
+    private:
+
+        std::vector<T> m_items;
+        size_t m_mask;
+        // Consumer and producer indexes live on their own cache lines
+        alignas(64) std::atomic<size_t> m_head;
+        alignas(64) std::atomic<size_t> m_tail;
+        std::atomic<uint64_t> m_dropped;
+};
+
+#endif /* STATUSQUEUE_H */
@@ -0,0 +1,80 @@
+#include "tlv.h"
+
+bool tlv_index(const uint8_t* data, size_t len, std::vector<uint32_t>* index) {
+    /* End of the value of the constructed data objects we're in, no recursion */
+    size_t ends[MAX_TLV_DEPTH + 1];
+    uint32_t depth = 0;
+    size_t pos = 0;
+    ends[0] = len;
+
+    index->clear();
+    for (;;) {
+        while (depth > 0 && pos == ends[depth]) {
+            depth--;
+        }
+
+        size_t end = ends[depth];
+        if (pos == end) {
+            return true;
+        }
+
+        uint8_t first = data[pos];
+        if (first == 0x00 || first == 0xFF) {
+            pos++;
+            continue;
+        }
+
+        /* Subsequent tag bytes have b8 set but the last one */
+        uint32_t tag = first;
+        size_t tag_len = 1;
+        if ((first & 0x1F) == 0x1F) {
+            uint8_t byte;
+            do {
+                if (tag_len == 4 || pos + tag_len >= end) {
+                    return false;
+                }
+
+                byte = data[pos + tag_len++];
+                tag = (tag << 8) | byte;
+            } while (byte & 0x80);
+        }
+
+        pos += tag_len;
+        if (pos >= end) {
+            return false;
+        }
+
+        /* Short form, or the number of length bytes which follow */
+        size_t value_len = data[pos++];
+        if (value_len & 0x80) {
+            size_t count = value_len & 0x7F;
+            if (count == 0 || count > 4 || count > end - pos) {
+                return false;
+            }
+
+            value_len = 0;
+            while (count--) {
+                value_len = (value_len << 8) | data[pos++];
+            }
+        }
+
+        if (value_len > end - pos) {
+            return false;
+        }
+
+        index->push_back(tag);
+        index->push_back(depth);
+        index->push_back((uint32_t)pos);
+        index->push_back((uint32_t)value_len);
+
+        if (first & 0x20) {
+            if (depth == MAX_TLV_DEPTH) {
+                return false;
+            }
+
+            ends[++depth] = pos + value_len;
+        } else {
+            pos += value_len;
+        }
+    }
+}
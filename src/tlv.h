@@ -0,0 +1,26 @@
+#ifndef TLV_H
+#define TLV_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Entries of a TLV index: tag, depth, offset and length of the value
+#define TLV_ENTRY_SIZE 4
+// Deepest nesting of constructed data objects indexed
+#define MAX_TLV_DEPTH 32
+
+/*
+ * Indexes the BER-TLV data objects of data (ISO 7816-4 5.2, as EMV and ICAO
+ * 9303 use them) into a flat array of TLV_ENTRY_SIZE uint32 per data object,
+ * in document order: the data objects of a constructed one follow it, one
+ * level deeper. Tags of up to 4 bytes are packed big endian (e.g. 0x5F20),
+ * lengths take the definite forms only. 00 and FF bytes between data objects
+ * are skipped as padding.
+ *
+ * Returns false, with the data objects indexed so far, when data isn't
+ * well-formed.
+ */
+bool tlv_index(const uint8_t* data, size_t len, std::vector<uint32_t>* index);
+
+#endif /* TLV_H */
@@ -0,0 +1,95 @@
+"use strict";
+
+const { describe, it } = require('mocha');
+const should = require('should');
+
+const { pcsclite, open, close } = require('./common');
+
+// ATR of the fake cards, a PC/SC storage card
+const ATR = '3b8f8001804f0ca000000306030001000000006a';
+
+
+describe('Testing the ATR patterns over the fake readers', function () {
+
+	// cardType of the first status of the card, classified by patterns
+	async function cardType(patterns) {
+		const ctx = await open(2, { atrPatterns: patterns });
+		await close(ctx);
+
+		ctx.status.atr.toString('hex').should.equal(ATR);
+		return ctx.status.cardType;
+	}
+
+	it('matches an ATR string', async function () {
+
+		(await cardType([{ atr: ATR.toUpperCase(), type: 'exact' }])).should.equal('exact');
+
+	});
+
+	it('matches \'.\' as any nibble', async function () {
+
+		const type = await cardType([
+			{ atr: '3B 6F 00 00 80 31 E0 6B ..', type: 'other' },
+			{ atr: '3B 8F 80 01 80 4F 0C A0 00 00 03 06 .. .. .. 00 00 00 00 ..', type: 'storage' },
+		]);
+
+		type.should.equal('storage');
+
+	});
+
+	it('matches a Buffer under its mask', async function () {
+
+		const atr = Buffer.from(ATR, 'hex');
+		atr[13] = 0x0F;
+		const mask = Buffer.alloc(atr.length, 0xFF);
+		mask[13] = 0xF0;
+
+		(await cardType([{ atr: atr, mask: mask, type: 1 }])).should.equal(1);
+
+	});
+
+	it('the first pattern matching wins', async function () {
+
+		const type = await cardType([
+			{ atr: '3B 8F 80 01 80 4F 0C A0 00 00 .. .. .. .. .. .. .. .. .. ..', type: 'first' },
+			{ atr: ATR, type: 'exact' },
+			{ atr: '3B 8F 80 01 80 4F 0C A0 00 00 03 06 .. .. .. 00 00 00 00 ..', type: 'last' },
+		]);
+
+		type.should.equal('first');
+
+	});
+
+	it('does not match', async function () {
+
+		const atr = Buffer.from(ATR, 'hex');
+		atr[13] = 0x0F;
+		// the bits of the mask differ
+		const mask = Buffer.alloc(atr.length, 0xFF);
+		mask[13] = 0x0F;
+
+		should(await cardType([
+			{ atr: atr, mask: mask, type: 'masked' },
+			// a byte short, or longer: an ATR only matches patterns of its length
+			{ atr: ATR.slice(0, -2), type: 'shorter' },
+			{ atr: ATR + '..', type: 'longer' },
+			{ atr: '3B 8F 80 01 80 4F 0C A0 00 00 03 06 .. .. .. 00 00 00 00 6B', type: 'checksum' },
+		])).be.undefined();
+
+		should(await cardType([])).be.undefined();
+
+	});
+
+	it('refuses an invalid pattern', function () {
+
+		const pcsc = pcsclite({ filter: () => false });
+
+		(() => pcsc.setAtrPatterns([{ atr: '3B 8F 8', type: 'odd' }])).should.throw(TypeError);
+		(() => pcsc.setAtrPatterns([{ atr: '3B XX', type: 'hex' }])).should.throw(TypeError);
+		(() => pcsc.setAtrPatterns([{ atr: Buffer.alloc(34), type: 'long' }])).should.throw(TypeError);
+
+		return pcsc.close();
+
+	});
+
+});
@@ -0,0 +1,107 @@
+"use strict";
+
+const { describe, it, before, after } = require('mocha');
+const should = require('should');
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+
+const { pcsclite, readerName, open, close, transmit } = require('./common');
+
+const ECHO = [0x80, 0xCA, 0x00, 0x00, 0x03, 0x01, 0x02, 0x03];
+
+
+// Resolves with the first reader of pcsc, then once it is connected
+function firstReader(pcsc) {
+	return new Promise((resolve, reject) => {
+		pcsc.on('error', reject);
+		pcsc.once('reader', resolve);
+	});
+}
+
+function connect(reader) {
+	return new Promise((resolve, reject) => {
+		reader.once('status', () => {
+			reader.connect({ share_mode: reader.SCARD_SHARE_SHARED }, (err, protocol) => err ? reject(err) : resolve(protocol));
+		});
+	});
+}
+
+
+describe('Testing the response cache over the fake readers', function () {
+
+	let ctx;
+
+	before(async function () {
+		ctx = await open(3);
+	});
+
+	after(async function () {
+		await close(ctx);
+	});
+
+	it('counts the cached responses apart', async function () {
+
+		ctx.reader.clearCache();
+		ctx.reader.resetStats();
+
+		(await transmit(ctx, ECHO, 258, { cache: true })).toString('hex').should.equal('0102039000');
+		(await transmit(ctx, ECHO, 258, { cache: true })).toString('hex').should.equal('0102039000');
+		(await transmit(ctx, ECHO, Buffer.alloc(258), { cache: true })).toString('hex').should.equal('0102039000');
+
+		const stats = ctx.reader.getStats();
+		stats.cached.should.equal(2);
+		stats.requests.should.equal(1);
+		stats.apdus.should.equal(1);
+		stats.latency.total.count.should.equal(1);
+		stats.cache.hits.should.equal(2);
+
+		ctx.reader.resetStats();
+		ctx.reader.getStats().cached.should.equal(0);
+
+	});
+
+	it('records the cached responses, answered from the cache on replay', async function () {
+
+		const log = path.join(os.tmpdir(), 'pcsclite-cache-' + process.pid + '.log');
+		const other = [0x80, 0xCA, 0x00, 0x00, 0x01, 0x07];
+
+		// recorded against the card
+		const pcsc = pcsclite({ filter: name => name === readerName(3) });
+		const reader = await firstReader(pcsc);
+		reader.startRecording(log);
+		const protocol = await connect(reader);
+		const recorded = { reader: reader, protocol: protocol };
+
+		(await transmit(recorded, ECHO, 258, { cache: true })).toString('hex').should.equal('0102039000');
+		(await transmit(recorded, ECHO, 258, { cache: true })).toString('hex').should.equal('0102039000');
+		(await transmit(recorded, other, 258)).toString('hex').should.equal('079000');
+		await reader.stopRecording();
+		await close({ reader: reader, pcsc: pcsc });
+
+		// played back: the cached response is not looked for in the log
+		const replay = pcsclite({ replay: log, speed: 0 });
+		const replayed = { reader: await firstReader(replay) };
+		replayed.protocol = await connect(replayed.reader);
+
+		try {
+			(await transmit(replayed, ECHO, 258, { cache: true })).toString('hex').should.equal('0102039000');
+			(await transmit(replayed, ECHO, 258, { cache: true })).toString('hex').should.equal('0102039000');
+			(await transmit(replayed, other, 258)).toString('hex').should.equal('079000');
+			replayed.reader.getStats().cached.should.equal(1);
+
+			// past the end of the log
+			await transmit(replayed, other, 258).then(function () {
+				throw new Error('should have been rejected');
+			}, function (err) {
+				err.should.be.an.Error();
+			});
+		} finally {
+			await close({ reader: replayed.reader, pcsc: replay });
+			fs.unlinkSync(log);
+		}
+
+	});
+
+});
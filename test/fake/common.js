@@ -0,0 +1,70 @@
+"use strict";
+
+// Set up of the tests over the simulated readers of src/fake (npm run test:fake).
+// The fake service reads its configuration once, so it is set before the addon loads.
+
+process.env.PCSCLITE_FAKE = '1';
+process.env.PCSC_FAKE_READERS = '4';
+
+const pcsclite = require('../../lib/pcsclite');
+
+
+function readerName(index) {
+	return 'Fake Reader ' + String(index).padStart(2, '0') + ' 00';
+}
+
+// Resolves with { pcsc, reader, protocol, status }: the fake reader of the given index, handled by
+// a PCSCLite instance of its own (created with options), connected in shared mode once its first
+// status is reported
+function open(index, options) {
+
+	const pcsc = pcsclite(Object.assign({ filter: name => name === readerName(index) }, options));
+
+	return new Promise((resolve, reject) => {
+
+		pcsc.on('error', reject);
+
+		pcsc.on('reader', (reader) => {
+			reader.once('status', (status) => {
+				reader.connect({ share_mode: reader.SCARD_SHARE_SHARED }, (err, protocol) => {
+					if (err) {
+						return reject(err);
+					}
+
+					resolve({ pcsc: pcsc, reader: reader, protocol: protocol, status: status });
+				});
+			});
+		});
+
+	});
+
+}
+
+async function close(ctx) {
+
+	await ctx.reader.close();
+	await ctx.pcsc.close();
+
+}
+
+function transmit(ctx, data, res_len, options) {
+
+	return new Promise((resolve, reject) => {
+		ctx.reader.transmit(Buffer.from(data), res_len, ctx.protocol, options || {}, (err, response, index) => {
+			if (err) {
+				return reject(err);
+			}
+
+			resolve(index === undefined ? response : { response: response, index: index });
+		});
+	});
+
+}
+
+module.exports = {
+	pcsclite: pcsclite,
+	readerName: readerName,
+	open: open,
+	close: close,
+	transmit: transmit,
+};
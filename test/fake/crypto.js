@@ -0,0 +1,159 @@
+"use strict";
+
+const { describe, it, before, after } = require('mocha');
+const should = require('should');
+
+const { open, close, transmit } = require('./common');
+
+const testing = require('../../build/Release/pcsclite_fake.node')._testing;
+
+const hex = (str) => Buffer.from(str, 'hex');
+
+// SP 800-38A F.2.1, RFC 4493
+const KEY = hex('2b7e151628aed2a6abf7158809cf4f3c');
+const PLAINTEXT = hex('6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e51' +
+	'30c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710');
+
+
+describe('Testing the crypto of the secure channel', function () {
+
+	describe('AES (FIPS-197 C.1 to C.3)', function () {
+
+		const block = hex('00112233445566778899aabbccddeeff');
+		const vectors = [
+			['000102030405060708090a0b0c0d0e0f', '69c4e0d86a7b0430d8cdb78070b4c55a'],
+			['000102030405060708090a0b0c0d0e0f1011121314151617', 'dda97ca4864cdfe06eaf70a0ec0d7191'],
+			['000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f', '8ea2b7ca516745bfeafc49904b496089'],
+		];
+
+		vectors.forEach(([key, ciphertext]) => {
+			it('AES-' + key.length * 4, function () {
+
+				testing.aes(hex(key), block, false).toString('hex').should.equal(ciphertext);
+				testing.aes(hex(key), hex(ciphertext), true).should.deepEqual(block);
+
+			});
+		});
+
+		it('refuses a bad key', function () {
+
+			(() => testing.aes(Buffer.alloc(15), block, false)).should.throw(TypeError);
+
+		});
+
+	});
+
+	it('AES-CBC (SP 800-38A F.2.1, F.2.2)', function () {
+
+		const iv = hex('000102030405060708090a0b0c0d0e0f');
+		const ciphertext = '7649abac8119b246cee98e9b12e9197d5086cb9b507219ee95db113a917678b2' +
+			'73bed6b8e3c1743b7116e69e222295163ff1caa1681fac09120eca307586e1a7';
+
+		testing.aesCbc(KEY, iv, PLAINTEXT, false).toString('hex').should.equal(ciphertext);
+		testing.aesCbc(KEY, iv, hex(ciphertext), true).should.deepEqual(PLAINTEXT);
+
+	});
+
+	it('AES-CMAC (RFC 4493)', function () {
+
+		testing.cmac(KEY, PLAINTEXT.slice(0, 0)).toString('hex').should.equal('bb1d6929e95937287fa37d129b756746');
+		testing.cmac(KEY, PLAINTEXT.slice(0, 16)).toString('hex').should.equal('070a16b46b4d4144f79bdd9dd04a287c');
+		testing.cmac(KEY, PLAINTEXT.slice(0, 40)).toString('hex').should.equal('dfa66747de9ae63030ca32611497c827');
+		testing.cmac(KEY, PLAINTEXT).toString('hex').should.equal('51f0bebf7e3b9d92fc49741779363cfe');
+
+	});
+
+});
+
+describe('Testing SCP03 over the fake readers', function () {
+
+	// Session keys of the fake cards
+	const keys = {
+		enc: hex('404142434445464748494a4b4c4d4e4f'),
+		mac: hex('505152535455565758595a5b5c5d5e5f'),
+		rmac: hex('606162636465666768696a6b6c6d6e6f'),
+	};
+
+	let ctx;
+
+	before(async function () {
+		ctx = await open(0);
+	});
+
+	after(async function () {
+		await close(ctx);
+	});
+
+	function openSecureChannel(channel_keys, level) {
+		return new Promise((resolve, reject) => {
+			ctx.reader.openSecureChannel(channel_keys, level, (err) => err ? reject(err) : resolve());
+		});
+	}
+
+	function closeSecureChannel() {
+		return new Promise((resolve, reject) => {
+			ctx.reader.closeSecureChannel((err) => err ? reject(err) : resolve());
+		});
+	}
+
+	function externalAuthenticate(level) {
+		return transmit(ctx, [0x80, 0x82, level, 0x00, 0x08, 1, 2, 3, 4, 5, 6, 7, 8], 2);
+	}
+
+	it('C-MAC, C-DECRYPTION, R-MAC and R-ENCRYPTION round trip', async function () {
+
+		const level = ctx.reader.SCP03_C_MAC | ctx.reader.SCP03_C_DECRYPTION |
+			ctx.reader.SCP03_R_MAC | ctx.reader.SCP03_R_ENCRYPTION;
+
+		await openSecureChannel(keys, level);
+		(await externalAuthenticate(level)).toString('hex').should.equal('9000');
+
+		// the counter and the MAC chaining value move on with every command
+		for (let i = 0; i < 4; i++) {
+			const response = await transmit(ctx, [0x80, 0xCA, 0x00, 0x00, 0x03, 0x01, 0x02, i, 0x00], 258);
+			response.should.deepEqual(Buffer.from([0x01, 0x02, i, 0x90, 0x00]));
+		}
+
+		(await transmit(ctx, [0x00, 0xB0, 0x00, 0x10, 0x02], 258)).toString('hex').should.equal('10119000');
+		// error status words are not protected
+		(await transmit(ctx, [0x00, 0xB1, 0x00, 0x00, 0x00], 258)).toString('hex').should.equal('6b00');
+
+		const data = Buffer.alloc(300, 0xA5);
+		const command = Buffer.concat([Buffer.from([0x80, 0xCA, 0x00, 0x00, 0x00, 0x01, 0x2C]), data, Buffer.from([0x00, 0x00])]);
+		const response = await transmit(ctx, command, 302);
+		response.should.deepEqual(Buffer.concat([data, Buffer.from([0x90, 0x00])]));
+
+		await closeSecureChannel();
+		(await transmit(ctx, [0x80, 0xCA, 0x00, 0x00, 0x01, 0x07], 258)).toString('hex').should.equal('079000');
+
+	});
+
+	it('C-MAC only', async function () {
+
+		await openSecureChannel(keys, ctx.reader.SCP03_C_MAC);
+		(await externalAuthenticate(ctx.reader.SCP03_C_MAC)).toString('hex').should.equal('9000');
+
+		(await transmit(ctx, [0x80, 0xCA, 0x00, 0x00, 0x02, 0x0A, 0x0B], 258)).toString('hex').should.equal('0a0b9000');
+
+		await closeSecureChannel();
+
+	});
+
+	it('fails on a wrong key', async function () {
+
+		await openSecureChannel(Object.assign({}, keys, { mac: Buffer.alloc(16) }), ctx.reader.SCP03_C_MAC);
+
+		// the card refuses the C-MAC, and the failed channel refuses to send anything else
+		(await externalAuthenticate(ctx.reader.SCP03_C_MAC)).toString('hex').should.equal('6982');
+		await transmit(ctx, [0x80, 0xCA, 0x00, 0x00, 0x01, 0x07], 258).then(function () {
+			throw new Error('should have been rejected');
+		}, function (err) {
+			err.should.be.an.Error();
+		});
+
+		await closeSecureChannel();
+		(await transmit(ctx, [0x80, 0xCA, 0x00, 0x00, 0x01, 0x07], 258)).toString('hex').should.equal('079000');
+
+	});
+
+});
@@ -0,0 +1,84 @@
+"use strict";
+
+const { describe, it, before, after } = require('mocha');
+const should = require('should');
+
+const { open, close, transmit } = require('./common');
+
+const ECHO = Buffer.from([0x80, 0xCA, 0x00, 0x00, 0x01, 0x07]);
+
+// E4: the card takes P1P2 ms more to answer
+function slow(ms) {
+	return Buffer.from([0x80, 0xE4, ms >> 8, ms & 0xFF]);
+}
+
+function rejected(promise) {
+	return promise.then(function () {
+		throw new Error('should have been rejected');
+	}, function (err) {
+		return err;
+	});
+}
+
+function delay(ms) {
+	return new Promise(resolve => setTimeout(resolve, ms));
+}
+
+
+describe('Testing the deadlines over the fake readers', function () {
+
+	this.timeout(5000);
+
+	let ctx;
+
+	before(async function () {
+		ctx = await open(0);
+	});
+
+	after(async function () {
+		await close(ctx);
+	});
+
+	it('a request past its deadline in the card leaves the reader unusable until it returns', async function () {
+
+		const start = Date.now();
+
+		const hung = rejected(ctx.reader.transmitAsync(slow(1000), 258, ctx.protocol, { timeout: 50 }));
+		const queued = rejected(ctx.reader.transmitAsync(ECHO, 258, ctx.protocol));
+		const queuedCallback = rejected(transmit(ctx, ECHO, 258));
+
+		// at the deadline, whatever the card does
+		const err = await hung;
+		err.code.should.equal('ETIMEDOUT');
+		(Date.now() - start).should.be.below(500);
+
+		// the requests behind it fail right away, as do the new ones
+		(await queued).code.should.equal('EBUSY');
+		(await queuedCallback).code.should.equal('EBUSY');
+		(await rejected(ctx.reader.transmitAsync(ECHO, 258, ctx.protocol))).code.should.equal('EBUSY');
+		(await rejected(transmit(ctx, ECHO, 258))).code.should.equal('EBUSY');
+		(Date.now() - start).should.be.below(500);
+
+		// usable again once the card answered
+		await delay(1200 - (Date.now() - start));
+		(await transmit(ctx, ECHO, 258)).toString('hex').should.equal('079000');
+		(await ctx.reader.transmitAsync(ECHO, 258, ctx.protocol)).toString('hex').should.equal('079000');
+
+	});
+
+	it('a request aborted while queued', async function () {
+
+		const controller = new AbortController();
+
+		const first = ctx.reader.transmitAsync(slow(100), 258, ctx.protocol);
+		const aborted = rejected(ctx.reader.transmitAsync(ECHO, 258, ctx.protocol, { signal: controller.signal }));
+		controller.abort();
+
+		(await aborted).code.should.equal('ABORT_ERR');
+		(await first).toString('hex').should.equal('9000');
+		// nothing hung
+		(await transmit(ctx, ECHO, 258)).toString('hex').should.equal('079000');
+
+	});
+
+});
@@ -0,0 +1,44 @@
+"use strict";
+
+const { describe, it, before, after } = require('mocha');
+const should = require('should');
+
+const { open, close } = require('./common');
+
+
+describe('Testing the I/O threads over the fake readers', function () {
+
+	let ctx;
+
+	before(async function () {
+		ctx = await open(1, { ioThreads: 4 });
+	});
+
+	after(async function () {
+		await close(ctx);
+	});
+
+	it('runs the requests of a reader in order', function (done) {
+
+		const count = 64;
+		const order = [];
+
+		for (let i = 0; i < count; i++) {
+			ctx.reader.transmit(Buffer.from([0x80, 0xCA, 0x00, 0x00, 0x01, i]), 258, ctx.protocol, function (err, response) {
+
+				should.not.exist(err);
+				// the card echoes the data, so the response tells which request it answers
+				response.toString('hex').should.equal(Buffer.from([i, 0x90, 0x00]).toString('hex'));
+				order.push(i);
+
+				if (order.length === count) {
+					order.should.eql(Array.from({ length: count }, (_, j) => j));
+					done();
+				}
+
+			});
+		}
+
+	});
+
+});
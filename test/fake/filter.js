@@ -0,0 +1,72 @@
+"use strict";
+
+const { describe, it } = require('mocha');
+const should = require('should');
+
+const { pcsclite, open, close, readerName } = require('./common');
+
+
+// The readers in the state table of pcsc, that is the ones its monitor thread watches
+function watched(pcsc) {
+	return pcsc.stateTable.snapshot().map(slot => slot.name).sort();
+}
+
+describe('Testing the filter option over the fake readers', function () {
+
+	it('watches the reader taken only', async function () {
+
+		const ctx = await open(2, { stateTable: 8 });
+
+		try {
+			watched(ctx.pcsc).should.eql([readerName(2)]);
+			Object.keys(ctx.pcsc.readers).should.eql([readerName(2)]);
+		} finally {
+			await close(ctx);
+		}
+
+	});
+
+	it('watches all the readers taken', async function () {
+
+		const names = [readerName(1), readerName(3)];
+		const pcsc = pcsclite({ filter: name => names.includes(name), stateTable: 8 });
+
+		await new Promise((resolve, reject) => {
+			let pending = names.length;
+			pcsc.on('error', reject);
+			pcsc.on('reader', (reader) => {
+				reader.once('status', () => {
+					if (--pending === 0) {
+						resolve();
+					}
+				});
+			});
+		});
+
+		try {
+			watched(pcsc).should.eql(names);
+		} finally {
+			await Promise.all(Object.keys(pcsc.readers).map(name => pcsc.readers[name].close()));
+			await pcsc.close();
+		}
+
+	});
+
+	it('watches no reader when none is taken', async function () {
+
+		const seen = [];
+		const pcsc = pcsclite({ filter: name => { seen.push(name); return false; }, stateTable: 8 });
+
+		await new Promise(resolve => setTimeout(resolve, 200));
+
+		try {
+			seen.length.should.equal(4);
+			watched(pcsc).should.eql([]);
+			Object.keys(pcsc.readers).should.eql([]);
+		} finally {
+			await pcsc.close();
+		}
+
+	});
+
+});
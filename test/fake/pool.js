@@ -0,0 +1,78 @@
+"use strict";
+
+const { describe, it, before, after } = require('mocha');
+const should = require('should');
+
+const { open, close, transmit } = require('./common');
+
+
+describe('Testing the request pools over the fake readers', function () {
+
+	let ctx;
+
+	before(async function () {
+		ctx = await open(2);
+	});
+
+	after(async function () {
+		await close(ctx);
+	});
+
+	it('reuses the buffer of a short response', async function () {
+
+		ctx.reader.resetStats();
+
+		for (let i = 0; i < 8; i++) {
+			const response = await transmit(ctx, [0x80, 0xCA, 0x00, 0x00, 0x01, i], 258);
+			response.toString('hex').should.equal(Buffer.from([i, 0x90, 0x00]).toString('hex'));
+		}
+
+		// copied out, so the buffer is back in the pool for the next transmit
+		const pool = ctx.reader.getStats().pool;
+		(pool.buffers.hits + pool.buffers.misses).should.equal(8);
+		pool.buffers.misses.should.be.belowOrEqual(1);
+		pool.buffers.free.should.be.aboveOrEqual(1);
+		pool.batons.hits.should.be.aboveOrEqual(7);
+		pool.requests.hits.should.be.aboveOrEqual(14);
+
+	});
+
+	it('hands over the buffer of a long response', async function () {
+
+		ctx.reader.resetStats();
+
+		// READ BINARY of 240 bytes at 0, 16, 32..., filling their buffer of 256 bytes
+		const responses = [];
+		for (let i = 0; i < 8; i++) {
+			responses.push(await transmit(ctx, [0x00, 0xB0, 0x00, i * 16, 0xF0], 242));
+		}
+
+		// the ones still referenced can't be reused, nor overwritten
+		responses.forEach((response, i) => {
+			response.length.should.equal(242);
+			response[0].should.equal(i * 16);
+			response[239].should.equal((i * 16 + 239) & 0xFF);
+			response.subarray(240).toString('hex').should.equal('9000');
+		});
+
+		const pool = ctx.reader.getStats().pool;
+		(pool.buffers.hits + pool.buffers.misses).should.equal(8);
+
+	});
+
+	it('leaves the buffers of the caller alone', async function () {
+
+		ctx.reader.resetStats();
+
+		const output = Buffer.alloc(16);
+		const response = await transmit(ctx, [0x80, 0xCA, 0x00, 0x00, 0x02, 0x0A, 0x0B], output);
+
+		response.toString('hex').should.equal('0a0b9000');
+		response.buffer.should.equal(output.buffer);
+
+		const pool = ctx.reader.getStats().pool;
+		(pool.buffers.hits + pool.buffers.misses).should.equal(0);
+
+	});
+
+});
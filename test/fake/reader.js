@@ -0,0 +1,62 @@
+"use strict";
+
+const { describe, it, before, after } = require('mocha');
+const should = require('should');
+
+const { open, close, transmit, readerName } = require('./common');
+
+
+describe('Testing CardReader over the fake readers', function () {
+
+	let ctx;
+
+	before(async function () {
+		ctx = await open(0);
+	});
+
+	after(async function () {
+		await close(ctx);
+	});
+
+	it('reports the card', function () {
+
+		ctx.reader.name.should.equal(readerName(0));
+		ctx.reader.connected.should.be.true();
+		(ctx.status.state & ctx.reader.SCARD_STATE_PRESENT).should.not.equal(0);
+		ctx.status.atr.toString('hex').should.equal('3b8f8001804f0ca000000306030001000000006a');
+
+	});
+
+	it('#transmit() echoes the data', async function () {
+
+		const response = await transmit(ctx, [0x80, 0xCA, 0x00, 0x00, 0x03, 0x01, 0x02, 0x03], 258);
+
+		response.toString('hex').should.equal('0102039000');
+
+	});
+
+	it('#transmit() READ BINARY', async function () {
+
+		const response = await transmit(ctx, [0x00, 0xB0, 0x01, 0x02, 0x04], 258);
+
+		response.toString('hex').should.equal('020304059000');
+
+	});
+
+	it('#transmit() past the end of the file', async function () {
+
+		const response = await transmit(ctx, [0x00, 0xB1, 0x00, 0x00, 0x00], 258);
+
+		response.toString('hex').should.equal('6b00');
+
+	});
+
+	it('#transmitAsync()', async function () {
+
+		const response = await ctx.reader.transmitAsync(Buffer.from([0x00, 0xB0, 0x00, 0x10, 0x02]), 258, ctx.protocol);
+
+		response.toString('hex').should.equal('10119000');
+
+	});
+
+});
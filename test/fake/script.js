@@ -0,0 +1,180 @@
+"use strict";
+
+const { describe, it, before, after } = require('mocha');
+const should = require('should');
+
+const { pcsclite, open, close } = require('./common');
+
+const ApduScript = pcsclite.ApduScript;
+
+
+describe('Testing APDU scripts over the fake readers', function () {
+
+	let ctx;
+
+	before(async function () {
+		ctx = await open(1);
+	});
+
+	after(async function () {
+		await close(ctx);
+	});
+
+	function runScript(script, options) {
+		return new Promise((resolve, reject) => {
+			ctx.reader.runScript(script, 258, ctx.protocol, options || {}, (err, result) => err ? reject(err) : resolve(result));
+		});
+	}
+
+	function rejected(promise) {
+		return promise.then(function () {
+			throw new Error('should have been rejected');
+		}, function (err) {
+			return err;
+		});
+	}
+
+	it('splices captures into later commands', async function () {
+
+		const script = new ApduScript()
+			.set('offset', [0x00, 0x10])
+			.send([0x00, 0xB0], 'offset', 0x04)      // READ BINARY: 10 11 12 13
+			.capture('middle', 1, 3)
+			.capture('all')
+			.send([0x80, 0xCA, 0x00, 0x00], { length: 'middle' }, 'middle', 0x00);
+
+		const result = await runScript(script);
+
+		result.count.should.equal(2);
+		result.responses.map(r => r.toString('hex')).should.deepEqual(['101112139000', '11129000']);
+		result.vars.offset.toString('hex').should.equal('0010');
+		result.vars.middle.toString('hex').should.equal('1112');
+		result.vars.all.toString('hex').should.equal('10111213');
+		result.steps.should.equal(12);
+
+	});
+
+	it('branches on the status word', async function () {
+
+		// E2 answers 6C P2 unless Le is P2: count P2 down to it
+		const script = new ApduScript()
+			.set('le', 0x05)
+			.label('retry')
+			.send([0x00, 0xE2, 0x00], 'le', 0x02)
+			.ifSw(0x9000, 'done')
+			.unlessSw(0x6C00, 'failed', 0xFF00)
+			.add('le', 0xFF)                          // - 1, wrapping around
+			.jump('retry')
+			.label('failed')
+			.set('failed', 0x01)
+			.label('done')
+			.capture('data');
+
+		const result = await runScript(script);
+
+		result.responses.map(r => r.toString('hex')).should.deepEqual(['6c05', '6c04', '6c03', '00019000']);
+		result.vars.le.toString('hex').should.equal('02');
+		result.vars.data.toString('hex').should.equal('0001');
+		result.vars.failed.length.should.equal(0);
+		result.steps.should.equal(1 + 3 * 8 + 5 + 1);
+
+	});
+
+	it('end() stops the script', async function () {
+
+		const script = new ApduScript()
+			.send([0x80, 0xCA, 0x00, 0x00, 0x01, 0x01])
+			.ifSw(0x9000, 'ok')
+			.send([0x80, 0xCA, 0x00, 0x00, 0x01, 0x02])
+			.label('ok')
+			.end()
+			.send([0x80, 0xCA, 0x00, 0x00, 0x01, 0x03]);
+
+		const result = await runScript(script);
+
+		result.responses.map(r => r.toString('hex')).should.deepEqual(['019000']);
+
+	});
+
+	it('stops past its step budget', async function () {
+
+		// never ends: the card always answers 90 00
+		const script = new ApduScript()
+			.set('n', 0x00)
+			.label('next')
+			.send([0x80, 0xCA, 0x00, 0x00, 0x01], 'n')
+			.add('n', 1)
+			.jump('next');
+
+		const err = await rejected(runScript(script, { maxSteps: 10 }));
+
+		err.message.should.equal('Script stopped: Step budget exhausted');
+		err.steps.should.equal(10);
+		// on the jump, after two sends
+		err.pc.should.equal(19);
+		err.index.should.equal(2);
+
+	});
+
+	it('stops on a capture out of the response', async function () {
+
+		const script = new ApduScript()
+			.send([0x80, 0xCA, 0x00, 0x00, 0x02, 0x01, 0x02])
+			.capture('x', 1, 3);
+
+		const err = await rejected(runScript(script));
+
+		err.message.should.equal('Script stopped: Capture out of the response');
+		err.pc.should.equal(11);
+		err.index.should.equal(1);
+
+	});
+
+	it('stops on a command too short', async function () {
+
+		const err = await rejected(runScript(new ApduScript().send([0x00, 0xB0])));
+
+		err.message.should.equal('Script stopped: Invalid command length');
+		err.index.should.equal(0);
+
+	});
+
+	it('stops as soon as a command grows too long', async function () {
+
+		// LIT of 0x8000 bytes, JUMP back to it: appends without ever sending
+		const code = Buffer.concat([Buffer.from([0x01, 0x80, 0x00]), Buffer.alloc(0x8000), Buffer.from([0x08, 0x00, 0x00])]);
+
+		const err = await rejected(new Promise((resolve, reject) => {
+			ctx.reader._run_script(code, 0, 258, ctx.protocol, 10000, false,
+				(err, result) => err ? reject(err) : resolve(result));
+		}));
+
+		err.message.should.equal('Script stopped: Invalid command length');
+		// on the third literal, which would go past MAX_SCRIPT_COMMAND
+		err.steps.should.equal(5);
+		err.pc.should.equal(0);
+		err.index.should.equal(0);
+
+	});
+
+	it('refuses malformed bytecode', function () {
+
+		const run = (code, vars) => () => ctx.reader._run_script(Buffer.from(code), vars, 258, ctx.protocol, 100, false,
+			() => { throw new Error('should not run'); });
+
+		// unknown opcode
+		run([0xEE], 0).should.throw('Invalid script: Invalid instruction');
+		// LIT of 4 bytes, 2 given
+		run([0x01, 0x00, 0x04, 0x00, 0xB0], 0).should.throw('Invalid script: Invalid instruction');
+		// VAR 0 of a script without variables
+		run([0x02, 0x00, 0x04], 0).should.throw('Invalid script: Undefined variable');
+		// JUMP past the end, and into the operands of the LIT
+		run([0x08, 0x00, 0x04], 0).should.throw('Invalid script: Jump out of the instructions');
+		run([0x08, 0x00, 0x04, 0x01, 0x00, 0x01, 0xB0], 0).should.throw('Invalid script: Jump out of the instructions');
+		// CAPTURE of [4, 2)
+		run([0x06, 0x00, 0x00, 0x04, 0x00, 0x02], 1).should.throw('Invalid script: Capture ends before its start');
+		run([], 257).should.throw('Invalid script: Too many variables');
+
+	});
+
+});
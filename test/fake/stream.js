@@ -0,0 +1,91 @@
+"use strict";
+
+const { describe, it, before, after } = require('mocha');
+const should = require('should');
+
+const { open, close } = require('./common');
+
+// Size of the file of the fake cards, B1 past 0x7FFF
+const FILE_SIZE = 0xC000;
+
+
+describe('Testing createReadStream() over the fake readers', function () {
+
+	let ctx;
+
+	before(async function () {
+		ctx = await open(1);
+	});
+
+	after(async function () {
+		await close(ctx);
+	});
+
+	async function read(options) {
+		const chunks = [];
+		for await (const chunk of ctx.reader.createReadStream(ctx.protocol, options)) {
+			chunks.push(chunk);
+		}
+
+		return Buffer.concat(chunks);
+	}
+
+	function checkFile(data, offset) {
+		for (let i = 0; i < data.length; i++) {
+			if (data[i] !== ((offset + i) & 0xFF)) {
+				throw new Error('Wrong byte at offset ' + (offset + i));
+			}
+		}
+	}
+
+	it('reads the whole file, past 0x7FFF', async function () {
+
+		const data = await read({ chunk_size: 0xE0 });
+
+		data.length.should.equal(FILE_SIZE);
+		checkFile(data, 0);
+
+	});
+
+	it('reads the whole file in extended length chunks', async function () {
+
+		const data = await read({ chunk_size: 0x1000 });
+
+		data.length.should.equal(FILE_SIZE);
+		checkFile(data, 0);
+
+	});
+
+	it('reads a range across 0x7FFF', async function () {
+
+		const data = await read({ offset: 0x7F00, length: 0x400, chunk_size: 0x82 });
+
+		data.length.should.equal(0x400);
+		checkFile(data, 0x7F00);
+
+	});
+
+	it('reads the file while the consumer is slow', async function () {
+
+		const chunks = [];
+		const stream = ctx.reader.createReadStream(ctx.protocol, { offset: 0x7000, chunk_size: 0x100, highWaterMark: 1 });
+		for await (const chunk of stream) {
+			chunks.push(chunk);
+			await new Promise(resolve => setImmediate(resolve));
+		}
+
+		const data = Buffer.concat(chunks);
+		data.length.should.equal(FILE_SIZE - 0x7000);
+		checkFile(data, 0x7000);
+
+	});
+
+	it('rejects offsets past 0xFFFFFF', function () {
+
+		(() => ctx.reader.createReadStream(ctx.protocol, { offset: 0x1000000 })).should.throw(RangeError);
+		(() => ctx.reader.createReadStream(ctx.protocol, { offset: 0xFFFFFF, length: 2 })).should.throw(RangeError);
+		(() => ctx.reader._read_binary(1, ctx.protocol, 0xFFFF00, 0x101, 0x100, () => {})).should.throw(RangeError);
+
+	});
+
+});
@@ -0,0 +1,134 @@
+"use strict";
+
+const { describe, it, before, after } = require('mocha');
+const should = require('should');
+
+const { pcsclite, open, close, transmit } = require('./common');
+
+// the fake cards echo the data of the command, followed by 90 00
+function echo(data) {
+	return Buffer.concat([Buffer.from([0x80, 0xCA, 0x00, 0x00, data.length]), Buffer.from(data)]);
+}
+
+// FCI of an application, then a cardholder name
+const FCI = Buffer.from('6f0f8407a0000000031010a50450024142' + '5f20024a4b', 'hex');
+const FCI_INDEX = [
+	0x6F, 0, 2, 15,
+	0x84, 1, 4, 7,
+	0xA5, 1, 13, 4,
+	0x50, 2, 15, 2,
+	0x5F20, 0, 20, 2,
+];
+
+
+describe('Testing the BER-TLV index over the fake readers', function () {
+
+	let ctx;
+
+	before(async function () {
+		ctx = await open(1);
+	});
+
+	after(async function () {
+		await close(ctx);
+	});
+
+	it('#transmit() indexes the response', async function () {
+
+		const { response, index } = await transmit(ctx, echo(FCI), 258, { tlv: true });
+
+		response.should.deepEqual(Buffer.concat([FCI, Buffer.from([0x90, 0x00])]));
+		index.should.be.an.instanceOf(Uint32Array);
+		Array.from(index).should.deepEqual(FCI_INDEX);
+
+		const i = pcsclite.findTlv(index, 0x5F20);
+		i.should.equal(16);
+		response.subarray(index[i + 2], index[i + 2] + index[i + 3]).toString().should.equal('JK');
+		pcsclite.findTlv(index, 0x9F38).should.equal(-1);
+
+	});
+
+	it('#transmit() indexes a response written into a Buffer', async function () {
+
+		const { response, index } = await transmit(ctx, echo(FCI), Buffer.alloc(258), { tlv: true });
+
+		response.length.should.equal(FCI.length + 2);
+		Array.from(index).should.deepEqual(FCI_INDEX);
+
+	});
+
+	it('#transmit() indexes a cached response', async function () {
+
+		const command = echo(FCI);
+
+		const first = await transmit(ctx, command, 258, { tlv: true, cache: true });
+		const cached = await transmit(ctx, command, 258, { tlv: true, cache: true });
+		ctx.reader.clearCache();
+
+		Array.from(first.index).should.deepEqual(FCI_INDEX);
+		Array.from(cached.index).should.deepEqual(FCI_INDEX);
+
+	});
+
+	it('#transmit() skips the padding', async function () {
+
+		const { index } = await transmit(ctx, echo([0x00, 0x50, 0x01, 0x41, 0xFF, 0xFF]), 258, { tlv: true });
+
+		Array.from(index).should.deepEqual([0x50, 0, 3, 1]);
+
+	});
+
+	it('#transmit() of malformed BER-TLV', async function () {
+
+		const malformed = [
+			// a value longer than the data
+			[0x50, 0x05, 0x41, 0x42],
+			// a data object overrunning its constructed one
+			[0x6F, 0x03, 0x84, 0x02, 0xA0, 0x00],
+			// a tag cut short
+			[0x5F],
+			// a length cut short
+			[0x50, 0x82, 0x01],
+			// a tag longer than 4 bytes
+			[0x5F, 0x81, 0x82, 0x83, 0x04, 0x00],
+		];
+
+		for (const data of malformed) {
+			const { response, index } = await transmit(ctx, echo(data), 258, { tlv: true });
+			response.length.should.equal(data.length + 2);
+			should(index).be.null();
+		}
+
+	});
+
+	it('#transmit() of too deeply nested data objects', async function () {
+
+		// 33 constructed data objects, one in the other
+		const depth = 33;
+		const data = [];
+		for (let i = 0; i < depth; i++) {
+			data.push(0x70, 2 * (depth - i - 1));
+		}
+
+		should((await transmit(ctx, echo(data), 258, { tlv: true })).index).be.null();
+		(await transmit(ctx, echo(data.slice(2)), 258, { tlv: true })).index.length.should.equal(4 * (depth - 1));
+
+	});
+
+	it('#transmit() without the tlv option', async function () {
+
+		const response = await transmit(ctx, echo(FCI), 258);
+
+		response.should.deepEqual(Buffer.concat([FCI, Buffer.from([0x90, 0x00])]));
+
+	});
+
+	it('indexTlv()', function () {
+
+		Array.from(pcsclite.indexTlv(FCI)).should.deepEqual(FCI_INDEX);
+		pcsclite.indexTlv(Buffer.alloc(0)).length.should.equal(0);
+		should(pcsclite.indexTlv(Buffer.from([0x6F, 0x10]))).be.null();
+
+	});
+
+});
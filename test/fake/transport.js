@@ -0,0 +1,87 @@
+"use strict";
+
+const { describe, it, before, after } = require('mocha');
+const should = require('should');
+
+const { open, close, transmit } = require('./common');
+
+
+// n bytes of the fake card's responses: the i-th being i & 0xFF
+function counting(n) {
+	return Buffer.from(Array.from({ length: n }, (_, i) => i & 0xFF));
+}
+
+describe('Testing the transport rules over the fake readers', function () {
+
+	let ctx;
+
+	before(async function () {
+		ctx = await open(3);
+	});
+
+	after(async function () {
+		await close(ctx);
+	});
+
+	it('61xx: fetches the rest of the response with GET RESPONSE', async function () {
+
+		// 600 bytes: 256, then 256 and 88 fetched after 61 00 and 61 58
+		const response = await transmit(ctx, [0x00, 0xE0, 0x02, 0x58, 0x00], 602, { chaining: true });
+
+		response.subarray(0, 600).equals(counting(600)).should.be.true();
+		response.subarray(600).toString('hex').should.equal('9000');
+
+	});
+
+	it('61xx: left to the caller without chaining', async function () {
+
+		const response = await transmit(ctx, [0x00, 0xE0, 0x01, 0x10, 0x00], 258);
+
+		response.length.should.equal(258);
+		response.subarray(256).toString('hex').should.equal('6110');
+
+	});
+
+	const cases = {
+		'case 1': [0x00, 0xE2, 0x00, 0x04],
+		'case 2S': [0x00, 0xE2, 0x00, 0x04, 0x00],
+		'case 2E': [0x00, 0xE2, 0x00, 0x04, 0x00, 0x00, 0x00],
+		'case 3S': [0x00, 0xE2, 0x00, 0x04, 0x01, 0xAA],
+		'case 4S': [0x00, 0xE2, 0x00, 0x04, 0x01, 0xAA, 0x00],
+		'case 3E': [0x00, 0xE2, 0x00, 0x04, 0x00, 0x00, 0x01, 0xAA],
+		'case 4E': [0x00, 0xE2, 0x00, 0x04, 0x00, 0x00, 0x01, 0xAA, 0x01, 0x00],
+	};
+
+	Object.keys(cases).forEach(function (name) {
+		it('6Cxx: sends the ' + name + ' command again with the right Le', async function () {
+
+			const response = await transmit(ctx, cases[name], 258, { chaining: true });
+
+			response.toString('hex').should.equal('000102039000');
+
+		});
+	});
+
+	it('6Cxx: Le of 256 in an extended command', async function () {
+
+		const response = await transmit(ctx, [0x00, 0xE2, 0x00, 0x00, 0x00, 0x00, 0x01, 0xAA, 0x00, 0x10], 258, { chaining: true });
+
+		response.subarray(0, 256).equals(counting(256)).should.be.true();
+		response.subarray(256).toString('hex').should.equal('9000');
+
+	});
+
+	it('chains the commands with over 255 bytes of data', async function () {
+
+		const data = Buffer.from(Array.from({ length: 600 }, (_, i) => (i * 7) & 0xFF));
+		const command = Buffer.concat([Buffer.from([0x80, 0xCA, 0x00, 0x00, 0x00, 0x02, 0x58]), data, Buffer.from([0x00, 0x00])]);
+
+		// the card echoes the data of the whole chain
+		const response = await transmit(ctx, command, 1024, { chaining: true });
+
+		response.subarray(0, 600).equals(data).should.be.true();
+		response.subarray(600).toString('hex').should.equal('9000');
+
+	});
+
+});
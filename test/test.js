@@ -15,7 +15,7 @@ describe('Testing PCSCLite private', function () {
 			try {
 
 				const stub = sinon.stub(p, 'start').callsFake(function (startCb) {
-					startCb(undefined, Buffer.from("ACS ACR122U PICC Interface\u0000ACS ACR122U PICC Interface 01\u0000\u0000"));
+					startCb(undefined, ["ACS ACR122U PICC Interface", "ACS ACR122U PICC Interface 01"], []);
 				});
 
 				let readerHit = 0;
@@ -41,6 +41,142 @@ describe('Testing PCSCLite private', function () {
 			}
 
 		});
+
+		it('#close() without monitor', function () {
+
+			const p = pcsc();
+
+			sinon.stub(p, '_close').returns(false);
+
+			return p.close();
+
+		});
+
+		it('#start() filtered readers', function (done) {
+
+			const p = pcsc({ filter: name => name.endsWith('01') });
+
+			sinon.stub(p, 'start').callsFake(function (startCb) {
+				startCb(undefined, ["ACS ACR122U PICC Interface", "ACS ACR122U PICC Interface 01"], []);
+				Object.keys(p.readers).should.eql(["ACS ACR122U PICC Interface 01"]);
+				p.close().then(() => done());
+			});
+
+			p.on('reader', function (reader) {
+				reader.name.should.equal("ACS ACR122U PICC Interface 01");
+				reader.close();
+			});
+
+		});
+
+		it('#setAtrPatterns() compiles the wildcards into masks', function () {
+
+			const p = pcsc();
+
+			const stub = sinon.stub(p, '_set_atr_patterns');
+
+			p.setAtrPatterns([
+				{ atr: '3B 8F 80 01 .. 4F', type: 'PC/SC part 3' },
+				{ atr: Buffer.from([0x3B, 0x00]), mask: Buffer.from([0xFF, 0x00]), type: 2 },
+			]);
+
+			stub.calledOnce.should.be.true();
+			stub.firstCall.args[0].should.eql([Buffer.from('3b8f8001004f', 'hex'), Buffer.from([0x3B, 0x00])]);
+			stub.firstCall.args[1].should.eql([Buffer.from('ffffffff00ff', 'hex'), Buffer.from([0xFF, 0x00])]);
+			p._cardTypes.should.eql(['PC/SC part 3', 2]);
+
+			return p.close();
+
+		});
+
+		it('ReaderStateTable#read() copies a slot', function () {
+
+			const table = new pcsc.ReaderStateTable(2);
+			const slot = new DataView(table.buffer, 16 + 320);
+
+			// as written by the monitor thread, see src/statetable.h
+			slot.setUint32(4, 3, true);
+			slot.setUint32(8, 0x22, true);
+			slot.setUint32(12, 2, true);
+			slot.setBigUint64(16, 1234n, true);
+			slot.setBigUint64(24, 7n, true);
+			slot.setUint32(32, 1, true);
+			slot.setUint32(36, 8, true);
+			table.bytes.set([0x3B, 0x00], 16 + 320 + 40);
+			table.bytes.set(Buffer.from('MyReader'), 16 + 320 + 76);
+
+			const target = {};
+
+			table.size.should.equal(2);
+			table.read(0, target).should.be.false();
+			table.read(1, target).should.be.true();
+			target.should.containEql({ name: 'MyReader', state: 0x22, connected: true, atrLength: 2, seq: 7, timestamp: 1234n });
+			target.atr.subarray(0, 2).should.eql(new Uint8Array([0x3B, 0x00]));
+
+			table.snapshot().map(r => r.name).should.eql(['MyReader']);
+
+		});
+
+		it('ReaderStateTable#read() retries a torn copy', function () {
+
+			const table = new pcsc.ReaderStateTable(1);
+			const slot = new DataView(table.buffer, 16);
+
+			slot.setUint32(4, 1, true);
+			slot.setUint32(8, 0x22, true);
+			slot.setUint32(32, 1, true);
+			slot.setUint32(36, 5, true);
+			table.bytes.set(Buffer.from('First'), 16 + 76);
+
+			// the monitor thread gives the slot to another reader while it is copied:
+			// the new id is seen along with the old name
+			const load = Atomics.load;
+			let loads = 0;
+			const stub = sinon.stub(Atomics, 'load').callsFake(function (array, index) {
+				const value = load(array, index);
+				if (++loads === 1) {
+					slot.setUint32(0, 3, true);
+					slot.setUint32(32, 2, true);
+				} else if (loads === 2) {
+					slot.setUint32(36, 6, true);
+					table.bytes.set(Buffer.from('Second'), 16 + 76);
+					slot.setUint32(0, 4, true);
+					return load(array, index);
+				}
+				return value;
+			});
+
+			const target = {};
+
+			try {
+				table.read(0, target).should.be.true();
+			} finally {
+				stub.restore();
+			}
+
+			// once torn, once whole
+			loads.should.equal(4);
+			target.should.containEql({ id: 2, name: 'Second' });
+
+		});
+
+		it('#start() removed readers', function (done) {
+
+			const p = pcsc();
+
+			sinon.stub(p, 'start').callsFake(function (startCb) {
+				startCb(undefined, ["MyReader"], []);
+				startCb(undefined, [], ["MyReader"]);
+			});
+
+			p.on('reader', function (reader) {
+				sinon.stub(reader, 'close').callsFake(function () {
+					p.close();
+					done();
+				});
+			});
+
+		});
 	});
 
 });
@@ -50,8 +186,7 @@ describe('Testing CardReader private', function () {
 	const get_reader = function () {
 		const p = pcsc();
 		const stub = sinon.stub(p, 'start').callsFake(function (my_cb) {
-			/* "MyReader\0" */
-			my_cb(undefined, Buffer.from("MyReader\u0000\u0000"));
+			my_cb(undefined, ["MyReader"], []);
 		});
 
 		return p;
@@ -154,4 +289,351 @@ describe('Testing CardReader private', function () {
 		});
 	});
 
+	describe('#_transmit_batch()', function () {
+
+		it('#_transmit_batch() success', function (done) {
+			const p = get_reader();
+			p.on('reader', function (reader) {
+				reader.connected = true;
+				sinon.stub(reader, '_transmit_batch').callsFake(function (apdus, res_len, protocol, expected_sw, transaction, batch_cb) {
+					expected_sw.should.eql([0x9000]);
+					transaction.should.be.true();
+					batch_cb(null, {
+						data: Buffer.from([0x90, 0x00, 0x01, 0x90, 0x00]),
+						offsets: new Uint32Array([0, 2, 5]),
+						count: 2,
+						stopped: false,
+					});
+				});
+
+				reader.transmitBatch([Buffer.from([0x00]), Buffer.from([0x01])], 258, 2, { expected_sw: [0x9000], transaction: true }, function (err, result) {
+					should.not.exist(err);
+					result.responses.length.should.equal(2);
+					result.responses[1].should.eql(Buffer.from([0x01, 0x90, 0x00]));
+					done();
+				});
+			});
+		});
+
+		it('#_transmit_batch() not connected', function (done) {
+			const p = get_reader();
+			p.on('reader', function (reader) {
+				reader.transmitBatch([Buffer.from([0x00])], 258, 2, function (err) {
+					should.exist(err);
+					done();
+				});
+			});
+		});
+
+	});
+
+	describe('#_run_script()', function () {
+
+		it('#_run_script() success', function (done) {
+			const p = get_reader();
+			p.on('reader', function (reader) {
+				reader.connected = true;
+				const script = new pcsc.ApduScript()
+					.send(Buffer.from('00A4040000', 'hex'))
+					.unlessSw(0x9000, 'end')
+					.capture('serial', 0, 2)
+					.send(Buffer.from('80CA0000', 'hex'), { length: 'serial' }, 'serial')
+					.label('end');
+				sinon.stub(reader, '_run_script').callsFake(function (code, vars, res_len, protocol, max_steps, transaction, script_cb) {
+					code.toString('hex').should.equal('01000500a4040000040a9000ffff002206000000000201000480ca00000300020004');
+					vars.should.equal(1);
+					max_steps.should.equal(10000);
+					transaction.should.be.false();
+					script_cb(null, {
+						data: Buffer.from([0x12, 0x34, 0x90, 0x00, 0x90, 0x00]),
+						offsets: new Uint32Array([0, 4, 6]),
+						count: 2,
+						vars: [Buffer.from([0x12, 0x34])],
+						steps: 7,
+					});
+				});
+
+				reader.runScript(script, 258, 2, function (err, result) {
+					should.not.exist(err);
+					result.responses.length.should.equal(2);
+					result.vars.serial.should.eql(Buffer.from([0x12, 0x34]));
+					done();
+				});
+			});
+		});
+
+		it('#_run_script() undefined label', function () {
+			(function () {
+				new pcsc.ApduScript().jump('nowhere').compile();
+			}).should.throw(/Undefined label/);
+		});
+
+	});
+
+	describe('#_transmit_many()', function () {
+
+		it('#_transmit_many() isolates the readers', function (done) {
+			const p = pcsc();
+			sinon.stub(p, 'start').callsFake(function (my_cb) {
+				my_cb(undefined, ["Reader 0", "Reader 1", "Reader 2"], []);
+			});
+
+			const readers = [];
+			p.on('reader', function (reader) {
+				reader.connected = reader.name !== "Reader 1";
+				if (readers.push(reader) < 3) {
+					return;
+				}
+
+				const stub = sinon.stub(reader.constructor, '_transmit_many').callsFake(function (targets, apdus, res_len, protocols, expected_sw, transaction, many_cb) {
+					targets.should.eql([readers[0], readers[2]]);
+					protocols.should.eql([1, 2]);
+					many_cb(null, [
+						{ data: Buffer.from([0x90, 0x00]), offsets: new Uint32Array([0, 2]), count: 1, stopped: false },
+						new Error('SCardTransmit error'),
+					]);
+				});
+
+				p.transmitMany(readers, [Buffer.from([0x00])], 258, [1, 0, 2], function (err, results) {
+					stub.restore();
+					should.not.exist(err);
+					results[0].reader.should.equal(readers[0]);
+					results[0].responses[0].should.eql(Buffer.from([0x90, 0x00]));
+					results[1].error.message.should.equal('Card Reader not connected');
+					results[2].reader.should.equal(readers[2]);
+					results[2].error.message.should.equal('SCardTransmit error');
+					done();
+				});
+			});
+		});
+
+	});
+
+	describe('#_reconnect()', function () {
+
+		it('#_reconnect() keeps the last share mode and protocol', function (done) {
+			const p = get_reader();
+			p.on('reader', function (reader) {
+				reader.connected = true;
+				sinon.stub(reader, '_reconnect').callsFake(function (share_mode, protocol, initialization, cb) {
+					should.not.exist(share_mode);
+					should.not.exist(protocol);
+					initialization.should.equal(reader.SCARD_RESET_CARD);
+					cb(null, reader.SCARD_PROTOCOL_T1);
+				});
+
+				reader.reconnect({ initialization: reader.SCARD_RESET_CARD }, function (err, protocol) {
+					should.not.exist(err);
+					protocol.should.equal(reader.SCARD_PROTOCOL_T1);
+					done();
+				});
+			});
+		});
+
+	});
+
+	describe('#_transmit()', function () {
+
+		it('#_transmit() chaining', function (done) {
+			const p = get_reader();
+			p.on('reader', function (reader) {
+				reader.connected = true;
+				sinon.stub(reader, '_transmit').callsFake(function (data, res_len, protocol, chaining, cache, tlv, cb) {
+					chaining.should.be.true();
+					cache.should.be.false();
+					cb(null, Buffer.from([0x01, 0x90, 0x00]));
+				});
+
+				reader.transmit(Buffer.from([0x00, 0xB0, 0x00, 0x00, 0x00]), 65538, 2, { chaining: true }, function (err, response) {
+					should.not.exist(err);
+					response.should.eql(Buffer.from([0x01, 0x90, 0x00]));
+					done();
+				});
+			});
+		});
+
+		it('#_transmit() cached response', function (done) {
+			const p = get_reader();
+			p.on('reader', function (reader) {
+				reader.connected = true;
+				sinon.stub(reader, '_transmit').callsFake(function (data, res_len, protocol, chaining, cache, tlv, cb) {
+					cache.should.be.true();
+					return Buffer.from([0x90, 0x00]);
+				});
+
+				let sync = true;
+				reader.transmit(Buffer.from([0x00, 0xA4, 0x04, 0x00]), 258, 2, { cache: true }, function (err, response) {
+					sync.should.be.false();
+					should.not.exist(err);
+					response.should.eql(Buffer.from([0x90, 0x00]));
+					done();
+				});
+				sync = false;
+			});
+		});
+
+
+		it('#_transmit() TLV index', function (done) {
+			const p = get_reader();
+			p.on('reader', function (reader) {
+				reader.connected = true;
+				// 6F 03 84 01 A0, 5F 20 01 41
+				const response = Buffer.from('6f038401a05f2001419000', 'hex');
+				sinon.stub(reader, '_transmit').callsFake(function (data, res_len, protocol, chaining, cache, tlv, cb) {
+					tlv.should.be.true();
+					cb(null, response, new Uint32Array([0x6F, 0, 2, 3, 0x84, 1, 4, 1, 0x5F20, 0, 7, 1]));
+				});
+
+				reader.transmit(Buffer.from([0x00, 0xA4, 0x04, 0x00, 0x00]), 258, 2, { tlv: true }, function (err, data, index) {
+					should.not.exist(err);
+					const at = pcsc.findTlv(index, 0x5F20);
+					at.should.equal(8);
+					data[index[at + 2]].should.equal(0x41);
+					pcsc.findTlv(index, 0x84, at).should.equal(-1);
+					done();
+				});
+			});
+		});
+
+	});
+
+	describe('#_read_binary()', function () {
+
+		it('#_read_binary() streams the chunks', function (done) {
+			const p = get_reader();
+			p.on('reader', function (reader) {
+				reader.connected = true;
+				sinon.stub(reader, '_read_binary_resume');
+				sinon.stub(reader, '_read_binary').callsFake(function (id, protocol, offset, length, chunk_size, cb) {
+					chunk_size.should.equal(2);
+					cb(null, Buffer.from([0x01, 0x02]));
+					cb(null, Buffer.from([0x03]));
+					cb(null, null);
+				});
+
+				const chunks = [];
+				reader.createReadStream(2, { chunk_size: 2 })
+					.on('data', chunk => chunks.push(chunk))
+					.on('end', function () {
+						Buffer.concat(chunks).should.eql(Buffer.from([0x01, 0x02, 0x03]));
+						done();
+					});
+			});
+		});
+
+	});
+
+	describe('#_end_transaction()', function () {
+
+		it('#_end_transaction() defaults to SCARD_LEAVE_CARD', function (done) {
+			const p = get_reader();
+			p.on('reader', function (reader) {
+				reader.connected = true;
+				sinon.stub(reader, '_end_transaction').callsFake(function (disposition, cb) {
+					disposition.should.equal(reader.SCARD_LEAVE_CARD);
+					cb(null);
+				});
+
+				reader.endTransaction(function (err) {
+					should.not.exist(err);
+					done();
+				});
+			});
+		});
+
+	});
+
+	describe('#_secure_channel()', function () {
+
+		it('#_secure_channel() opens and closes', function (done) {
+			const p = get_reader();
+			p.on('reader', function (reader) {
+				reader.connected = true;
+				const keys = { enc: Buffer.alloc(16, 1), mac: Buffer.alloc(16, 2), rmac: Buffer.alloc(16, 3) };
+				const stub = sinon.stub(reader, '_secure_channel').callsFake(function (enc, mac, rmac, level, sc_cb) {
+					sc_cb(null);
+				});
+
+				reader.openSecureChannel(keys, 0x33, function (err) {
+					should.not.exist(err);
+					stub.firstCall.args.slice(0, 4).should.eql([keys.enc, keys.mac, keys.rmac, 0x33]);
+
+					reader.closeSecureChannel(function (err) {
+						should.not.exist(err);
+						stub.secondCall.args.slice(0, 4).should.eql([null, null, null, 0]);
+						done();
+					});
+				});
+			});
+		});
+
+	});
+
+	describe('#_transmit_async()', function () {
+
+		it('#_transmit_async() success', function () {
+			const p = get_reader();
+			return new Promise(resolve => p.on('reader', resolve)).then(function (reader) {
+				reader.connected = true;
+				sinon.stub(reader, '_transmit_async').callsFake(function (data, res_len, protocol, chaining, cache, timeout, id) {
+					chaining.should.be.false();
+					timeout.should.equal(100);
+					return Promise.resolve(Buffer.from([0x90, 0x00]));
+				});
+
+				return reader.transmitAsync(Buffer.from([0x00]), 258, 2, { timeout: 100 });
+			}).then(function (response) {
+				response.should.eql(Buffer.from([0x90, 0x00]));
+			});
+		});
+
+		it('#_transmit_async() aborted', function () {
+			const p = get_reader();
+			return new Promise(resolve => p.on('reader', resolve)).then(function (reader) {
+				reader.connected = true;
+				const controller = new AbortController();
+				controller.abort();
+
+				return reader.transmitAsync(Buffer.from([0x00]), 258, 2, { signal: controller.signal });
+			}).then(function () {
+				throw new Error('should have been rejected');
+			}, function (err) {
+				err.code.should.equal('ABORT_ERR');
+			});
+		});
+
+	});
+
+	describe('#_stop_recording()', function () {
+
+		it('#_stop_recording() reports the write error', function () {
+			const p = get_reader();
+			return new Promise(resolve => p.on('reader', resolve)).then(function (reader) {
+				sinon.stub(reader, '_stop_recording').callsFake(function (cb) {
+					setImmediate(cb, new Error('Session log error: No space left on device'));
+					return true;
+				});
+
+				return reader.stopRecording();
+			}).then(function () {
+				throw new Error('should have been rejected');
+			}, function (err) {
+				err.message.should.match(/No space left/);
+			});
+		});
+
+		it('#_stop_recording() not recording', function (done) {
+			const p = get_reader();
+			p.on('reader', function (reader) {
+				sinon.stub(reader, '_stop_recording').returns(false);
+
+				reader.stopRecording(function (err) {
+					should.not.exist(err);
+					done();
+				});
+			});
+		});
+
+	});
+
 });